@@ -0,0 +1,61 @@
+#include <algorithm>
+
+#include <lib/arena/arena.hpp>
+
+namespace Arena {
+// MonotonicArena
+
+    MonotonicArena::MonotonicArena(const char * name_, size_t initial_size_) :
+        name(name_),
+        initial_size(initial_size_)
+    {
+        // blocks grow geometrically, so this is never exceeded in practice
+        blocks.reserve(32u);
+    }
+
+    MonotonicArena::~MonotonicArena() {
+        for (const auto & block: blocks) free_block(block);
+    }
+
+    void MonotonicArena::reset() {
+        // coalesce into one block so that the same workload fits without growing again
+        if (blocks.size() > 1) {
+            auto size = capacity();
+            for (const auto & block: blocks) free_block(block);
+            blocks.clear();
+            blocks.push_back(allocate_block(size));
+        }
+        used = 0;
+    }
+
+    size_t MonotonicArena::capacity() const {
+        size_t size = 0;
+        for (const auto & block: blocks) size += block.size;
+        return size;
+    }
+
+    void * MonotonicArena::allocate_from_new_block(size_t size, size_t alignment) {
+        auto block_size = std::max({ initial_size, 2 * capacity(), size + alignment });
+        blocks.push_back(allocate_block(block_size));
+        used = 0;
+        return allocate(size, alignment);
+    }
+
+    MonotonicArena::Block MonotonicArena::allocate_block(size_t size) {
+#ifdef ENABLE_MEMORY_TRACKER
+        auto * data = MemoryTracker::allocate(size, MemoryTracker::current_stage(), MemoryTracker::account_id(name, true));
+#else
+        static_cast<void>(name);
+        auto * data = ::operator new(size);
+#endif
+        return { static_cast<uint8_t *>(data), size };
+    }
+
+    void MonotonicArena::free_block(const Block & block) {
+#ifdef ENABLE_MEMORY_TRACKER
+        MemoryTracker::deallocate(block.data);
+#else
+        ::operator delete(block.data);
+#endif
+    }
+}
@@ -0,0 +1,88 @@
+#ifndef ARENA_HPP
+#define ARENA_HPP
+
+#include <vector>
+#include <memory>
+#include <cstdint>
+#include <new>
+
+#include <lib/memory_tracker/memory_tracker.hpp>
+
+namespace Arena {
+    // Bump allocator for scratch memory of a task (a chunk, a worm, an optimizer pass).
+    // Memory is only given back by reset(), which keeps the capacity so that
+    // the next task of the same size does not touch the global heap.
+    class MonotonicArena {
+        struct Block {
+            uint8_t * data;
+            size_t size;
+        };
+
+        const char * name;
+        size_t initial_size;
+        std::vector<Block> blocks;
+        size_t used = 0;
+
+    public:
+        MonotonicArena(const char * name_, size_t initial_size_ = 64u * 1024u);
+        ~MonotonicArena();
+
+        MonotonicArena(const MonotonicArena &) = delete;
+        MonotonicArena & operator=(const MonotonicArena &) = delete;
+
+        void * allocate(size_t size, size_t alignment) {
+            if (!blocks.empty()) {
+                auto & block = blocks.back();
+                auto offset = (reinterpret_cast<uintptr_t>(block.data) + used + alignment - 1) / alignment * alignment
+                    - reinterpret_cast<uintptr_t>(block.data);
+                if (offset + size <= block.size) {
+                    used = offset + size;
+                    return block.data + offset;
+                }
+            }
+            return allocate_from_new_block(size, alignment);
+        }
+
+        void reset();
+        size_t capacity() const;
+
+    private:
+        void * allocate_from_new_block(size_t size, size_t alignment);
+        Block allocate_block(size_t size);
+        void free_block(const Block & block);
+    };
+
+    // pmr-style allocator: allocates from the arena, or from the global heap when default constructed
+    template<typename T>
+    class Allocator {
+        template<typename U> friend class Allocator;
+        MonotonicArena * arena = nullptr;
+
+    public:
+        using value_type = T;
+
+        Allocator() = default;
+        Allocator(MonotonicArena * arena_) : arena(arena_) {}
+        template<typename U>
+        Allocator(const Allocator<U> & other) : arena(other.arena) {}
+
+        T * allocate(size_t n) {
+            if (arena) return static_cast<T *>(arena->allocate(n * sizeof(T), alignof(T)));
+            return static_cast<T *>(::operator new(n * sizeof(T)));
+        }
+
+        void deallocate(T * p, size_t) {
+            if (!arena) ::operator delete(p);
+        }
+
+        template<typename U>
+        bool operator==(const Allocator<U> & other) const { return arena == other.arena; }
+        template<typename U>
+        bool operator!=(const Allocator<U> & other) const { return arena != other.arena; }
+    };
+
+    template<typename T>
+    using Vector = std::vector<T, Allocator<T>>;
+}
+
+#endif
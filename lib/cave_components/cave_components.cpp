@@ -0,0 +1,278 @@
+#include <lib/cave_components/cave_components.hpp>
+
+namespace CaveComponents {
+// UnionFind
+
+    UnionFind::UnionFind(size_t size, Arena::MonotonicArena * arena) :
+        parent(size, 0u, Arena::Allocator<uint32_t>(arena))
+    {
+        for (uint32_t i = 0; i < size; ++i) parent[i] = i;
+    }
+
+    uint32_t UnionFind::find(uint32_t i) {
+        // path halving
+        while (parent[i] != i) {
+            parent[i] = parent[parent[i]];
+            i = parent[i];
+        }
+        return i;
+    }
+
+    void UnionFind::unite(uint32_t a, uint32_t b) {
+        a = find(a);
+        b = find(b);
+        if (a == b) return;
+        if (a < b) parent[b] = a;
+        else parent[a] = b;
+    }
+
+// Component
+
+    void Component::merge(const Component & other) {
+        volume += other.volume;
+        min = glm::min(min, other.min);
+        max = glm::max(max, other.max);
+    }
+
+// Analyzer
+
+    Analyzer::Analyzer(const glm::vec2 & chunk_from_, const glm::vec2 & chunk_to_, ChunkSource source_, uint32_t threads_) :
+        chunk_from(chunk_from_),
+        chunk_to(chunk_to_),
+        source(source_),
+        threads(threads_)
+    {}
+
+    void Analyzer::run() {
+        PROFILE_ZONE("components/run");
+        MEMORY_SCOPE("components");
+        chunks.clear();
+        chunks.resize(width() * height());
+        components_.clear();
+
+        {
+            PROFILE_ZONE("components/label");
+            Helpers::parallel_for(chunks.size(), [this](uint32_t i) { label_chunk(i); }, threads);
+        }
+        merge_seams();
+    }
+
+    uint64_t Analyzer::total_volume() const {
+        uint64_t volume = 0u;
+        for (const auto & component: components_) volume += component.volume;
+        return volume;
+    }
+
+    VoxelRenderer::Vertices Analyzer::filter(const glm::vec2 & chunk, const VoxelRenderer::Vertices & vertices, uint64_t min_volume) const {
+        thread_local Arena::MonotonicArena arena("cave_components");
+        arena.reset();
+        Arena::Vector<uint64_t> keys(&arena);
+        Arena::Vector<uint32_t> labels(&arena);
+        uint32_t count;
+        label(vertices, keys, labels, count, arena);
+
+        const auto & local_components = chunks[index_of(chunk)].components;
+        if (local_components.size() != count) {
+            throw (boost::format("chunk (%d, %d) changed since it was labeled") % chunk.x % chunk.y).str();
+        }
+
+        VoxelRenderer::Vertices result;
+        for (size_t i = 0; i < keys.size(); ++i) {
+            if (components_[local_components[labels[i]]].volume < min_volume) continue;
+            auto v = VoxelRenderer::VerticesOptimizer::unpack(keys[i]);
+            result.push_back({ GLfloat(v.x), GLfloat(v.y), GLfloat(v.z) });
+        }
+        return result;
+    }
+
+    VoxelRenderer::Vertices Analyzer::filter(uint64_t min_volume) const {
+        PROFILE_ZONE("components/filter");
+        std::vector<VoxelRenderer::Vertices> filtered(chunks.size());
+        Helpers::parallel_for(chunks.size(), [&](uint32_t i) {
+            auto chunk = chunk_at(i);
+            filtered[i] = filter(chunk, source(chunk), min_volume);
+        }, threads);
+
+        VoxelRenderer::Vertices vertices;
+        for (const auto & chunk_vertices: filtered) {
+            vertices.insert(vertices.end(), chunk_vertices.begin(), chunk_vertices.end());
+        }
+        return vertices;
+    }
+
+    void Analyzer::print_summary(std::ostream & os, uint32_t top, uint64_t min_volume) const {
+        std::vector<uint32_t> order(components_.size());
+        for (uint32_t i = 0; i < order.size(); ++i) order[i] = i;
+        std::sort(order.begin(), order.end(), [this](auto a, auto b) { return components_[a].volume > components_[b].volume; });
+
+        uint32_t small = 0u;
+        uint64_t small_volume = 0u;
+        for (const auto & component: components_) {
+            if (component.volume >= min_volume) continue;
+            ++small;
+            small_volume += component.volume;
+        }
+
+        os << boost::format("Cave components: %d components, %d voxels") % components_.size() % total_volume() << std::endl;
+        if (min_volume > 0u) {
+            os << boost::format("  %d components below %d voxels, %d voxels in total") % small % min_volume % small_volume << std::endl;
+        }
+        for (uint32_t i = 0; i < std::min<size_t>(top, order.size()); ++i) {
+            const auto & component = components_[order[i]];
+            os << boost::format("  #%d: %d voxels in %d chunks, (%d, %d, %d) - (%d, %d, %d)")
+                % order[i]
+                % component.volume
+                % component.chunks
+                % component.min.x % component.min.y % component.min.z
+                % component.max.x % component.max.y % component.max.z
+                << std::endl;
+        }
+    }
+
+    glm::vec2 Analyzer::chunk_at(uint32_t i) const {
+        return { int32_t(chunk_from.x) + int32_t(i % width()), int32_t(chunk_from.y) + int32_t(i / width()) };
+    }
+
+    uint32_t Analyzer::index_of(const glm::vec2 & chunk) const {
+        const int32_t x = int32_t(chunk.x) - int32_t(chunk_from.x);
+        const int32_t y = int32_t(chunk.y) - int32_t(chunk_from.y);
+        if (x < 0 || x >= int32_t(width()) || y < 0 || y >= int32_t(height()) || chunks.empty()) {
+            throw (boost::format("chunk (%d, %d) has not been labeled") % chunk.x % chunk.y).str();
+        }
+        return y * width() + x;
+    }
+
+    void Analyzer::label_chunk(uint32_t i) {
+        thread_local Arena::MonotonicArena arena("cave_components");
+        arena.reset();
+        auto chunk = chunk_at(i);
+        auto & labels_of_chunk = chunks[i];
+
+        Arena::Vector<uint64_t> keys(&arena);
+        Arena::Vector<uint32_t> labels(&arena);
+        uint32_t count;
+        {
+            // the voxels of the chunk are only alive in this scope
+            auto vertices = source(chunk);
+            label(vertices, keys, labels, count, arena);
+        }
+
+        PROFILE_COUNTER("components/chunk_voxels", keys.size());
+        labels_of_chunk.locals.resize(count);
+        const int32_t min_x = int32_t(chunk.x) * chunk_size;
+        const int32_t min_y = int32_t(chunk.y) * chunk_size;
+        const int32_t max_x = min_x + chunk_size - 1;
+        const int32_t max_y = min_y + chunk_size - 1;
+
+        for (size_t j = 0; j < keys.size(); ++j) {
+            auto v = VoxelRenderer::VerticesOptimizer::unpack(keys[j]);
+            auto & component = labels_of_chunk.locals[labels[j]];
+            ++component.volume;
+            component.min = glm::min(component.min, v);
+            component.max = glm::max(component.max, v);
+
+            // keys are sorted, so are the faces
+            if (v.x == min_x) labels_of_chunk.faces[negative_x].push_back({ keys[j], labels[j] });
+            if (v.x == max_x) labels_of_chunk.faces[positive_x].push_back({ keys[j], labels[j] });
+            if (v.y == min_y) labels_of_chunk.faces[negative_y].push_back({ keys[j], labels[j] });
+            if (v.y == max_y) labels_of_chunk.faces[positive_y].push_back({ keys[j], labels[j] });
+        }
+    }
+
+    void Analyzer::merge_seams() {
+        PROFILE_ZONE("components/merge");
+        uint32_t total = 0u;
+        for (auto & chunk: chunks) {
+            chunk.offset = total;
+            total += chunk.locals.size();
+        }
+
+        // find the touching voxels across the +x and +y seams of every chunk in parallel
+        std::vector<std::vector<std::pair<uint32_t, uint32_t>>> links(chunks.size());
+        Helpers::parallel_for(chunks.size(), [&](uint32_t i) {
+            auto link = [&](Face face, uint32_t j, Face neighbour_face, const glm::ivec3 & step) {
+                const auto & others = chunks[j].faces[neighbour_face];
+                for (const auto & voxel: chunks[i].faces[face]) {
+                    auto v = VoxelRenderer::VerticesOptimizer::unpack(voxel.first) + step;
+                    auto key = VoxelRenderer::VerticesOptimizer::pack(v.x, v.y, v.z);
+                    auto it = std::lower_bound(others.begin(), others.end(), std::make_pair(key, 0u));
+                    if (it == others.end() || it->first != key) continue;
+                    links[i].push_back({ chunks[i].offset + voxel.second, chunks[j].offset + it->second });
+                }
+            };
+            if (i % width() + 1 < width()) link(positive_x, i + 1, negative_x, { 1, 0, 0 });
+            if (i / width() + 1 < height()) link(positive_y, i + width(), negative_y, { 0, 1, 0 });
+        }, threads);
+
+        UnionFind sets(total);
+        for (const auto & chunk_links: links) {
+            for (const auto & link: chunk_links) sets.unite(link.first, link.second);
+        }
+
+        // dense ids in the order of the roots
+        std::vector<uint32_t> ids(total, std::numeric_limits<uint32_t>::max());
+        for (uint32_t i = 0; i < total; ++i) {
+            auto root = sets.find(i);
+            if (ids[root] == std::numeric_limits<uint32_t>::max()) {
+                ids[root] = components_.size();
+                components_.emplace_back();
+            }
+        }
+
+        for (auto & chunk: chunks) {
+            chunk.components.resize(chunk.locals.size());
+            for (uint32_t j = 0; j < chunk.locals.size(); ++j) {
+                auto id = ids[sets.find(chunk.offset + j)];
+                chunk.components[j] = id;
+                components_[id].merge(chunk.locals[j]);
+            }
+
+            auto touched = chunk.components;
+            Helpers::unique(touched);
+            for (auto id: touched) ++components_[id].chunks;
+
+            // only the mapping of the labels is needed from now on
+            chunk.locals = {};
+            for (auto & face: chunk.faces) face = {};
+        }
+    }
+
+    void Analyzer::label(
+        const VoxelRenderer::Vertices & vertices,
+        Arena::Vector<uint64_t> & keys,
+        Arena::Vector<uint32_t> & labels,
+        uint32_t & count,
+        Arena::MonotonicArena & arena
+    ) {
+        using VoxelRenderer::VerticesOptimizer;
+        keys.reserve(vertices.size());
+        for (const auto & v: vertices) {
+            keys.push_back(VerticesOptimizer::pack(std::round(v[0]), std::round(v[1]), std::round(v[2])));
+        }
+        Helpers::unique(keys);
+
+        UnionFind sets(keys.size(), &arena);
+        auto find = [&keys](size_t from, uint64_t key) {
+            auto it = std::lower_bound(keys.begin() + from, keys.end(), key);
+            return it != keys.end() && *it == key ? size_t(it - keys.begin()) : keys.size();
+        };
+
+        // keys are sorted by z, y and then x, so only the neighbours ahead have to be searched
+        for (size_t i = 0; i < keys.size(); ++i) {
+            auto v = VerticesOptimizer::unpack(keys[i]);
+            if (i + 1 < keys.size() && keys[i + 1] == VerticesOptimizer::pack(v.x + 1, v.y, v.z)) sets.unite(i, i + 1);
+            auto y = find(i + 1, VerticesOptimizer::pack(v.x, v.y + 1, v.z));
+            if (y < keys.size()) sets.unite(i, y);
+            auto z = find(i + 1, VerticesOptimizer::pack(v.x, v.y, v.z + 1));
+            if (z < keys.size()) sets.unite(i, z);
+        }
+
+        // roots are the first voxels of their components
+        count = 0u;
+        labels.resize(keys.size());
+        for (size_t i = 0; i < keys.size(); ++i) {
+            auto root = sets.find(i);
+            labels[i] = root == i ? count++ : labels[root];
+        }
+    }
+}
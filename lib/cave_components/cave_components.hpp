@@ -0,0 +1,103 @@
+#ifndef CAVE_COMPONENTS_HPP
+#define CAVE_COMPONENTS_HPP
+
+#include <iostream>
+#include <vector>
+#include <array>
+#include <limits>
+#include <algorithm>
+#include <functional>
+#include <boost/format.hpp>
+
+#include <lib/helpers.hpp>
+#include <lib/voxel_renderer/voxel_renderer.hpp>
+#include <lib/profiler/profiler.hpp>
+#include <lib/memory_tracker/memory_tracker.hpp>
+#include <lib/arena/arena.hpp>
+
+namespace CaveComponents {
+    // 6-connected voxels of a chunk column, which is chunk_size voxels wide on x and y
+    static constexpr uint32_t chunk_size = 16u;
+
+    class UnionFind {
+        Arena::Vector<uint32_t> parent;
+
+    public:
+        UnionFind(size_t size, Arena::MonotonicArena * arena = nullptr);
+
+        uint32_t find(uint32_t i);
+        // the smaller root survives, so that labels do not depend on the order of unions
+        void unite(uint32_t a, uint32_t b);
+        size_t size() const { return parent.size(); }
+    };
+
+    struct Component {
+        uint64_t volume = 0u;
+        glm::ivec3 min{ std::numeric_limits<int32_t>::max() };
+        glm::ivec3 max{ std::numeric_limits<int32_t>::lowest() };
+        uint32_t chunks = 0u;
+
+        void merge(const Component & other);
+    };
+
+    // Labels the carved voxels of the chunks in two passes: every chunk is labeled on its own in parallel,
+    // keeping only its component summaries and the voxels on its side faces, and then the components are merged
+    // across the chunk seams. Chunks are pulled from the source one by one and dropped after labeling,
+    // so the memory is bounded by the surface of the chunks instead of the volume of the world.
+    class Analyzer {
+    public:
+        using ChunkSource = std::function<VoxelRenderer::Vertices(const glm::vec2 & chunk)>;
+
+        Analyzer(const glm::vec2 & chunk_from_, const glm::vec2 & chunk_to_, ChunkSource source_, uint32_t threads_ = 0);
+
+        void run();
+
+        const std::vector<Component> & components() const { return components_; }
+        uint64_t total_volume() const;
+
+        // the voxels of the chunk which belong to components of at least min_volume voxels
+        VoxelRenderer::Vertices filter(const glm::vec2 & chunk, const VoxelRenderer::Vertices & vertices, uint64_t min_volume) const;
+        // filters all the chunks pulling them from the source again
+        VoxelRenderer::Vertices filter(uint64_t min_volume) const;
+
+        void print_summary(std::ostream & os = std::cout, uint32_t top = 10u, uint64_t min_volume = 0u) const;
+
+    private:
+        enum Face { negative_x, positive_x, negative_y, positive_y };
+
+        struct ChunkLabels {
+            // global component id for each local label
+            std::vector<uint32_t> components;
+            std::vector<Component> locals;
+            // (key, local label) of the voxels on each side face, sorted by key
+            std::array<std::vector<std::pair<uint64_t, uint32_t>>, 4> faces;
+            uint32_t offset = 0u;
+        };
+
+        glm::vec2 chunk_from;
+        glm::vec2 chunk_to;
+        ChunkSource source;
+        uint32_t threads;
+        std::vector<ChunkLabels> chunks;
+        std::vector<Component> components_;
+
+        uint32_t width() const { return int32_t(chunk_to.x) - int32_t(chunk_from.x) + 1; }
+        uint32_t height() const { return int32_t(chunk_to.y) - int32_t(chunk_from.y) + 1; }
+        glm::vec2 chunk_at(uint32_t i) const;
+        uint32_t index_of(const glm::vec2 & chunk) const;
+
+        void label_chunk(uint32_t i);
+        void merge_seams();
+
+        // sorted unique voxel keys of the vertices, and their 6-connected labels numbered by first voxel
+        static void label(
+            const VoxelRenderer::Vertices & vertices,
+            Arena::Vector<uint64_t> & keys,
+            Arena::Vector<uint32_t> & labels,
+            uint32_t & count,
+            Arena::MonotonicArena & arena
+        );
+    };
+}
+
+#endif
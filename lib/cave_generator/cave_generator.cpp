@@ -0,0 +1,661 @@
+#include <lib/cave_generator/cave_generator.hpp>
+
+namespace CaveGenerator {
+// Parameters
+
+    const std::vector<std::pair<std::string, uint32_t Parameters::*>> Parameters::fields{
+        { "per_chunk", &Parameters::per_chunk },
+        { "max_length", &Parameters::max_length },
+        { "min_length", &Parameters::min_length },
+        { "max_branches", &Parameters::max_branches },
+        { "min_branches", &Parameters::min_branches },
+        { "max_layer", &Parameters::max_layer },
+        { "base_radius", &Parameters::base_radius },
+        { "angle_octaves", &Parameters::angle_octaves },
+        { "radius_octaves", &Parameters::radius_octaves }
+    };
+
+    uint32_t Parameters::get(const std::string & name) const {
+        for (const auto & field: fields) {
+            if (field.first == name) return this->*field.second;
+        }
+        throw (boost::format("unknown cave parameter: %s") % name).str();
+    }
+
+    void Parameters::set(const std::string & name, uint32_t value) {
+        for (const auto & field: fields) {
+            if (field.first == name) {
+                this->*field.second = value;
+                return;
+            }
+        }
+        throw (boost::format("unknown cave parameter: %s") % name).str();
+    }
+
+    void Parameters::validate() const {
+        if (per_chunk == 0u) throw std::string("per_chunk must be positive");
+        if (max_length == 0u) throw std::string("max_length must be positive");
+        if (min_length > max_length) throw std::string("min_length must not exceed max_length");
+        if (max_branches > max_branches_per_cave) {
+            throw (boost::format("max_branches must not exceed %d") % max_branches_per_cave).str();
+        }
+        if (min_branches > max_branches) throw std::string("min_branches must not exceed max_branches");
+        if (max_layer > max_cave_layer) throw (boost::format("max_layer must not exceed %d") % max_cave_layer).str();
+        if (angle_octaves == 0u || angle_octaves > 30u) throw std::string("angle_octaves must be in [1, 30]");
+        if (radius_octaves == 0u || radius_octaves > 30u) throw std::string("radius_octaves must be in [1, 30]");
+    }
+
+// CaveInfo
+
+    CaveInfo::CaveInfo(
+        const glm::vec3 & position_,
+        uint32_t length_,
+        uint8_t direction_,
+        BranchPoints branch_points_,
+        uint32_t layer_
+    ) :
+        position(position_),
+        length(length_),
+        branch_points(branch_points_),
+        layer(layer_)
+    {
+        switch (direction_) {
+        case 0: // x
+            p_direction = glm::vec3(1.0f, 0.0f, 0.0f);
+            s_direction = glm::vec3(0.0f, 1.0f, 0.0f);
+            w_rotation_axis = glm::vec3(0.0f, 0.0f, 1.0f);
+            h_rotation_axis = glm::vec3(0.0f, 1.0f, 0.0f);
+            break;
+        case 1: // -x
+            p_direction = glm::vec3(-1.0f, 0.0f, 0.0f);
+            s_direction = glm::vec3(0.0f, -1.0f, 0.0f);
+            w_rotation_axis = glm::vec3(0.0f, 0.0f, 1.0f);
+            h_rotation_axis = glm::vec3(0.0f, 1.0f, 0.0f);
+            break;
+        case 2: // y
+            p_direction = glm::vec3(0.0f, 1.0f, 0.0f);
+            s_direction = glm::vec3(1.0f, 0.0f, 0.0f);
+            w_rotation_axis = glm::vec3(0.0f, 0.0f, 1.0f);
+            h_rotation_axis = glm::vec3(1.0f, 0.0f, 0.0f);
+            break;
+        case 3: // -y
+            p_direction = glm::vec3(0.0f, -1.0f, 0.0f);
+            s_direction = glm::vec3(-1.0f, 0.0f, 0.0f);
+            w_rotation_axis = glm::vec3(0.0f, 0.0f, 1.0f);
+            h_rotation_axis = glm::vec3(1.0f, 0.0f, 0.0f);
+            break;
+        }
+    }
+
+// CaveInfoGenerator
+
+    CaveInfoGenerator::CaveInfoGenerator(int32_t seed, const Parameters & parameters_) :
+        parameters(parameters_)
+    {
+        std::mt19937 mt(seed);
+        std::uniform_int_distribution<uint8_t> rand(0u, 255u);
+        Helpers::times(256u * 3u, [&](auto) {
+            r.push_back(rand(mt));
+        });
+    }
+
+    std::optional<CaveInfo> CaveInfoGenerator::make_from_chunk(const glm::vec2 & chunk) const {
+        // floor-mod, so that the lattice of the root caves continues through the negative chunks
+        const int32_t n = parameters.per_chunk;
+        auto on_lattice = [n](float c) { return ((int32_t(c) % n) + n) % n == 0; };
+        if (!on_lattice(chunk.x) || !on_lattice(chunk.y)) return std::nullopt;
+        glm::vec2 center{
+            chunk.x * chunk_size + 8u,
+            chunk.y * chunk_size + 8u
+        };
+        auto z = chunk_hash(chunk);
+        return make_from_point({ center, z }, 0);
+    }
+
+    std::optional<CaveInfo> CaveInfoGenerator::make_from_point(const glm::vec3 & position, uint32_t layer) const {
+        if (layer > parameters.max_layer) return std::nullopt;
+        auto h = position_hash(position);
+
+        uint8_t direction = r[h + 1] % 4;
+
+        auto length_hash = r[h + 2];
+        auto max_length_for_current_layer = max_length_for_layer(layer);
+        auto min_length_for_current_layer = parameters.min_length;
+        auto depth_weight =  0.25f * (127.0f - position.z) / 127.0f;
+        uint32_t length = glm::clamp(
+            (float)std::round(max_length_for_current_layer * (per(length_hash) + depth_weight)),
+            (float)min_length_for_current_layer,
+            (float)max_length_for_current_layer
+        );
+
+        auto branch_size_hash = r[h + 3];
+        auto max_branches_for_current_layer = parameters.max_branches * (float(length) / max_length_for_current_layer);
+        auto min_branches_for_current_layer = parameters.min_branches;
+        uint32_t branch_size = glm::clamp(
+            (float)std::round(max_branches_for_current_layer * per(branch_size_hash)),
+            (float)min_branches_for_current_layer,
+            (float)max_branches_for_current_layer
+        );
+
+        BranchPoints branch_points;
+
+        for (uint32_t i = 1; i <= branch_size; ++i) {
+            auto point_hash = r[r[h + 3] + i];
+            auto point = std::round(length * per(point_hash));
+            branch_points.push_back(point);
+        }
+        Helpers::unique(branch_points);
+
+        return {{ position, length, direction, branch_points, layer }};
+    }
+
+    float CaveInfoGenerator::max_length_for_layer(uint32_t layer) const {
+        return parameters.max_length * std::pow(0.75, layer);
+    }
+
+    float CaveInfoGenerator::max_reach_for_layer(uint32_t layer) const {
+        if (layer > parameters.max_layer) return 0.0f;
+        return max_length_for_layer(layer) + max_reach_for_layer(layer + 1);
+    }
+
+    uint32_t CaveInfoGenerator::chunk_hash(const glm::vec2 & chunk) const {
+        uint8_t cxi = int32_t(chunk.x) % 256u;
+        uint8_t cyi = int32_t(chunk.y) % 256u;
+        return r[r[cxi] + cyi];
+    }
+
+    uint32_t CaveInfoGenerator::position_hash(const glm::vec3 & position) const {
+        auto chunk_x = int32_t(position.x) % chunk_size;
+        auto chunk_y = int32_t(position.y) % chunk_size;
+        uint8_t cxi = chunk_x % 256u;
+        uint8_t cyi = chunk_y % 256u;
+        uint8_t xi = int32_t(position.x) % 256u;
+        uint8_t yi = int32_t(position.y) % 256u;
+        uint8_t zi = int32_t(position.z) % 256u;
+        return r[r[r[r[r[cxi] + cyi] + xi] + yi] + zi];
+    }
+
+    float CaveInfoGenerator::per(uint8_t hash) const {
+        return hash / 255.0f;
+    }
+
+// Footprint
+
+    bool Footprint::intersects(const glm::vec3 & min_, const glm::vec3 & max_) const {
+        return
+            min.x <= max_.x && min_.x <= max.x &&
+            min.y <= max_.y && min_.y <= max.y &&
+            min.z <= max_.z && min_.z <= max.z;
+    }
+
+// FootprintIndex
+
+    FootprintIndex::FootprintIndex(const Generator & generator, const glm::vec2 & chunk_from_, const glm::vec2 & chunk_to_) :
+        chunk_from(chunk_from_),
+        chunk_to(chunk_to_)
+    {
+        const int32_t reach = generator.max_reach_in_chunks();
+        const int32_t from_x = chunk_from.x;
+        const int32_t from_y = chunk_from.y;
+        const int32_t to_x = chunk_to.x;
+        const int32_t to_y = chunk_to.y;
+        const int32_t width = to_x - from_x + 1;
+        cells.resize(width * (to_y - from_y + 1));
+
+        for (int32_t x = from_x - reach; x <= to_x + reach; ++x) {
+            for (int32_t y = from_y - reach; y <= to_y + reach; ++y) {
+                auto info = generator.info_generator().make_from_chunk({ x, y });
+                if (!info) continue;
+
+                auto footprint = generator.footprint(*info);
+                footprint.chunk = { x, y };
+
+                auto cx_min = std::max(from_x, int32_t(std::floor(footprint.min.x / chunk_size)));
+                auto cx_max = std::min(to_x, int32_t(std::floor(footprint.max.x / chunk_size)));
+                auto cy_min = std::max(from_y, int32_t(std::floor(footprint.min.y / chunk_size)));
+                auto cy_max = std::min(to_y, int32_t(std::floor(footprint.max.y / chunk_size)));
+                if (cx_min > cx_max || cy_min > cy_max) continue;
+
+                uint32_t id = footprints.size();
+                footprints.push_back(footprint);
+
+                for (auto cx = cx_min; cx <= cx_max; ++cx) {
+                    for (auto cy = cy_min; cy <= cy_max; ++cy) {
+                        cells[(cy - from_y) * width + (cx - from_x)].push_back(id);
+                    }
+                }
+            }
+        }
+    }
+
+    const std::vector<uint32_t> & FootprintIndex::find(const glm::vec2 & chunk) const {
+        const int32_t x = chunk.x;
+        const int32_t y = chunk.y;
+        if (x < chunk_from.x || x > chunk_to.x || y < chunk_from.y || y > chunk_to.y) {
+            throw (boost::format("chunk (%d, %d) is out of the footprint index") % x % y).str();
+        }
+        const int32_t width = int32_t(chunk_to.x) - int32_t(chunk_from.x) + 1;
+        return cells[(y - int32_t(chunk_from.y)) * width + (x - int32_t(chunk_from.x))];
+    }
+
+// Generator
+
+    Generator::Generator(int32_t base_seed_, const Parameters & parameters_) :
+        base_seed(base_seed_),
+        generator(base_seed_, parameters_)
+    {
+        parameters_.validate();
+
+        angle_noise.SetSeed(base_seed + 1);
+        angle_noise.SetOctaveCount(parameters_.angle_octaves);
+        angle_noise.SetFrequency(2.0f / angle_noise_unit);
+
+        radius_noise.SetSeed(base_seed + 2);
+        radius_noise.SetOctaveCount(parameters_.radius_octaves);
+        radius_noise.SetFrequency(8.0f / radius_noise_unit);
+    }
+
+    VoxelRenderer::Vertices Generator::generate(
+        const glm::vec2 & chunk_from,
+        const glm::vec2 chunk_to,
+        ChunkCache::DiskCache * cache,
+        const EditOverlay::Overlay * edits
+    ) const {
+        VoxelRenderer::Vertices vertices;
+        MEMORY_SCOPE("cave/generate");
+        std::optional<FootprintIndex> index;
+        Arena::MonotonicArena arena("cave_generator");
+
+        // the index is only needed once a chunk misses the cache
+        auto index_ = [&]() -> const FootprintIndex & {
+            if (!index) index.emplace(*this, chunk_from, chunk_to);
+            return *index;
+        };
+
+        for (int32_t x = chunk_from.x; x <= chunk_to.x; ++x) {
+            for (int32_t y = chunk_from.y; y <= chunk_to.y; ++y) {
+                glm::vec2 chunk{ x, y };
+                auto begin = vertices.size();
+                if (!cache) {
+                    generate_chunk(chunk, index_(), vertices, arena);
+                }
+                else {
+                    auto chunk_vertices = cache->fetch(chunk_hash(chunk), [&]() { return generate_chunk(chunk, index_()); });
+                    vertices.insert(vertices.end(), chunk_vertices.begin(), chunk_vertices.end());
+                }
+                if (edits) edits->apply(chunk, vertices, begin);
+            }
+        }
+
+        return vertices;
+    }
+
+    VoxelRenderer::Vertices Generator::generate_chunk(const glm::vec2 & chunk, const FootprintIndex & index) const {
+        thread_local Arena::MonotonicArena arena("cave_generator");
+        VoxelRenderer::Vertices vertices;
+        generate_chunk(chunk, index, vertices, arena);
+        return vertices;
+    }
+
+    void Generator::generate_chunk(
+        const glm::vec2 & chunk,
+        const FootprintIndex & index,
+        VoxelRenderer::Vertices & vertices,
+        Arena::MonotonicArena & arena
+    ) const {
+        generate_chunk(chunk, index, vertices, arena, nullptr);
+    }
+
+    void Generator::generate_chunk(
+        const glm::vec2 & chunk,
+        const FootprintIndex & index,
+        VoxelRenderer::Vertices & vertices,
+        Arena::MonotonicArena & arena,
+        const Surface & surface
+    ) const {
+        generate_chunk(chunk, index, vertices, arena, &surface);
+    }
+
+    void Generator::generate_chunk(
+        const glm::vec2 & chunk,
+        const FootprintIndex & index,
+        VoxelRenderer::Vertices & vertices,
+        Arena::MonotonicArena & arena,
+        const Surface * surface
+    ) const {
+        PROFILE_ZONE("cave/generate_chunk");
+        MEMORY_SCOPE("cave/generate_chunk");
+        arena.reset();
+        [[maybe_unused]] auto vertices_begin = vertices.size();
+        ChunkClip clip{
+            { chunk.x * chunk_size, chunk.y * chunk_size, std::numeric_limits<float>::lowest() },
+            { (chunk.x + 1) * chunk_size, (chunk.y + 1) * chunk_size, std::numeric_limits<float>::max() },
+            surface
+        };
+        // caves entirely above the surface are skipped as a whole
+        if (surface) clip.max.z = surface->max_height;
+
+        for (auto id: index.find(chunk)) {
+            auto info = generator.make_from_chunk(index.at(id).chunk);
+            generate_cave(info, clip, vertices, arena);
+        }
+        PROFILE_COUNTER("cave/chunk_vertices", vertices.size() - vertices_begin);
+    }
+
+    std::vector<uint32_t> Generator::count_caves(const glm::vec2 & chunk_from, const glm::vec2 & chunk_to) const {
+        std::vector<uint32_t> histogram(parameters().max_layer + 1, 0u);
+        for (int32_t x = chunk_from.x; x <= chunk_to.x; ++x) {
+            for (int32_t y = chunk_from.y; y <= chunk_to.y; ++y) {
+                count_caves(generator.make_from_chunk({ x, y }), histogram);
+            }
+        }
+        return histogram;
+    }
+
+    ChunkCache::ParameterHash Generator::parameter_hash() const {
+        ChunkCache::ParameterHash hash;
+        auto add_noise = [&hash](const noise::module::Perlin & noise) {
+            hash
+                .add(int32_t(noise.GetSeed()))
+                .add(int32_t(noise.GetOctaveCount()))
+                .add(noise.GetFrequency())
+                .add(noise.GetPersistence())
+                .add(noise.GetLacunarity())
+                .add(int32_t(noise.GetNoiseQuality()));
+        };
+
+        hash
+            .add(std::string("CaveGenerator::Generator"))
+            .add(version)
+            .add(base_seed)
+            .add(parameters().base_radius)
+            .add(uint32_t(angle_noise_unit))
+            .add(uint32_t(radius_noise_unit))
+            .add(max_w_rotation_rad)
+            .add(max_h_rotation_rad)
+            .add(parameters().per_chunk)
+            .add(parameters().max_length)
+            .add(parameters().min_length)
+            .add(parameters().max_branches)
+            .add(parameters().min_branches)
+            .add(parameters().max_layer)
+            .add(chunk_size);
+        add_noise(angle_noise);
+        add_noise(radius_noise);
+        return hash;
+    }
+
+    ChunkCache::ParameterHash Generator::chunk_hash(const glm::vec2 & chunk) const {
+        return parameter_hash().add(int32_t(chunk.x)).add(int32_t(chunk.y));
+    }
+
+    Footprint Generator::footprint(const CaveInfo & info) const {
+        auto reach = float(info.length);
+
+        if (info.layer < parameters().max_layer) {
+            auto branch_reach = generator.max_reach_for_layer(info.layer + 1);
+            for (auto point: info.branch_points) {
+                reach = std::max(reach, point + 1 + branch_reach);
+            }
+        }
+
+        // a step of the path is a unit vector tilted by at most max_h_rotation_rad
+        auto margin = wall_margin();
+        glm::vec3 extent{
+            reach + margin,
+            reach + margin,
+            std::sin(max_h_rotation_rad) * reach + margin
+        };
+        return { {}, info.position - extent, info.position + extent };
+    }
+
+    float Generator::wall_margin() const {
+        // amplitude of a libnoise Perlin is bounded by the sum of its octave persistences
+        float noise_bound = 0.0f;
+        for (int32_t i = 0; i < radius_noise.GetOctaveCount(); ++i) {
+            noise_bound += std::pow(radius_noise.GetPersistence(), i);
+        }
+        auto base_radius = parameters().base_radius;
+        return std::floor(base_radius / 2.0f) + std::ceil(base_radius * noise_bound) + 1.0f;
+    }
+
+    uint32_t Generator::max_reach_in_chunks() const {
+        return std::ceil((generator.max_reach_for_layer(0) + wall_margin()) / chunk_size) + 1;
+    }
+
+    bool Generator::ChunkClip::contains(float x, float y) const {
+        x = std::round(x);
+        y = std::round(y);
+        return min.x <= x && x < max.x && min.y <= y && y < max.y;
+    }
+
+    bool Generator::ChunkClip::is_near(const glm::vec3 & position, float margin) const {
+        return
+            min.x - margin <= position.x && position.x <= max.x + margin &&
+            min.y - margin <= position.y && position.y <= max.y + margin &&
+            (!surface || position.z - margin < surface->max_height);
+    }
+
+    void Generator::trace_cave(const std::optional<CaveInfo> & info, std::vector<Path> & paths, Arena::MonotonicArena & arena) const {
+        if (!info) return;
+        PROFILE_ZONE("cave/trace");
+        auto id = paths.size();
+        paths.push_back({ info->position });
+        walk_cave(
+            *info,
+            arena,
+            [&](const glm::vec3 &, const glm::vec3 & next_position) { paths[id].push_back(next_position); },
+            [&](const std::optional<CaveInfo> & branch_info) { trace_cave(branch_info, paths, arena); }
+        );
+    }
+
+    void Generator::stamp_path(
+        const Path & path,
+        const glm::vec2 & chunk_from,
+        const glm::vec2 & chunk_to,
+        VoxelRenderer::Vertices & vertices
+    ) const {
+        PROFILE_ZONE("cave/stamp_path");
+        ChunkClip clip{
+            { chunk_from.x * chunk_size, chunk_from.y * chunk_size, std::numeric_limits<float>::lowest() },
+            { (chunk_to.x + 1) * chunk_size, (chunk_to.y + 1) * chunk_size, std::numeric_limits<float>::max() }
+        };
+        auto margin = wall_margin();
+        for (size_t i = 1; i < path.size(); ++i) {
+            if (clip.is_near(path[i - 1], margin) || clip.is_near(path[i], margin)) {
+                stamp_step(path[i - 1], path[i], clip, vertices);
+            }
+        }
+    }
+
+    void Generator::stamp_path_coarse(
+        const Path & path,
+        const glm::vec2 & chunk_from,
+        const glm::vec2 & chunk_to,
+        uint32_t stride,
+        VoxelRenderer::Vertices & vertices
+    ) const {
+        PROFILE_ZONE("cave/stamp_path_coarse");
+        ChunkClip clip{
+            { chunk_from.x * chunk_size, chunk_from.y * chunk_size, std::numeric_limits<float>::lowest() },
+            { (chunk_to.x + 1) * chunk_size, (chunk_to.y + 1) * chunk_size, std::numeric_limits<float>::max() }
+        };
+        auto margin = wall_margin();
+        auto r = int32_t(std::floor(parameters().base_radius / 2.0f));
+        auto cell_of = [stride](float v) {
+            auto i = int32_t(std::round(v));
+            return i >= 0 ? i / int32_t(stride) : -((-i + int32_t(stride) - 1) / int32_t(stride));
+        };
+
+        // the steps are a voxel long, so the consecutive positions mostly cover the same cells
+        glm::ivec3 last_min(std::numeric_limits<int32_t>::max());
+        for (const auto & position: path) {
+            if (!clip.is_near(position, margin)) continue;
+            glm::ivec3 min{ cell_of(position.x - r), cell_of(position.y - r), cell_of(position.z - r) };
+            glm::ivec3 max{ cell_of(position.x + r), cell_of(position.y + r), cell_of(position.z + r) };
+            if (min == last_min) continue;
+            last_min = min;
+
+            for (auto x = min.x; x <= max.x; ++x) {
+                for (auto y = min.y; y <= max.y; ++y) {
+                    for (auto z = min.z; z <= max.z; ++z) {
+                        auto v = glm::vec3(x, y, z) * float(stride);
+                        if (clip.contains(v.x, v.y)) vertices.push_back({ v.x, v.y, v.z });
+                    }
+                }
+            }
+        }
+    }
+
+    void Generator::generate_cave(
+        const std::optional<CaveInfo> & info,
+        const ChunkClip & clip,
+        VoxelRenderer::Vertices & vertices,
+        Arena::MonotonicArena & arena
+    ) const {
+        if (!info) return;
+        if (!footprint(*info).intersects(clip.min, clip.max)) return;
+        PROFILE_ZONE("cave/cave");
+        PROFILE_COUNTER("cave/layer", info->layer);
+        auto margin = wall_margin();
+
+        walk_cave(
+            *info,
+            arena,
+            [&](const glm::vec3 & current_position, const glm::vec3 & next_position) {
+                // walls far from the chunk can not leave any voxel in it
+                if (clip.is_near(current_position, margin) || clip.is_near(next_position, margin)) {
+                    stamp_step(current_position, next_position, clip, vertices);
+                }
+            },
+            [&](const std::optional<CaveInfo> & branch_info) { generate_cave(branch_info, clip, vertices, arena); }
+        );
+    }
+
+    template<typename OnStep, typename OnBranch>
+    void Generator::walk_cave(const CaveInfo & info, Arena::MonotonicArena & arena, OnStep && on_step, OnBranch && on_branch) const {
+        using namespace glm;
+
+        // branches are generated while these are alive, so they stay in the arena until the chunk ends
+        Arena::Vector<float> w_rotations(&arena);
+        Arena::Vector<float> h_lotations(&arena);
+        w_rotations.reserve(info.length);
+        h_lotations.reserve(info.length);
+        {
+            PROFILE_ZONE("cave/angle_noise");
+            for (uint32_t i = 0; i < info.length; ++i) {
+                auto rotation = rotations(info, i);
+                w_rotations.push_back(rotation.x);
+                h_lotations.push_back(rotation.y);
+            }
+        }
+
+        vec3 current_position = info.position;
+        auto branch_points_it = info.branch_points.cbegin();
+        auto branch_points_end = info.branch_points.cend();
+        PROFILE_ZONE("cave/path");
+
+        for (uint32_t i = 0; i < info.length; ++i) {
+            auto next_position = this->next_position(info, current_position, { w_rotations[i], h_lotations[i] });
+            on_step(current_position, next_position);
+
+            // make branches
+            if (branch_points_it != branch_points_end && i == *branch_points_it) {
+                ++branch_points_it;
+                on_branch(generator.make_from_point(next_position, info.layer + 1));
+            }
+
+            current_position = next_position;
+        }
+    }
+
+    void Generator::stamp_step(
+        const glm::vec3 & current_position,
+        const glm::vec3 & next_position,
+        const ChunkClip & clip,
+        VoxelRenderer::Vertices & vertices
+    ) const {
+        // make walls
+        make_walls(next_position, clip, vertices);
+
+        // fill opening
+        uint32_t distance_i = std::ceil(glm::length(next_position - current_position));
+        for (uint32_t ti = 1; ti < distance_i; ++ti) {
+            auto t = float(ti) / distance_i;
+            auto v = lerp(current_position, next_position, t);
+            make_walls(v, clip, vertices);
+        }
+    }
+
+    void Generator::count_caves(const std::optional<CaveInfo> & info, std::vector<uint32_t> & histogram) const {
+        if (!info) return;
+        ++histogram[info->layer];
+        if (info->branch_points.empty()) return;
+
+        // the path only has to be followed up to the last branch point
+        glm::vec3 current_position = info->position;
+        auto branch_points_it = info->branch_points.cbegin();
+        for (uint32_t i = 0; i < info->length && branch_points_it != info->branch_points.cend(); ++i) {
+            auto next_position = this->next_position(*info, current_position, rotations(*info, i));
+            if (i == *branch_points_it) {
+                ++branch_points_it;
+                count_caves(generator.make_from_point(next_position, info->layer + 1), histogram);
+            }
+            current_position = next_position;
+        }
+    }
+
+    glm::vec2 Generator::rotations(const CaveInfo & info, uint32_t i) const {
+        auto pp = info.position + float(i) * info.p_direction;
+        float pv = angle_noise.GetValue(pp.x, pp.y, pp.z);
+
+        auto sp = info.position + float(i) * info.s_direction;
+        float sv = angle_noise.GetValue(sp.x, sp.y, sp.z);
+
+        return { glm::clamp(pv, -1.0f, 1.0f), glm::clamp(sv, -1.0f, 1.0f) };
+    }
+
+    glm::vec3 Generator::next_position(const CaveInfo & info, const glm::vec3 & current_position, const glm::vec2 & rotation) const {
+        using namespace glm;
+        mat4 m(1.0f);
+        m *= rotate(max_w_rotation_rad * rotation.x, info.w_rotation_axis);
+        m *= rotate(max_h_rotation_rad * rotation.y, info.h_rotation_axis);
+        return vec3(m * vec4(info.p_direction, 1.0f)) + current_position;
+    }
+
+    void Generator::make_walls(const glm::vec3 & position, const ChunkClip & clip, VoxelRenderer::Vertices & vertices) const {
+        auto base_radius = parameters().base_radius;
+        float r = base_radius / 2.0f;
+        // the walls of a position this high leave no voxel under the surface, whatever the radius noise
+        auto ceiling = clip.surface ? clip.surface->max_height + wall_margin() : std::numeric_limits<float>::max();
+
+        auto push = [&clip, &vertices](float x, float y, float z) {
+            if (!clip.contains(x, y)) return;
+            if (clip.surface && std::round(z) >= clip.surface->height(std::round(x), std::round(y))) return;
+            vertices.push_back({ x, y, z });
+        };
+
+        for (int32_t xi = -std::floor(r); xi <= std::floor(r); ++xi) {
+            for (int32_t yi = -std::floor(r); yi <= std::floor(r); ++yi) {
+                for (int32_t zi = -std::floor(r); zi <= std::floor(r); ++zi) {
+                    auto x = position.x + xi;
+                    auto y = position.y + yi;
+                    auto z = position.z + zi;
+                    if (z >= ceiling) continue;
+                    auto nv = int32_t(base_radius * radius_noise.GetValue(x, y, z));
+                    push(x + nv, y     , z      );
+                    push(x + nv, y + nv, z      );
+                    push(x     , y + nv, z      );
+                    push(x     , y + nv, z + nv );
+                    push(x     , y     , z + nv );
+                    push(x + nv, y     , z + nv );
+                }
+            }
+        }
+    }
+
+    glm::vec3 Generator::lerp(const glm::vec3 & v1, const glm::vec3 & v2, float t) const {
+        t = glm::clamp(t, 0.0f, 1.0f);
+        return t * (v2 - v1) + v1;
+    }
+}
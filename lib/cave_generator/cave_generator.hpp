@@ -0,0 +1,250 @@
+#ifndef CAVE_GENERATOR_HPP
+#define CAVE_GENERATOR_HPP
+
+#include <iostream>
+#include <random>
+#include <cmath>
+#include <optional>
+#include <vector>
+#include <algorithm>
+#include <functional>
+#include <noise/noise.h>
+#include <boost/format.hpp>
+#include <boost/container/static_vector.hpp>
+#include <boost/math/constants/constants.hpp>
+
+#include <lib/helpers.hpp>
+#include <lib/gl_helpers.hpp>
+#include <lib/voxel_renderer/voxel_renderer.hpp>
+#include <lib/chunk_cache/chunk_cache.hpp>
+#include <lib/edit_overlay/edit_overlay.hpp>
+#include <lib/profiler/profiler.hpp>
+#include <lib/memory_tracker/memory_tracker.hpp>
+#include <lib/arena/arena.hpp>
+
+namespace CaveGenerator {
+    static constexpr uint32_t chunk_size = 16u;
+
+    static constexpr uint32_t max_branches_per_cave = 4u;
+    using BranchPoints = boost::container::static_vector<uint32_t, max_branches_per_cave>;
+    // the deepest max_layer, as the caves of a root cave grow as max_branches^max_layer
+    static constexpr uint32_t max_cave_layer = 8u;
+
+    // tunable constants of the generator, all of which are part of the parameter hash
+    struct Parameters {
+        uint32_t per_chunk = 5u;
+        uint32_t max_length = 250u;
+        uint32_t min_length = 20u;
+        uint32_t max_branches = max_branches_per_cave;
+        uint32_t min_branches = 0u;
+        uint32_t max_layer = 2u;
+        uint32_t base_radius = 4u;
+        uint32_t angle_octaves = 5u;
+        uint32_t radius_octaves = 3u;
+
+        // parameters by name, for sweeps and config files
+        static const std::vector<std::pair<std::string, uint32_t Parameters::*>> fields;
+
+        uint32_t get(const std::string & name) const;
+        void set(const std::string & name, uint32_t value);
+        void validate() const;
+    };
+
+    struct CaveInfo {
+        glm::vec3 position;
+        glm::vec3 p_direction;
+        glm::vec3 s_direction;
+        glm::vec3 w_rotation_axis;
+        glm::vec3 h_rotation_axis;
+        uint32_t length;
+        BranchPoints branch_points;
+        uint32_t layer;
+
+        CaveInfo(
+            const glm::vec3 & position_,
+            uint32_t length_,
+            uint8_t direction_,
+            BranchPoints branch_points_,
+            uint32_t layer_
+        );
+    };
+
+    class CaveInfoGenerator {
+    public:
+        Parameters parameters;
+        std::vector<uint8_t> r;
+
+        CaveInfoGenerator(int32_t seed, const Parameters & parameters_);
+
+        std::optional<CaveInfo> make_from_chunk(const glm::vec2 & chunk) const;
+        std::optional<CaveInfo> make_from_point(const glm::vec3 & position, uint32_t layer) const;
+
+        // upper bound of the length of a cave on the layer
+        float max_length_for_layer(uint32_t layer) const;
+
+        // upper bound of the path length that a cave on the layer and its all branches can reach
+        float max_reach_for_layer(uint32_t layer) const;
+
+    private:
+        uint32_t chunk_hash(const glm::vec2 & chunk) const;
+        uint32_t position_hash(const glm::vec3 & position) const;
+        float per(uint8_t hash) const;
+    };
+
+    // conservative bounding volume of a cave and its all branches
+    struct Footprint {
+        glm::vec2 chunk;
+        glm::vec3 min;
+        glm::vec3 max;
+
+        bool intersects(const glm::vec3 & min_, const glm::vec3 & max_) const;
+    };
+
+    // the terrain above the caves: the voxels at or above the height of their column are not carved
+    struct Surface {
+        std::function<int32_t(int32_t x, int32_t y)> height;
+        // of the columns of the chunk
+        int32_t max_height;
+    };
+
+    class Generator;
+
+    // spatial index from chunks to the root caves which may reach them
+    class FootprintIndex {
+        glm::vec2 chunk_from;
+        glm::vec2 chunk_to;
+        std::vector<Footprint> footprints;
+        std::vector<std::vector<uint32_t>> cells;
+
+    public:
+        FootprintIndex(const Generator & generator, const glm::vec2 & chunk_from_, const glm::vec2 & chunk_to_);
+
+        const std::vector<uint32_t> & find(const glm::vec2 & chunk) const;
+        const Footprint & at(uint32_t id) const { return footprints[id]; }
+        size_t size() const { return footprints.size(); }
+    };
+
+    // positions of a cave along its path, from the start position
+    using Path = std::vector<glm::vec3>;
+
+    class Generator {
+        // bump when the output changes without any parameter change
+        static constexpr uint32_t version = 2u;
+        static constexpr auto angle_noise_unit = 300u;
+        static constexpr auto radius_noise_unit = 255u;
+        static constexpr float max_w_rotation_rad = boost::math::constants::pi<float>();
+        static constexpr float max_h_rotation_rad = boost::math::constants::pi<float>() / 4.0;
+
+        int32_t base_seed;
+        CaveInfoGenerator generator;
+        noise::module::Perlin angle_noise;
+        noise::module::Perlin radius_noise;
+
+    public:
+        Generator(int32_t base_seed_, const Parameters & parameters_ = {});
+
+        // the edits are applied on top of the chunks after the cache, which keeps only the procedural chunks
+        VoxelRenderer::Vertices generate(
+            const glm::vec2 & chunk_from,
+            const glm::vec2 chunk_to,
+            ChunkCache::DiskCache * cache = nullptr,
+            const EditOverlay::Overlay * edits = nullptr
+        ) const;
+        VoxelRenderer::Vertices generate_chunk(const glm::vec2 & chunk, const FootprintIndex & index) const;
+
+        // appends to the vertices, and resets the arena for the scratch memory of the chunk
+        void generate_chunk(
+            const glm::vec2 & chunk,
+            const FootprintIndex & index,
+            VoxelRenderer::Vertices & vertices,
+            Arena::MonotonicArena & arena
+        ) const;
+        // carves only below the surface: the steps of the caves above the highest column are skipped before
+        // the radius noise of their walls is sampled, and the voxels above their own column are not kept
+        void generate_chunk(
+            const glm::vec2 & chunk,
+            const FootprintIndex & index,
+            VoxelRenderer::Vertices & vertices,
+            Arena::MonotonicArena & arena,
+            const Surface & surface
+        ) const;
+
+        // the stages of generate_chunk, for the pipelines which keep the paths across the changes of the walls:
+        // appends the paths of the cave and its all branches
+        void trace_cave(const std::optional<CaveInfo> & info, std::vector<Path> & paths, Arena::MonotonicArena & arena) const;
+        // appends the walls along the path which leave voxels in the chunks
+        void stamp_path(
+            const Path & path,
+            const glm::vec2 & chunk_from,
+            const glm::vec2 & chunk_to,
+            VoxelRenderer::Vertices & vertices
+        ) const;
+        // appends the cells of the lattice of the stride which the path passes within the base radius of,
+        // without the radius noise, as a cheap preview of stamp_path
+        void stamp_path_coarse(
+            const Path & path,
+            const glm::vec2 & chunk_from,
+            const glm::vec2 & chunk_to,
+            uint32_t stride,
+            VoxelRenderer::Vertices & vertices
+        ) const;
+
+        // number of caves on each layer, counting the root caves which start in the chunks and their branches
+        std::vector<uint32_t> count_caves(const glm::vec2 & chunk_from, const glm::vec2 & chunk_to) const;
+
+        const CaveInfoGenerator & info_generator() const { return generator; }
+        const Parameters & parameters() const { return generator.parameters; }
+        ChunkCache::ParameterHash parameter_hash() const;
+        ChunkCache::ParameterHash chunk_hash(const glm::vec2 & chunk) const;
+        Footprint footprint(const CaveInfo & info) const;
+        float wall_margin() const;
+
+        // chunks that the root cave of any chunk can reach
+        uint32_t max_reach_in_chunks() const;
+
+    private:
+        struct ChunkClip {
+            glm::vec3 min;
+            glm::vec3 max;
+            const Surface * surface = nullptr;
+
+            bool contains(float x, float y) const;
+            bool is_near(const glm::vec3 & position, float margin) const;
+        };
+
+        void generate_cave(
+            const std::optional<CaveInfo> & info,
+            const ChunkClip & clip,
+            VoxelRenderer::Vertices & vertices,
+            Arena::MonotonicArena & arena
+        ) const;
+        void count_caves(const std::optional<CaveInfo> & info, std::vector<uint32_t> & histogram) const;
+        void generate_chunk(
+            const glm::vec2 & chunk,
+            const FootprintIndex & index,
+            VoxelRenderer::Vertices & vertices,
+            Arena::MonotonicArena & arena,
+            const Surface * surface
+        ) const;
+
+        // calls back with every step along the path of the cave, as on_step(current_position, next_position),
+        // and with every branch where it starts, as on_branch(branch_info); a template rather than std::function
+        // so that the callbacks capturing the chunk do not allocate for every cave
+        template<typename OnStep, typename OnBranch>
+        void walk_cave(const CaveInfo & info, Arena::MonotonicArena & arena, OnStep && on_step, OnBranch && on_branch) const;
+        void stamp_step(
+            const glm::vec3 & current_position,
+            const glm::vec3 & next_position,
+            const ChunkClip & clip,
+            VoxelRenderer::Vertices & vertices
+        ) const;
+
+        // w and h rotations of the i-th step in [-1, 1]
+        glm::vec2 rotations(const CaveInfo & info, uint32_t i) const;
+        glm::vec3 next_position(const CaveInfo & info, const glm::vec3 & current_position, const glm::vec2 & rotation) const;
+        void make_walls(const glm::vec3 & position, const ChunkClip & clip, VoxelRenderer::Vertices & vertices) const;
+        glm::vec3 lerp(const glm::vec3 & v1, const glm::vec3 & v2, float t) const;
+    };
+}
+
+#endif
@@ -0,0 +1,223 @@
+#include <lib/cave_pipeline/cave_pipeline.hpp>
+
+namespace CavePipeline {
+    namespace {
+        const std::vector<std::pair<std::string, Stage>> parameter_stages{
+            { "per_chunk", Stage::placement },
+            { "max_length", Stage::placement },
+            { "min_length", Stage::placement },
+            { "max_branches", Stage::placement },
+            { "min_branches", Stage::placement },
+            { "max_layer", Stage::placement },
+            { "angle_octaves", Stage::paths },
+            { "base_radius", Stage::stamping },
+            { "radius_octaves", Stage::stamping }
+        };
+    }
+
+    const char * stage_name(Stage stage) {
+        switch (stage) {
+        case Stage::placement: return "placement";
+        case Stage::paths: return "paths";
+        case Stage::stamping: return "stamping";
+        case Stage::surface: return "surface";
+        default: return "done";
+        }
+    }
+
+    Stage stage_of(const std::string & parameter) {
+        for (const auto & [name, stage]: parameter_stages) {
+            if (name == parameter) return stage;
+        }
+        throw (boost::format("unknown cave parameter: %s") % parameter).str();
+    }
+
+    CaveGenerator::Parameters load_parameters(const boost::filesystem::path & path) {
+        std::ifstream ifs(path.string());
+        if (!ifs) throw (boost::format("Failed to open the parameters: %s") % path.string()).str();
+
+        CaveGenerator::Parameters parameters;
+        std::string line;
+        for (uint32_t line_number = 1; std::getline(ifs, line); ++line_number) {
+            line = line.substr(0, line.find('#'));
+            boost::algorithm::trim(line);
+            if (line.empty()) continue;
+
+            auto separator = line.find('=');
+            if (separator == std::string::npos) {
+                throw (boost::format("%s:%d: expected name = value") % path.string() % line_number).str();
+            }
+            auto name = boost::algorithm::trim_copy(line.substr(0, separator));
+            auto value = boost::algorithm::trim_copy(line.substr(separator + 1));
+            try {
+                size_t parsed = 0u;
+                auto v = std::stoul(value, &parsed);
+                if (parsed != value.size()) throw std::invalid_argument(value);
+                parameters.set(name, v);
+            }
+            catch (const std::exception &) {
+                throw (boost::format("%s:%d: invalid value of %s: %s") % path.string() % line_number % name % value).str();
+            }
+            catch (const std::string & message) {
+                throw (boost::format("%s:%d: %s") % path.string() % line_number % message).str();
+            }
+        }
+        try {
+            parameters.validate();
+        }
+        catch (const std::string & message) {
+            throw (boost::format("%s: %s") % path.string() % message).str();
+        }
+        return parameters;
+    }
+
+    void save_parameters(const boost::filesystem::path & path, const CaveGenerator::Parameters & parameters) {
+        std::ofstream ofs(path.string(), std::ios::trunc);
+        ofs << "# CaveGenerator::Parameters, the stage which each of them reruns from is in the comment" << std::endl;
+        for (const auto & [name, field]: CaveGenerator::Parameters::fields) {
+            ofs << boost::format("%s = %d # %s") % name % (parameters.*field) % stage_name(stage_of(name)) << std::endl;
+        }
+        if (!ofs) throw (boost::format("Failed to write the parameters: %s") % path.string()).str();
+    }
+
+// FileWatcher
+
+    FileWatcher::FileWatcher(const boost::filesystem::path & path_) : path(path_) {
+        changed();
+    }
+
+    bool FileWatcher::changed() {
+        boost::system::error_code ec;
+        auto modified_ = boost::filesystem::last_write_time(path, ec);
+        if (ec) return false;
+        auto size_ = boost::filesystem::file_size(path, ec);
+        if (ec) return false;
+
+        if (modified_ == modified && size_ == size) return false;
+        modified = modified_;
+        size = size_;
+        return true;
+    }
+
+// Pipeline
+
+    Pipeline::Pipeline(int32_t seed_, const glm::vec2 & chunk_from_, const glm::vec2 & chunk_to_, uint32_t threads_) :
+        seed(seed_),
+        chunk_from(chunk_from_),
+        chunk_to(chunk_to_),
+        threads(threads_)
+    {}
+
+    Stage Pipeline::update(const CaveGenerator::Parameters & parameters, Stage last) {
+        CaveGenerator::Generator next(seed, parameters);
+        auto first = std::min(generator_ ? first_dirty_stage(next) : Stage::placement, pending);
+        if (first > last) return Stage::done;
+        generator_.emplace(next);
+
+        auto start = std::chrono::steady_clock::now();
+        auto run = [&](Stage stage, auto && body) {
+            if (stage < first || stage > last) return;
+            PROFILE_ZONE("cave_pipeline/stage");
+            auto stage_start = std::chrono::steady_clock::now();
+            body();
+            auto i = uint32_t(stage);
+            ++stats_.runs[i];
+            stats_.seconds[i] += std::chrono::duration<double>(std::chrono::steady_clock::now() - stage_start).count();
+        };
+
+        run(Stage::placement, [&]() { place(); });
+        run(Stage::paths, [&]() { trace(); });
+        run(Stage::stamping, [&]() {
+            // the surface still shows the vertices of the stamping before the last one which it saw
+            if (!surface_behind) extracted = std::move(vertices_);
+            stamp();
+            surface_behind = true;
+        });
+        run(Stage::surface, [&]() {
+            extract(extracted);
+            extracted = {};
+            surface_behind = false;
+        });
+        pending = Stage(uint32_t(last) + 1u);
+
+        stats_.last_stage = first;
+        stats_.last_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        return first;
+    }
+
+    void Pipeline::print_stats(std::ostream & os) const {
+        os << boost::format("Pipeline: %d roots, %d vertices, reran from %s in %.3f s")
+            % roots.size()
+            % vertices_.size()
+            % stage_name(stats_.last_stage)
+            % stats_.last_seconds
+            << std::endl;
+        for (uint32_t i = 0; i < stage_count; ++i) {
+            os << boost::format("Pipeline %s: %d runs, %.3f s")
+                % stage_name(Stage(i))
+                % stats_.runs[i]
+                % stats_.seconds[i]
+                << std::endl;
+        }
+    }
+
+    Stage Pipeline::first_dirty_stage(const CaveGenerator::Generator & next) const {
+        auto first = Stage::done;
+        for (const auto & [name, field]: CaveGenerator::Parameters::fields) {
+            if (next.parameters().*field != parameters().*field) first = std::min(first, stage_of(name));
+        }
+
+        // thicker walls may reach the world from the roots which were culled
+        if (first != Stage::done && next.wall_margin() > placed_margin) first = Stage::placement;
+        return first;
+    }
+
+    void Pipeline::place() {
+        MEMORY_SCOPE("cave_pipeline/placement");
+        roots.clear();
+        const int32_t reach = generator_->max_reach_in_chunks();
+        glm::vec3 world_min{ chunk_from.x * CaveGenerator::chunk_size, chunk_from.y * CaveGenerator::chunk_size, std::numeric_limits<float>::lowest() };
+        glm::vec3 world_max{ (chunk_to.x + 1) * CaveGenerator::chunk_size, (chunk_to.y + 1) * CaveGenerator::chunk_size, std::numeric_limits<float>::max() };
+
+        for (int32_t x = chunk_from.x - reach; x <= chunk_to.x + reach; ++x) {
+            for (int32_t y = chunk_from.y - reach; y <= chunk_to.y + reach; ++y) {
+                auto info = generator_->info_generator().make_from_chunk({ x, y });
+                if (info && generator_->footprint(*info).intersects(world_min, world_max)) roots.push_back(*info);
+            }
+        }
+        placed_margin = generator_->wall_margin();
+    }
+
+    void Pipeline::trace() {
+        MEMORY_SCOPE("cave_pipeline/paths");
+        paths_.assign(roots.size(), {});
+        Helpers::parallel_for(roots.size(), [&](uint32_t i) {
+            thread_local Arena::MonotonicArena arena("cave_pipeline");
+            arena.reset();
+            generator_->trace_cave(roots[i], paths_[i], arena);
+        }, threads);
+    }
+
+    void Pipeline::stamp() {
+        MEMORY_SCOPE("cave_pipeline/stamping");
+        std::vector<VoxelRenderer::Vertices> walls(roots.size());
+        Helpers::parallel_for(roots.size(), [&](uint32_t i) {
+            for (const auto & path: paths_[i]) generator_->stamp_path(path, chunk_from, chunk_to, walls[i]);
+        }, threads);
+
+        size_t size = 0u;
+        for (const auto & w: walls) size += w.size();
+        vertices_.clear();
+        vertices_.reserve(size);
+        for (const auto & w: walls) vertices_.insert(vertices_.end(), w.begin(), w.end());
+    }
+
+    void Pipeline::extract(const VoxelRenderer::Vertices & before) {
+        MEMORY_SCOPE("cave_pipeline/surface");
+        if (!surface_) {
+            surface_.emplace(vertices_);
+            return;
+        }
+        surface_->replace(before, vertices_);
+    }
+}
@@ -0,0 +1,109 @@
+#ifndef CAVE_PIPELINE_HPP
+#define CAVE_PIPELINE_HPP
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <array>
+#include <optional>
+#include <chrono>
+#include <ctime>
+#include <boost/format.hpp>
+#include <boost/filesystem.hpp>
+#include <boost/algorithm/string.hpp>
+
+#include <lib/helpers.hpp>
+#include <lib/cave_generator/cave_generator.hpp>
+#include <lib/voxel_renderer/voxel_renderer.hpp>
+#include <lib/voxel_renderer/surface_extractor.hpp>
+#include <lib/profiler/profiler.hpp>
+#include <lib/memory_tracker/memory_tracker.hpp>
+#include <lib/arena/arena.hpp>
+
+namespace CavePipeline {
+    // every stage depends on the ones before it
+    enum class Stage : uint32_t { placement = 0u, paths, stamping, surface, done };
+    static constexpr uint32_t stage_count = 4u;
+
+    const char * stage_name(Stage stage);
+    // first stage which reads the parameter
+    Stage stage_of(const std::string & parameter);
+
+    // "name = value" lines of CaveGenerator::Parameters and "#" comments, the rest keep their defaults
+    CaveGenerator::Parameters load_parameters(const boost::filesystem::path & path);
+    void save_parameters(const boost::filesystem::path & path, const CaveGenerator::Parameters & parameters);
+
+    // polls the modification time and the size of a file, which works the same on every platform
+    class FileWatcher {
+        boost::filesystem::path path;
+        std::time_t modified = 0;
+        uintmax_t size = 0u;
+
+    public:
+        FileWatcher(const boost::filesystem::path & path_);
+
+        // true once after every change, false while the file is missing
+        bool changed();
+    };
+
+    // Cave generation over a fixed range of chunks split into the stages of CaveGenerator::Generator:
+    // placement of the root caves, integration of the paths of the caves and their branches, stamping of the walls,
+    // and the surface. The results of every stage are kept, and a parameter change reruns only the stage which
+    // reads the parameter and the ones after it. The surface is updated with SurfaceExtractor::replace,
+    // so that its owner re-extracts and uploads only the voxels which changed.
+    class Pipeline {
+    public:
+        struct Stats {
+            std::array<uint32_t, stage_count> runs{};
+            std::array<double, stage_count> seconds{};
+            Stage last_stage = Stage::done;
+            double last_seconds = 0.0;
+        };
+
+        Pipeline(int32_t seed_, const glm::vec2 & chunk_from_, const glm::vec2 & chunk_to_, uint32_t threads_ = 0);
+
+        // returns the first stage which reran, or done if nothing changed;
+        // the stages after the last one are left for a later update
+        Stage update(const CaveGenerator::Parameters & parameters, Stage last = Stage::surface);
+
+        const CaveGenerator::Parameters & parameters() const { return generator_->parameters(); }
+        const CaveGenerator::Generator & generator() const { return *generator_; }
+        // paths of each root cave and its branches
+        const std::vector<std::vector<CaveGenerator::Path>> & paths() const { return paths_; }
+        const VoxelRenderer::Vertices & vertices() const { return vertices_; }
+        // valid after the first update
+        VoxelRenderer::SurfaceExtractor & surface() { return *surface_; }
+
+        const Stats & stats() const { return stats_; }
+        void print_stats(std::ostream & os = std::cout) const;
+
+    private:
+        int32_t seed;
+        glm::vec2 chunk_from;
+        glm::vec2 chunk_to;
+        uint32_t threads;
+        Stats stats_;
+
+        std::optional<CaveGenerator::Generator> generator_;
+        // the first stage which has not run with the parameters of the generator
+        Stage pending = Stage::placement;
+        // the roots are culled with the wall margin at the placement, which is conservative for smaller ones
+        float placed_margin = 0.0f;
+        std::vector<CaveGenerator::CaveInfo> roots;
+        std::vector<std::vector<CaveGenerator::Path>> paths_;
+        VoxelRenderer::Vertices vertices_;
+        std::optional<VoxelRenderer::SurfaceExtractor> surface_;
+        // vertices which the surface was extracted from, while the stamping is ahead of it
+        VoxelRenderer::Vertices extracted;
+        bool surface_behind = false;
+
+        Stage first_dirty_stage(const CaveGenerator::Generator & next) const;
+        void place();
+        void trace();
+        void stamp();
+        void extract(const VoxelRenderer::Vertices & before);
+    };
+}
+
+#endif
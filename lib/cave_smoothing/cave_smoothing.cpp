@@ -0,0 +1,259 @@
+#include <lib/cave_smoothing/cave_smoothing.hpp>
+
+namespace CaveSmoothing {
+    namespace {
+        // 5 bit counters of 64 voxels, bit k of every counter in planes[k]
+        struct BitSlicedCounter {
+            uint64_t planes[5] = { 0u, 0u, 0u, 0u, 0u };
+
+            void add(uint64_t bits) {
+                for (auto & plane: planes) {
+                    auto carry = plane & bits;
+                    plane ^= bits;
+                    bits = carry;
+                }
+            }
+
+            // counters >= k, compared from the most significant bit
+            uint64_t at_least(uint32_t k) const {
+                uint64_t greater = 0u;
+                uint64_t equal = ~uint64_t(0u);
+                for (int32_t b = 4; b >= 0; --b) {
+                    if (k >> b & 1u) {
+                        equal &= planes[b];
+                    }
+                    else {
+                        greater |= equal & planes[b];
+                        equal &= ~planes[b];
+                    }
+                }
+                return greater | equal;
+            }
+        };
+    }
+
+// Parameters
+
+    std::optional<Parameters> Parameters::from_env() {
+        auto value = std::getenv("TGP_SMOOTH");
+        if (!value) return std::nullopt;
+
+        std::vector<std::string> tokens;
+        boost::algorithm::split(tokens, std::string(value), boost::is_any_of(","));
+        Parameters parameters;
+        parameters.iterations = std::stoul(tokens[0]);
+        if (tokens.size() == 3) {
+            parameters.birth = std::stoul(tokens[1]);
+            parameters.survival = std::stoul(tokens[2]);
+        }
+        else if (tokens.size() != 1) {
+            throw (boost::format("TGP_SMOOTH expects iterations[,birth,survival]: %s") % value).str();
+        }
+        return parameters;
+    }
+
+// Smoother::Bricks
+
+    const Smoother::Rows * Smoother::Bricks::find(const glm::ivec3 & coord) const {
+        auto it = index.find(VoxelRenderer::VerticesOptimizer::pack(coord.x, coord.y, coord.z));
+        return it == index.end() ? nullptr : &rows[it->second];
+    }
+
+    uint32_t Smoother::Bricks::insert(const glm::ivec3 & coord) {
+        auto result = index.insert({ VoxelRenderer::VerticesOptimizer::pack(coord.x, coord.y, coord.z), coords.size() });
+        if (result.second) {
+            coords.push_back(coord);
+            rows.emplace_back();
+            rows.back().fill(0u);
+        }
+        return result.first->second;
+    }
+
+// Smoother
+
+    Smoother::Smoother(const Parameters & parameters_, uint32_t threads_) :
+        parameters(parameters_),
+        threads(threads_)
+    {
+        // with birth 0 the whole space would be carved
+        if (parameters.birth == 0u || parameters.birth > 26u) throw std::string("birth must be in [1, 26]");
+        if (parameters.survival > 26u) throw std::string("survival must be in [0, 26]");
+    }
+
+    VoxelRenderer::Vertices Smoother::smooth(const VoxelRenderer::Vertices & vertices) {
+        PROFILE_ZONE("smoothing/smooth");
+        MEMORY_SCOPE("smoothing");
+        auto start = std::chrono::steady_clock::now();
+        stats_ = {};
+
+        Bricks bricks;
+        {
+            PROFILE_ZONE("smoothing/pack");
+            for (const auto & v: vertices) {
+                glm::ivec3 voxel{ int32_t(std::round(v[0])), int32_t(std::round(v[1])), int32_t(std::round(v[2])) };
+                auto brick = brick_of(voxel);
+                auto local = voxel - brick * brick_size;
+                auto & rows = bricks.rows[bricks.insert(brick)];
+                rows[local.z * brick_size + local.y] |= uint64_t(1u) << local.x;
+            }
+        }
+
+        auto count = [](const Bricks & bricks) {
+            size_t voxels = 0u;
+            for (const auto & rows: bricks.rows) {
+                for (auto row: rows) voxels += __builtin_popcountll(row);
+            }
+            return voxels;
+        };
+        stats_.voxels_before = count(bricks);
+
+        for (uint32_t i = 0; i < parameters.iterations; ++i) {
+            bricks = step(bricks, stats_.bricks);
+        }
+        stats_.iterations = parameters.iterations;
+        stats_.voxels_after = count(bricks);
+
+        VoxelRenderer::Vertices result;
+        result.reserve(stats_.voxels_after);
+        {
+            PROFILE_ZONE("smoothing/unpack");
+            for (size_t i = 0; i < bricks.rows.size(); ++i) {
+                auto origin = bricks.coords[i] * brick_size;
+                for (int32_t r = 0; r < brick_size * brick_size; ++r) {
+                    for (auto row = bricks.rows[i][r]; row != 0u; row &= row - 1u) {
+                        auto x = __builtin_ctzll(row);
+                        result.push_back({
+                            GLfloat(origin.x + x),
+                            GLfloat(origin.y + r % brick_size),
+                            GLfloat(origin.z + r / brick_size)
+                        });
+                    }
+                }
+            }
+        }
+
+        stats_.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        return result;
+    }
+
+    void Smoother::print_stats(std::ostream & os) const {
+        os << boost::format("Smoothing: %d iterations over %d bricks with %d threads, %d -> %d voxels in %.2f ms (%.1f Mvoxels/s)")
+            % stats_.iterations
+            % stats_.bricks
+            % Helpers::thread_count(threads)
+            % stats_.voxels_before
+            % stats_.voxels_after
+            % (stats_.seconds * 1000.0)
+            % (stats_.bricks * double(brick_size * brick_size * brick_size) / stats_.seconds / 1e6)
+            << std::endl;
+    }
+
+    VoxelRenderer::Vertices Smoother::smooth_from_env(const VoxelRenderer::Vertices & vertices) {
+        auto parameters = Parameters::from_env();
+        if (!parameters) return vertices;
+
+        Smoother smoother(*parameters);
+        auto result = smoother.smooth(vertices);
+        smoother.print_stats();
+
+        VoxelRenderer::VerticesOptimizer optimizer(false);
+        optimizer.optimize(vertices);
+        auto before = optimizer.stats.visible_vertices;
+        optimizer.optimize(result);
+        auto after = optimizer.stats.visible_vertices;
+        std::cout << boost::format("Smoothing: %d -> %d visible voxels (%.1f%%)")
+            % before
+            % after
+            % (before == 0u ? 0.0 : 100.0 * (double(after) - before) / before)
+            << std::endl;
+        return result;
+    }
+
+    Smoother::Bricks Smoother::step(const Bricks & from, size_t & processed) const {
+        PROFILE_ZONE("smoothing/step");
+
+        // solid voxels in the bricks around can be carved as well
+        Bricks to;
+        for (const auto & coord: from.coords) {
+            for (int32_t dz = -1; dz <= 1; ++dz) {
+                for (int32_t dy = -1; dy <= 1; ++dy) {
+                    for (int32_t dx = -1; dx <= 1; ++dx) {
+                        to.insert(coord + glm::ivec3(dx, dy, dz));
+                    }
+                }
+            }
+        }
+
+        processed += to.rows.size();
+        Helpers::parallel_for(to.rows.size(), [&](uint32_t i) {
+            step_brick(from, to.coords[i], to.rows[i]);
+        }, threads);
+
+        // empty bricks are dropped
+        Bricks result;
+        for (size_t i = 0; i < to.rows.size(); ++i) {
+            bool empty = std::all_of(to.rows[i].begin(), to.rows[i].end(), [](auto row) { return row == 0u; });
+            if (empty) continue;
+            result.rows[result.insert(to.coords[i])] = to.rows[i];
+        }
+        return result;
+    }
+
+    void Smoother::step_brick(const Bricks & from, const glm::ivec3 & coord, Rows & out) const {
+        static constexpr int32_t padded = brick_size + 2;
+        static const Rows empty{};
+
+        // halo exchange: the rows of the brick and its one voxel border from the neighbours,
+        // each as the row itself and the rows shifted by one voxel to -x and +x
+        thread_local std::vector<std::array<uint64_t, 3>> halo(padded * padded);
+        const Rows * neighbours[3][3][3];
+        for (int32_t dz = -1; dz <= 1; ++dz) {
+            for (int32_t dy = -1; dy <= 1; ++dy) {
+                for (int32_t dx = -1; dx <= 1; ++dx) {
+                    auto rows = from.find(coord + glm::ivec3(dx, dy, dz));
+                    neighbours[dz + 1][dy + 1][dx + 1] = rows ? rows : &empty;
+                }
+            }
+        }
+
+        for (int32_t pz = 0; pz < padded; ++pz) {
+            auto z = pz - 1;
+            auto bz = z < 0 ? 0 : z < brick_size ? 1 : 2;
+            auto lz = z - (bz - 1) * brick_size;
+            for (int32_t py = 0; py < padded; ++py) {
+                auto y = py - 1;
+                auto by = y < 0 ? 0 : y < brick_size ? 1 : 2;
+                auto ly = y - (by - 1) * brick_size;
+                auto r = lz * brick_size + ly;
+                auto center = (*neighbours[bz][by][1])[r];
+                auto west = (*neighbours[bz][by][0])[r];
+                auto east = (*neighbours[bz][by][2])[r];
+                // bit x holds the voxel x - 1, x and x + 1
+                halo[pz * padded + py] = { center, center << 1 | west >> 63, center >> 1 | east << 63 };
+            }
+        }
+
+        for (int32_t z = 0; z < brick_size; ++z) {
+            for (int32_t y = 0; y < brick_size; ++y) {
+                BitSlicedCounter counter;
+                for (int32_t dz = 0; dz < 3; ++dz) {
+                    for (int32_t dy = 0; dy < 3; ++dy) {
+                        const auto & row = halo[(z + dz) * padded + y + dy];
+                        if (dz != 1 || dy != 1) counter.add(row[0]);
+                        counter.add(row[1]);
+                        counter.add(row[2]);
+                    }
+                }
+                auto carved = halo[(z + 1) * padded + y + 1][0];
+                out[z * brick_size + y] =
+                    (carved & counter.at_least(parameters.survival)) |
+                    (~carved & counter.at_least(parameters.birth));
+            }
+        }
+    }
+
+    glm::ivec3 Smoother::brick_of(const glm::ivec3 & v) {
+        auto floor_div = [](int32_t a) { return a >= 0 ? a / brick_size : -((-a + brick_size - 1) / brick_size); };
+        return { floor_div(v.x), floor_div(v.y), floor_div(v.z) };
+    }
+}
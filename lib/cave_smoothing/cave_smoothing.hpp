@@ -0,0 +1,80 @@
+#ifndef CAVE_SMOOTHING_HPP
+#define CAVE_SMOOTHING_HPP
+
+#include <iostream>
+#include <vector>
+#include <array>
+#include <string>
+#include <optional>
+#include <unordered_map>
+#include <chrono>
+#include <cstdlib>
+#include <boost/format.hpp>
+
+#include <lib/helpers.hpp>
+#include <lib/voxel_renderer/voxel_renderer.hpp>
+#include <lib/profiler/profiler.hpp>
+#include <lib/memory_tracker/memory_tracker.hpp>
+
+namespace CaveSmoothing {
+    struct Parameters {
+        uint32_t iterations = 2u;
+        // a solid voxel is carved with at least birth carved voxels out of its 26 neighbours,
+        // and a carved voxel stays carved with at least survival (14 / 13 is the majority, keeping ties)
+        uint32_t birth = 14u;
+        uint32_t survival = 13u;
+
+        // TGP_SMOOTH="iterations[,birth,survival]"
+        static std::optional<Parameters> from_env();
+    };
+
+    // Cellular automaton over the carved voxels, which are packed into bricks of 64^3 bits with a row along x
+    // in a 64 bit word. Neighbours are counted for the 64 voxels of a row at once with bit-sliced adders,
+    // after gathering a one voxel halo from the 26 neighbouring bricks.
+    class Smoother {
+    public:
+        static constexpr int32_t brick_size = 64;
+
+        struct Stats {
+            uint32_t iterations = 0u;
+            size_t bricks = 0u;
+            size_t voxels_before = 0u;
+            size_t voxels_after = 0u;
+            double seconds = 0.0;
+        };
+
+        Smoother(const Parameters & parameters_ = {}, uint32_t threads_ = 0);
+
+        VoxelRenderer::Vertices smooth(const VoxelRenderer::Vertices & vertices);
+
+        const Stats & stats() const { return stats_; }
+        void print_stats(std::ostream & os = std::cout) const;
+
+        // smooths with the parameters of TGP_SMOOTH and prints the reduction of the visible surface,
+        // or returns the vertices as they are without it
+        static VoxelRenderer::Vertices smooth_from_env(const VoxelRenderer::Vertices & vertices);
+
+    private:
+        using Rows = std::array<uint64_t, brick_size * brick_size>;
+
+        struct Bricks {
+            std::vector<glm::ivec3> coords;
+            std::vector<Rows> rows;
+            std::unordered_map<uint64_t, uint32_t> index;
+
+            const Rows * find(const glm::ivec3 & coord) const;
+            uint32_t insert(const glm::ivec3 & coord);
+        };
+
+        Parameters parameters;
+        uint32_t threads;
+        Stats stats_;
+
+        Bricks step(const Bricks & from, size_t & processed) const;
+        void step_brick(const Bricks & from, const glm::ivec3 & coord, Rows & out) const;
+
+        static glm::ivec3 brick_of(const glm::ivec3 & v);
+    };
+}
+
+#endif
@@ -0,0 +1,131 @@
+#include <lib/chunk_cache/chunk_cache.hpp>
+
+namespace ChunkCache {
+// ParameterHash
+
+    ParameterHash & ParameterHash::add(const void * data, size_t size) {
+        const auto * bytes = static_cast<const uint8_t *>(data);
+        for (size_t i = 0; i < size; ++i) {
+            value ^= bytes[i];
+            value *= 1099511628211ull;
+        }
+        return *this;
+    }
+
+    ParameterHash & ParameterHash::add(const std::string & v) {
+        add(uint64_t(v.size()));
+        return add(v.data(), v.size());
+    }
+
+    ParameterHash & ParameterHash::add(int64_t v) {
+        return add(uint64_t(v));
+    }
+
+    ParameterHash & ParameterHash::add(uint64_t v) {
+        uint8_t bytes[8];
+        for (uint32_t i = 0; i < 8; ++i) bytes[i] = (v >> (8 * i)) & 0xff;
+        return add(bytes, sizeof(bytes));
+    }
+
+    ParameterHash & ParameterHash::add(double v) {
+        uint64_t bits;
+        std::memcpy(&bits, &v, sizeof(bits));
+        return add(bits);
+    }
+
+    std::string ParameterHash::hex() const {
+        return (boost::format("%016x") % value).str();
+    }
+
+// DiskCache
+
+    boost::filesystem::path DiskCache::default_directory() {
+        if (const char * dir = std::getenv("TGP_CACHE_DIR")) return dir;
+        return boost::filesystem::temp_directory_path() / "terrain-generation-prototyping";
+    }
+
+    DiskCache::DiskCache(const boost::filesystem::path & directory_) : directory(directory_) {
+        boost::filesystem::create_directories(directory);
+    }
+
+    std::optional<VoxelRenderer::Vertices> DiskCache::load(const ParameterHash & key) {
+        MEMORY_SCOPE("chunk_cache");
+        auto path = path_for(key);
+        std::ifstream ifs(path.string(), std::ios::binary);
+        uint32_t header[2] = { 0, 0 };
+        uint64_t size = 0;
+
+        if (
+            !ifs.read(reinterpret_cast<char *>(header), sizeof(header)) ||
+            header[0] != magic || header[1] != version ||
+            !ifs.read(reinterpret_cast<char *>(&size), sizeof(size)) ||
+            boost::filesystem::file_size(path) != sizeof(header) + sizeof(size) + size * sizeof(VoxelRenderer::Vertices::value_type)
+        ) {
+            ++stats_.misses;
+            return std::nullopt;
+        }
+
+        VoxelRenderer::Vertices vertices(size);
+        if (!ifs.read(reinterpret_cast<char *>(vertices.data()), size * sizeof(VoxelRenderer::Vertices::value_type))) {
+            ++stats_.misses;
+            return std::nullopt;
+        }
+
+        ++stats_.hits;
+        stats_.bytes_read += boost::filesystem::file_size(path);
+        return vertices;
+    }
+
+    void DiskCache::store(const ParameterHash & key, const VoxelRenderer::Vertices & vertices) {
+        auto path = path_for(key);
+        auto temp_path = boost::filesystem::unique_path(path.string() + ".%%%%-%%%%.tmp");
+        uint32_t header[2] = { magic, version };
+        uint64_t size = vertices.size();
+
+        {
+            std::ofstream ofs(temp_path.string(), std::ios::binary | std::ios::trunc);
+            ofs.write(reinterpret_cast<const char *>(header), sizeof(header));
+            ofs.write(reinterpret_cast<const char *>(&size), sizeof(size));
+            ofs.write(reinterpret_cast<const char *>(vertices.data()), size * sizeof(VoxelRenderer::Vertices::value_type));
+            if (!ofs.flush()) {
+                std::cerr << boost::format("Failed to write the chunk cache: %s") % temp_path.string() << std::endl;
+                boost::system::error_code ec;
+                boost::filesystem::remove(temp_path, ec);
+                return;
+            }
+        }
+
+        // readers see either no file or a complete one
+        boost::system::error_code ec;
+        boost::filesystem::rename(temp_path, path, ec);
+        if (ec) {
+            std::cerr << boost::format("Failed to write the chunk cache: %s") % ec.message() << std::endl;
+            boost::filesystem::remove(temp_path, ec);
+            return;
+        }
+        stats_.bytes_written += boost::filesystem::file_size(path);
+    }
+
+    VoxelRenderer::Vertices DiskCache::fetch(const ParameterHash & key, std::function<VoxelRenderer::Vertices()> generate) {
+        if (auto vertices = load(key)) return std::move(*vertices);
+
+        auto vertices = generate();
+        store(key, vertices);
+        return vertices;
+    }
+
+    void DiskCache::print_stats(std::ostream & os) const {
+        uint64_t hits = stats_.hits;
+        uint64_t misses = stats_.misses;
+        auto total = hits + misses;
+
+        os << boost::format("Chunk cache: %s") % directory.string() << std::endl;
+        os << boost::format("Chunk cache hit rate: %.1f%% (%d / %d)") % (total == 0 ? 0.0 : 100.0 * hits / total) % hits % total << std::endl;
+        os << boost::format("Chunk cache bytes saved: %d") % stats_.bytes_read << std::endl;
+        os << boost::format("Chunk cache bytes written: %d") % stats_.bytes_written << std::endl;
+    }
+
+    boost::filesystem::path DiskCache::path_for(const ParameterHash & key) const {
+        return directory / (key.hex() + ".chunk");
+    }
+}
@@ -0,0 +1,67 @@
+#ifndef CHUNK_CACHE_HPP
+#define CHUNK_CACHE_HPP
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <cstring>
+#include <cstdlib>
+#include <optional>
+#include <atomic>
+#include <functional>
+#include <boost/format.hpp>
+#include <boost/filesystem.hpp>
+
+#include <lib/voxel_renderer/voxel_renderer.hpp>
+
+namespace ChunkCache {
+    // FNV-1a over the little endian bytes of the values, stable across runs and platforms
+    class ParameterHash {
+        uint64_t value = 14695981039346656037ull;
+
+    public:
+        ParameterHash & add(const void * data, size_t size);
+        ParameterHash & add(const std::string & v);
+        ParameterHash & add(int64_t v);
+        ParameterHash & add(uint64_t v);
+        ParameterHash & add(int32_t v) { return add(int64_t(v)); }
+        ParameterHash & add(uint32_t v) { return add(uint64_t(v)); }
+        ParameterHash & add(double v);
+        ParameterHash & add(float v) { return add(double(v)); }
+
+        uint64_t digest() const { return value; }
+        std::string hex() const;
+    };
+
+    class DiskCache {
+    public:
+        struct Stats {
+            std::atomic<uint64_t> hits{ 0 };
+            std::atomic<uint64_t> misses{ 0 };
+            std::atomic<uint64_t> bytes_read{ 0 };
+            std::atomic<uint64_t> bytes_written{ 0 };
+        };
+
+        static boost::filesystem::path default_directory();
+
+        DiskCache(const boost::filesystem::path & directory_ = default_directory());
+
+        std::optional<VoxelRenderer::Vertices> load(const ParameterHash & key);
+        void store(const ParameterHash & key, const VoxelRenderer::Vertices & vertices);
+        VoxelRenderer::Vertices fetch(const ParameterHash & key, std::function<VoxelRenderer::Vertices()> generate);
+
+        const Stats & stats() const { return stats_; }
+        void print_stats(std::ostream & os = std::cout) const;
+
+    private:
+        static constexpr uint32_t magic = 0x43505447u; // "TGPC"
+        static constexpr uint32_t version = 1u;
+
+        boost::filesystem::path directory;
+        Stats stats_;
+
+        boost::filesystem::path path_for(const ParameterHash & key) const;
+    };
+}
+
+#endif
@@ -0,0 +1,209 @@
+#include <lib/chunk_cache/memory_cache.hpp>
+
+namespace ChunkCache {
+    namespace {
+        constexpr uint64_t fill_ones = 1ull << 31;
+        constexpr uint64_t max_fill = fill_ones - 1u;
+        constexpr uint64_t max_literals = 0xffffffffull;
+
+        bool is_fill(uint64_t word) {
+            return word == 0u || word == ~0ull;
+        }
+
+        glm::ivec3 round(const std::array<GLfloat, 3> & v) {
+            return { int32_t(std::round(v[0])), int32_t(std::round(v[1])), int32_t(std::round(v[2])) };
+        }
+
+        double seconds_since(std::chrono::steady_clock::time_point start) {
+            return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        }
+    }
+
+// VoxelCodec
+
+    VoxelCodec::Compressed VoxelCodec::compress(const VoxelRenderer::Vertices & vertices) {
+        PROFILE_ZONE("memory_cache/compress");
+        Compressed result;
+        if (vertices.empty()) return result;
+
+        glm::ivec3 min(std::numeric_limits<int32_t>::max());
+        glm::ivec3 max(std::numeric_limits<int32_t>::lowest());
+        for (const auto & v: vertices) {
+            auto voxel = round(v);
+            min = glm::min(min, voxel);
+            max = glm::max(max, voxel);
+        }
+        result.min = min;
+        result.size = max - min + 1;
+
+        // the bit set is scratch memory of the thread, as large as the largest chunk so far
+        thread_local std::vector<uint64_t> bits;
+        uint32_t row_words = (result.size.x + 63u) / 64u;
+        size_t words = size_t(row_words) * result.size.y * result.size.z;
+        bits.assign(words, 0u);
+        for (const auto & v: vertices) {
+            auto voxel = round(v) - min;
+            auto row = size_t(voxel.z) * result.size.y + voxel.y;
+            bits[row * row_words + voxel.x / 64] |= 1ull << (voxel.x % 64);
+        }
+
+        Words stream;
+        for (size_t i = 0; i < words;) {
+            auto fill = bits[i];
+            uint64_t fill_count = 0u;
+            if (is_fill(fill)) {
+                while (i < words && bits[i] == fill && fill_count < max_fill) ++i, ++fill_count;
+            }
+            auto header = stream.size();
+            stream.push_back(0u);
+            uint64_t literals = 0u;
+            while (i < words && !is_fill(bits[i]) && literals < max_literals) {
+                result.voxels += __builtin_popcountll(bits[i]);
+                stream.push_back(bits[i++]);
+                ++literals;
+            }
+            if (fill == ~0ull) result.voxels += 64u * fill_count;
+            stream[header] = fill_count | (fill_count > 0u && fill == ~0ull ? fill_ones : 0u) | literals << 32;
+        }
+        result.words = Words(stream.begin(), stream.end());
+        return result;
+    }
+
+    VoxelRenderer::Vertices VoxelCodec::decompress(const Compressed & compressed) {
+        PROFILE_ZONE("memory_cache/decompress");
+        VoxelRenderer::Vertices vertices;
+        vertices.reserve(compressed.voxels);
+        uint32_t row_words = (compressed.size.x + 63u) / 64u;
+
+        size_t word = 0u;
+        auto emit = [&](uint64_t bits) {
+            auto row = word / row_words;
+            auto x = GLfloat(compressed.min.x + int32_t(word % row_words * 64u));
+            auto y = GLfloat(compressed.min.y + int32_t(row % compressed.size.y));
+            auto z = GLfloat(compressed.min.z + int32_t(row / compressed.size.y));
+            for (; bits != 0u; bits &= bits - 1u) vertices.push_back({ x + __builtin_ctzll(bits), y, z });
+            ++word;
+        };
+
+        for (size_t i = 0; i < compressed.words.size();) {
+            auto header = compressed.words[i++];
+            auto fill_count = header & max_fill;
+            if (header & fill_ones) {
+                for (uint64_t k = 0; k < fill_count; ++k) emit(~0ull);
+            }
+            else {
+                word += fill_count;
+            }
+            for (auto end = i + (header >> 32); i < end; ++i) emit(compressed.words[i]);
+        }
+        return vertices;
+    }
+
+// MemoryCache
+
+    MemoryCache::MemoryCache(size_t hot_chunks_, size_t cold_bytes_) :
+        hot_capacity(std::max<size_t>(hot_chunks_, 1u)),
+        cold_capacity(cold_bytes_)
+    {}
+
+    const VoxelRenderer::Vertices & MemoryCache::fetch(const ParameterHash & key_, std::function<VoxelRenderer::Vertices()> load) {
+        MEMORY_SCOPE("memory_cache");
+        auto key = key_.digest();
+
+        auto hot_it = hot_index.find(key);
+        if (hot_it != hot_index.end()) {
+            ++stats_.hot_hits;
+            hot.splice(hot.begin(), hot, hot_it->second);
+            return hot.front().vertices;
+        }
+
+        auto cold_it = cold_index.find(key);
+        if (cold_it != cold_index.end()) {
+            ++stats_.cold_hits;
+            auto start = std::chrono::steady_clock::now();
+            auto vertices = VoxelCodec::decompress(cold_it->second->compressed);
+            auto seconds = seconds_since(start);
+            stats_.decompress_seconds += seconds;
+            stats_.max_decompress_seconds = std::max(stats_.max_decompress_seconds, seconds);
+
+            cold_bytes_ -= cold_it->second->compressed.bytes();
+            cold.erase(cold_it->second);
+            cold_index.erase(cold_it);
+            return insert_hot(key, std::move(vertices));
+        }
+
+        ++stats_.misses;
+        auto start = std::chrono::steady_clock::now();
+        auto vertices = load();
+        stats_.load_seconds += seconds_since(start);
+        return insert_hot(key, std::move(vertices));
+    }
+
+    const VoxelRenderer::Vertices & MemoryCache::insert_hot(uint64_t key, VoxelRenderer::Vertices vertices) {
+        while (hot.size() >= hot_capacity) demote_least_recently_used();
+        hot_bytes_ += vertices.capacity() * sizeof(VoxelRenderer::Vertices::value_type);
+        hot.push_front({ key, std::move(vertices) });
+        hot_index[key] = hot.begin();
+        return hot.front().vertices;
+    }
+
+    void MemoryCache::demote_least_recently_used() {
+        auto & chunk = hot.back();
+        auto raw_bytes = chunk.vertices.capacity() * sizeof(VoxelRenderer::Vertices::value_type);
+
+        auto start = std::chrono::steady_clock::now();
+        auto compressed = VoxelCodec::compress(chunk.vertices);
+        stats_.compress_seconds += seconds_since(start);
+        ++stats_.demoted_chunks;
+        stats_.demoted_bytes += raw_bytes;
+        stats_.compressed_bytes += compressed.bytes();
+
+        hot_bytes_ -= raw_bytes;
+        cold_bytes_ += compressed.bytes();
+        cold.push_front({ chunk.key, std::move(compressed) });
+        cold_index[chunk.key] = cold.begin();
+        hot_index.erase(chunk.key);
+        hot.pop_back();
+
+        while (cold_bytes_ > cold_capacity && !cold.empty()) {
+            ++stats_.evicted_chunks;
+            cold_bytes_ -= cold.back().compressed.bytes();
+            cold_index.erase(cold.back().key);
+            cold.pop_back();
+        }
+    }
+
+    void MemoryCache::print_stats(std::ostream & os) const {
+        auto total = stats_.hot_hits + stats_.cold_hits + stats_.misses;
+        auto percent = [total](uint64_t n) { return total == 0u ? 0.0 : 100.0 * n / total; };
+        auto per_chunk = [](size_t bytes, size_t chunks) { return chunks == 0u ? 0.0 : bytes / 1024.0 / chunks; };
+
+        os << boost::format("Memory cache hot tier: %.1f%% hits (%d), %d chunks, %.1f KB per chunk")
+            % percent(stats_.hot_hits)
+            % stats_.hot_hits
+            % hot.size()
+            % per_chunk(hot_bytes_, hot.size())
+            << std::endl;
+        os << boost::format("Memory cache cold tier: %.1f%% hits (%d), %d chunks, %.1f KB per chunk, %d evicted")
+            % percent(stats_.cold_hits)
+            % stats_.cold_hits
+            % cold.size()
+            % per_chunk(cold_bytes_, cold.size())
+            % stats_.evicted_chunks
+            << std::endl;
+        os << boost::format("Memory cache misses: %.1f%% (%d), %.3f ms per load")
+            % percent(stats_.misses)
+            % stats_.misses
+            % (stats_.misses == 0u ? 0.0 : 1e3 * stats_.load_seconds / stats_.misses)
+            << std::endl;
+        os << boost::format("Memory cache compression: %.1fx over %d chunks, %.1f us per chunk")
+            % (stats_.compressed_bytes == 0u ? 0.0 : double(stats_.demoted_bytes) / stats_.compressed_bytes)
+            % stats_.demoted_chunks
+            % (stats_.demoted_chunks == 0u ? 0.0 : 1e6 * stats_.compress_seconds / stats_.demoted_chunks)
+            << std::endl;
+        os << boost::format("Memory cache promotion: %.1f us per chunk on average, %.1f us at most")
+            % (stats_.cold_hits == 0u ? 0.0 : 1e6 * stats_.decompress_seconds / stats_.cold_hits)
+            % (1e6 * stats_.max_decompress_seconds)
+            << std::endl;
+    }
+}
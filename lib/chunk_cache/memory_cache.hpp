@@ -0,0 +1,99 @@
+#ifndef MEMORY_CACHE_HPP
+#define MEMORY_CACHE_HPP
+
+#include <iostream>
+#include <list>
+#include <chrono>
+#include <unordered_map>
+#include <functional>
+#include <boost/format.hpp>
+
+#include <lib/chunk_cache/chunk_cache.hpp>
+#include <lib/voxel_renderer/voxel_renderer.hpp>
+#include <lib/profiler/profiler.hpp>
+#include <lib/memory_tracker/memory_tracker.hpp>
+
+namespace ChunkCache {
+    // Occupancy of the voxels of a chunk within their bounds, one row of 64 bit words along x for every y and z,
+    // run length encoded: a header word with a run of words which are all 0 or all 1 in its low 32 bits and the
+    // number of literal words which follow it in its high 32 bits. The voxels are rounded to the grid as every
+    // consumer of the chunks does, and come back sorted by z, y and x and without duplicates.
+    class VoxelCodec {
+    public:
+        struct WordsTag { static constexpr const char * name = "compressed_chunks"; };
+        using Words = std::vector<uint64_t, MemoryTracker::Allocator<uint64_t, WordsTag>>;
+
+        struct Compressed {
+            glm::ivec3 min{ 0 };
+            glm::ivec3 size{ 0 };
+            uint32_t voxels = 0u;
+            Words words;
+
+            size_t bytes() const { return sizeof(Compressed) + words.capacity() * sizeof(uint64_t); }
+        };
+
+        static Compressed compress(const VoxelRenderer::Vertices & vertices);
+        static VoxelRenderer::Vertices decompress(const Compressed & compressed);
+    };
+
+    // Chunks in memory in 2 tiers: the hot tier holds the most recently fetched ones as they are, and the chunks
+    // it drops are compressed into the cold tier, which drops the least recently used ones beyond its budget of
+    // bytes. A chunk fetched from the cold tier is decompressed back into the hot tier. Not thread safe.
+    class MemoryCache {
+    public:
+        struct Stats {
+            uint64_t hot_hits = 0u;
+            uint64_t cold_hits = 0u;
+            uint64_t misses = 0u;
+            uint64_t demoted_chunks = 0u;
+            uint64_t evicted_chunks = 0u;
+            // of the chunks as they were loaded, and as they are in the cold tier
+            uint64_t demoted_bytes = 0u;
+            uint64_t compressed_bytes = 0u;
+            double compress_seconds = 0.0;
+            double decompress_seconds = 0.0;
+            double max_decompress_seconds = 0.0;
+            double load_seconds = 0.0;
+        };
+
+        MemoryCache(size_t hot_chunks_, size_t cold_bytes_);
+
+        // the vertices stay valid until the next fetch
+        const VoxelRenderer::Vertices & fetch(const ParameterHash & key, std::function<VoxelRenderer::Vertices()> load);
+
+        size_t hot_chunks() const { return hot.size(); }
+        size_t cold_chunks() const { return cold.size(); }
+        size_t hot_bytes() const { return hot_bytes_; }
+        size_t cold_bytes() const { return cold_bytes_; }
+
+        const Stats & stats() const { return stats_; }
+        void print_stats(std::ostream & os = std::cout) const;
+
+    private:
+        struct HotChunk {
+            uint64_t key;
+            VoxelRenderer::Vertices vertices;
+        };
+
+        struct ColdChunk {
+            uint64_t key;
+            VoxelCodec::Compressed compressed;
+        };
+
+        size_t hot_capacity;
+        size_t cold_capacity;
+        // the most recently used first
+        std::list<HotChunk> hot;
+        std::list<ColdChunk> cold;
+        std::unordered_map<uint64_t, std::list<HotChunk>::iterator> hot_index;
+        std::unordered_map<uint64_t, std::list<ColdChunk>::iterator> cold_index;
+        size_t hot_bytes_ = 0u;
+        size_t cold_bytes_ = 0u;
+        Stats stats_;
+
+        const VoxelRenderer::Vertices & insert_hot(uint64_t key, VoxelRenderer::Vertices vertices);
+        void demote_least_recently_used();
+    };
+}
+
+#endif
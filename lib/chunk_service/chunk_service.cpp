@@ -0,0 +1,567 @@
+#include <lib/chunk_service/chunk_service.hpp>
+
+#include <cstring>
+#include <cerrno>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/stat.h>
+
+namespace ChunkService {
+    namespace {
+        struct FrameHeader {
+            uint32_t magic;
+            MessageType type;
+            uint64_t size;
+        };
+
+        constexpr uint64_t max_payload = uint64_t(1u) << 30;
+        // of a ChunkRequest in a generate message
+        constexpr uint64_t request_size = sizeof(int32_t) + sizeof(Generator) + 2u * sizeof(int32_t) + sizeof(uint32_t);
+
+        class Writer {
+        public:
+            std::vector<uint8_t> bytes;
+
+            template<typename T>
+            Writer & put(const T & v) {
+                return put(&v, sizeof(T));
+            }
+
+            Writer & put(const void * data, size_t size) {
+                const auto * begin = static_cast<const uint8_t *>(data);
+                bytes.insert(bytes.end(), begin, begin + size);
+                return *this;
+            }
+        };
+
+        class Reader {
+            const std::vector<uint8_t> & bytes;
+            size_t offset = 0u;
+
+        public:
+            Reader(const std::vector<uint8_t> & bytes_) : bytes(bytes_) {}
+
+            template<typename T>
+            T get() {
+                T v;
+                get(&v, sizeof(T));
+                return v;
+            }
+
+            void get(void * data, size_t size) {
+                if (offset + size > bytes.size()) throw std::string("truncated chunk service message");
+                std::memcpy(data, bytes.data() + offset, size);
+                offset += size;
+            }
+        };
+
+        bool send_all(int fd, const void * data, size_t size) {
+            const auto * p = static_cast<const uint8_t *>(data);
+            while (size > 0u) {
+                auto n = ::send(fd, p, size, MSG_NOSIGNAL);
+                if (n < 0 && errno == EINTR) continue;
+                if (n <= 0) return false;
+                p += n;
+                size -= n;
+            }
+            return true;
+        }
+
+        bool receive_all(int fd, void * data, size_t size) {
+            auto * p = static_cast<uint8_t *>(data);
+            while (size > 0u) {
+                auto n = ::recv(fd, p, size, 0);
+                if (n < 0 && errno == EINTR) continue;
+                if (n <= 0) return false;
+                p += n;
+                size -= n;
+            }
+            return true;
+        }
+
+        bool send_frame(int fd, MessageType type, const std::vector<uint8_t> & payload) {
+            FrameHeader header{ magic, type, payload.size() };
+            return send_all(fd, &header, sizeof(header)) && send_all(fd, payload.data(), payload.size());
+        }
+
+        // false when the peer closed the connection
+        bool receive_frame(int fd, MessageType & type, std::vector<uint8_t> & payload) {
+            FrameHeader header;
+            if (!receive_all(fd, &header, sizeof(header))) return false;
+            if (header.magic != magic || header.size > max_payload) throw std::string("invalid chunk service frame");
+            type = header.type;
+            payload.resize(header.size);
+            return receive_all(fd, payload.data(), payload.size());
+        }
+
+        std::vector<uint8_t> error_payload(const std::string & message) {
+            return std::vector<uint8_t>(message.begin(), message.end());
+        }
+
+        sockaddr_un socket_address(const boost::filesystem::path & path) {
+            sockaddr_un address{};
+            address.sun_family = AF_UNIX;
+            if (path.string().size() >= sizeof(address.sun_path)) {
+                throw (boost::format("the socket path %s is too long") % path.string()).str();
+            }
+            std::strncpy(address.sun_path, path.c_str(), sizeof(address.sun_path) - 1u);
+            return address;
+        }
+
+        void write_stats(Writer & writer, const Stats & stats) {
+            writer
+                .put(stats.batches)
+                .put(stats.chunks)
+                .put(stats.generated)
+                .put(stats.cache_hits)
+                .put(stats.coalesced)
+                .put(stats.failed)
+                .put(stats.cache_chunks)
+                .put(stats.cache_bytes)
+                .put(stats.threads)
+                .put(stats.uptime_seconds)
+                .put(stats.generation_seconds)
+                .put(stats.latency_p50)
+                .put(stats.latency_p90)
+                .put(stats.latency_p99)
+                .put(stats.latency_max);
+        }
+
+        Stats read_stats(Reader & reader) {
+            Stats stats;
+            stats.batches = reader.get<uint64_t>();
+            stats.chunks = reader.get<uint64_t>();
+            stats.generated = reader.get<uint64_t>();
+            stats.cache_hits = reader.get<uint64_t>();
+            stats.coalesced = reader.get<uint64_t>();
+            stats.failed = reader.get<uint64_t>();
+            stats.cache_chunks = reader.get<uint64_t>();
+            stats.cache_bytes = reader.get<uint64_t>();
+            stats.threads = reader.get<uint32_t>();
+            stats.uptime_seconds = reader.get<double>();
+            stats.generation_seconds = reader.get<double>();
+            stats.latency_p50 = reader.get<double>();
+            stats.latency_p90 = reader.get<double>();
+            stats.latency_p99 = reader.get<double>();
+            stats.latency_max = reader.get<double>();
+            return stats;
+        }
+
+        void write_chunk(Writer & writer, const ChunkCache::VoxelCodec::Compressed & voxels) {
+            writer
+                .put(voxels.min)
+                .put(voxels.size)
+                .put(voxels.voxels)
+                .put(uint64_t(voxels.words.size()))
+                .put(voxels.words.data(), voxels.words.size() * sizeof(uint64_t));
+        }
+
+        ChunkCache::VoxelCodec::Compressed read_chunk(Reader & reader) {
+            ChunkCache::VoxelCodec::Compressed voxels;
+            voxels.min = reader.get<glm::ivec3>();
+            voxels.size = reader.get<glm::ivec3>();
+            voxels.voxels = reader.get<uint32_t>();
+            auto words = reader.get<uint64_t>();
+            if (words > max_payload / sizeof(uint64_t)) throw std::string("truncated chunk service message");
+            voxels.words.resize(words);
+            reader.get(voxels.words.data(), words * sizeof(uint64_t));
+            return voxels;
+        }
+    }
+
+// functions
+
+    uint64_t ChunkRequest::key() const {
+        return ChunkCache::ParameterHash()
+            .add(seed)
+            .add(uint32_t(generator))
+            .add(x)
+            .add(y)
+            .add(lod)
+            .digest();
+    }
+
+    void Stats::print(std::ostream & os) const {
+        os << boost::format("Chunk service: %d chunks in %d batches over %.1f s (%.1f chunks/s), %d threads")
+            % chunks
+            % batches
+            % uptime_seconds
+            % (uptime_seconds > 0.0 ? chunks / uptime_seconds : 0.0)
+            % threads
+            << std::endl;
+        os << boost::format("Chunk service requests: %d generated (%.2f ms each), %d cache hits, %d coalesced, %d failed")
+            % generated
+            % (generated > 0u ? 1e3 * generation_seconds / generated : 0.0)
+            % cache_hits
+            % coalesced
+            % failed
+            << std::endl;
+        os << boost::format("Chunk service latency: p50 %.2f ms, p90 %.2f ms, p99 %.2f ms, max %.2f ms")
+            % latency_p50
+            % latency_p90
+            % latency_p99
+            % latency_max
+            << std::endl;
+        os << boost::format("Chunk service cache: %d chunks, %d bytes") % cache_chunks % cache_bytes << std::endl;
+    }
+
+    boost::filesystem::path default_socket_path() {
+        if (const char * path = std::getenv("TGP_SERVICE_SOCKET")) return path;
+        return boost::filesystem::temp_directory_path() / "terrain-generation-prototyping.sock";
+    }
+
+// Server
+
+    Server::Server(const boost::filesystem::path & path_, uint32_t threads_, size_t cache_bytes_) :
+        path(path_),
+        threads(Helpers::thread_count(threads_)),
+        cache_capacity(cache_bytes_)
+    {
+        auto address = socket_address(path);
+        listen_fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+        if (listen_fd < 0) throw (boost::format("failed to create the socket: %s") % std::strerror(errno)).str();
+
+        // a socket left by a service which did not shut down is removed, but not the one of a running service
+        auto probe_fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+        if (probe_fd < 0) {
+            auto message = (boost::format("failed to create the socket: %s") % std::strerror(errno)).str();
+            ::close(listen_fd);
+            throw message;
+        }
+        auto connected = ::connect(probe_fd, reinterpret_cast<const sockaddr *>(&address), sizeof(address)) == 0;
+        auto probe_errno = errno;
+        ::close(probe_fd);
+        if (connected || (probe_errno != ECONNREFUSED && probe_errno != ENOENT)) {
+            ::close(listen_fd);
+            if (connected) throw (boost::format("a chunk service is already running on %s") % path.string()).str();
+            throw (boost::format("failed to probe %s: %s") % path.string() % std::strerror(probe_errno)).str();
+        }
+        if (probe_errno == ECONNREFUSED) ::unlink(path.c_str());
+
+        struct stat socket_stat{};
+        if (
+            ::bind(listen_fd, reinterpret_cast<const sockaddr *>(&address), sizeof(address)) != 0 ||
+            ::listen(listen_fd, 64) != 0 ||
+            ::stat(path.c_str(), &socket_stat) != 0
+        ) {
+            auto message = (boost::format("failed to listen on %s: %s") % path.string() % std::strerror(errno)).str();
+            ::close(listen_fd);
+            throw message;
+        }
+        socket_device = socket_stat.st_dev;
+        socket_inode = socket_stat.st_ino;
+        stats_.threads = threads;
+    }
+
+    Server::~Server() {
+        if (listen_fd >= 0) ::close(listen_fd);
+        // only the socket bound here, not one that replaced it since
+        struct stat socket_stat{};
+        if (::stat(path.c_str(), &socket_stat) == 0 && socket_stat.st_dev == socket_device && socket_stat.st_ino == socket_inode) {
+            ::unlink(path.c_str());
+        }
+    }
+
+    void Server::run() {
+        for (uint32_t i = 0; i < threads; ++i) pool.emplace_back([this]() { work(); });
+
+        while (!stopping) {
+            auto fd = ::accept(listen_fd, nullptr, nullptr);
+            if (fd < 0) {
+                if (stopping) break;
+                if (errno == EINTR || errno == ECONNABORTED) continue;
+                throw (boost::format("failed to accept a connection: %s") % std::strerror(errno)).str();
+            }
+            std::lock_guard<std::mutex> lock(connections_mutex);
+            for (auto id: finished_connections) {
+                connections[id].join();
+                connections.erase(id);
+            }
+            finished_connections.clear();
+            open_fds.insert(fd);
+            auto id = next_connection++;
+            connections[id] = std::thread([this, id, fd]() { serve(id, fd); });
+        }
+
+        // the connections end with their next read, and the pool with its queue
+        {
+            std::lock_guard<std::mutex> lock(connections_mutex);
+            for (auto fd: open_fds) ::shutdown(fd, SHUT_RDWR);
+        }
+        for (auto & connection: connections) connection.second.join();
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            pool_stopping = true;
+        }
+        task_ready.notify_all();
+        for (auto & thread: pool) thread.join();
+    }
+
+    Stats Server::stats() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto result = stats_;
+        result.cache_chunks = cache.size();
+        result.cache_bytes = cache_bytes;
+        result.uptime_seconds = std::chrono::duration<double>(Clock::now() - start_time).count();
+
+        auto sorted = latencies;
+        std::sort(sorted.begin(), sorted.end());
+        auto percentile = [&sorted](double p) {
+            return sorted.empty() ? 0.0 : double(sorted[std::min<size_t>(p * sorted.size(), sorted.size() - 1u)]);
+        };
+        result.latency_p50 = percentile(0.5);
+        result.latency_p90 = percentile(0.9);
+        result.latency_p99 = percentile(0.99);
+        result.latency_max = percentile(1.0);
+        return result;
+    }
+
+    void Server::serve(uint64_t id, int fd) {
+        MessageType type;
+        std::vector<uint8_t> payload;
+        try {
+            while (receive_frame(fd, type, payload)) {
+                bool sent = true;
+                try {
+                    if (type == MessageType::generate) {
+                        sent = send_frame(fd, MessageType::chunks, generate_batch(payload));
+                    }
+                    else if (type == MessageType::stats) {
+                        Writer writer;
+                        write_stats(writer, stats());
+                        sent = send_frame(fd, MessageType::stats_reply, writer.bytes);
+                    }
+                    else if (type == MessageType::shutdown) {
+                        stopping = true;
+                        ::shutdown(listen_fd, SHUT_RDWR);
+                        break;
+                    }
+                    else {
+                        throw (boost::format("unexpected chunk service message %d") % uint32_t(type)).str();
+                    }
+                }
+                catch (std::string str) {
+                    sent = send_frame(fd, MessageType::error, error_payload(str));
+                }
+                catch (const std::exception & e) {
+                    sent = send_frame(fd, MessageType::error, error_payload(e.what()));
+                }
+                if (!sent) break;
+            }
+        }
+        catch (std::string str) {
+            std::cerr << str << std::endl;
+        }
+
+        std::lock_guard<std::mutex> lock(connections_mutex);
+        open_fds.erase(fd);
+        ::close(fd);
+        finished_connections.push_back(id);
+    }
+
+    std::vector<uint8_t> Server::generate_batch(const std::vector<uint8_t> & payload) {
+        PROFILE_ZONE("chunk_service/batch");
+        auto start = Clock::now();
+        Reader reader(payload);
+        auto count = reader.get<uint32_t>();
+        // checked before the requests are allocated, so a short message can not ask for a huge batch
+        if (uint64_t(count) * request_size != payload.size() - sizeof(uint32_t)) {
+            throw (boost::format("a batch of %d chunks needs %d bytes, not %d") % count % (uint64_t(count) * request_size) % (payload.size() - sizeof(uint32_t))).str();
+        }
+
+        std::vector<ChunkRequest> chunk_requests(count);
+        for (auto & r: chunk_requests) {
+            r.seed = reader.get<int32_t>();
+            r.generator = reader.get<Generator>();
+            r.x = reader.get<int32_t>();
+            r.y = reader.get<int32_t>();
+            r.lod = reader.get<uint32_t>();
+            if (r.generator != Generator::caves) throw (boost::format("unknown generator %d") % uint32_t(r.generator)).str();
+            if (r.lod > max_lod) throw (boost::format("lod %d is above %d") % r.lod % max_lod).str();
+        }
+
+        std::vector<std::shared_future<Result>> results;
+        for (const auto & r: chunk_requests) results.push_back(request(r));
+
+        Writer writer;
+        writer.put(count);
+        std::vector<float> batch_latencies;
+        for (auto & future: results) {
+            try {
+                const auto & result = future.get();
+                write_chunk(writer, *result.voxels);
+                batch_latencies.push_back(1e3f * std::chrono::duration<float>(std::max(result.ready, start) - start).count());
+            }
+            catch (std::string str) {
+                throw (boost::format("failed to generate a chunk: %s") % str).str();
+            }
+        }
+
+        std::lock_guard<std::mutex> lock(mutex);
+        ++stats_.batches;
+        stats_.chunks += count;
+        for (auto latency: batch_latencies) {
+            if (latencies.size() < latency_samples) latencies.push_back(latency);
+            else latencies[next_latency] = latency;
+            next_latency = (next_latency + 1u) % latency_samples;
+        }
+        return writer.bytes;
+    }
+
+    std::shared_future<Server::Result> Server::request(const ChunkRequest & chunk_request) {
+        auto key = chunk_request.key();
+        std::lock_guard<std::mutex> lock(mutex);
+
+        auto cached = cache_index.find(key);
+        if (cached != cache_index.end()) {
+            ++stats_.cache_hits;
+            cache.splice(cache.begin(), cache, cached->second);
+            std::promise<Result> promise;
+            promise.set_value({ cache.front().voxels, Clock::now() });
+            return promise.get_future().share();
+        }
+
+        auto pending = in_flight.find(key);
+        if (pending != in_flight.end()) {
+            ++stats_.coalesced;
+            return pending->second;
+        }
+
+        auto promise = std::make_shared<std::promise<Result>>();
+        auto future = promise->get_future().share();
+        in_flight[key] = future;
+        tasks.push_back([this, chunk_request, key, promise]() {
+            auto start = Clock::now();
+            try {
+                auto voxels = std::make_shared<const ChunkCache::VoxelCodec::Compressed>(generate(chunk_request));
+                {
+                    // a request after the chunk leaves the in-flight ones finds it in the cache
+                    std::lock_guard<std::mutex> lock(mutex);
+                    ++stats_.generated;
+                    stats_.generation_seconds += std::chrono::duration<double>(Clock::now() - start).count();
+                    cache_insert(key, voxels);
+                    in_flight.erase(key);
+                }
+                promise->set_value({ voxels, Clock::now() });
+            }
+            catch (...) {
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    ++stats_.failed;
+                    in_flight.erase(key);
+                }
+                promise->set_exception(std::current_exception());
+            }
+        });
+        task_ready.notify_one();
+        return future;
+    }
+
+    ChunkCache::VoxelCodec::Compressed Server::generate(const ChunkRequest & chunk_request) {
+        PROFILE_ZONE("chunk_service/generate");
+        thread_local Arena::MonotonicArena arena("chunk_service");
+        auto cave = cave_generator(chunk_request.seed);
+        glm::vec2 chunk(chunk_request.x, chunk_request.y);
+        CaveGenerator::FootprintIndex index(*cave, chunk, chunk);
+
+        VoxelRenderer::Vertices vertices;
+        if (chunk_request.lod == 0u) {
+            cave->generate_chunk(chunk, index, vertices, arena);
+        }
+        else {
+            arena.reset();
+            std::vector<CaveGenerator::Path> paths;
+            for (auto id: index.find(chunk)) {
+                cave->trace_cave(cave->info_generator().make_from_chunk(index.at(id).chunk), paths, arena);
+            }
+            for (const auto & path: paths) cave->stamp_path_coarse(path, chunk, chunk, 1u << chunk_request.lod, vertices);
+        }
+        return ChunkCache::VoxelCodec::compress(vertices);
+    }
+
+    std::shared_ptr<const CaveGenerator::Generator> Server::cave_generator(int32_t seed) {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto & generator = generators[seed];
+        if (!generator) generator = std::make_shared<const CaveGenerator::Generator>(seed);
+        return generator;
+    }
+
+    void Server::cache_insert(uint64_t key, const Voxels & voxels) {
+        cache.push_front({ key, voxels });
+        cache_index[key] = cache.begin();
+        cache_bytes += voxels->bytes();
+        while (cache_bytes > cache_capacity && !cache.empty()) {
+            cache_bytes -= cache.back().voxels->bytes();
+            cache_index.erase(cache.back().key);
+            cache.pop_back();
+        }
+    }
+
+    void Server::work() {
+        while (true) {
+            std::function<void()> task;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                task_ready.wait(lock, [this]() { return pool_stopping || !tasks.empty(); });
+                if (tasks.empty()) return;
+                task = std::move(tasks.front());
+                tasks.pop_front();
+            }
+            task();
+        }
+    }
+
+// Client
+
+    Client::Client(const boost::filesystem::path & path_) : path(path_) {
+        auto address = socket_address(path);
+        fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd < 0) throw (boost::format("failed to create the socket: %s") % std::strerror(errno)).str();
+        if (::connect(fd, reinterpret_cast<const sockaddr *>(&address), sizeof(address)) != 0) {
+            auto message = (boost::format("failed to connect to the chunk service at %s: %s") % path.string() % std::strerror(errno)).str();
+            ::close(fd);
+            throw message;
+        }
+    }
+
+    Client::~Client() {
+        ::close(fd);
+    }
+
+    std::vector<ChunkCache::VoxelCodec::Compressed> Client::generate(const std::vector<ChunkRequest> & requests) {
+        Writer writer;
+        writer.put(uint32_t(requests.size()));
+        for (const auto & r: requests) writer.put(r.seed).put(r.generator).put(r.x).put(r.y).put(r.lod);
+
+        auto payload = call(MessageType::generate, writer.bytes, MessageType::chunks);
+        Reader reader(payload);
+        std::vector<ChunkCache::VoxelCodec::Compressed> chunks(reader.get<uint32_t>());
+        if (chunks.size() != requests.size()) throw std::string("the chunk service answered a different batch");
+        for (auto & chunk: chunks) chunk = read_chunk(reader);
+        return chunks;
+    }
+
+    Stats Client::stats() {
+        auto payload = call(MessageType::stats, {}, MessageType::stats_reply);
+        Reader reader(payload);
+        return read_stats(reader);
+    }
+
+    void Client::shutdown() {
+        if (!send_frame(fd, MessageType::shutdown, {})) {
+            throw (boost::format("lost the connection to the chunk service at %s") % path.string()).str();
+        }
+    }
+
+    std::vector<uint8_t> Client::call(MessageType type, const std::vector<uint8_t> & payload, MessageType reply) {
+        MessageType reply_type;
+        std::vector<uint8_t> reply_payload;
+        if (!send_frame(fd, type, payload) || !receive_frame(fd, reply_type, reply_payload)) {
+            throw (boost::format("lost the connection to the chunk service at %s") % path.string()).str();
+        }
+        if (reply_type == MessageType::error) throw std::string(reply_payload.begin(), reply_payload.end());
+        if (reply_type != reply) throw (boost::format("unexpected chunk service message %d") % uint32_t(reply_type)).str();
+        return reply_payload;
+    }
+}
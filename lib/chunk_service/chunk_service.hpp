@@ -0,0 +1,168 @@
+#ifndef CHUNK_SERVICE_HPP
+#define CHUNK_SERVICE_HPP
+
+#include <iostream>
+#include <vector>
+#include <deque>
+#include <list>
+#include <set>
+#include <map>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <future>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <unordered_map>
+#include <boost/format.hpp>
+#include <boost/filesystem.hpp>
+
+#include <lib/helpers.hpp>
+#include <lib/cave_generator/cave_generator.hpp>
+#include <lib/chunk_cache/memory_cache.hpp>
+#include <lib/profiler/profiler.hpp>
+
+namespace ChunkService {
+    // Frames over a Unix domain socket: a header of the magic, the message type and the size of the payload,
+    // and the payload in the byte order of the host. A generate request holds a count and the requests, and
+    // is answered by a chunks message with the chunks in the order of the requests, each in the compressed
+    // form of ChunkCache::VoxelCodec, or by an error message with the reason.
+    static constexpr uint32_t magic = 0x53505447u; // "TGPS"
+
+    enum class MessageType : uint32_t { generate = 1u, stats, shutdown, chunks, stats_reply, error };
+
+    enum class Generator : uint32_t { caves = 0u };
+
+    // the coarse previews of Progressive at the stride 2^lod
+    static constexpr uint32_t max_lod = 3u;
+
+    struct ChunkRequest {
+        int32_t seed = 0;
+        Generator generator = Generator::caves;
+        int32_t x = 0;
+        int32_t y = 0;
+        uint32_t lod = 0u;
+
+        uint64_t key() const;
+    };
+
+    struct Stats {
+        uint64_t batches = 0u;
+        uint64_t chunks = 0u;
+        uint64_t generated = 0u;
+        uint64_t cache_hits = 0u;
+        // requests for chunks which were already being generated for another one
+        uint64_t coalesced = 0u;
+        uint64_t failed = 0u;
+        uint64_t cache_chunks = 0u;
+        uint64_t cache_bytes = 0u;
+        uint32_t threads = 0u;
+        double uptime_seconds = 0.0;
+        double generation_seconds = 0.0;
+        // milliseconds from the arrival of the batch to the chunk being ready, over the recent chunks
+        double latency_p50 = 0.0;
+        double latency_p90 = 0.0;
+        double latency_p99 = 0.0;
+        double latency_max = 0.0;
+
+        void print(std::ostream & os = std::cout) const;
+    };
+
+    // TGP_SERVICE_SOCKET, or a socket in the temporary directory
+    boost::filesystem::path default_socket_path();
+
+    // Generates the requested chunks on a pool of threads, shared by all the connections: a chunk which is
+    // being generated is not generated again for other requests, which wait for the same result, and the
+    // results are kept in a cache of compressed chunks up to its budget of bytes.
+    class Server {
+    public:
+        Server(const boost::filesystem::path & path_, uint32_t threads_ = 0, size_t cache_bytes_ = size_t(256u) << 20);
+        ~Server();
+
+        Server(const Server &) = delete;
+        Server & operator=(const Server &) = delete;
+
+        // serves the connections until a shutdown request
+        void run();
+        Stats stats() const;
+
+    private:
+        using Voxels = std::shared_ptr<const ChunkCache::VoxelCodec::Compressed>;
+        using Clock = std::chrono::steady_clock;
+
+        struct Result {
+            Voxels voxels;
+            Clock::time_point ready;
+        };
+
+        struct CacheEntry {
+            uint64_t key;
+            Voxels voxels;
+        };
+
+        static constexpr size_t latency_samples = 1u << 16;
+
+        boost::filesystem::path path;
+        uint32_t threads;
+        size_t cache_capacity;
+        int listen_fd = -1;
+        // the device and inode of the bound socket, so that only this one is unlinked
+        uint64_t socket_device = 0u;
+        uint64_t socket_inode = 0u;
+        std::atomic<bool> stopping{ false };
+        Clock::time_point start_time = Clock::now();
+
+        // connections by id, the finished ones are joined on the next accept
+        std::mutex connections_mutex;
+        std::map<uint64_t, std::thread> connections;
+        std::vector<uint64_t> finished_connections;
+        std::set<int> open_fds;
+        uint64_t next_connection = 0u;
+
+        // generation pool, in-flight requests, cache and stats
+        mutable std::mutex mutex;
+        std::condition_variable task_ready;
+        std::deque<std::function<void()>> tasks;
+        std::vector<std::thread> pool;
+        bool pool_stopping = false;
+        std::unordered_map<uint64_t, std::shared_future<Result>> in_flight;
+        std::list<CacheEntry> cache;
+        std::unordered_map<uint64_t, std::list<CacheEntry>::iterator> cache_index;
+        size_t cache_bytes = 0u;
+        std::map<int32_t, std::shared_ptr<const CaveGenerator::Generator>> generators;
+        std::vector<float> latencies;
+        size_t next_latency = 0u;
+        Stats stats_;
+
+        void serve(uint64_t id, int fd);
+        std::vector<uint8_t> generate_batch(const std::vector<uint8_t> & payload);
+        std::shared_future<Result> request(const ChunkRequest & chunk_request);
+        ChunkCache::VoxelCodec::Compressed generate(const ChunkRequest & chunk_request);
+        std::shared_ptr<const CaveGenerator::Generator> cave_generator(int32_t seed);
+        void cache_insert(uint64_t key, const Voxels & voxels);
+        void work();
+    };
+
+    class Client {
+    public:
+        explicit Client(const boost::filesystem::path & path = default_socket_path());
+        ~Client();
+
+        Client(const Client &) = delete;
+        Client & operator=(const Client &) = delete;
+
+        // throws the reason when the service fails any of the chunks
+        std::vector<ChunkCache::VoxelCodec::Compressed> generate(const std::vector<ChunkRequest> & requests);
+        Stats stats();
+        void shutdown();
+
+    private:
+        int fd = -1;
+        boost::filesystem::path path;
+
+        std::vector<uint8_t> call(MessageType type, const std::vector<uint8_t> & payload, MessageType reply);
+    };
+}
+
+#endif
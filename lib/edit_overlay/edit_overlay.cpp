@@ -0,0 +1,267 @@
+#include <lib/edit_overlay/edit_overlay.hpp>
+
+namespace EditOverlay {
+    namespace {
+        constexpr int32_t z_offset = 1 << 22;
+
+        // nearest voxel without a call into libm nor a branch on the sign, which dominate the scan
+        // over the vertices otherwise, for the coordinates in [-2^20, 2^20) as VerticesOptimizer::pack
+        int32_t round(GLfloat v) {
+            return int32_t(v + 0.5f + 1048576.0f) - 1048576;
+        }
+
+        int32_t floor_div(int32_t v, int32_t d) {
+            return v >= 0 ? v / d : -((-v + d - 1) / d);
+        }
+    }
+
+// ChunkEdits
+
+    uint32_t ChunkEdits::encode(const glm::ivec3 & local, Operation operation) {
+        if (
+            local.x < 0 || local.x >= chunk_size ||
+            local.y < 0 || local.y >= chunk_size ||
+            local.z < -z_offset || local.z >= z_offset
+        ) {
+            throw (boost::format("Voxel out of the chunk: (%d, %d, %d)") % local.x % local.y % local.z).str();
+        }
+        return uint32_t(local.x) | uint32_t(local.y) << 4 | uint32_t(local.z + z_offset) << 8 | uint32_t(operation) << 31;
+    }
+
+    glm::ivec3 ChunkEdits::local_of(uint32_t edit) {
+        return { int32_t(edit & 0xfu), int32_t(edit >> 4 & 0xfu), int32_t(edit >> 8 & 0x7fffffu) - z_offset };
+    }
+
+    bool ChunkEdits::set(uint32_t edit) {
+        auto it = edits_.begin() + (lower_bound(edit) - edits_.cbegin());
+        if (it != edits_.end() && (*it & voxel_mask) == (edit & voxel_mask)) {
+            if (*it == edit) return false;
+            if (operation_of(*it) == Operation::remove) --removals;
+            *it = edit;
+        }
+        else {
+            edits_.insert(it, edit);
+        }
+
+        if (operation_of(edit) == Operation::remove) {
+            // the bounds only grow, and stay conservative
+            auto local = local_of(edit);
+            ++removals;
+            removal_min = glm::min(removal_min, local);
+            removal_max = glm::max(removal_max, local);
+        }
+        return true;
+    }
+
+    void ChunkEdits::apply(const glm::ivec3 & origin, VoxelRenderer::Vertices & vertices, size_t begin) const {
+        if (removals > 0u) {
+            auto removed = [&](const VoxelRenderer::Vertices::value_type & v) {
+                glm::ivec3 local{ round(v[0]) - origin.x, round(v[1]) - origin.y, round(v[2]) - origin.z };
+                // non-short-circuit, as almost every vertex is outside of the bounds of a local dig
+                if (!(
+                    (local.x >= removal_min.x) & (local.y >= removal_min.y) & (local.z >= removal_min.z) &
+                    (local.x <= removal_max.x) & (local.y <= removal_max.y) & (local.z <= removal_max.z)
+                )) return false;
+                auto edit = encode(local, Operation::remove);
+                auto it = lower_bound(edit);
+                return it != edits_.end() && *it == edit;
+            };
+            vertices.erase(std::remove_if(vertices.begin() + begin, vertices.end(), removed), vertices.end());
+        }
+
+        vertices.reserve(vertices.size() + edits_.size() - removals);
+        for (auto edit: edits_) {
+            if (operation_of(edit) != Operation::add) continue;
+            auto local = local_of(edit) + origin;
+            vertices.push_back({ GLfloat(local.x), GLfloat(local.y), GLfloat(local.z) });
+        }
+    }
+
+    std::vector<uint32_t>::const_iterator ChunkEdits::lower_bound(uint32_t edit) const {
+        return std::lower_bound(edits_.begin(), edits_.end(), edit & voxel_mask, [](uint32_t e, uint32_t voxel) {
+            return (e & voxel_mask) < voxel;
+        });
+    }
+
+// Overlay
+
+    Overlay::Overlay() {}
+
+    Overlay::Overlay(const boost::filesystem::path & journal_path_) : journal_path(journal_path_) {
+        if (journal_path->has_parent_path()) boost::filesystem::create_directories(journal_path->parent_path());
+        if (!boost::filesystem::exists(*journal_path)) {
+            open_journal(true);
+            return;
+        }
+
+        replay();
+        // most of the journal is overwritten edits
+        if (stats_.journal_records > 2u * edit_count + 4096u) {
+            compact();
+        }
+        else {
+            open_journal(false);
+        }
+    }
+
+    Overlay::~Overlay() {
+        if (journal.is_open()) journal.flush();
+    }
+
+    std::optional<boost::filesystem::path> Overlay::path_from_env() {
+        if (const char * path = std::getenv("TGP_EDITS")) return boost::filesystem::path(path);
+        return std::nullopt;
+    }
+
+    glm::vec2 Overlay::chunk_of(const glm::ivec3 & voxel) {
+        return { floor_div(voxel.x, chunk_size), floor_div(voxel.y, chunk_size) };
+    }
+
+    void Overlay::edit(const glm::ivec3 & voxel, Operation operation) {
+        auto chunk = chunk_of(voxel);
+        glm::ivec3 origin{ int32_t(chunk.x) * chunk_size, int32_t(chunk.y) * chunk_size, 0 };
+        Record record{ int32_t(chunk.x), int32_t(chunk.y), ChunkEdits::encode(voxel - origin, operation) };
+        if (!set(record)) return;
+
+        if (journal.is_open()) {
+            journal.write(reinterpret_cast<const char *>(&record), sizeof(record));
+            ++stats_.journal_records;
+        }
+
+        auto [it, inserted] = dirty.try_emplace(key_of(record.chunk_x, record.chunk_y), DirtyRegion{ chunk, voxel, voxel });
+        if (!inserted) {
+            it->second.min = glm::min(it->second.min, voxel);
+            it->second.max = glm::max(it->second.max, voxel);
+        }
+    }
+
+    void Overlay::apply(const glm::vec2 & chunk, VoxelRenderer::Vertices & vertices, size_t begin) const {
+        auto edits = find(chunk);
+        if (!edits) return;
+
+        PROFILE_ZONE("edit_overlay/apply");
+        MEMORY_SCOPE("edit_overlay/apply");
+        auto start = std::chrono::steady_clock::now();
+        edits->apply({ int32_t(chunk.x) * chunk_size, int32_t(chunk.y) * chunk_size, 0 }, vertices, begin);
+        ++stats_.applied_chunks;
+        stats_.apply_nanoseconds += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    const ChunkEdits * Overlay::find(const glm::vec2 & chunk) const {
+        auto it = chunks.find(key_of(chunk.x, chunk.y));
+        return it == chunks.end() ? nullptr : &it->second;
+    }
+
+    std::vector<DirtyRegion> Overlay::take_dirty() {
+        std::vector<DirtyRegion> regions;
+        regions.reserve(dirty.size());
+        for (const auto & [key, region]: dirty) regions.push_back(region);
+        dirty.clear();
+        return regions;
+    }
+
+    void Overlay::flush() {
+        if (journal.is_open() && !journal.flush()) {
+            throw (boost::format("Failed to write the edit journal: %s") % journal_path->string()).str();
+        }
+    }
+
+    void Overlay::compact() {
+        if (!journal_path) return;
+        if (journal.is_open()) journal.close();
+
+        auto temp_path = boost::filesystem::unique_path(journal_path->string() + ".%%%%-%%%%.tmp");
+        {
+            std::ofstream ofs(temp_path.string(), std::ios::binary | std::ios::trunc);
+            uint32_t header[2] = { magic, version };
+            ofs.write(reinterpret_cast<const char *>(header), sizeof(header));
+            for (const auto & [key, edits]: chunks) {
+                for (auto edit: edits.edits()) {
+                    Record record{ int32_t(key >> 32), int32_t(key & 0xffffffffu), edit };
+                    ofs.write(reinterpret_cast<const char *>(&record), sizeof(record));
+                }
+            }
+            if (!ofs.flush()) {
+                boost::system::error_code ec;
+                boost::filesystem::remove(temp_path, ec);
+                throw (boost::format("Failed to write the edit journal: %s") % temp_path.string()).str();
+            }
+        }
+
+        // a crash leaves either the old journal or the compacted one
+        boost::filesystem::rename(temp_path, *journal_path);
+        stats_.journal_records = edit_count;
+        open_journal(false);
+    }
+
+    size_t Overlay::memory_bytes() const {
+        // nodes of the map and its buckets, and the edits
+        size_t bytes = chunks.bucket_count() * sizeof(void *);
+        for (const auto & [key, edits]: chunks) {
+            bytes += sizeof(std::pair<const uint64_t, ChunkEdits>) + sizeof(void *) + edits.memory_bytes();
+        }
+        return bytes;
+    }
+
+    void Overlay::print_stats(std::ostream & os) const {
+        uint64_t applied = stats_.applied_chunks;
+        os << boost::format("Edit overlay: %d edits in %d chunks, %d bytes") % edit_count % chunks.size() % memory_bytes() << std::endl;
+        if (journal_path) {
+            os << boost::format("Edit journal: %s (%d records, %d replayed)") % journal_path->string() % stats_.journal_records % stats_.replayed_records << std::endl;
+        }
+        os << boost::format("Edit overlay applied to %d chunks: %.1f us per chunk")
+            % applied
+            % (applied == 0u ? 0.0 : stats_.apply_nanoseconds / 1000.0 / applied)
+            << std::endl;
+    }
+
+    uint64_t Overlay::key_of(int32_t chunk_x, int32_t chunk_y) {
+        return uint64_t(uint32_t(chunk_x)) << 32 | uint32_t(chunk_y);
+    }
+
+    bool Overlay::set(const Record & record) {
+        auto & edits = chunks[key_of(record.chunk_x, record.chunk_y)];
+        auto size = edits.size();
+        if (!edits.set(record.edit)) return false;
+        edit_count += edits.size() - size;
+        return true;
+    }
+
+    void Overlay::replay() {
+        MEMORY_SCOPE("edit_overlay/replay");
+        std::ifstream ifs(journal_path->string(), std::ios::binary);
+        uint32_t header[2] = { 0, 0 };
+        if (!ifs.read(reinterpret_cast<char *>(header), sizeof(header)) || header[0] != magic || header[1] != version) {
+            throw (boost::format("Not an edit journal: %s") % journal_path->string()).str();
+        }
+
+        Record record;
+        size_t records = 0u;
+        while (ifs.read(reinterpret_cast<char *>(&record), sizeof(record))) {
+            set(record);
+            ++records;
+        }
+        ifs.close();
+
+        // drops a record torn by a crash in the middle of the write
+        auto valid_size = sizeof(header) + records * sizeof(Record);
+        if (boost::filesystem::file_size(*journal_path) != valid_size) {
+            std::cerr << boost::format("Truncating a torn record of the edit journal: %s") % journal_path->string() << std::endl;
+            boost::filesystem::resize_file(*journal_path, valid_size);
+        }
+        stats_.journal_records = records;
+        stats_.replayed_records = records;
+        dirty.clear();
+    }
+
+    void Overlay::open_journal(bool truncate) {
+        journal.open(journal_path->string(), std::ios::binary | (truncate ? std::ios::trunc : std::ios::app));
+        if (truncate) {
+            uint32_t header[2] = { magic, version };
+            journal.write(reinterpret_cast<const char *>(header), sizeof(header));
+        }
+        if (!journal) {
+            throw (boost::format("Failed to open the edit journal: %s") % journal_path->string()).str();
+        }
+    }
+}
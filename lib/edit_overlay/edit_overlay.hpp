@@ -0,0 +1,141 @@
+#ifndef EDIT_OVERLAY_HPP
+#define EDIT_OVERLAY_HPP
+
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <string>
+#include <optional>
+#include <unordered_map>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <limits>
+#include <cstdlib>
+#include <boost/format.hpp>
+#include <boost/filesystem.hpp>
+
+#include <lib/voxel_renderer/voxel_renderer.hpp>
+#include <lib/profiler/profiler.hpp>
+#include <lib/memory_tracker/memory_tracker.hpp>
+
+namespace EditOverlay {
+    static constexpr int32_t chunk_size = 16;
+
+    // add puts a voxel into the vertices of its chunk, remove takes it out
+    enum class Operation : uint32_t { add = 0u, remove = 1u };
+
+    // bounds of the voxels edited in a chunk since the last take_dirty
+    struct DirtyRegion {
+        glm::vec2 chunk;
+        glm::ivec3 min;
+        glm::ivec3 max;
+    };
+
+    // latest edit of every edited voxel of a chunk, sorted by the voxel
+    class ChunkEdits {
+    public:
+        // local x and y in 4 bits each, z + 2^22 in 23 bits and the operation in the top bit
+        static uint32_t encode(const glm::ivec3 & local, Operation operation);
+        static glm::ivec3 local_of(uint32_t edit);
+        static Operation operation_of(uint32_t edit) { return Operation(edit >> 31); }
+
+        // replaces the previous edit of the same voxel, and returns false if it was the same edit
+        bool set(uint32_t edit);
+
+        // removes the voxels and appends the added ones to vertices[begin, end)
+        void apply(const glm::ivec3 & origin, VoxelRenderer::Vertices & vertices, size_t begin = 0u) const;
+
+        const std::vector<uint32_t> & edits() const { return edits_; }
+        size_t size() const { return edits_.size(); }
+        size_t memory_bytes() const { return edits_.capacity() * sizeof(uint32_t); }
+
+    private:
+        static constexpr uint32_t voxel_mask = 0x7fffffffu;
+
+        std::vector<uint32_t> edits_;
+        uint32_t removals = 0u;
+        // bounds of the removed voxels, which reject most of the vertices of a chunk without any search
+        glm::ivec3 removal_min{ std::numeric_limits<int32_t>::max() };
+        glm::ivec3 removal_max{ std::numeric_limits<int32_t>::min() };
+
+        // first edit which is not before the voxel of the edit, ignoring the operations
+        std::vector<uint32_t>::const_iterator lower_bound(uint32_t edit) const;
+    };
+
+    // Sparse per-chunk edits on top of the procedural chunks, which are applied whenever a chunk is
+    // (re)generated or loaded from the cache. Every edit is appended to a journal file, which is replayed
+    // on construction, so the memory and the journal scale with the number of edits rather than the world.
+    class Overlay {
+    public:
+        struct Stats {
+            size_t journal_records = 0u;
+            size_t replayed_records = 0u;
+            std::atomic<uint64_t> applied_chunks{ 0u };
+            std::atomic<uint64_t> apply_nanoseconds{ 0u };
+        };
+
+        // edits only in memory
+        Overlay();
+        // replays the journal if it exists, and appends to it
+        explicit Overlay(const boost::filesystem::path & journal_path_);
+        ~Overlay();
+
+        Overlay(const Overlay &) = delete;
+        Overlay & operator=(const Overlay &) = delete;
+
+        // journal of TGP_EDITS
+        static std::optional<boost::filesystem::path> path_from_env();
+        static glm::vec2 chunk_of(const glm::ivec3 & voxel);
+
+        // not thread safe against apply, edits happen between the generations
+        void edit(const glm::ivec3 & voxel, Operation operation);
+        void add(const glm::ivec3 & voxel) { edit(voxel, Operation::add); }
+        void remove(const glm::ivec3 & voxel) { edit(voxel, Operation::remove); }
+
+        // applies the edits of the chunk to vertices[begin, end), which hold the voxels of the chunk
+        void apply(const glm::vec2 & chunk, VoxelRenderer::Vertices & vertices, size_t begin = 0u) const;
+        const ChunkEdits * find(const glm::vec2 & chunk) const;
+
+        // chunks edited since the last call
+        std::vector<DirtyRegion> take_dirty();
+
+        // writes the buffered journal records through to the file
+        void flush();
+        // rewrites the journal with only the latest edit of every voxel
+        void compact();
+
+        size_t size() const { return edit_count; }
+        size_t chunk_count() const { return chunks.size(); }
+        size_t memory_bytes() const;
+
+        const Stats & stats() const { return stats_; }
+        void print_stats(std::ostream & os = std::cout) const;
+
+    private:
+        static constexpr uint32_t magic = 0x45505447u; // "TGPE"
+        static constexpr uint32_t version = 1u;
+
+        struct Record {
+            int32_t chunk_x;
+            int32_t chunk_y;
+            uint32_t edit;
+        };
+
+        std::optional<boost::filesystem::path> journal_path;
+        std::ofstream journal;
+        std::unordered_map<uint64_t, ChunkEdits> chunks;
+        std::unordered_map<uint64_t, DirtyRegion> dirty;
+        size_t edit_count = 0u;
+        mutable Stats stats_;
+
+        static uint64_t key_of(int32_t chunk_x, int32_t chunk_y);
+
+        bool set(const Record & record);
+        void replay();
+        void open_journal(bool truncate);
+    };
+}
+
+#endif
@@ -0,0 +1,304 @@
+#include <lib/erosion/erosion.hpp>
+
+namespace Erosion {
+    namespace {
+        // the sequences of std::mt19937 and std::seed_seq are fixed by the standard, unlike the distributions
+        float uniform(std::mt19937 & random) {
+            return (random() >> 8) * (1.0f / 16777216.0f);
+        }
+
+        // height moved from the neighbour at d above, or to it below, beyond the talus
+        inline float slide(float d, float talus) {
+            return std::max(d - talus, 0.0f) + std::min(d + talus, 0.0f);
+        }
+
+        inline float thermal_pixel(float c, float up, float down, float left, float right, float talus, float rate) {
+            return c + rate * (slide(up - c, talus) + slide(down - c, talus) + slide(left - c, talus) + slide(right - c, talus));
+        }
+
+        // the rows never alias, and the blocks of a fixed number of lanes are branchless with 64 bit indices,
+        // which the compiler turns into vector instructions
+        void thermal_row(
+            const float * up,
+            const float * row,
+            const float * down,
+            float * __restrict out,
+            size_t w,
+            float talus,
+            float rate
+        ) {
+            constexpr size_t lanes = 8u;
+            out[0] = thermal_pixel(row[0], up[0], down[0], row[0], row[1], talus, rate);
+            size_t x = 1u;
+            for (; x + lanes < w; x += lanes) {
+                for (size_t k = 0; k < lanes; ++k) {
+                    out[x + k] = thermal_pixel(row[x + k], up[x + k], down[x + k], row[x + k - 1u], row[x + k + 1u], talus, rate);
+                }
+            }
+            for (; x + 1u < w; ++x) out[x] = thermal_pixel(row[x], up[x], down[x], row[x - 1u], row[x + 1u], talus, rate);
+            out[w - 1u] = thermal_pixel(row[w - 1u], up[w - 1u], down[w - 1u], row[w - 2u], row[w - 1u], talus, rate);
+        }
+
+        struct Sample {
+            float height;
+            float gradient_x;
+            float gradient_y;
+        };
+
+        // bilinear over the 4 pixels around the position, which is inside of the map
+        Sample sample(const Heightmap & map, float x, float y) {
+            auto xi = uint32_t(x);
+            auto yi = uint32_t(y);
+            auto u = x - xi;
+            auto v = y - yi;
+            auto nw = map.at(xi, yi);
+            auto ne = map.at(xi + 1u, yi);
+            auto sw = map.at(xi, yi + 1u);
+            auto se = map.at(xi + 1u, yi + 1u);
+            return {
+                nw * (1 - u) * (1 - v) + ne * u * (1 - v) + sw * (1 - u) * v + se * u * v,
+                (ne - nw) * (1 - v) + (se - sw) * v,
+                (sw - nw) * (1 - u) + (se - ne) * u
+            };
+        }
+    }
+
+// Heightmap
+
+    Heightmap::Heightmap(uint32_t width_, uint32_t height_, float value) :
+        width(width_),
+        height(height_),
+        heights(size_t(width_) * height_, value)
+    {}
+
+// Parameters
+
+    std::optional<Parameters> Parameters::from_env() {
+        auto value = std::getenv("TGP_EROSION");
+        if (!value) return std::nullopt;
+
+        std::vector<std::string> tokens;
+        boost::algorithm::split(tokens, std::string(value), boost::is_any_of(","));
+        if (tokens.size() > 2) {
+            throw (boost::format("TGP_EROSION expects droplets_per_pixel[,thermal_iterations]: %s") % value).str();
+        }
+        Parameters parameters;
+        parameters.droplets_per_pixel = std::stof(tokens[0]);
+        if (tokens.size() == 2) parameters.thermal_iterations = std::stoul(tokens[1]);
+        return parameters;
+    }
+
+// Eroder
+
+    Eroder::Eroder(const Parameters & parameters_, int32_t seed_, uint32_t threads_) :
+        parameters(parameters_),
+        seed(seed_),
+        threads(threads_)
+    {
+        if (parameters.passes == 0u) throw std::string("passes must be at least 1");
+        if (parameters.droplets_per_pixel < 0.0f) throw std::string("droplets_per_pixel must not be negative");
+
+        // weights fall off linearly to the radius
+        auto r = int32_t(parameters.radius);
+        float sum = 0.0f;
+        for (int32_t dy = -r; dy <= r; ++dy) {
+            for (int32_t dx = -r; dx <= r; ++dx) {
+                auto weight = r == 0 ? 1.0f : float(r) - std::sqrt(float(dx * dx + dy * dy));
+                if (weight <= 0.0f) continue;
+                brush.push_back({ dx, dy, weight });
+                sum += weight;
+            }
+        }
+        for (auto & cell: brush) cell.weight /= sum;
+    }
+
+    void Eroder::erode(Heightmap & map) {
+        hydraulic(map);
+        thermal(map);
+    }
+
+    void Eroder::hydraulic(Heightmap & map) {
+        PROFILE_ZONE("erosion/hydraulic");
+        MEMORY_SCOPE("erosion/hydraulic");
+        auto start = std::chrono::steady_clock::now();
+        auto tile = tile_size();
+        uint32_t tiles_x = (map.width + tile - 1u) / tile;
+        uint32_t tiles_y = (map.height + tile - 1u) / tile;
+
+        std::vector<uint64_t> droplets(size_t(tiles_x) * tiles_y, 0u);
+        std::vector<uint64_t> steps(size_t(tiles_x) * tiles_y, 0u);
+        for (uint32_t pass = 0; pass < parameters.passes; ++pass) {
+            for (uint32_t phase = 0; phase < 4u; ++phase) {
+                // every other tile in both of the directions
+                uint32_t px = phase & 1u;
+                uint32_t py = phase >> 1;
+                uint32_t count_x = (tiles_x - px + 1u) / 2u;
+                uint32_t count_y = (tiles_y - py + 1u) / 2u;
+                Helpers::parallel_for(count_x * count_y, [&](uint32_t i) {
+                    uint32_t tx = px + 2u * (i % count_x);
+                    uint32_t ty = py + 2u * (i / count_x);
+                    auto t = size_t(ty) * tiles_x + tx;
+                    run_tile(map, tx, ty, pass, droplets[t], steps[t]);
+                }, threads);
+            }
+        }
+
+        for (auto d: droplets) stats_.droplets += d;
+        for (auto s: steps) stats_.steps += s;
+        stats_.tiles = tiles_x * tiles_y;
+        stats_.pixels = size_t(map.width) * map.height;
+        stats_.hydraulic_seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    void Eroder::thermal(Heightmap & map) {
+        if (parameters.thermal_iterations == 0u || map.width < 2u || map.height < 2u) return;
+        PROFILE_ZONE("erosion/thermal");
+        MEMORY_SCOPE("erosion/thermal");
+        auto start = std::chrono::steady_clock::now();
+
+        const uint32_t rows_per_task = 32u;
+        uint32_t tasks = (map.height + rows_per_task - 1u) / rows_per_task;
+        Heightmap next(map.width, map.height);
+        for (uint32_t i = 0; i < parameters.thermal_iterations; ++i) {
+            Helpers::parallel_for(tasks, [&](uint32_t task) {
+                auto y_begin = task * rows_per_task;
+                thermal_rows(map, next, y_begin, std::min(y_begin + rows_per_task, map.height));
+            }, threads);
+            std::swap(map.heights, next.heights);
+        }
+
+        stats_.thermal_iterations += parameters.thermal_iterations;
+        stats_.pixels = size_t(map.width) * map.height;
+        stats_.thermal_seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    uint32_t Eroder::tile_size() const {
+        // a droplet moves a pixel a step, and the brush and the bilinear deposit reach a little further
+        return 2u * (parameters.lifetime + parameters.radius + 2u);
+    }
+
+    void Eroder::print_stats(std::ostream & os) const {
+        auto megapixels = stats_.pixels / 1e6;
+        os << boost::format("Erosion: %d droplets (%d steps) over %d tiles of %d pixels in %.3f s, %.0f droplets/s")
+            % stats_.droplets
+            % stats_.steps
+            % stats_.tiles
+            % tile_size()
+            % stats_.hydraulic_seconds
+            % (stats_.hydraulic_seconds > 0.0 ? stats_.droplets / stats_.hydraulic_seconds : 0.0)
+            << std::endl;
+        os << boost::format("Erosion: %d thermal iterations in %.3f s")
+            % stats_.thermal_iterations
+            % stats_.thermal_seconds
+            << std::endl;
+        os << boost::format("Erosion: %.3f s per megapixel")
+            % (megapixels > 0.0 ? (stats_.hydraulic_seconds + stats_.thermal_seconds) / megapixels : 0.0)
+            << std::endl;
+    }
+
+    void Eroder::run_tile(Heightmap & map, uint32_t tile_x, uint32_t tile_y, uint32_t pass, uint64_t & droplets, uint64_t & steps) const {
+        PROFILE_ZONE("erosion/tile");
+        auto tile = tile_size();
+        uint32_t x0 = tile_x * tile;
+        uint32_t y0 = tile_y * tile;
+        uint32_t width = std::min(tile, map.width - x0);
+        uint32_t height = std::min(tile, map.height - y0);
+
+        // the droplets of the tile are split evenly between the passes
+        auto total = uint64_t(double(parameters.droplets_per_pixel) * width * height);
+        auto begin = total * pass / parameters.passes;
+        auto end = total * (pass + 1u) / parameters.passes;
+
+        std::seed_seq seq{ uint32_t(seed), pass, tile_x, tile_y };
+        std::mt19937 random(seq);
+        for (auto i = begin; i < end; ++i) {
+            Droplet droplet{ x0 + uniform(random) * width, y0 + uniform(random) * height };
+            steps += run_droplet(map, droplet);
+        }
+        droplets += end - begin;
+    }
+
+    uint32_t Eroder::run_droplet(Heightmap & map, Droplet droplet) const {
+        const auto & p = parameters;
+        // the bilinear sample needs the pixel on the right and below
+        float max_x = map.width - 1.0f;
+        float max_y = map.height - 1.0f;
+        if (!(droplet.x < max_x && droplet.y < max_y)) return 0u;
+
+        float dx = 0.0f;
+        float dy = 0.0f;
+        float speed = 1.0f;
+        float water = 1.0f;
+        float sediment = 0.0f;
+        uint32_t step = 0u;
+
+        for (; step < p.lifetime; ++step) {
+            auto xi = uint32_t(droplet.x);
+            auto yi = uint32_t(droplet.y);
+            auto u = droplet.x - xi;
+            auto v = droplet.y - yi;
+            auto here = sample(map, droplet.x, droplet.y);
+
+            // downhill, keeping some of the direction
+            dx = dx * p.inertia - here.gradient_x * (1.0f - p.inertia);
+            dy = dy * p.inertia - here.gradient_y * (1.0f - p.inertia);
+            auto length = std::sqrt(dx * dx + dy * dy);
+            if (length == 0.0f) break;
+            dx /= length;
+            dy /= length;
+            droplet.x += dx;
+            droplet.y += dy;
+            if (!(droplet.x >= 0.0f && droplet.y >= 0.0f && droplet.x < max_x && droplet.y < max_y)) break;
+
+            auto delta = sample(map, droplet.x, droplet.y).height - here.height;
+            auto capacity = std::max(-delta * speed * water * p.capacity, p.min_capacity);
+
+            if (sediment > capacity || delta > 0.0f) {
+                // fills the pit up to the droplet, or drops the sediment beyond the capacity
+                auto amount = delta > 0.0f ? std::min(delta, sediment) : (sediment - capacity) * p.deposition;
+                sediment -= amount;
+                map.at(xi, yi) += amount * (1 - u) * (1 - v);
+                map.at(xi + 1u, yi) += amount * u * (1 - v);
+                map.at(xi, yi + 1u) += amount * (1 - u) * v;
+                map.at(xi + 1u, yi + 1u) += amount * u * v;
+            }
+            else {
+                // never digs deeper than the drop of the step
+                auto amount = std::min((capacity - sediment) * p.erosion, -delta);
+                auto r = int32_t(p.radius);
+                bool inside = xi >= uint32_t(r) && yi >= uint32_t(r) && xi + r < map.width && yi + r < map.height;
+                for (const auto & cell: brush) {
+                    auto x = int32_t(xi) + cell.dx;
+                    auto y = int32_t(yi) + cell.dy;
+                    if (!inside && (x < 0 || y < 0 || x >= int32_t(map.width) || y >= int32_t(map.height))) continue;
+                    auto & h = map.at(x, y);
+                    auto eroded = std::min(h, amount * cell.weight);
+                    h -= eroded;
+                    sediment += eroded;
+                }
+            }
+
+            speed = std::sqrt(std::max(speed * speed - delta * p.gravity, 0.0f));
+            water *= 1.0f - p.evaporation;
+        }
+        return step;
+    }
+
+    void Eroder::thermal_rows(const Heightmap & from, Heightmap & to, uint32_t y_begin, uint32_t y_end) const {
+        // a pixel gives at most half of its excess to each of the 4 neighbours, which keeps it stable
+        const auto rate = parameters.thermal_rate * 0.125f;
+        const size_t w = from.width;
+        for (auto y = y_begin; y < y_end; ++y) {
+            const float * row = &from.heights[y * w];
+            thermal_row(
+                y > 0u ? row - w : row,
+                row,
+                y + 1u < from.height ? row + w : row,
+                &to.heights[y * w],
+                w,
+                parameters.talus,
+                rate
+            );
+        }
+    }
+}
@@ -0,0 +1,111 @@
+#ifndef EROSION_HPP
+#define EROSION_HPP
+
+#include <iostream>
+#include <vector>
+#include <string>
+#include <optional>
+#include <random>
+#include <chrono>
+#include <cstdlib>
+#include <boost/format.hpp>
+#include <boost/algorithm/string.hpp>
+
+#include <lib/helpers.hpp>
+#include <lib/profiler/profiler.hpp>
+#include <lib/memory_tracker/memory_tracker.hpp>
+
+namespace Erosion {
+    // heights in rows of the width
+    struct Heightmap {
+        uint32_t width = 0u;
+        uint32_t height = 0u;
+        std::vector<float> heights;
+
+        Heightmap(uint32_t width_, uint32_t height_, float value = 0.0f);
+
+        float & at(uint32_t x, uint32_t y) { return heights[size_t(y) * width + x]; }
+        float at(uint32_t x, uint32_t y) const { return heights[size_t(y) * width + x]; }
+    };
+
+    struct Parameters {
+        // hydraulic erosion by droplets which carry sediment downhill, with heights in the same unit as a pixel
+        float droplets_per_pixel = 1.0f;
+        // the droplets of a tile are split into passes, so that the tiles of every phase see the others
+        uint32_t passes = 4u;
+        uint32_t lifetime = 30u;
+        float inertia = 0.05f;
+        float capacity = 4.0f;
+        float min_capacity = 0.01f;
+        float deposition = 0.3f;
+        float erosion = 0.3f;
+        float evaporation = 0.01f;
+        float gravity = 4.0f;
+        // of the brush which spreads the erosion of a step
+        uint32_t radius = 3u;
+
+        // thermal erosion, which moves the height above the talus between neighbours
+        uint32_t thermal_iterations = 0u;
+        float talus = 1.5f;
+        float thermal_rate = 0.5f;
+
+        // TGP_EROSION="droplets_per_pixel[,thermal_iterations]"
+        static std::optional<Parameters> from_env();
+    };
+
+    // Droplet erosion over tiles which are large enough that a droplet never reaches past the half of the tile
+    // around its own. The tiles are run in 4 phases by the parity of their coordinates, so the tiles of a phase
+    // never touch the same pixels and run in parallel, each with its own random sequence from the seed.
+    // The result depends only on the seed, for any number of threads. The thermal pass updates every pixel
+    // from the heights before the iteration with branchless rows, which the compiler vectorizes.
+    class Eroder {
+    public:
+        struct Stats {
+            uint64_t droplets = 0u;
+            uint64_t steps = 0u;
+            uint32_t tiles = 0u;
+            uint32_t thermal_iterations = 0u;
+            size_t pixels = 0u;
+            double hydraulic_seconds = 0.0;
+            double thermal_seconds = 0.0;
+        };
+
+        Eroder(const Parameters & parameters_, int32_t seed_, uint32_t threads_ = 0);
+
+        // hydraulic then thermal
+        void erode(Heightmap & map);
+        void hydraulic(Heightmap & map);
+        void thermal(Heightmap & map);
+
+        // the edge of the tiles, twice the reach of a droplet
+        uint32_t tile_size() const;
+
+        const Stats & stats() const { return stats_; }
+        void print_stats(std::ostream & os = std::cout) const;
+
+    private:
+        struct BrushCell {
+            int32_t dx;
+            int32_t dy;
+            float weight;
+        };
+
+        struct Droplet {
+            float x;
+            float y;
+        };
+
+        Parameters parameters;
+        int32_t seed;
+        uint32_t threads;
+        std::vector<BrushCell> brush;
+        Stats stats_;
+
+        // adds up the droplets and their steps
+        void run_tile(Heightmap & map, uint32_t tile_x, uint32_t tile_y, uint32_t pass, uint64_t & droplets, uint64_t & steps) const;
+        uint32_t run_droplet(Heightmap & map, Droplet droplet) const;
+        void thermal_rows(const Heightmap & from, Heightmap & to, uint32_t y_begin, uint32_t y_end) const;
+    };
+}
+
+#endif
@@ -4,8 +4,13 @@
 #include <iostream>
 #include <boost/format.hpp>
 
+#ifdef __APPLE__
 #include <OpenGL/OpenGL.h>
 #include <OpenGL/gl3.h>
+#else
+#define GL_GLEXT_PROTOTYPES
+#include <GL/glcorearb.h>
+#endif
 #include <glm/glm.hpp>
 #include <glm/gtx/transform.hpp>
 
@@ -0,0 +1,339 @@
+#include <lib/height_pyramid/height_pyramid.hpp>
+
+#include <cstring>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+namespace HeightPyramid {
+    namespace {
+        constexpr uint64_t level_alignment = 4096u;
+
+        uint64_t align(uint64_t v, uint64_t alignment) {
+            return (v + alignment - 1u) / alignment * alignment;
+        }
+
+        std::string error(const std::string & what, const boost::filesystem::path & path) {
+            return (boost::format("%s %s: %s") % what % path.string() % std::strerror(errno)).str();
+        }
+
+        double seconds_since(std::chrono::steady_clock::time_point start) {
+            return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        }
+
+        glm::uvec2 level_size(uint32_t width, uint32_t height, uint32_t level) {
+            return { uint32_t(((uint64_t(width) - 1u) >> level) + 1u), uint32_t(((uint64_t(height) - 1u) >> level) + 1u) };
+        }
+
+        uint32_t tile_count(const glm::uvec2 & size) {
+            return ((size.x + tile_edge - 1u) / tile_edge) * ((size.y + tile_edge - 1u) / tile_edge);
+        }
+    }
+
+// Pyramid
+
+    void Pyramid::Accumulator::add(const Cell & other, uint64_t area) {
+        cell.min = std::min(cell.min, other.min);
+        cell.max = std::max(cell.max, other.max);
+        sum += double(other.mean) * area;
+        count += area;
+    }
+
+    Pyramid::Pyramid(const boost::filesystem::path & path_, uint32_t width, uint32_t height, Sampler sample, uint32_t threads) :
+        path(path_)
+    {
+        try {
+            create(width, height);
+            build(sample, threads);
+        }
+        catch (...) {
+            close();
+            throw;
+        }
+    }
+
+    Pyramid::Pyramid(const boost::filesystem::path & path_, const Erosion::Heightmap & map, uint32_t threads) :
+        Pyramid(path_, map.width, map.height, [&map](uint32_t x, uint32_t y) { return map.at(x, y); }, threads)
+    {}
+
+    Pyramid::Pyramid(const boost::filesystem::path & path_) : path(path_) {
+        fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) throw error("failed to open", path);
+
+        try {
+            struct stat st;
+            if (::fstat(fd, &st) != 0) throw error("failed to stat", path);
+            if (size_t(st.st_size) < sizeof(Header)) throw (boost::format("%s is not a height pyramid") % path.string()).str();
+            map(st.st_size, false);
+            const auto & h = header();
+            if (h.magic != magic || h.version != version || h.tile_edge != tile_edge || h.size != mapped_size) {
+                throw (boost::format("%s is not a height pyramid of this version") % path.string()).str();
+            }
+        }
+        catch (...) {
+            close();
+            throw;
+        }
+    }
+
+    Pyramid::~Pyramid() {
+        close();
+    }
+
+    glm::uvec2 Pyramid::size(uint32_t level) const {
+        return level_size(header().width, header().height, level);
+    }
+
+    size_t Pyramid::index(uint32_t level, uint32_t x, uint32_t y) const {
+        auto tiles_x = (size(level).x + tile_edge - 1u) / tile_edge;
+        auto tile = size_t(y / tile_edge) * tiles_x + x / tile_edge;
+        return tile * tile_edge * tile_edge + (y % tile_edge) * tile_edge + x % tile_edge;
+    }
+
+    glm::uvec2 Pyramid::extent(uint32_t level, uint32_t x, uint32_t y) const {
+        auto edge = uint64_t(1u) << level;
+        return {
+            uint32_t(std::min(edge, header().width - x * edge)),
+            uint32_t(std::min(edge, header().height - y * edge))
+        };
+    }
+
+    float Pyramid::height(uint32_t x, uint32_t y) const {
+        return heights()[index(0u, x, y)];
+    }
+
+    Cell Pyramid::cell(uint32_t level, uint32_t x, uint32_t y) const {
+        if (level == 0u) {
+            auto h = height(x, y);
+            return { h, h, h };
+        }
+        return cells(level)[index(level, x, y)];
+    }
+
+    Cell Pyramid::range(const glm::uvec2 & min, const glm::uvec2 & max_) const {
+        auto max = glm::min(max_, size());
+        if (min.x >= max.x || min.y >= max.y) throw std::string("the range of the height pyramid is empty");
+        Accumulator result;
+        range(levels() - 1u, 0u, 0u, min, max, result);
+        result.cell.mean = result.sum / result.count;
+        return result.cell;
+    }
+
+    void Pyramid::range(uint32_t level, uint32_t x, uint32_t y, const glm::uvec2 & min, const glm::uvec2 & max, Accumulator & result) const {
+        auto edge = 1u << level;
+        glm::uvec2 from{ x * edge, y * edge };
+        auto to = from + extent(level, x, y);
+        if (to.x <= min.x || max.x <= from.x || to.y <= min.y || max.y <= from.y) return;
+        if (level == 0u || (min.x <= from.x && to.x <= max.x && min.y <= from.y && to.y <= max.y)) {
+            result.add(cell(level, x, y), uint64_t(to.x - from.x) * (to.y - from.y));
+            return;
+        }
+
+        auto children = size(level - 1u);
+        for (uint32_t j = 0; j < 2u; ++j) {
+            for (uint32_t i = 0; i < 2u; ++i) {
+                if (2u * x + i < children.x && 2u * y + j < children.y) range(level - 1u, 2u * x + i, 2u * y + j, min, max, result);
+            }
+        }
+    }
+
+    std::pair<glm::uvec2, float> Pyramid::highest(const glm::uvec2 & min, const glm::uvec2 & max_) const {
+        PROFILE_ZONE("height_pyramid/highest");
+        auto max = glm::min(max_, size());
+        if (min.x >= max.x || min.y >= max.y) throw std::string("the range of the height pyramid is empty");
+
+        struct Candidate {
+            float max;
+            uint32_t level;
+            uint32_t x;
+            uint32_t y;
+            bool inside;
+
+            bool operator<(const Candidate & other) const { return max < other.max; }
+        };
+
+        // the cells by their max, the first inside the range holds the highest height of the range
+        std::priority_queue<Candidate> candidates;
+        auto push = [&](uint32_t level, uint32_t x, uint32_t y) {
+            auto edge = 1u << level;
+            glm::uvec2 from{ x * edge, y * edge };
+            auto to = from + extent(level, x, y);
+            if (to.x <= min.x || max.x <= from.x || to.y <= min.y || max.y <= from.y) return;
+            auto inside = min.x <= from.x && to.x <= max.x && min.y <= from.y && to.y <= max.y;
+            candidates.push({ cell(level, x, y).max, level, x, y, inside });
+        };
+
+        push(levels() - 1u, 0u, 0u);
+        while (!candidates.empty()) {
+            auto c = candidates.top();
+            candidates.pop();
+            if (c.inside) {
+                // the max of a cell is the max of one of its children
+                while (c.level > 0u) {
+                    auto children = size(c.level - 1u);
+                    uint32_t x = 2u * c.x;
+                    uint32_t y = 2u * c.y;
+                    for (uint32_t k = 0; k < 4u; ++k) {
+                        auto cx = 2u * c.x + k % 2u;
+                        auto cy = 2u * c.y + k / 2u;
+                        if (cx < children.x && cy < children.y && cell(c.level - 1u, cx, cy).max == c.max) {
+                            x = cx;
+                            y = cy;
+                            break;
+                        }
+                    }
+                    c = { c.max, c.level - 1u, x, y, true };
+                }
+                return { { c.x, c.y }, c.max };
+            }
+
+            auto children = size(c.level - 1u);
+            for (uint32_t k = 0; k < 4u; ++k) {
+                auto cx = 2u * c.x + k % 2u;
+                auto cy = 2u * c.y + k / 2u;
+                if (cx < children.x && cy < children.y) push(c.level - 1u, cx, cy);
+            }
+        }
+        throw std::string("the range of the height pyramid is empty");
+    }
+
+    std::vector<Pyramid::Node> Pyramid::select(const glm::vec2 & viewer, float detail, uint32_t min_level) const {
+        PROFILE_ZONE("height_pyramid/select");
+        std::vector<Node> nodes;
+        select(levels() - 1u, 0u, 0u, viewer, detail, min_level, nodes);
+        return nodes;
+    }
+
+    void Pyramid::select(
+        uint32_t level,
+        uint32_t x,
+        uint32_t y,
+        const glm::vec2 & viewer,
+        float detail,
+        uint32_t min_level,
+        std::vector<Node> & nodes
+    ) const {
+        auto edge = float(1u << level);
+        auto e = extent(level, x, y);
+        auto distance = std::hypot(x * edge + e.x / 2.0f - viewer.x, y * edge + e.y / 2.0f - viewer.y);
+        if (level <= min_level || edge <= detail * distance) {
+            nodes.push_back({ level, x, y, cell(level, x, y) });
+            return;
+        }
+
+        auto children = size(level - 1u);
+        for (uint32_t j = 0; j < 2u; ++j) {
+            for (uint32_t i = 0; i < 2u; ++i) {
+                if (2u * x + i < children.x && 2u * y + j < children.y) {
+                    select(level - 1u, 2u * x + i, 2u * y + j, viewer, detail, min_level, nodes);
+                }
+            }
+        }
+    }
+
+    void Pyramid::print_stats(std::ostream & os) const {
+        os << boost::format("Height pyramid: %dx%d heights, %d levels, %.1f MB")
+            % header().width
+            % header().height
+            % levels()
+            % (mapped_size / 1024.0 / 1024.0)
+            << std::endl;
+        os << boost::format("Height pyramid build: %.1f ms sampling, %.1f ms reducing")
+            % (1e3 * stats_.sample_seconds)
+            % (1e3 * stats_.reduce_seconds)
+            << std::endl;
+    }
+
+    void Pyramid::create(uint32_t width, uint32_t height) {
+        if (width == 0u || height == 0u || width > (1u << 30) || height > (1u << 30)) {
+            throw (boost::format("invalid size of a height pyramid: %dx%d") % width % height).str();
+        }
+
+        Header h{};
+        h.magic = magic;
+        h.version = version;
+        h.width = width;
+        h.height = height;
+        h.tile_edge = tile_edge;
+        h.levels = 1u;
+        while (level_size(width, height, h.levels - 1u) != glm::uvec2(1u)) ++h.levels;
+
+        uint64_t offset = align(sizeof(Header), level_alignment);
+        for (uint32_t level = 0; level < h.levels; ++level) {
+            h.offsets[level] = offset;
+            auto element = level == 0u ? sizeof(float) : sizeof(Cell);
+            offset = align(offset + uint64_t(tile_count(level_size(width, height, level))) * tile_edge * tile_edge * element, level_alignment);
+        }
+        h.size = offset;
+
+        if (!path.empty()) {
+            fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+            if (fd < 0) throw error("failed to open", path);
+            if (::ftruncate(fd, h.size) != 0) throw error("failed to resize", path);
+        }
+        map(h.size, true);
+        std::memcpy(data, &h, sizeof(Header));
+    }
+
+    void Pyramid::build(const Sampler & sample, uint32_t threads) {
+        PROFILE_ZONE("height_pyramid/build");
+        auto start = std::chrono::steady_clock::now();
+        auto level_0 = size(0u);
+        auto tiles_x = (level_0.x + tile_edge - 1u) / tile_edge;
+        Helpers::parallel_for(tile_count(level_0), [&](uint32_t tile) {
+            auto * tile_heights = heights() + size_t(tile) * tile_edge * tile_edge;
+            glm::uvec2 from{ tile % tiles_x * tile_edge, tile / tiles_x * tile_edge };
+            auto to = glm::min(from + tile_edge, level_0);
+            for (auto y = from.y; y < to.y; ++y) {
+                for (auto x = from.x; x < to.x; ++x) tile_heights[(y - from.y) * tile_edge + (x - from.x)] = sample(x, y);
+            }
+        }, threads);
+        stats_.sample_seconds = seconds_since(start);
+
+        start = std::chrono::steady_clock::now();
+        for (uint32_t level = 1; level < levels(); ++level) {
+            auto level_size = size(level);
+            auto children = size(level - 1u);
+            auto level_tiles_x = (level_size.x + tile_edge - 1u) / tile_edge;
+            Helpers::parallel_for(tile_count(level_size), [&](uint32_t tile) {
+                auto * tile_cells = cells(level) + size_t(tile) * tile_edge * tile_edge;
+                glm::uvec2 from{ tile % level_tiles_x * tile_edge, tile / level_tiles_x * tile_edge };
+                auto to = glm::min(from + tile_edge, level_size);
+                for (auto y = from.y; y < to.y; ++y) {
+                    for (auto x = from.x; x < to.x; ++x) {
+                        Accumulator result;
+                        for (uint32_t k = 0; k < 4u; ++k) {
+                            auto cx = 2u * x + k % 2u;
+                            auto cy = 2u * y + k / 2u;
+                            if (cx >= children.x || cy >= children.y) continue;
+                            auto e = extent(level - 1u, cx, cy);
+                            result.add(cell(level - 1u, cx, cy), uint64_t(e.x) * e.y);
+                        }
+                        result.cell.mean = result.sum / result.count;
+                        tile_cells[(y - from.y) * tile_edge + (x - from.x)] = result.cell;
+                    }
+                }
+            }, threads);
+        }
+        stats_.reduce_seconds = seconds_since(start);
+    }
+
+    void Pyramid::map(size_t size, bool writable) {
+        auto protection = writable ? PROT_READ | PROT_WRITE : PROT_READ;
+        auto flags = fd < 0 ? MAP_PRIVATE | MAP_ANONYMOUS : MAP_SHARED;
+        auto mapped = ::mmap(nullptr, size, protection, flags, fd, 0);
+        if (mapped == MAP_FAILED) throw error("failed to map", path);
+        data = static_cast<uint8_t *>(mapped);
+        mapped_size = size;
+    }
+
+    void Pyramid::close() {
+        if (data) ::munmap(data, mapped_size);
+        data = nullptr;
+        mapped_size = 0u;
+        if (fd >= 0) ::close(fd);
+        fd = -1;
+    }
+}
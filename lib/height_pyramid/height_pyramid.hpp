@@ -0,0 +1,125 @@
+#ifndef HEIGHT_PYRAMID_HPP
+#define HEIGHT_PYRAMID_HPP
+
+#include <iostream>
+#include <vector>
+#include <queue>
+#include <chrono>
+#include <functional>
+#include <boost/format.hpp>
+#include <boost/filesystem.hpp>
+
+#include <lib/helpers.hpp>
+#include <lib/gl_helpers.hpp>
+#include <lib/erosion/erosion.hpp>
+#include <lib/profiler/profiler.hpp>
+
+namespace HeightPyramid {
+    // cells of a level are stored in square tiles of this edge, so that a tile is contiguous in the file
+    static constexpr uint32_t tile_edge = 64u;
+
+    struct Cell {
+        float min;
+        float max;
+        float mean;
+    };
+
+    // A quadtree over a heightmap in a file: level 0 holds the heights and every cell of the level k holds the
+    // min, max and mean of the 2^k x 2^k heights under it, each level in tiles of tile_edge x tile_edge cells.
+    // The heights are sampled tile by tile in parallel while the file is built, so the heightmap is never held in
+    // memory as a whole, and the file is mapped so a viewer only reads the tiles it touches. Range queries descend
+    // from the top cell and stop at the cells which are inside the range or outside of it.
+    class Pyramid {
+    public:
+        using Sampler = std::function<float(uint32_t x, uint32_t y)>;
+
+        struct Node {
+            uint32_t level;
+            uint32_t x;
+            uint32_t y;
+            Cell cell;
+        };
+
+        struct Stats {
+            double sample_seconds = 0.0;
+            double reduce_seconds = 0.0;
+        };
+
+        // builds into the file, or into anonymous memory when the path is empty
+        Pyramid(const boost::filesystem::path & path_, uint32_t width, uint32_t height, Sampler sample, uint32_t threads = 0);
+        Pyramid(const boost::filesystem::path & path_, const Erosion::Heightmap & map, uint32_t threads = 0);
+        // maps a built file read only
+        explicit Pyramid(const boost::filesystem::path & path_);
+        ~Pyramid();
+
+        Pyramid(const Pyramid &) = delete;
+        Pyramid & operator=(const Pyramid &) = delete;
+
+        uint32_t levels() const { return header().levels; }
+        // in cells of the level
+        glm::uvec2 size(uint32_t level = 0u) const;
+        size_t bytes() const { return mapped_size; }
+
+        float height(uint32_t x, uint32_t y) const;
+        Cell cell(uint32_t level, uint32_t x, uint32_t y) const;
+
+        // of the heights in [min, max)
+        Cell range(const glm::uvec2 & min, const glm::uvec2 & max) const;
+        // the highest height in [min, max) and where it is, any of them on ties
+        std::pair<glm::uvec2, float> highest(const glm::uvec2 & min, const glm::uvec2 & max) const;
+        // the coarsest cells covering the heightmap whose edge is at most `detail` times their distance to the
+        // viewer, in heights, and no finer than min_level
+        std::vector<Node> select(const glm::vec2 & viewer, float detail, uint32_t min_level = 0u) const;
+
+        const Stats & stats() const { return stats_; }
+        void print_stats(std::ostream & os = std::cout) const;
+
+    private:
+        static constexpr uint32_t magic = 0x48505447u; // "TGPH"
+        static constexpr uint32_t version = 1u;
+        static constexpr uint32_t max_levels = 32u;
+
+        struct Header {
+            uint32_t magic;
+            uint32_t version;
+            uint32_t width;
+            uint32_t height;
+            uint32_t tile_edge;
+            uint32_t levels;
+            // of the tiles of every level from the start of the file
+            uint64_t offsets[max_levels];
+            uint64_t size;
+        };
+
+        struct Accumulator {
+            Cell cell{ std::numeric_limits<float>::max(), std::numeric_limits<float>::lowest(), 0.0f };
+            double sum = 0.0;
+            uint64_t count = 0u;
+
+            void add(const Cell & other, uint64_t area);
+        };
+
+        boost::filesystem::path path;
+        int fd = -1;
+        uint8_t * data = nullptr;
+        size_t mapped_size = 0u;
+        Stats stats_;
+
+        const Header & header() const { return *reinterpret_cast<const Header *>(data); }
+        // of the cell in the tiles of its level
+        size_t index(uint32_t level, uint32_t x, uint32_t y) const;
+        float * heights() const { return reinterpret_cast<float *>(data + header().offsets[0]); }
+        Cell * cells(uint32_t level) const { return reinterpret_cast<Cell *>(data + header().offsets[level]); }
+        // the heights under the cell, fewer at the right and bottom edges
+        glm::uvec2 extent(uint32_t level, uint32_t x, uint32_t y) const;
+
+        void create(uint32_t width, uint32_t height);
+        void build(const Sampler & sample, uint32_t threads);
+        void map(size_t size, bool writable);
+        void close();
+        void range(uint32_t level, uint32_t x, uint32_t y, const glm::uvec2 & min, const glm::uvec2 & max, Accumulator & result) const;
+        void select(uint32_t level, uint32_t x, uint32_t y, const glm::vec2 & viewer, float detail, uint32_t min_level, std::vector<Node> & nodes) const;
+    };
+}
+
+#endif
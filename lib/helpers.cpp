@@ -1,5 +1,9 @@
 #include <lib/helpers.hpp>
 
+#include <limits>
+#include <cmath>
+#include <cctype>
+
 namespace Helpers {
     std::string trim_base_indent(const std::string & source) {
         std::deque<std::string> lines;
@@ -28,4 +32,146 @@ namespace Helpers {
             callback(i);
         }
     }
-}
\ No newline at end of file
+
+    void parallel_for(uint32_t n, std::function<void(uint32_t)> callback, uint32_t threads) {
+        threads = std::min(thread_count(threads), n);
+        if (threads <= 1) {
+            times(n, callback);
+            return;
+        }
+
+        std::atomic<uint32_t> next{ 0 };
+        std::exception_ptr error;
+        std::mutex error_mutex;
+        auto worker = [&]() {
+            for (uint32_t i = next++; i < n; i = next++) {
+                try {
+                    callback(i);
+                }
+                catch (...) {
+                    std::lock_guard<std::mutex> lock(error_mutex);
+                    if (!error) error = std::current_exception();
+                    next = n;
+                }
+            }
+        };
+
+        std::vector<std::thread> pool;
+        for (uint32_t i = 1; i < threads; ++i) pool.emplace_back(worker);
+        worker();
+        for (auto & t: pool) t.join();
+        if (error) std::rethrow_exception(error);
+    }
+
+    uint32_t thread_count(uint32_t threads) {
+        if (threads > 0) return threads;
+        return std::max(1u, std::thread::hardware_concurrency());
+    }
+
+// Arguments
+
+    Arguments::Arguments(int argc, char ** argv, const std::set<std::string> & flags) {
+        for (int i = 1; i < argc; ++i) {
+            std::string name = argv[i];
+            if (!boost::algorithm::starts_with(name, "--")) {
+                positional_.push_back(name);
+                continue;
+            }
+            given.insert(name);
+            if (flags.count(name) > 0u) {
+                options.push_back({ name, "" });
+                continue;
+            }
+            if (i + 1 >= argc) throw (boost::format("%s needs a value") % name).str();
+            options.push_back({ name, argv[++i] });
+        }
+    }
+
+    bool Arguments::flag(const std::string & name) {
+        return find(name) != nullptr;
+    }
+
+    std::string Arguments::get(const std::string & name, const std::string & fallback) {
+        auto value = find(name);
+        return value ? *value : fallback;
+    }
+
+    int32_t Arguments::get(const std::string & name, int32_t fallback) {
+        auto value = find(name);
+        if (!value) return fallback;
+        size_t end = 0u;
+        long long v = 0;
+        try {
+            v = std::stoll(*value, &end);
+        }
+        catch (const std::exception &) {
+            end = 0u;
+        }
+        if (end == 0u || end != value->size() || v < std::numeric_limits<int32_t>::min() || v > std::numeric_limits<int32_t>::max()) {
+            throw (boost::format("%s expects an integer: %s") % name % *value).str();
+        }
+        return int32_t(v);
+    }
+
+    uint32_t Arguments::get(const std::string & name, uint32_t fallback) {
+        auto v = get(name, uint64_t(fallback));
+        if (v > std::numeric_limits<uint32_t>::max()) throw (boost::format("%s is too large: %d") % name % v).str();
+        return uint32_t(v);
+    }
+
+    uint64_t Arguments::get(const std::string & name, uint64_t fallback) {
+        auto value = find(name);
+        if (!value) return fallback;
+        size_t end = 0u;
+        unsigned long long v = 0u;
+        // std::stoull would wrap a negative value around
+        if (!value->empty() && std::isdigit(static_cast<unsigned char>((*value)[0]))) {
+            try {
+                v = std::stoull(*value, &end);
+            }
+            catch (const std::exception &) {
+                end = 0u;
+            }
+        }
+        if (end == 0u || end != value->size()) throw (boost::format("%s expects an unsigned integer: %s") % name % *value).str();
+        return uint64_t(v);
+    }
+
+    float Arguments::get(const std::string & name, float fallback) {
+        auto value = find(name);
+        if (!value) return fallback;
+        size_t end = 0u;
+        float v = 0.0f;
+        try {
+            v = std::stof(*value, &end);
+        }
+        catch (const std::exception &) {
+            end = 0u;
+        }
+        if (end == 0u || end != value->size() || !std::isfinite(v)) throw (boost::format("%s expects a number: %s") % name % *value).str();
+        return v;
+    }
+
+    std::vector<std::string> Arguments::get_all(const std::string & name) {
+        used.insert(name);
+        std::vector<std::string> values;
+        for (const auto & option: options) {
+            if (option.first == name) values.push_back(option.second);
+        }
+        return values;
+    }
+
+    void Arguments::check() const {
+        for (const auto & name: given) {
+            if (used.count(name) == 0u) throw (boost::format("unknown option: %s") % name).str();
+        }
+    }
+
+    const std::string * Arguments::find(const std::string & name) {
+        used.insert(name);
+        for (auto option = options.rbegin(); option != options.rend(); ++option) {
+            if (option->first == name) return &option->second;
+        }
+        return nullptr;
+    }
+}
@@ -6,6 +6,13 @@
 #include <algorithm>
 #include <regex>
 #include <functional>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <exception>
+#include <vector>
+#include <set>
+#include <boost/format.hpp>
 #include <boost/algorithm/string.hpp>
 #include <boost/algorithm/string/trim.hpp>
 #include <boost/algorithm/string/join.hpp>
@@ -14,6 +21,11 @@ namespace Helpers {
     std::string trim_base_indent(const std::string & source);
     void times(uint32_t n, std::function<void(uint32_t)> callback);
 
+    // calls back with every index in [0, n) from a pool of threads (0: hardware concurrency),
+    // and rethrows the first exception after all of them finished
+    void parallel_for(uint32_t n, std::function<void(uint32_t)> callback, uint32_t threads = 0);
+    uint32_t thread_count(uint32_t threads = 0);
+
     template<typename T>
     T threshold(T v, T t, T l, T u) {
         return v < t ? l : u;
@@ -26,18 +38,45 @@ namespace Helpers {
         return oss.str();
     }
 
-    template<typename T>
-    std::string to_string(const std::vector<T> & list, const std::string & separator = ", ") {
+    template<typename T, typename A>
+    std::string to_string(const std::vector<T, A> & list, const std::string & separator = ", ") {
         std::vector<std::string> string_list;
         std::transform(list.begin(), list.end(), std::back_inserter(string_list), [](const auto & v){ return to_string(v); });
         return boost::algorithm::join(string_list, separator);
     }
 
-    template<typename T>
-    void unique(std::vector<T> & v) {
+    template<typename C>
+    void unique(C & v) {
         std::sort(v.begin(), v.end());
         v.erase(std::unique(v.begin(), v.end()), v.end());
     }
+
+    // "--name value" options and "--name" flags of a command line, with the other arguments as positional ones.
+    // The getters throw on a value of the wrong type, and check() on the options which nothing asked for.
+    class Arguments {
+    public:
+        Arguments(int argc, char ** argv, const std::set<std::string> & flags = {});
+
+        const std::vector<std::string> & positional() const { return positional_; }
+        bool flag(const std::string & name);
+        // the last value given, or the fallback
+        std::string get(const std::string & name, const std::string & fallback);
+        int32_t get(const std::string & name, int32_t fallback);
+        uint32_t get(const std::string & name, uint32_t fallback);
+        uint64_t get(const std::string & name, uint64_t fallback);
+        float get(const std::string & name, float fallback);
+        // every value given, in order
+        std::vector<std::string> get_all(const std::string & name);
+        void check() const;
+
+    private:
+        std::vector<std::pair<std::string, std::string>> options;
+        std::vector<std::string> positional_;
+        std::set<std::string> given;
+        std::set<std::string> used;
+
+        const std::string * find(const std::string & name);
+    };
 }
 
 #endif
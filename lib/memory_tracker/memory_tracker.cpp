@@ -0,0 +1,192 @@
+#include <mutex>
+#include <atomic>
+#include <cstring>
+#include <fstream>
+#include <boost/format.hpp>
+
+#include <lib/memory_tracker/memory_tracker.hpp>
+
+namespace MemoryTracker {
+#ifdef ENABLE_MEMORY_TRACKER
+    namespace {
+        struct Account {
+            const char * name;
+            bool structure;
+            std::atomic<uint64_t> allocated_bytes;
+            std::atomic<uint64_t> allocations;
+            std::atomic<int64_t> current_bytes;
+            std::atomic<int64_t> peak_bytes;
+
+            void add(int64_t size) {
+                if (size > 0) {
+                    allocated_bytes.fetch_add(size, std::memory_order_relaxed);
+                    allocations.fetch_add(1, std::memory_order_relaxed);
+                }
+                auto current = current_bytes.fetch_add(size, std::memory_order_relaxed) + size;
+                auto peak = peak_bytes.load(std::memory_order_relaxed);
+                while (current > peak && !peak_bytes.compare_exchange_weak(peak, current, std::memory_order_relaxed));
+            }
+        };
+
+        // nothing here may allocate, it runs inside operator new
+        static constexpr uint32_t max_accounts = 64u;
+        Account accounts[max_accounts];
+        Account total;
+        std::atomic<uint32_t> account_size{ 1 };
+        std::mutex account_mutex;
+        thread_local uint32_t stage = 0;
+
+        struct Header {
+            uint32_t stage;
+            uint32_t structure;
+            uint64_t size;
+        };
+        static_assert(sizeof(Header) == 16, "Header must keep the malloc alignment");
+
+        struct ReportAtExit {
+            ~ReportAtExit() {
+                print_report();
+                if (const char * path = std::getenv("TGP_MEMORY_REPORT")) {
+                    std::ofstream ofs(path);
+                    write_json(ofs);
+                }
+            }
+        } report_at_exit;
+    }
+
+    Counters totals() {
+        return { total.allocations.load(std::memory_order_relaxed), total.allocated_bytes.load(std::memory_order_relaxed) };
+    }
+
+    uint32_t account_id(const char * name, bool structure) {
+        std::lock_guard<std::mutex> lock(account_mutex);
+        uint32_t size = account_size;
+        for (uint32_t i = 1; i < size; ++i) {
+            if (accounts[i].structure == structure && std::strcmp(accounts[i].name, name) == 0) return i;
+        }
+        if (size == max_accounts) return 0;
+
+        accounts[size].name = name;
+        accounts[size].structure = structure;
+        account_size = size + 1;
+        return size;
+    }
+
+    uint32_t current_stage() {
+        return stage;
+    }
+
+    void * allocate(size_t size, uint32_t stage_, uint32_t structure) {
+        auto * header = static_cast<Header *>(std::malloc(sizeof(Header) + size));
+        if (!header) throw std::bad_alloc();
+
+        *header = { stage_, structure, size };
+        accounts[stage_].add(size);
+        if (structure != no_account) accounts[structure].add(size);
+        total.add(size);
+        return header + 1;
+    }
+
+    void deallocate(void * p) {
+        if (!p) return;
+        auto * header = static_cast<Header *>(p) - 1;
+        int64_t size = header->size;
+
+        accounts[header->stage].add(-size);
+        if (header->structure != no_account) accounts[header->structure].add(-size);
+        total.add(-size);
+        std::free(header);
+    }
+
+// Scope
+
+    Scope::Scope(const char * name) : prev(stage) {
+        stage = account_id(name, false);
+    }
+
+    Scope::~Scope() {
+        stage = prev;
+    }
+
+// report
+
+    void print_report(std::ostream & os) {
+        auto print = [&os](const char * name, const Account & a) {
+            os << boost::format("  %-28s %14d bytes %10d allocs %14d peak %14d live")
+                % name % a.allocated_bytes % a.allocations % a.peak_bytes % a.current_bytes
+            << std::endl;
+        };
+
+        os << "Memory by stage:" << std::endl;
+        print("(untracked)", accounts[0]);
+        for (uint32_t i = 1; i < account_size; ++i) {
+            if (!accounts[i].structure) print(accounts[i].name, accounts[i]);
+        }
+        os << "Memory by structure:" << std::endl;
+        for (uint32_t i = 1; i < account_size; ++i) {
+            if (accounts[i].structure) print(accounts[i].name, accounts[i]);
+        }
+        print("total", total);
+    }
+
+    void write_json(std::ostream & os) {
+        auto write = [&os](const char * name, const Account & a) {
+            os << boost::format(R"({"name":"%s","bytes":%d,"allocations":%d,"peak_bytes":%d,"live_bytes":%d})")
+                % name % a.allocated_bytes % a.allocations % a.peak_bytes % a.current_bytes;
+        };
+        auto write_accounts = [&](bool structure) {
+            bool first = true;
+            for (uint32_t i = 0; i < account_size; ++i) {
+                if (accounts[i].structure != structure || (i == 0 && structure)) continue;
+                if (!first) os << ",";
+                first = false;
+                write(i == 0 ? "(untracked)" : accounts[i].name, accounts[i]);
+            }
+        };
+
+        os << R"({"stages":[)";
+        write_accounts(false);
+        os << R"(],"structures":[)";
+        write_accounts(true);
+        os << R"(],"total":)";
+        write("total", total);
+        os << "}" << std::endl;
+    }
+#else
+    void print_report(std::ostream & os) {
+        os << "Memory tracker is disabled, build with -DENABLE_MEMORY_TRACKER=ON" << std::endl;
+    }
+
+    void write_json(std::ostream & os) {
+        os << "{}" << std::endl;
+    }
+#endif
+}
+
+#ifdef ENABLE_MEMORY_TRACKER
+// global operator new hook, attributing every heap allocation to the current stage
+// (over-aligned allocations keep the default implementation and are not tracked)
+
+void * operator new(size_t size) {
+    return MemoryTracker::allocate(size, MemoryTracker::current_stage(), MemoryTracker::no_account);
+}
+
+void * operator new[](size_t size) {
+    return MemoryTracker::allocate(size, MemoryTracker::current_stage(), MemoryTracker::no_account);
+}
+
+void * operator new(size_t size, const std::nothrow_t &) noexcept {
+    try { return operator new(size); } catch (...) { return nullptr; }
+}
+
+void * operator new[](size_t size, const std::nothrow_t &) noexcept {
+    try { return operator new[](size); } catch (...) { return nullptr; }
+}
+
+void operator delete(void * p) noexcept { MemoryTracker::deallocate(p); }
+void operator delete[](void * p) noexcept { MemoryTracker::deallocate(p); }
+void operator delete(void * p, size_t) noexcept { MemoryTracker::deallocate(p); }
+void operator delete[](void * p, size_t) noexcept { MemoryTracker::deallocate(p); }
+void operator delete(void * p, const std::nothrow_t &) noexcept { MemoryTracker::deallocate(p); }
+void operator delete[](void * p, const std::nothrow_t &) noexcept { MemoryTracker::deallocate(p); }
+#endif
@@ -0,0 +1,84 @@
+#ifndef MEMORY_TRACKER_HPP
+#define MEMORY_TRACKER_HPP
+
+#include <iostream>
+#include <memory>
+#include <cstdlib>
+#include <cstdint>
+#include <new>
+
+// Stage names must be string literals, only their pointers are kept.
+#ifdef ENABLE_MEMORY_TRACKER
+#define MEMORY_TRACKER_CONCAT_(a, b) a##b
+#define MEMORY_TRACKER_CONCAT(a, b) MEMORY_TRACKER_CONCAT_(a, b)
+#define MEMORY_SCOPE(name) MemoryTracker::Scope MEMORY_TRACKER_CONCAT(memory_scope_, __LINE__)(name)
+#else
+#define MEMORY_SCOPE(name) ((void)0)
+#endif
+
+namespace MemoryTracker {
+#ifdef ENABLE_MEMORY_TRACKER
+    static constexpr uint32_t no_account = 0xffffffffu;
+
+    struct Counters {
+        uint64_t allocations;
+        uint64_t allocated_bytes;
+    };
+
+    // of every stage since the start, for checks which compare them around a workload
+    Counters totals();
+
+    uint32_t account_id(const char * name, bool structure);
+    uint32_t current_stage();
+    void * allocate(size_t size, uint32_t stage, uint32_t structure);
+    void deallocate(void * p);
+
+    // attributes heap allocations of this thread to the named stage while alive
+    class Scope {
+        uint32_t prev;
+
+    public:
+        Scope(const char * name);
+        ~Scope();
+
+        Scope(const Scope &) = delete;
+        Scope & operator=(const Scope &) = delete;
+    };
+
+    // accounts the container memory to Tag::name besides the current stage
+    template<typename T, typename Tag>
+    class Allocator {
+    public:
+        using value_type = T;
+
+        template<typename U>
+        struct rebind { using other = Allocator<U, Tag>; };
+
+        Allocator() = default;
+        template<typename U>
+        Allocator(const Allocator<U, Tag> &) {}
+
+        T * allocate(size_t n) {
+            static const uint32_t id = account_id(Tag::name, true);
+            return static_cast<T *>(MemoryTracker::allocate(n * sizeof(T), current_stage(), id));
+        }
+
+        void deallocate(T * p, size_t) {
+            MemoryTracker::deallocate(p);
+        }
+
+        template<typename U>
+        bool operator==(const Allocator<U, Tag> &) const { return true; }
+        template<typename U>
+        bool operator!=(const Allocator<U, Tag> &) const { return false; }
+    };
+#else
+    template<typename T, typename Tag>
+    using Allocator = std::allocator<T>;
+#endif
+
+    void print_report(std::ostream & os = std::cerr);
+    void write_json(std::ostream & os);
+}
+
+#endif
@@ -0,0 +1,344 @@
+#include <lib/mesh_exporter/mesh_exporter.hpp>
+
+namespace MeshExporter {
+    namespace {
+        // the faces of the cube of geometry.glsl as quads, counter-clockwise from outside
+        struct Face {
+            glm::ivec3 normal;
+            std::array<glm::vec3, 4> corners;
+        };
+
+        const std::array<Face, 6> cube_faces{ {
+            { {  0,  0,  1 }, { { { 1, 1, 1 }, { 0, 1, 1 }, { 0, 0, 1 }, { 1, 0, 1 } } } },
+            { {  1,  0,  0 }, { { { 1, 1, 1 }, { 1, 0, 1 }, { 1, 0, 0 }, { 1, 1, 0 } } } },
+            { {  0,  1,  0 }, { { { 1, 1, 1 }, { 1, 1, 0 }, { 0, 1, 0 }, { 0, 1, 1 } } } },
+            { { -1,  0,  0 }, { { { 0, 1, 1 }, { 0, 1, 0 }, { 0, 0, 0 }, { 0, 0, 1 } } } },
+            { {  0, -1,  0 }, { { { 0, 0, 0 }, { 1, 0, 0 }, { 1, 0, 1 }, { 0, 0, 1 } } } },
+            { {  0,  0, -1 }, { { { 1, 0, 0 }, { 0, 0, 0 }, { 0, 1, 0 }, { 1, 1, 0 } } } }
+        } };
+
+        // the columns of the cave chunks
+        static constexpr int32_t chunk_size = 16;
+
+        int32_t chunk_of(int32_t v) {
+            return v >= 0 ? v / chunk_size : -((-v + chunk_size - 1) / chunk_size);
+        }
+
+        glm::ivec2 chunk_of(const std::array<GLfloat, 3> & v) {
+            return { chunk_of(std::round(v[0])), chunk_of(std::round(v[1])) };
+        }
+
+        uint64_t key_of(const std::array<GLfloat, 3> & v) {
+            return VoxelRenderer::VerticesOptimizer::pack(std::round(v[0]), std::round(v[1]), std::round(v[2]));
+        }
+
+        std::string padded_count(uint64_t count, int32_t width) {
+            return (boost::format("%0" + std::to_string(width) + "d") % count).str();
+        }
+    }
+
+// BufferedWriter
+
+    BufferedWriter::BufferedWriter(const boost::filesystem::path & path_, size_t capacity) :
+        buffer(capacity),
+        path(path_)
+    {
+        // the stream does not buffer again
+        ofs.rdbuf()->pubsetbuf(nullptr, 0);
+        ofs.open(path.string(), std::ios::binary | std::ios::trunc);
+        if (!ofs) throw (boost::format("failed to open %s") % path.string()).str();
+    }
+
+    void BufferedWriter::flush() {
+        if (used == 0u) return;
+        PROFILE_ZONE("exporter/flush");
+        ofs.write(buffer.data(), used);
+        if (!ofs) throw (boost::format("failed to write %s") % path.string()).str();
+        used = 0u;
+    }
+
+    void BufferedWriter::write_through(const void * data, size_t size) {
+        ofs.write(static_cast<const char *>(data), size);
+        if (!ofs) throw (boost::format("failed to write %s") % path.string()).str();
+        bytes_ += size;
+    }
+
+    void BufferedWriter::overwrite(uint64_t offset, const std::string & data) {
+        flush();
+        ofs.seekp(offset);
+        ofs.write(data.data(), data.size());
+        ofs.seekp(0, std::ios::end);
+        if (!ofs) throw (boost::format("failed to write %s") % path.string()).str();
+    }
+
+// Exporter
+
+    Exporter::Exporter(const boost::filesystem::path & path_, size_t buffer_size) :
+        path(path_),
+        format(format_of(path_)),
+        writer(format == Format::ply ? path_ : bin_path(path_), buffer_size),
+        start(std::chrono::steady_clock::now())
+    {
+        if (format == Format::ply) write_ply_header();
+    }
+
+    Exporter::~Exporter() {
+        try {
+            finish();
+        }
+        catch (std::string str) {
+            std::cerr << str << std::endl;
+        }
+    }
+
+    void Exporter::add_voxels(const VoxelRenderer::Vertices & visible_vertices, Occupancy is_carved) {
+        PROFILE_ZONE("exporter/add_voxels");
+        MEMORY_SCOPE("exporter");
+        if (finished) throw std::string("the export has already finished");
+
+        arena.reset();
+        Arena::Vector<uint64_t> keys(&arena);
+        keys.reserve(visible_vertices.size());
+        for (const auto & v: visible_vertices) keys.push_back(key_of(v));
+        Helpers::unique(keys);
+        add_keys(keys.data(), keys.data() + keys.size(), is_carved);
+    }
+
+    void Exporter::add_chunks(const glm::vec2 & chunk_from, const glm::vec2 & chunk_to, const ChunkSource & source) {
+        PROFILE_ZONE("exporter/add_chunks");
+        MEMORY_SCOPE("exporter");
+        if (finished) throw std::string("the export has already finished");
+
+        const int32_t from_x = chunk_from.x;
+        const int32_t from_y = chunk_from.y;
+        const int32_t to_x = chunk_to.x;
+        const int32_t to_y = chunk_to.y;
+        using Row = std::vector<std::vector<uint64_t>>;
+        auto load_row = [&](int32_t x) {
+            Row row;
+            if (x > to_x) return row;
+            for (int32_t y = from_y; y <= to_y; ++y) {
+                auto source_start = std::chrono::steady_clock::now();
+                auto vertices = source({ x, y });
+                stats_.source_seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - source_start).count();
+                std::vector<uint64_t> keys;
+                keys.reserve(vertices.size());
+                for (const auto & v: vertices) keys.push_back(key_of(v));
+                Helpers::unique(keys);
+                row.push_back(std::move(keys));
+            }
+            return row;
+        };
+
+        // the rows x - 1, x and x + 1, the neighbours of a voxel are at most one chunk away
+        Row previous;
+        Row current = load_row(from_x);
+        Row next;
+        for (int32_t x = from_x; x <= to_x; ++x) {
+            next = load_row(x + 1);
+            auto is_carved = [&](const glm::ivec3 & v) {
+                auto cx = chunk_of(v.x);
+                auto cy = chunk_of(v.y);
+                const auto & row = cx == x - 1 ? previous : cx == x ? current : next;
+                if (cx < x - 1 || cx > x + 1 || cy < from_y || cy > to_y || row.empty()) return false;
+                const auto & keys = row[cy - from_y];
+                return std::binary_search(keys.begin(), keys.end(), VoxelRenderer::VerticesOptimizer::pack(v.x, v.y, v.z));
+            };
+            for (const auto & keys: current) add_keys(keys.data(), keys.data() + keys.size(), is_carved);
+
+            previous = std::move(current);
+            current = std::move(next);
+        }
+    }
+
+    void Exporter::add_keys(const uint64_t * begin, const uint64_t * end, const Occupancy & is_carved) {
+        using VoxelRenderer::VerticesOptimizer;
+        auto has_voxel = [&](const glm::ivec3 & v) {
+            if (std::binary_search(begin, end, VerticesOptimizer::pack(v.x, v.y, v.z))) return true;
+            return is_carved && is_carved(v);
+        };
+
+        for (auto it = begin; it != end; ++it) {
+            auto voxel = VerticesOptimizer::unpack(*it);
+            glm::vec3 origin(voxel);
+            auto faces = stats_.faces;
+            for (const auto & face: cube_faces) {
+                if (has_voxel(voxel + face.normal)) continue;
+                if (stats_.faces == max_faces) throw (boost::format("%s: too many faces") % path.string()).str();
+
+                glm::vec3 normal(face.normal);
+                for (const auto & corner: face.corners) {
+                    auto position = origin + corner;
+                    min = glm::min(min, position);
+                    max = glm::max(max, position);
+                    // position and normal interleaved in both formats
+                    const float vertex[6] = { position.x, position.y, position.z, normal.x, normal.y, normal.z };
+                    writer.write(vertex, sizeof(vertex));
+                }
+                ++stats_.faces;
+            }
+            // the voxels inside of the caves leave no face
+            if (stats_.faces != faces) ++stats_.voxels;
+        }
+    }
+
+    void Exporter::finish() {
+        if (finished) return;
+        finished = true;
+        PROFILE_ZONE("exporter/finish");
+
+        auto vertex_bytes = writer.bytes();
+        if (format == Format::ply) {
+            write_ply_faces();
+            writer.overwrite(vertex_count_offset, padded_count(stats_.faces * 4u, count_width));
+            writer.overwrite(face_count_offset, padded_count(stats_.faces, count_width));
+        }
+        else {
+            write_gltf_indices();
+            writer.flush();
+            write_gltf_json(vertex_bytes, writer.bytes() - vertex_bytes);
+        }
+        writer.flush();
+
+        stats_.bytes = writer.bytes();
+        stats_.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    void Exporter::print_stats(std::ostream & os) const {
+        auto megabytes = stats_.bytes / (1024.0 * 1024.0);
+        os << boost::format("Exporter: %d voxels, %d faces, %.1f MB to %s in %.2f s (%.1f MB/s)")
+            % stats_.voxels
+            % stats_.faces
+            % megabytes
+            % path.string()
+            % (stats_.seconds - stats_.source_seconds)
+            % (megabytes / (stats_.seconds - stats_.source_seconds))
+            << std::endl;
+        if (stats_.source_seconds > 0.0) {
+            os << boost::format("Exporter: %.2f s waiting for the chunks") % stats_.source_seconds << std::endl;
+        }
+    }
+
+    Exporter::Format Exporter::format_of(const boost::filesystem::path & path) {
+        auto extension = path.extension().string();
+        if (extension == ".ply") return Format::ply;
+        if (extension == ".gltf") return Format::gltf;
+        throw (boost::format("unknown mesh format: %s") % path.string()).str();
+    }
+
+    bool Exporter::export_chunks_from_env(const glm::vec2 & chunk_from, const glm::vec2 & chunk_to, const ChunkSource & source) {
+        auto path = std::getenv("TGP_EXPORT");
+        if (!path) return false;
+
+        Exporter exporter(path);
+        exporter.add_chunks(chunk_from, chunk_to, source);
+        exporter.finish();
+        exporter.print_stats();
+        return true;
+    }
+
+    bool Exporter::export_from_env(const VoxelRenderer::Vertices & vertices) {
+        if (!std::getenv("TGP_EXPORT")) return false;
+        if (vertices.size() > std::numeric_limits<uint32_t>::max()) throw std::string("too many voxels to export");
+
+        glm::ivec2 chunk_from(std::numeric_limits<int32_t>::max());
+        glm::ivec2 chunk_to(std::numeric_limits<int32_t>::lowest());
+        for (const auto & v: vertices) {
+            auto chunk = chunk_of(v);
+            chunk_from = glm::min(chunk_from, chunk);
+            chunk_to = glm::max(chunk_to, chunk);
+        }
+        if (vertices.empty()) chunk_to = chunk_from = glm::ivec2(0);
+
+        // the indices of the voxels counted out into the chunks, in place of a sorted copy of the world
+        size_t columns = chunk_to.y - chunk_from.y + 1;
+        auto bucket_of = [&](const glm::ivec2 & chunk) {
+            return size_t(chunk.x - chunk_from.x) * columns + size_t(chunk.y - chunk_from.y);
+        };
+        std::vector<uint32_t> offsets(size_t(chunk_to.x - chunk_from.x + 1) * columns + 1u, 0u);
+        for (const auto & v: vertices) ++offsets[bucket_of(chunk_of(v)) + 1u];
+        std::partial_sum(offsets.begin(), offsets.end(), offsets.begin());
+        std::vector<uint32_t> indices(vertices.size());
+        {
+            auto next = offsets;
+            for (uint32_t i = 0; i < vertices.size(); ++i) indices[next[bucket_of(chunk_of(vertices[i]))]++] = i;
+        }
+
+        return export_chunks_from_env(glm::vec2(chunk_from), glm::vec2(chunk_to), [&](const glm::vec2 & chunk) {
+            auto bucket = bucket_of(glm::ivec2(chunk));
+            VoxelRenderer::Vertices result;
+            result.reserve(offsets[bucket + 1u] - offsets[bucket]);
+            for (auto i = offsets[bucket]; i < offsets[bucket + 1u]; ++i) result.push_back(vertices[indices[i]]);
+            return result;
+        });
+    }
+
+    boost::filesystem::path Exporter::bin_path(const boost::filesystem::path & path) {
+        auto bin = path;
+        return bin.replace_extension(".bin");
+    }
+
+    void Exporter::write_ply_header() {
+        // the counts are rewritten in place at the end, so they have fixed widths
+        std::string header = "ply\nformat binary_little_endian 1.0\ncomment terrain-generation-prototyping\nelement vertex ";
+        vertex_count_offset = header.size();
+        header += padded_count(0u, count_width);
+        header +=
+            "\nproperty float x\nproperty float y\nproperty float z\n"
+            "property float nx\nproperty float ny\nproperty float nz\n"
+            "element face ";
+        face_count_offset = header.size();
+        header += padded_count(0u, count_width);
+        header += "\nproperty list uchar uint vertex_indices\nend_header\n";
+        writer.write(header.data(), header.size());
+    }
+
+    void Exporter::write_ply_faces() {
+        for (uint32_t i = 0; i < stats_.faces; ++i) {
+            writer.put(uint8_t(4u));
+            const uint32_t indices[4] = { 4u * i, 4u * i + 1u, 4u * i + 2u, 4u * i + 3u };
+            writer.write(indices, sizeof(indices));
+        }
+    }
+
+    void Exporter::write_gltf_indices() {
+        for (uint32_t i = 0; i < stats_.faces; ++i) {
+            const uint32_t indices[6] = { 4u * i, 4u * i + 1u, 4u * i + 2u, 4u * i, 4u * i + 2u, 4u * i + 3u };
+            writer.write(indices, sizeof(indices));
+        }
+    }
+
+    void Exporter::write_gltf_json(uint64_t vertex_bytes, uint64_t index_bytes) const {
+        std::ofstream ofs(path.string());
+        if (!ofs) throw (boost::format("failed to open %s") % path.string()).str();
+
+        ofs << "{\"asset\":{\"version\":\"2.0\",\"generator\":\"terrain-generation-prototyping\"},\"scene\":0,";
+        if (stats_.faces == 0u) {
+            ofs << "\"scenes\":[{\"nodes\":[]}]}" << std::endl;
+            return;
+        }
+
+        auto vertices = stats_.faces * 4u;
+        ofs
+            << "\"scenes\":[{\"nodes\":[0]}],\"nodes\":[{\"mesh\":0}],"
+            << "\"meshes\":[{\"primitives\":[{\"attributes\":{\"POSITION\":0,\"NORMAL\":1},\"indices\":2,\"mode\":4}]}],"
+            << boost::format("\"buffers\":[{\"uri\":\"%s\",\"byteLength\":%d}],")
+                % bin_path(path).filename().string()
+                % (vertex_bytes + index_bytes)
+            << boost::format("\"bufferViews\":[{\"buffer\":0,\"byteOffset\":0,\"byteLength\":%d,\"byteStride\":24,\"target\":34962},")
+                % vertex_bytes
+            << boost::format("{\"buffer\":0,\"byteOffset\":%d,\"byteLength\":%d,\"target\":34963}],")
+                % vertex_bytes
+                % index_bytes
+            << boost::format("\"accessors\":[{\"bufferView\":0,\"byteOffset\":0,\"componentType\":5126,\"count\":%d,\"type\":\"VEC3\",")
+                % vertices
+            << boost::format("\"min\":[%f,%f,%f],\"max\":[%f,%f,%f]},")
+                % min.x % min.y % min.z
+                % max.x % max.y % max.z
+            << boost::format("{\"bufferView\":0,\"byteOffset\":12,\"componentType\":5126,\"count\":%d,\"type\":\"VEC3\"},")
+                % vertices
+            << boost::format("{\"bufferView\":1,\"byteOffset\":0,\"componentType\":5125,\"count\":%d,\"type\":\"SCALAR\"}]}")
+                % (stats_.faces * 6u)
+            << std::endl;
+    }
+}
@@ -0,0 +1,131 @@
+#ifndef MESH_EXPORTER_HPP
+#define MESH_EXPORTER_HPP
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <array>
+#include <numeric>
+#include <limits>
+#include <chrono>
+#include <cstring>
+#include <cstdlib>
+#include <boost/format.hpp>
+#include <boost/filesystem.hpp>
+
+#include <lib/helpers.hpp>
+#include <lib/voxel_renderer/voxel_renderer.hpp>
+#include <lib/profiler/profiler.hpp>
+#include <lib/memory_tracker/memory_tracker.hpp>
+#include <lib/arena/arena.hpp>
+
+namespace MeshExporter {
+    // sequential writes in large blocks, bypassing the buffer of the stream
+    class BufferedWriter {
+        std::ofstream ofs;
+        std::vector<char> buffer;
+        size_t used = 0u;
+        uint64_t bytes_ = 0u;
+        boost::filesystem::path path;
+
+    public:
+        BufferedWriter(const boost::filesystem::path & path_, size_t capacity);
+
+        void write(const void * data, size_t size) {
+            if (used + size > buffer.size()) flush();
+            if (size > buffer.size()) {
+                write_through(data, size);
+                return;
+            }
+            std::memcpy(buffer.data() + used, data, size);
+            used += size;
+            bytes_ += size;
+        }
+
+        template<typename T>
+        void put(const T & v) { write(&v, sizeof(T)); }
+
+        void flush();
+        // rewrites already written bytes in place, e.g. counts in a header
+        void overwrite(uint64_t offset, const std::string & data);
+        uint64_t bytes() const { return bytes_; }
+
+    private:
+        void write_through(const void * data, size_t size);
+    };
+
+    // Exports voxels as cubes with flat normals, one chunk of visible voxels at a time.
+    // Faces between voxels of the same chunk, or towards the voxels of the occupancy, are left out.
+    // Only the write buffer and the scratch of a chunk are held in memory, the indices of the quads
+    // are generated at the end.
+    class Exporter {
+    public:
+        enum class Format { ply, gltf };
+        using Occupancy = std::function<bool(const glm::ivec3 & voxel)>;
+        // the voxels in the 16x16 columns of the chunk, e.g. from the generator or the chunk cache
+        using ChunkSource = std::function<VoxelRenderer::Vertices(const glm::vec2 & chunk)>;
+
+        struct Stats {
+            uint64_t voxels = 0u;
+            uint64_t faces = 0u;
+            uint64_t bytes = 0u;
+            double seconds = 0.0;
+            // of the seconds, waiting for the chunk source
+            double source_seconds = 0.0;
+        };
+
+        static constexpr size_t default_buffer_size = 4u * 1024u * 1024u;
+
+        // .ply, or .gltf with its buffer in a .bin next to it
+        Exporter(const boost::filesystem::path & path_, size_t buffer_size = default_buffer_size);
+        ~Exporter();
+
+        Exporter(const Exporter &) = delete;
+        Exporter & operator=(const Exporter &) = delete;
+
+        void add_voxels(const VoxelRenderer::Vertices & visible_vertices, Occupancy is_carved = nullptr);
+        // pulls the chunks from the source row by row, each of them once, holding only the voxels of three rows
+        // of chunks to cull the faces between the neighbouring chunks
+        void add_chunks(const glm::vec2 & chunk_from, const glm::vec2 & chunk_to, const ChunkSource & source);
+        void finish();
+
+        const Stats & stats() const { return stats_; }
+        void print_stats(std::ostream & os = std::cout) const;
+
+        static Format format_of(const boost::filesystem::path & path);
+
+        // exports the chunks when TGP_EXPORT names an output path, without holding the world
+        static bool export_chunks_from_env(const glm::vec2 & chunk_from, const glm::vec2 & chunk_to, const ChunkSource & source);
+        // the same, for the worlds which are already in memory, through the indices of their voxels by chunk
+        static bool export_from_env(const VoxelRenderer::Vertices & vertices);
+
+    private:
+        static constexpr uint32_t max_faces = 1u << 30; // 32 bit indices of 4 vertices per face
+        static constexpr int32_t count_width = 12;
+
+        boost::filesystem::path path;
+        Format format;
+        BufferedWriter writer;
+        Arena::MonotonicArena arena{ "exporter" };
+        Stats stats_;
+        glm::vec3 min{ std::numeric_limits<float>::max() };
+        glm::vec3 max{ std::numeric_limits<float>::lowest() };
+        uint64_t vertex_count_offset = 0u;
+        uint64_t face_count_offset = 0u;
+        bool finished = false;
+        std::chrono::steady_clock::time_point start;
+
+        static boost::filesystem::path bin_path(const boost::filesystem::path & path);
+
+        // the keys of VerticesOptimizer::pack, sorted and unique
+        void add_keys(const uint64_t * begin, const uint64_t * end, const Occupancy & is_carved);
+
+        void write_ply_header();
+        void write_ply_faces();
+        void write_gltf_indices();
+        void write_gltf_json(uint64_t vertex_bytes, uint64_t index_bytes) const;
+    };
+}
+
+#endif
@@ -0,0 +1,147 @@
+#include <lib/profiler/profiler.hpp>
+
+namespace Profiler {
+    std::atomic<bool> enabled_{ false };
+
+    namespace {
+        std::atomic<size_t> buffer_capacity{ 1u << 18 };
+
+        struct Registry {
+            std::mutex mutex;
+            std::vector<std::unique_ptr<RingBuffer>> buffers;
+            // of the exited threads, for the next new ones
+            std::vector<RingBuffer *> free;
+        };
+
+        // buffers outlive their threads so that the trace can be exported after joining them
+        Registry & registry() {
+            static Registry instance;
+            return instance;
+        }
+
+        // returns the buffer of the thread to the pool when it exits, so that the threads started by every
+        // parallel_for reuse the buffers of the previous ones and the memory is bounded by the concurrent threads
+        struct ThreadSlot {
+            RingBuffer * buffer = nullptr;
+
+            ~ThreadSlot() {
+                if (!buffer) return;
+                auto & r = registry();
+                std::lock_guard<std::mutex> lock(r.mutex);
+                r.free.push_back(buffer);
+            }
+        };
+
+        const auto epoch = std::chrono::steady_clock::now();
+
+        std::string escape(const char * name) {
+            std::string result;
+            for (const char * c = name; *c; ++c) {
+                if (*c == '"' || *c == '\\') result.push_back('\\');
+                result.push_back(*c);
+            }
+            return result;
+        }
+    }
+
+// RingBuffer
+
+    RingBuffer::RingBuffer(uint32_t thread_id_, size_t capacity) :
+        events(capacity),
+        thread_id(thread_id_)
+    {}
+
+    std::vector<Event> RingBuffer::snapshot() const {
+        auto n = written.load(std::memory_order_acquire);
+        auto begin = n > events.size() ? n - events.size() : 0;
+
+        std::vector<Event> result;
+        result.reserve(n - begin);
+        for (auto i = begin; i < n; ++i) {
+            result.push_back(events[i % events.size()]);
+        }
+        return result;
+    }
+
+    uint64_t RingBuffer::dropped() const {
+        auto n = written.load(std::memory_order_acquire);
+        return n > events.size() ? n - events.size() : 0;
+    }
+
+// functions
+
+    void enable(bool enabled) {
+        enabled_.store(enabled, std::memory_order_relaxed);
+    }
+
+    void set_buffer_capacity(size_t capacity) {
+        buffer_capacity = std::max<size_t>(capacity, 1u);
+    }
+
+    uint64_t now_ns() {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - epoch).count();
+    }
+
+    RingBuffer & thread_buffer() {
+        thread_local ThreadSlot slot;
+        if (!slot.buffer) {
+            auto & r = registry();
+            std::lock_guard<std::mutex> lock(r.mutex);
+            if (!r.free.empty()) {
+                slot.buffer = r.free.back();
+                r.free.pop_back();
+            }
+            else {
+                r.buffers.push_back(std::make_unique<RingBuffer>(r.buffers.size(), buffer_capacity));
+                slot.buffer = r.buffers.back().get();
+            }
+        }
+        return *slot.buffer;
+    }
+
+    void write_chrome_trace(std::ostream & os) {
+        auto & r = registry();
+        std::lock_guard<std::mutex> lock(r.mutex);
+        bool first = true;
+
+        os << "{\"traceEvents\":[";
+        for (const auto & buffer: r.buffers) {
+            if (buffer->dropped() > 0) {
+                std::cerr << boost::format("Profiler: thread %d dropped %d events") % buffer->thread_id % buffer->dropped() << std::endl;
+            }
+            for (const auto & e: buffer->snapshot()) {
+                os << (first ? "\n" : ",\n");
+                first = false;
+
+                if (e.phase == 'X') {
+                    os << boost::format(R"({"name":"%s","ph":"X","ts":%.3f,"dur":%.3f,"pid":1,"tid":%d})")
+                        % escape(e.name) % (e.timestamp_ns / 1000.0) % (e.duration_ns / 1000.0) % buffer->thread_id;
+                }
+                else {
+                    os << boost::format(R"({"name":"%s","ph":"C","ts":%.3f,"pid":1,"tid":%d,"args":{"value":%d}})")
+                        % escape(e.name) % (e.timestamp_ns / 1000.0) % buffer->thread_id % e.value;
+                }
+            }
+        }
+        os << "\n],\"displayTimeUnit\":\"ms\"}" << std::endl;
+    }
+
+    void write_chrome_trace(const std::string & path) {
+        std::ofstream ofs(path);
+        write_chrome_trace(ofs);
+    }
+
+// Session
+
+    Session::Session() {
+        if (const char * p = std::getenv("TGP_TRACE")) path = p;
+        if (!path.empty()) enable();
+    }
+
+    Session::~Session() {
+        if (path.empty()) return;
+        enable(false);
+        write_chrome_trace(path);
+        std::cout << "Trace: " << path << std::endl;
+    }
+}
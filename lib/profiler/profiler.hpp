@@ -0,0 +1,103 @@
+#ifndef PROFILER_HPP
+#define PROFILER_HPP
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <cstdlib>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <boost/format.hpp>
+
+// Zone and counter names must be string literals, only their pointers are recorded.
+#ifdef ENABLE_PROFILER
+#define PROFILER_CONCAT_(a, b) a##b
+#define PROFILER_CONCAT(a, b) PROFILER_CONCAT_(a, b)
+#define PROFILE_ZONE(name) Profiler::Zone PROFILER_CONCAT(profiler_zone_, __LINE__)(name)
+#define PROFILE_COUNTER(name, value) Profiler::counter(name, value)
+#else
+#define PROFILE_ZONE(name) ((void)0)
+#define PROFILE_COUNTER(name, value) ((void)0)
+#endif
+
+namespace Profiler {
+    struct Event {
+        const char * name;
+        char phase; // 'X': complete zone, 'C': counter
+        uint64_t timestamp_ns;
+        uint64_t duration_ns;
+        int64_t value;
+    };
+
+    // written only by its own thread, read when the trace is exported; a thread which starts after another one
+    // exited takes over its buffer, and the thread id with it
+    class RingBuffer {
+        std::vector<Event> events;
+        std::atomic<uint64_t> written{ 0 };
+
+    public:
+        const uint32_t thread_id;
+
+        RingBuffer(uint32_t thread_id_, size_t capacity);
+
+        void push(const Event & event) {
+            auto n = written.load(std::memory_order_relaxed);
+            events[n % events.size()] = event;
+            written.store(n + 1, std::memory_order_release);
+        }
+
+        std::vector<Event> snapshot() const;
+        uint64_t dropped() const;
+    };
+
+    extern std::atomic<bool> enabled_;
+
+    inline bool is_enabled() {
+        return enabled_.load(std::memory_order_relaxed);
+    }
+
+    void enable(bool enabled = true);
+    void set_buffer_capacity(size_t capacity);
+    uint64_t now_ns();
+    RingBuffer & thread_buffer();
+
+    inline void counter(const char * name, int64_t value) {
+        if (!is_enabled()) return;
+        thread_buffer().push({ name, 'C', now_ns(), 0, value });
+    }
+
+    class Zone {
+        const char * name;
+        uint64_t begin_ns;
+
+    public:
+        Zone(const char * name_) : name(is_enabled() ? name_ : nullptr) {
+            if (name) begin_ns = now_ns();
+        }
+
+        ~Zone() {
+            if (name) thread_buffer().push({ name, 'X', begin_ns, now_ns() - begin_ns, 0 });
+        }
+
+        Zone(const Zone &) = delete;
+        Zone & operator=(const Zone &) = delete;
+    };
+
+    // Chrome trace event format, loadable in chrome://tracing or Perfetto
+    void write_chrome_trace(std::ostream & os);
+    void write_chrome_trace(const std::string & path);
+
+    // records while alive when TGP_TRACE names an output path, and writes the trace there at the end
+    class Session {
+        std::string path;
+
+    public:
+        Session();
+        ~Session();
+    };
+}
+
+#endif
@@ -0,0 +1,145 @@
+#include <lib/progressive/progressive.hpp>
+
+namespace Progressive {
+    namespace {
+        int32_t floor_div(int32_t v, int32_t d) {
+            return v >= 0 ? v / d : -((-v + d - 1) / d);
+        }
+
+        uint32_t log2(uint32_t stride) {
+            uint32_t shift = 0u;
+            while ((1u << shift) < stride) ++shift;
+            return shift;
+        }
+    }
+
+    uint32_t stride_from_env() {
+        auto value = std::getenv("TGP_PROGRESSIVE");
+        if (!value) return 0u;
+        auto stride = uint32_t(std::stoul(value));
+        if (stride < 2u || stride > max_stride || (stride & (stride - 1u)) != 0u) {
+            throw (boost::format("TGP_PROGRESSIVE expects a stride of 2, 4 or 8: %s") % value).str();
+        }
+        return stride;
+    }
+
+    VoxelRenderer::RegionSurface make_surface(uint64_t key, const VoxelRenderer::Vertices & vertices, uint32_t stride) {
+        PROFILE_ZONE("progressive/surface");
+        thread_local VoxelRenderer::VerticesOptimizer optimizer(false);
+        VoxelRenderer::RegionSurface surface{ key, {}, {}, {} };
+        // the regions are already made in parallel
+        if (stride == 1u) {
+            surface.vertices = optimizer.optimize(vertices, surface.face_masks, surface.occlusions, 1u);
+            return surface;
+        }
+
+        // the optimizer finds the neighbours on the unit lattice
+        VoxelRenderer::Vertices lattice;
+        lattice.reserve(vertices.size());
+        for (const auto & v: vertices) {
+            lattice.push_back({
+                GLfloat(floor_div(int32_t(std::round(v[0])), stride)),
+                GLfloat(floor_div(int32_t(std::round(v[1])), stride)),
+                GLfloat(floor_div(int32_t(std::round(v[2])), stride))
+            });
+        }
+        // the levels of the corners are the same at any scale
+        surface.vertices = optimizer.optimize(lattice, surface.face_masks, surface.occlusions, 1u);
+
+        GLubyte scale = GLubyte(log2(stride) << VoxelRenderer::voxel_scale_shift);
+        for (auto & v: surface.vertices) {
+            for (auto & c: v) c *= stride;
+        }
+        for (auto & mask: surface.face_masks) mask |= scale;
+        return surface;
+    }
+
+// Refiner
+
+    Refiner::Refiner(std::vector<uint64_t> keys_, Generate generate_, uint32_t coarse_stride_, uint32_t threads_) :
+        keys(std::move(keys_)),
+        generate(std::move(generate_)),
+        coarse_stride(coarse_stride_),
+        threads(threads_)
+    {
+        if (coarse_stride < 1u || coarse_stride > max_stride || (coarse_stride & (coarse_stride - 1u)) != 0u) {
+            throw (boost::format("Unsupported coarse stride: %d") % coarse_stride).str();
+        }
+    }
+
+    Refiner::~Refiner() {
+        stopping = true;
+        if (worker.joinable()) worker.join();
+    }
+
+    void Refiner::start() {
+        PROFILE_ZONE("progressive/preview");
+        MEMORY_SCOPE("progressive/preview");
+        start_time = std::chrono::steady_clock::now();
+
+        std::vector<VoxelRenderer::RegionSurface> surfaces(keys.size());
+        std::vector<size_t> voxels(keys.size(), 0u);
+        Helpers::parallel_for(keys.size(), [&](uint32_t i) {
+            auto vertices = generate(keys[i], coarse_stride);
+            voxels[i] = vertices.size();
+            surfaces[i] = make_surface(keys[i], vertices, coarse_stride);
+        }, threads);
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            for (auto v: voxels) stats_.coarse_voxels += v;
+            stats_.preview_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time).count();
+            ready = std::move(surfaces);
+        }
+        worker = std::thread([this]() { refine(); });
+    }
+
+    std::vector<VoxelRenderer::RegionSurface> Refiner::take() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return std::move(ready);
+    }
+
+    void Refiner::wait() {
+        if (worker.joinable()) worker.join();
+    }
+
+    Refiner::Stats Refiner::stats() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return stats_;
+    }
+
+    void Refiner::print_stats(std::ostream & os) const {
+        auto stats = this->stats();
+        os << boost::format("Progressive: %d regions, preview at stride %d in %.3f s (%d voxels)")
+            % keys.size()
+            % coarse_stride
+            % stats.preview_seconds
+            % stats.coarse_voxels
+            << std::endl;
+        os << boost::format("Progressive: %d regions refined in %.3f s (%d voxels)%s")
+            % stats.refined_regions
+            % stats.full_seconds
+            % stats.full_voxels
+            % (done ? "" : ", stopped")
+            << std::endl;
+    }
+
+    void Refiner::refine() {
+        PROFILE_ZONE("progressive/refine");
+        MEMORY_SCOPE("progressive/refine");
+        Helpers::parallel_for(keys.size(), [&](uint32_t i) {
+            if (stopping) return;
+            auto vertices = generate(keys[i], 1u);
+            auto surface = make_surface(keys[i], vertices, 1u);
+
+            std::lock_guard<std::mutex> lock(mutex);
+            stats_.full_voxels += vertices.size();
+            ++stats_.refined_regions;
+            ready.push_back(std::move(surface));
+        }, threads);
+
+        std::lock_guard<std::mutex> lock(mutex);
+        stats_.full_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time).count();
+        done = !stopping;
+    }
+}
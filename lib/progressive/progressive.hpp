@@ -0,0 +1,80 @@
+#ifndef PROGRESSIVE_HPP
+#define PROGRESSIVE_HPP
+
+#include <iostream>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <boost/format.hpp>
+
+#include <lib/helpers.hpp>
+#include <lib/voxel_renderer/voxel_renderer.hpp>
+#include <lib/profiler/profiler.hpp>
+#include <lib/memory_tracker/memory_tracker.hpp>
+
+namespace Progressive {
+    // voxels of the region in world coordinates, on the lattice of the stride:
+    // a coarse voxel at a multiple of the stride stands for the stride^3 voxels from it
+    using Generate = std::function<VoxelRenderer::Vertices(uint64_t key, uint32_t stride)>;
+
+    // strides which fit in the scale bits of the face masks
+    static constexpr uint32_t max_stride = 8u;
+
+    // TGP_PROGRESSIVE=<stride> of the preview, 0 when unset
+    uint32_t stride_from_env();
+
+    // the visible voxels of the region at the stride, with the stride in the scale bits of the face masks
+    VoxelRenderer::RegionSurface make_surface(uint64_t key, const VoxelRenderer::Vertices & vertices, uint32_t stride);
+
+    // Coarse-to-fine generation of a set of regions: start generates every region at the coarse stride,
+    // which is a small fraction of the work, and returns once the whole preview is ready.
+    // A background thread then regenerates the regions at the full resolution, and take hands over
+    // the surfaces finished since the last call, each of which replaces the previous one of its region.
+    class Refiner {
+    public:
+        struct Stats {
+            size_t coarse_voxels = 0u;
+            size_t full_voxels = 0u;
+            size_t refined_regions = 0u;
+            double preview_seconds = 0.0;
+            double full_seconds = 0.0;
+        };
+
+        Refiner(std::vector<uint64_t> keys_, Generate generate_, uint32_t coarse_stride_ = 8u, uint32_t threads_ = 0);
+        ~Refiner();
+
+        Refiner(const Refiner &) = delete;
+        Refiner & operator=(const Refiner &) = delete;
+
+        void start();
+        std::vector<VoxelRenderer::RegionSurface> take();
+        // blocks until every region is refined
+        void wait();
+        bool is_done() const { return done; }
+
+        // the stats of the refinement are final once it is done
+        Stats stats() const;
+        void print_stats(std::ostream & os = std::cout) const;
+
+    private:
+        std::vector<uint64_t> keys;
+        Generate generate;
+        uint32_t coarse_stride;
+        uint32_t threads;
+
+        mutable std::mutex mutex;
+        std::vector<VoxelRenderer::RegionSurface> ready;
+        Stats stats_;
+        std::chrono::steady_clock::time_point start_time;
+        std::thread worker;
+        std::atomic<bool> stopping{ false };
+        std::atomic<bool> done{ false };
+
+        void refine();
+    };
+}
+
+#endif
@@ -0,0 +1,294 @@
+#include <lib/ray_cast/ray_cast.hpp>
+
+namespace RayCast {
+    namespace {
+        // rays of a batch per thread task
+        constexpr uint32_t block_size = 4096u;
+
+        // the face of the next voxel which a ray stepping along the axis enters through
+        uint32_t entered_face(uint32_t axis, float direction) {
+            static const std::array<std::array<uint32_t, 2>, 3> faces{ {
+                { 3u, 1u },
+                { 4u, 2u },
+                { 5u, 0u }
+            } };
+            return faces[axis][direction > 0.0f ? 0 : 1];
+        }
+
+        // the cell of the level of the edge 2^shift
+        glm::ivec3 cell_of(const glm::ivec3 & v, int32_t shift) {
+            return { v.x >> shift, v.y >> shift, v.z >> shift };
+        }
+    }
+
+// OccupancyGrid
+
+    OccupancyGrid::OccupancyGrid(const VoxelRenderer::Vertices & vertices, Solid solid) {
+        PROFILE_ZONE("ray_cast/build");
+        MEMORY_SCOPE("ray_cast");
+        if (vertices.empty()) throw std::string("no voxels to cast rays against");
+
+        glm::ivec3 max(std::numeric_limits<int32_t>::lowest());
+        origin = glm::ivec3(std::numeric_limits<int32_t>::max());
+        std::vector<glm::ivec3> voxels;
+        voxels.reserve(vertices.size());
+        for (const auto & v: vertices) {
+            glm::ivec3 voxel(int32_t(std::round(v[0])), int32_t(std::round(v[1])), int32_t(std::round(v[2])));
+            origin = glm::min(origin, voxel);
+            max = glm::max(max, voxel);
+            voxels.push_back(voxel);
+        }
+        size_ = max - origin + 1;
+
+        // every level has a quarter of the words of the previous one along each axis
+        glm::ivec3 words = (size_ + 3) / 4;
+        while (true) {
+            levels.push_back({ words, std::vector<uint64_t>(size_t(words.x) * words.y * words.z, 0u) });
+            if (words.x == 1 && words.y == 1 && words.z == 1) break;
+            words = (words + 3) / 4;
+        }
+
+        if (solid == Solid::voxels) {
+            for (const auto & v: voxels) set(0u, v - origin);
+        }
+        else {
+            for (int32_t z = 0; z < size_.z; ++z) {
+                for (int32_t y = 0; y < size_.y; ++y) {
+                    for (int32_t x = 0; x < size_.x; ++x) set(0u, { x, y, z });
+                }
+            }
+            auto & level = levels[0];
+            for (const auto & v: voxels) {
+                auto cell = v - origin;
+                auto word = cell_of(cell, 2);
+                level.words[size_t(word.z) * level.size.y * level.size.x + size_t(word.y) * level.size.x + word.x] &=
+                    ~(uint64_t(1u) << ((cell.x & 3) | (cell.y & 3) << 2 | (cell.z & 3) << 4));
+            }
+        }
+
+        // a cell is occupied when any of its 4^3 cells of the previous level is
+        for (uint32_t l = 0; l + 1 < levels.size(); ++l) {
+            const auto & level = levels[l];
+            for (int32_t z = 0; z < level.size.z; ++z) {
+                for (int32_t y = 0; y < level.size.y; ++y) {
+                    for (int32_t x = 0; x < level.size.x; ++x) {
+                        if (level.words[(size_t(z) * level.size.y + y) * level.size.x + x] != 0u) set(l + 1u, { x, y, z });
+                    }
+                }
+            }
+        }
+    }
+
+    bool OccupancyGrid::is_occupied(const glm::ivec3 & voxel) const {
+        auto cell = voxel - origin;
+        for (uint32_t a = 0; a < 3; ++a) {
+            if (cell[a] < 0 || cell[a] >= size_[a]) return false;
+        }
+        return is_occupied(0u, cell);
+    }
+
+    Hit OccupancyGrid::cast(const Ray & ray) const {
+        Traversal traversal;
+        if (!begin(ray, traversal)) return {};
+        while (true) {
+            if (is_occupied(0u, traversal.voxel)) return hit(traversal);
+            if (!step(traversal)) {
+                Hit miss;
+                miss.steps = traversal.steps;
+                return miss;
+            }
+        }
+    }
+
+    std::vector<Hit> OccupancyGrid::cast(const std::vector<Ray> & rays, uint32_t threads) {
+        PROFILE_ZONE("ray_cast/batch");
+        auto start = std::chrono::steady_clock::now();
+        std::vector<Hit> hits(rays.size());
+        uint32_t blocks = (rays.size() + block_size - 1u) / block_size;
+
+        Helpers::parallel_for(blocks, [&](uint32_t block) {
+            auto end = std::min(size_t(block + 1u) * block_size, rays.size());
+            for (size_t i = size_t(block) * block_size; i < end; ++i) hits[i] = cast(rays[i]);
+        }, threads);
+
+        stats_.rays += rays.size();
+        for (const auto & hit: hits) {
+            stats_.hits += hit.hit;
+            stats_.steps += hit.steps;
+        }
+        stats_.seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        PROFILE_COUNTER("ray_cast/rays", rays.size());
+        return hits;
+    }
+
+    size_t OccupancyGrid::bytes() const {
+        size_t bytes = 0u;
+        for (const auto & level: levels) bytes += level.words.size() * sizeof(uint64_t);
+        return bytes;
+    }
+
+    void OccupancyGrid::print_stats(std::ostream & os) const {
+        os << boost::format("Occupancy grid: %dx%dx%d voxels from (%d, %d, %d), %d levels, %.1f MB")
+            % size_.x % size_.y % size_.z
+            % origin.x % origin.y % origin.z
+            % levels.size()
+            % (bytes() / (1024.0 * 1024.0))
+            << std::endl;
+        auto rays = std::max<uint64_t>(stats_.rays, 1u);
+        os << boost::format("Ray cast: %d rays, %.1f%% hit, %.1f steps per ray in %.3f s (%.2f M rays/s)")
+            % stats_.rays
+            % (100.0 * stats_.hits / rays)
+            % (double(stats_.steps) / rays)
+            % stats_.seconds
+            % (stats_.seconds > 0.0 ? stats_.rays / stats_.seconds / 1e6 : 0.0)
+            << std::endl;
+    }
+
+    bool OccupancyGrid::is_occupied(uint32_t level, const glm::ivec3 & cell) const {
+        const auto & l = levels[level];
+        auto word = cell_of(cell, 2);
+        auto bit = (cell.x & 3) | (cell.y & 3) << 2 | (cell.z & 3) << 4;
+        return (l.words[(size_t(word.z) * l.size.y + word.y) * l.size.x + word.x] >> bit) & 1u;
+    }
+
+    void OccupancyGrid::set(uint32_t level, const glm::ivec3 & cell) {
+        auto & l = levels[level];
+        auto word = cell_of(cell, 2);
+        auto bit = (cell.x & 3) | (cell.y & 3) << 2 | (cell.z & 3) << 4;
+        l.words[(size_t(word.z) * l.size.y + word.y) * l.size.x + word.x] |= uint64_t(1u) << bit;
+    }
+
+    bool OccupancyGrid::begin(const Ray & ray, Traversal & traversal) const {
+        auto length = glm::length(ray.direction);
+        if (!(length > 0.0f)) return false;
+
+        traversal.origin = ray.origin - glm::vec3(origin);
+        traversal.direction = ray.direction / length;
+        for (uint32_t a = 0; a < 3; ++a) {
+            // -0 to +0, so that the ray leaves the cells along an axis it does not move along at +inf
+            if (traversal.direction[a] == 0.0f) traversal.direction[a] = 0.0f;
+            traversal.positive[a] = traversal.direction[a] >= 0.0f;
+        }
+        traversal.inverse = glm::vec3(1.0f) / traversal.direction;
+        traversal.delta = glm::abs(traversal.inverse);
+        traversal.max_distance = ray.max_distance;
+        traversal.level = 0u;
+        traversal.steps = 0u;
+
+        // where the ray enters the bounds, and along which axis
+        float near = std::numeric_limits<float>::lowest();
+        float far = std::numeric_limits<float>::max();
+        uint32_t axis = no_face;
+        for (uint32_t a = 0; a < 3; ++a) {
+            const auto o = traversal.origin[a];
+            const auto d = traversal.direction[a];
+            if (d == 0.0f) {
+                if (o < 0.0f || o >= float(size_[a])) return false;
+                continue;
+            }
+            auto t0 = (0.0f - o) * traversal.inverse[a];
+            auto t1 = (float(size_[a]) - o) * traversal.inverse[a];
+            if (t0 > t1) std::swap(t0, t1);
+            if (t0 > near) {
+                near = t0;
+                axis = a;
+            }
+            far = std::min(far, t1);
+        }
+        if (far <= std::max(near, 0.0f) || near > traversal.max_distance) return false;
+
+        if (near > 0.0f) {
+            auto p = traversal.origin + near * traversal.direction;
+            traversal.voxel = glm::clamp(glm::ivec3(glm::floor(p)), glm::ivec3(0), size_ - 1);
+            traversal.voxel[axis] = traversal.direction[axis] > 0.0f ? 0 : size_[axis] - 1;
+            traversal.distance = near;
+            traversal.face = entered_face(axis, traversal.direction[axis]);
+        }
+        else {
+            traversal.voxel = glm::clamp(glm::ivec3(glm::floor(traversal.origin)), glm::ivec3(0), size_ - 1);
+            traversal.distance = 0.0f;
+            traversal.face = no_face;
+        }
+        start_voxel(traversal);
+        return true;
+    }
+
+    bool OccupancyGrid::step(Traversal & traversal) const {
+        ++traversal.steps;
+        auto & voxel = traversal.voxel;
+
+        // a plain DDA step to the next voxel, while the 4^3 voxels around are not empty
+        if (levels.size() == 1u || is_occupied(1u, cell_of(voxel, 2))) {
+            const auto & t = traversal.next_distance;
+            uint32_t axis = t.x < t.y ? (t.x < t.z ? 0u : 2u) : (t.y < t.z ? 1u : 2u);
+            auto distance = t[axis];
+            if (distance > traversal.max_distance) return false;
+
+            voxel[axis] += traversal.positive[axis] ? 1 : -1;
+            if (uint32_t(voxel[axis]) >= uint32_t(size_[axis])) return false;
+            traversal.next_distance[axis] += traversal.delta[axis];
+            traversal.distance = distance;
+            traversal.face = entered_face(axis, traversal.direction[axis]);
+            traversal.level = 0u;
+            return true;
+        }
+
+        // the largest empty cell around the voxel, searched from the level of the previous skip
+        // as the next cell is often as empty
+        auto level = std::max(traversal.level, 1u);
+        auto from = level;
+        while (level > 1u && is_occupied(level, cell_of(voxel, int32_t(2u * level)))) --level;
+        if (level == from) {
+            while (level + 1u < levels.size() && !is_occupied(level + 1u, cell_of(voxel, int32_t(2u * (level + 1u))))) ++level;
+        }
+        traversal.level = level;
+        auto shift = int32_t(2u * level);
+        auto edge = 1 << shift;
+        auto low = cell_of(voxel, shift) * edge;
+
+        const auto & o = traversal.origin;
+        const auto & positive = traversal.positive;
+        float tx = (float(low.x + positive.x * edge) - o.x) * traversal.inverse.x;
+        float ty = (float(low.y + positive.y * edge) - o.y) * traversal.inverse.y;
+        float tz = (float(low.z + positive.z * edge) - o.z) * traversal.inverse.z;
+        uint32_t axis = tx < ty ? (tx < tz ? 0u : 2u) : (ty < tz ? 1u : 2u);
+        auto distance = std::min(tx, std::min(ty, tz));
+        if (distance > traversal.max_distance) return false;
+
+        // the next voxel across the face the ray leaves through, never stepping back along the other axes
+        auto p = o + distance * traversal.direction;
+        glm::ivec3 next;
+        for (uint32_t a = 0; a < 3; ++a) {
+            // truncating is flooring once clamped into the cell, which never has negative coordinates
+            auto v = std::clamp(int32_t(p[a]), low[a], low[a] + edge - 1);
+            next[a] = positive[a] ? std::max(v, voxel[a]) : std::min(v, voxel[a]);
+        }
+        next[axis] = positive[axis] ? low[axis] + edge : low[axis] - 1;
+        // the cells of the upper levels reach past the bounds
+        uint32_t outside = 0u;
+        for (uint32_t a = 0; a < 3; ++a) outside |= uint32_t(next[a]) >= uint32_t(size_[a]);
+        if (outside) return false;
+
+        voxel = next;
+        traversal.distance = std::max(traversal.distance, distance);
+        traversal.face = entered_face(axis, traversal.direction[axis]);
+        start_voxel(traversal);
+        return true;
+    }
+
+    void OccupancyGrid::start_voxel(Traversal & traversal) const {
+        for (uint32_t a = 0; a < 3; ++a) {
+            traversal.next_distance[a] = (float(traversal.voxel[a] + traversal.positive[a]) - traversal.origin[a]) * traversal.inverse[a];
+        }
+    }
+
+    Hit OccupancyGrid::hit(const Traversal & traversal) const {
+        Hit hit;
+        hit.hit = true;
+        hit.voxel = traversal.voxel + origin;
+        hit.face = traversal.face;
+        hit.distance = traversal.distance;
+        hit.steps = traversal.steps;
+        return hit;
+    }
+}
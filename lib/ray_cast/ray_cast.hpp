@@ -0,0 +1,119 @@
+#ifndef RAY_CAST_HPP
+#define RAY_CAST_HPP
+
+#include <iostream>
+#include <vector>
+#include <array>
+#include <limits>
+#include <chrono>
+#include <boost/format.hpp>
+
+#include <lib/helpers.hpp>
+#include <lib/voxel_renderer/voxel_renderer.hpp>
+#include <lib/profiler/profiler.hpp>
+#include <lib/memory_tracker/memory_tracker.hpp>
+
+namespace RayCast {
+    // the voxel at v spans [v, v + 1) as in geometry.glsl
+    struct Ray {
+        glm::vec3 origin;
+        // need not be normalized, the distances are along the normalized direction
+        glm::vec3 direction;
+        float max_distance = std::numeric_limits<float>::max();
+    };
+
+    // face of the hit voxel which the ray enters through, when it does not start in it
+    static constexpr uint32_t no_face = 6u;
+
+    struct Hit {
+        bool hit = false;
+        glm::ivec3 voxel{ 0 };
+        // in the order of the face mask bits (+z, +x, +y, -x, -y, -z)
+        uint32_t face = no_face;
+        float distance = 0.0f;
+        // cells visited, of any level
+        uint32_t steps = 0u;
+    };
+
+    enum class Solid : uint32_t {
+        // the given voxels, as they are rendered
+        voxels,
+        // every voxel in their bounds but them, as the rock around carved caves
+        complement
+    };
+
+    // Bit occupancy of the bounds of the voxels with 4^3 cells to a 64 bit word, at level 0 for the voxels and
+    // at every next level for the 4^3 cells of the previous one, up to a single word. Rays step voxel by voxel
+    // with a 3D-DDA among occupied voxels, and otherwise through the largest empty cell around the current
+    // voxel, finding the voxel after it from the axis the ray leaves it along, so empty space is crossed
+    // in a few steps at any distance.
+    class OccupancyGrid {
+    public:
+        struct Stats {
+            uint64_t rays = 0u;
+            uint64_t hits = 0u;
+            uint64_t steps = 0u;
+            double seconds = 0.0;
+        };
+
+        OccupancyGrid(const VoxelRenderer::Vertices & vertices, Solid solid = Solid::voxels);
+
+        bool is_occupied(const glm::ivec3 & voxel) const;
+        Hit cast(const Ray & ray) const;
+        // the batch is split into blocks of rays for the threads
+        std::vector<Hit> cast(const std::vector<Ray> & rays, uint32_t threads = 0);
+
+        const glm::ivec3 & min() const { return origin; }
+        const glm::ivec3 & size() const { return size_; }
+        uint32_t level_count() const { return levels.size(); }
+        size_t bytes() const;
+
+        const Stats & stats() const { return stats_; }
+        void print_stats(std::ostream & os = std::cout) const;
+
+    private:
+        struct Level {
+            // of the words
+            glm::ivec3 size;
+            std::vector<uint64_t> words;
+        };
+
+        // the state of a ray between its steps, in the coordinates of the grid
+        struct Traversal {
+            glm::vec3 origin;
+            glm::vec3 direction;
+            glm::vec3 inverse;
+            // distance across a voxel along each axis
+            glm::vec3 delta;
+            // 1 along the axes the ray does not go back along
+            glm::ivec3 positive;
+            glm::ivec3 voxel;
+            // to the next voxel boundary along each axis
+            glm::vec3 next_distance;
+            float distance;
+            float max_distance;
+            uint32_t face;
+            // of the cell of the last skip, 0 after a voxel step
+            uint32_t level;
+            uint32_t steps;
+        };
+
+        glm::ivec3 origin;
+        glm::ivec3 size_;
+        std::vector<Level> levels;
+        Stats stats_;
+
+        bool is_occupied(uint32_t level, const glm::ivec3 & cell) const;
+        void set(uint32_t level, const glm::ivec3 & cell);
+
+        // false when the ray misses the bounds
+        bool begin(const Ray & ray, Traversal & traversal) const;
+        // leaves the voxel, or the largest empty cell around it, false when the ray leaves the bounds or its distance
+        bool step(Traversal & traversal) const;
+        // the distances to the boundaries of a voxel the ray entered anew
+        void start_voxel(Traversal & traversal) const;
+        Hit hit(const Traversal & traversal) const;
+    };
+}
+
+#endif
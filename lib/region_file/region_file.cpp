@@ -0,0 +1,280 @@
+#include <lib/region_file/region_file.hpp>
+
+#include <cstring>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+namespace RegionFile {
+    namespace {
+        constexpr uint64_t payload_alignment = 8u;
+        constexpr uint64_t data_alignment = 4096u;
+        constexpr uint64_t state_mask = 3u;
+
+        uint64_t align(uint64_t v, uint64_t alignment) {
+            return (v + alignment - 1u) / alignment * alignment;
+        }
+
+        std::string error(const std::string & what, const boost::filesystem::path & path) {
+            return (boost::format("%s %s: %s") % what % path.string() % std::strerror(errno)).str();
+        }
+    }
+
+// Region
+
+    bool Region::Layout::operator==(const Layout & other) const {
+        return parameter_hash == other.parameter_hash
+            && chunk_from == other.chunk_from
+            && chunk_to == other.chunk_to
+            && slab_width == other.slab_width;
+    }
+
+    Region::Region(const boost::filesystem::path & path_, const Layout & layout, uint64_t capacity) :
+        path(path_),
+        layout_(layout)
+    {
+        if (layout.slab_width == 0u || layout.chunk_to.x < layout.chunk_from.x || layout.chunk_to.y < layout.chunk_from.y) {
+            throw (boost::format("invalid layout of the region file %s") % path.string()).str();
+        }
+
+        fd = ::open(path.c_str(), O_RDWR | O_CREAT, 0644);
+        if (fd < 0) throw error("failed to open", path);
+
+        try {
+            // the workers inherit the lock, so it is only taken by another coordinator
+            if (::flock(fd, LOCK_EX | LOCK_NB) != 0) {
+                throw (boost::format("the region file %s is used by another process") % path.string()).str();
+            }
+
+            struct stat st;
+            if (::fstat(fd, &st) != 0) throw error("failed to stat", path);
+            if (st.st_size == 0) {
+                create(capacity);
+                return;
+            }
+
+            map(st.st_size);
+            read_layout();
+            if (!(layout_ == layout)) {
+                throw (boost::format("the region file %s was written for other parameters or bounds") % path.string()).str();
+            }
+
+            capacity = align(capacity, data_alignment);
+            if (capacity > header().capacity) {
+                unmap();
+                if (::ftruncate(fd, capacity) != 0) throw error("failed to resize", path);
+                map(capacity);
+                header().capacity = capacity;
+            }
+
+            for (uint32_t i = 0; i < slab_count(); ++i) {
+                auto & s = slab(i);
+                if ((s.state.load() & state_mask) == claimed) s.state.store(pending);
+            }
+        }
+        catch (...) {
+            close();
+            throw;
+        }
+    }
+
+    Region::Region(const boost::filesystem::path & path_) : path(path_) {
+        fd = ::open(path.c_str(), O_RDWR);
+        if (fd < 0) throw error("failed to open", path);
+
+        try {
+            struct stat st;
+            if (::fstat(fd, &st) != 0) throw error("failed to stat", path);
+            if (size_t(st.st_size) < sizeof(Header)) throw (boost::format("%s is not a region file") % path.string()).str();
+            map(st.st_size);
+            read_layout();
+        }
+        catch (...) {
+            close();
+            throw;
+        }
+    }
+
+    Region::~Region() {
+        close();
+    }
+
+    uint32_t Region::slab_count() const {
+        return header().slab_count;
+    }
+
+    std::pair<glm::ivec2, glm::ivec2> Region::slab_chunks(uint32_t slab) const {
+        auto from_x = layout_.chunk_from.x + int32_t(slab * layout_.slab_width);
+        auto to_x = std::min(from_x + int32_t(layout_.slab_width) - 1, layout_.chunk_to.x);
+        return { { from_x, layout_.chunk_from.y }, { to_x, layout_.chunk_to.y } };
+    }
+
+    std::optional<uint32_t> Region::claim(int32_t pid) {
+        for (uint32_t i = 0; i < slab_count(); ++i) {
+            auto & s = slab(i);
+            auto expected = uint64_t(pending);
+            if (!s.state.compare_exchange_strong(expected, claimed_by(pid), std::memory_order_acq_rel)) continue;
+            s.attempts.fetch_add(1u, std::memory_order_relaxed);
+            return i;
+        }
+        return std::nullopt;
+    }
+
+    void Region::complete(uint32_t i) {
+        slab(i).state.store(done, std::memory_order_release);
+    }
+
+    uint32_t Region::release(int32_t pid) {
+        uint32_t released = 0u;
+        for (uint32_t i = 0; i < slab_count(); ++i) {
+            auto expected = claimed_by(pid);
+            if (slab(i).state.compare_exchange_strong(expected, pending, std::memory_order_acq_rel)) ++released;
+        }
+        return released;
+    }
+
+    uint32_t Region::attempts(uint32_t i) const {
+        return slab(i).attempts.load(std::memory_order_relaxed);
+    }
+
+    bool Region::is_ready(const glm::ivec2 & chunk) const {
+        return slot(chunk).ready.load(std::memory_order_acquire) != 0u;
+    }
+
+    void Region::write(const glm::ivec2 & chunk, const VoxelRenderer::Vertices & vertices) {
+        auto bytes = vertices.size() * sizeof(VoxelRenderer::Vertices::value_type);
+        auto & h = header();
+        auto offset = h.data_end.fetch_add(align(bytes, payload_alignment), std::memory_order_relaxed);
+        if (offset + bytes > h.capacity) {
+            throw (boost::format("the region file %s is full (%d bytes)") % path.string() % h.capacity).str();
+        }
+
+        std::memcpy(data + offset, vertices.data(), bytes);
+        auto & s = slot(chunk);
+        s.offset = offset;
+        s.size = vertices.size();
+        s.ready.store(1u, std::memory_order_release);
+    }
+
+    VoxelRenderer::Vertices Region::read(const glm::ivec2 & chunk) const {
+        if (!is_ready(chunk)) {
+            throw (boost::format("chunk (%d, %d) of %s is not generated") % chunk.x % chunk.y % path.string()).str();
+        }
+        const auto & s = slot(chunk);
+        VoxelRenderer::Vertices vertices(s.size);
+        std::memcpy(vertices.data(), data + s.offset, s.size * sizeof(VoxelRenderer::Vertices::value_type));
+        return vertices;
+    }
+
+    Region::Progress Region::progress() const {
+        Progress result;
+        const auto & h = header();
+        result.slabs = h.slab_count;
+        result.chunks = h.chunk_count;
+        result.used_bytes = std::min(h.data_end.load(std::memory_order_relaxed), h.capacity);
+        result.capacity = h.capacity;
+
+        for (uint32_t i = 0; i < h.slab_count; ++i) {
+            auto state = slab(i).state.load(std::memory_order_acquire) & state_mask;
+            if (state == done) ++result.done_slabs;
+            else if (state == claimed) ++result.claimed_slabs;
+        }
+        for (int32_t x = layout_.chunk_from.x; x <= layout_.chunk_to.x; ++x) {
+            for (int32_t y = layout_.chunk_from.y; y <= layout_.chunk_to.y; ++y) {
+                if (!is_ready({ x, y })) continue;
+                ++result.ready_chunks;
+                result.voxels += slot({ x, y }).size;
+            }
+        }
+        return result;
+    }
+
+    void Region::print_stats(std::ostream & os) const {
+        auto p = progress();
+        os << boost::format("Region file: %s") % path.string() << std::endl;
+        os << boost::format("Region slabs: %d done, %d claimed of %d") % p.done_slabs % p.claimed_slabs % p.slabs << std::endl;
+        os << boost::format("Region chunks: %d of %d, %d voxels") % p.ready_chunks % p.chunks % p.voxels << std::endl;
+        os << boost::format("Region bytes: %d of %d (%.1f%%)")
+            % p.used_bytes
+            % p.capacity
+            % (100.0 * p.used_bytes / p.capacity)
+            << std::endl;
+    }
+
+    uint64_t Region::claimed_by(int32_t pid) {
+        return uint64_t(uint32_t(pid)) << state_bits | claimed;
+    }
+
+    Region::Slab & Region::slab(uint32_t i) const {
+        return reinterpret_cast<Slab *>(data + sizeof(Header))[i];
+    }
+
+    Region::Slot & Region::slot(const glm::ivec2 & chunk) const {
+        auto height = uint64_t(layout_.chunk_to.y - layout_.chunk_from.y + 1);
+        auto i = uint64_t(chunk.x - layout_.chunk_from.x) * height + uint64_t(chunk.y - layout_.chunk_from.y);
+        return reinterpret_cast<Slot *>(data + sizeof(Header) + header().slab_count * sizeof(Slab))[i];
+    }
+
+    void Region::map(size_t size) {
+        auto p = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (p == MAP_FAILED) throw error("failed to map", path);
+        data = static_cast<uint8_t *>(p);
+        mapped_size = size;
+    }
+
+    void Region::unmap() {
+        if (data) ::munmap(data, mapped_size);
+        data = nullptr;
+        mapped_size = 0u;
+    }
+
+    void Region::create(uint64_t capacity) {
+        auto width = uint32_t(layout_.chunk_to.x - layout_.chunk_from.x + 1);
+        auto height = uint32_t(layout_.chunk_to.y - layout_.chunk_from.y + 1);
+        auto slabs = (width + layout_.slab_width - 1u) / layout_.slab_width;
+        uint64_t chunks = uint64_t(width) * height;
+        auto data_begin = align(sizeof(Header) + slabs * sizeof(Slab) + chunks * sizeof(Slot), data_alignment);
+        capacity = std::max(align(capacity, data_alignment), data_begin);
+
+        // the file is sparse, and zero is the pending state of the slabs and the slots
+        if (::ftruncate(fd, capacity) != 0) throw error("failed to resize", path);
+        map(capacity);
+
+        auto & h = header();
+        h.version = version;
+        h.parameter_hash = layout_.parameter_hash;
+        h.chunk_from[0] = layout_.chunk_from.x;
+        h.chunk_from[1] = layout_.chunk_from.y;
+        h.chunk_to[0] = layout_.chunk_to.x;
+        h.chunk_to[1] = layout_.chunk_to.y;
+        h.slab_width = layout_.slab_width;
+        h.slab_count = slabs;
+        h.chunk_count = chunks;
+        h.data_begin = data_begin;
+        h.capacity = capacity;
+        h.data_end.store(data_begin);
+        // a file is only reused with the magic, which is written last
+        std::atomic_thread_fence(std::memory_order_release);
+        h.magic = magic;
+    }
+
+    void Region::close() {
+        unmap();
+        if (fd >= 0) ::close(fd);
+        fd = -1;
+    }
+
+    void Region::read_layout() {
+        const auto & h = header();
+        if (h.magic != magic || h.version != version || mapped_size < h.capacity) {
+            throw (boost::format("%s is not a region file of version %d") % path.string() % version).str();
+        }
+        layout_.parameter_hash = h.parameter_hash;
+        layout_.chunk_from = { h.chunk_from[0], h.chunk_from[1] };
+        layout_.chunk_to = { h.chunk_to[0], h.chunk_to[1] };
+        layout_.slab_width = h.slab_width;
+    }
+}
@@ -0,0 +1,134 @@
+#ifndef REGION_FILE_HPP
+#define REGION_FILE_HPP
+
+#include <iostream>
+#include <string>
+#include <atomic>
+#include <optional>
+#include <boost/format.hpp>
+#include <boost/filesystem.hpp>
+
+#include <lib/voxel_renderer/voxel_renderer.hpp>
+
+namespace RegionFile {
+    // Chunks of a region in a file which is mapped shared by the processes generating them. The region is
+    // partitioned into slabs of consecutive columns of chunks, which the processes claim with an atomic
+    // compare and swap in the file, and the payloads of the chunks are allocated by an atomic bump of the end
+    // of the data, so the processes never lock. A slab claimed by a process which died can be released and
+    // claimed again, and the chunks of it which were already written are not generated again.
+    class Region {
+    public:
+        struct Layout {
+            // of the generator, the region file is only reused for the same one
+            uint64_t parameter_hash = 0u;
+            glm::ivec2 chunk_from{ 0 };
+            glm::ivec2 chunk_to{ 0 };
+            // columns of chunks of a slab
+            uint32_t slab_width = 1u;
+
+            bool operator==(const Layout & other) const;
+        };
+
+        struct Progress {
+            uint32_t slabs = 0u;
+            uint32_t done_slabs = 0u;
+            uint32_t claimed_slabs = 0u;
+            uint64_t chunks = 0u;
+            uint64_t ready_chunks = 0u;
+            uint64_t voxels = 0u;
+            uint64_t used_bytes = 0u;
+            uint64_t capacity = 0u;
+        };
+
+        // creates the file, or opens it when it was written with the same layout and grows it to the capacity;
+        // claims of earlier runs are released, as none of their processes can be alive
+        Region(const boost::filesystem::path & path, const Layout & layout, uint64_t capacity);
+        // opens an existing file
+        explicit Region(const boost::filesystem::path & path);
+        ~Region();
+
+        Region(const Region &) = delete;
+        Region & operator=(const Region &) = delete;
+
+        const Layout & layout() const { return layout_; }
+        uint32_t slab_count() const;
+        // chunks of the slab, inclusive
+        std::pair<glm::ivec2, glm::ivec2> slab_chunks(uint32_t slab) const;
+
+        // the first pending slab, which is then claimed by the process
+        std::optional<uint32_t> claim(int32_t pid);
+        void complete(uint32_t slab);
+        // releases the slabs the process claimed and did not complete, returns how many
+        uint32_t release(int32_t pid);
+        // times the slab was claimed, more than once when a process died while generating it
+        uint32_t attempts(uint32_t slab) const;
+
+        bool is_ready(const glm::ivec2 & chunk) const;
+        // throws when the file is full
+        void write(const glm::ivec2 & chunk, const VoxelRenderer::Vertices & vertices);
+        VoxelRenderer::Vertices read(const glm::ivec2 & chunk) const;
+
+        Progress progress() const;
+        void print_stats(std::ostream & os = std::cout) const;
+
+    private:
+        static constexpr uint32_t magic = 0x52505447u; // "TGPR"
+        static constexpr uint32_t version = 1u;
+
+        enum SlabState : uint64_t { pending = 0u, claimed, done };
+        static constexpr uint64_t state_bits = 2u;
+
+        struct Header {
+            uint32_t magic;
+            uint32_t version;
+            uint64_t parameter_hash;
+            int32_t chunk_from[2];
+            int32_t chunk_to[2];
+            uint32_t slab_width;
+            uint32_t slab_count;
+            uint64_t chunk_count;
+            uint64_t data_begin;
+            uint64_t capacity;
+            // of the bump allocation of the payloads
+            std::atomic<uint64_t> data_end;
+        };
+
+        struct Slab {
+            // the state in the low bits and the process which claimed it above them, swapped at once
+            std::atomic<uint64_t> state;
+            std::atomic<uint32_t> attempts;
+            uint32_t padding;
+        };
+
+        struct Slot {
+            uint64_t offset;
+            uint64_t size;
+            // set after the payload is written
+            std::atomic<uint32_t> ready;
+            uint32_t padding;
+        };
+
+        static_assert(std::atomic<uint64_t>::is_always_lock_free, "the processes share the atomics of the file");
+        static_assert(std::atomic<uint32_t>::is_always_lock_free, "the processes share the atomics of the file");
+
+        boost::filesystem::path path;
+        Layout layout_;
+        int fd = -1;
+        uint8_t * data = nullptr;
+        size_t mapped_size = 0u;
+
+        static uint64_t claimed_by(int32_t pid);
+
+        Header & header() const { return *reinterpret_cast<Header *>(data); }
+        Slab & slab(uint32_t i) const;
+        Slot & slot(const glm::ivec2 & chunk) const;
+
+        void create(uint64_t capacity);
+        void map(size_t size);
+        void unmap();
+        void close();
+        void read_layout();
+    };
+}
+
+#endif
@@ -0,0 +1,321 @@
+#include <lib/terrain/terrain.hpp>
+
+namespace Terrain {
+    namespace {
+        using Clock = std::chrono::steady_clock;
+
+        double seconds_since(Clock::time_point start) {
+            return std::chrono::duration<double>(Clock::now() - start).count();
+        }
+
+        glm::ivec3 round(const std::array<GLfloat, 3> & v) {
+            return { int32_t(std::round(v[0])), int32_t(std::round(v[1])), int32_t(std::round(v[2])) };
+        }
+
+        // the voxels of the chunks in x and y
+        struct Bounds {
+            glm::ivec2 min;
+            glm::ivec2 size;
+
+            Bounds(const glm::vec2 & chunk_from, const glm::vec2 & chunk_to) :
+                min(glm::ivec2(chunk_from) * int32_t(CaveGenerator::chunk_size)),
+                size((glm::ivec2(chunk_to) - glm::ivec2(chunk_from) + 1) * int32_t(CaveGenerator::chunk_size))
+            {}
+
+            bool contains(int32_t x, int32_t y) const {
+                return min.x <= x && x < min.x + size.x && min.y <= y && y < min.y + size.y;
+            }
+        };
+
+        // concatenates the voxels of the parts in their order
+        VoxelRenderer::Vertices join(
+            std::vector<VoxelRenderer::Vertices> & parts,
+            std::vector<VoxelRenderer::FaceMasks> & part_masks,
+            VoxelRenderer::FaceMasks & face_masks
+        ) {
+            VoxelRenderer::Vertices vertices;
+            face_masks.clear();
+            for (size_t i = 0; i < parts.size(); ++i) {
+                vertices.insert(vertices.end(), parts[i].begin(), parts[i].end());
+                face_masks.insert(face_masks.end(), part_masks[i].begin(), part_masks[i].end());
+            }
+            return vertices;
+        }
+    }
+
+// Stats
+
+    void Stats::print(const std::string & name, std::ostream & os) const {
+        os << boost::format("Terrain %s: %.1f ms heights, %.1f ms caves, %.1f ms surface, %.1f ms in total")
+            % name
+            % (1e3 * height_seconds)
+            % (1e3 * carve_seconds)
+            % (1e3 * surface_seconds)
+            % (1e3 * seconds())
+            << std::endl;
+        os << boost::format("Terrain %s: %d cave voxels stamped, %d carved, %d of %d voxels examined, %d visible, %.1f M voxels/s")
+            % name
+            % stamped
+            % carved
+            % examined
+            % volume
+            % visible
+            % (seconds() == 0.0 ? 0.0 : volume / seconds() / 1e6)
+            << std::endl;
+    }
+
+// Generator
+
+    Generator::Generator(int32_t seed, const Parameters & parameters_, const CaveGenerator::Parameters & cave_parameters) :
+        parameters(parameters_),
+        cave(seed, cave_parameters)
+    {
+        if (parameters.relief < 0) throw std::string("relief must not be negative");
+        if (parameters.base_height - parameters.relief <= parameters.bottom) throw std::string("the surface must be above the bottom");
+        if (parameters.octaves == 0u || parameters.octaves > 30u) throw std::string("octaves must be in [1, 30]");
+        if (parameters.wavelength <= 0.0f) throw std::string("wavelength must be positive");
+
+        height_noise.SetSeed(seed + 3);
+        height_noise.SetOctaveCount(parameters.octaves);
+        height_noise.SetFrequency(1.0f / parameters.wavelength);
+    }
+
+    int32_t Generator::height(int32_t x, int32_t y) const {
+        auto v = glm::clamp(height_noise.GetValue(x, y, 0.0), -1.0, 1.0);
+        return parameters.base_height + int32_t(std::round(parameters.relief * v));
+    }
+
+    VoxelRenderer::Vertices Generator::generate(
+        const glm::vec2 & chunk_from,
+        const glm::vec2 & chunk_to,
+        VoxelRenderer::FaceMasks & face_masks,
+        bool surface_aware,
+        uint32_t threads
+    ) {
+        PROFILE_ZONE("terrain/generate");
+        MEMORY_SCOPE("terrain/generate");
+        stats_ = {};
+        return surface_aware
+            ? scan_surface(chunk_from, chunk_to, face_masks, threads)
+            : scan_volume(chunk_from, chunk_to, face_masks, threads);
+    }
+
+    int32_t Generator::Columns::at(int32_t x, int32_t y) const {
+        return heights[size_t(y - min.y) * size.x + (x - min.x)];
+    }
+
+    Generator::Columns Generator::make_columns(const glm::vec2 & chunk_from, const glm::vec2 & chunk_to, uint32_t threads) const {
+        PROFILE_ZONE("terrain/heights");
+        Bounds bounds(chunk_from, chunk_to);
+        Columns columns{ bounds.min - 1, bounds.size + 2, {} };
+        columns.heights.resize(size_t(columns.size.x) * columns.size.y);
+        Helpers::parallel_for(columns.size.y, [&](uint32_t yi) {
+            for (int32_t xi = 0; xi < columns.size.x; ++xi) {
+                columns.heights[size_t(yi) * columns.size.x + xi] = height(columns.min.x + xi, columns.min.y + int32_t(yi));
+            }
+        }, threads);
+        return columns;
+    }
+
+    std::vector<VoxelRenderer::Vertices> Generator::carve(
+        const glm::vec2 & chunk_from,
+        const glm::vec2 & chunk_to,
+        const Columns * columns,
+        uint32_t threads
+    ) const {
+        PROFILE_ZONE("terrain/carve");
+        CaveGenerator::FootprintIndex index(cave, chunk_from, chunk_to);
+        const int32_t width = int32_t(chunk_to.x) - int32_t(chunk_from.x) + 1;
+        const int32_t height = int32_t(chunk_to.y) - int32_t(chunk_from.y) + 1;
+
+        std::vector<VoxelRenderer::Vertices> chunks(size_t(width) * height);
+        Helpers::parallel_for(chunks.size(), [&](uint32_t i) {
+            thread_local Arena::MonotonicArena arena("terrain");
+            glm::vec2 chunk{ chunk_from.x + int32_t(i) % width, chunk_from.y + int32_t(i) / width };
+            if (!columns) {
+                cave.generate_chunk(chunk, index, chunks[i], arena);
+                return;
+            }
+
+            CaveGenerator::Surface surface{
+                [columns](int32_t x, int32_t y) { return columns->at(x, y); },
+                std::numeric_limits<int32_t>::lowest()
+            };
+            for (uint32_t y = 0; y < CaveGenerator::chunk_size; ++y) {
+                for (uint32_t x = 0; x < CaveGenerator::chunk_size; ++x) {
+                    surface.max_height = std::max(surface.max_height, columns->at(
+                        int32_t(chunk.x) * CaveGenerator::chunk_size + x,
+                        int32_t(chunk.y) * CaveGenerator::chunk_size + y
+                    ));
+                }
+            }
+            cave.generate_chunk(chunk, index, chunks[i], arena, surface);
+        }, threads);
+        return chunks;
+    }
+
+    VoxelRenderer::Vertices Generator::scan_volume(
+        const glm::vec2 & chunk_from,
+        const glm::vec2 & chunk_to,
+        VoxelRenderer::FaceMasks & face_masks,
+        uint32_t threads
+    ) {
+        auto start = Clock::now();
+        auto columns = make_columns(chunk_from, chunk_to, threads);
+        stats_.height_seconds = seconds_since(start);
+
+        start = Clock::now();
+        auto chunks = carve(chunk_from, chunk_to, nullptr, threads);
+        stats_.carve_seconds = seconds_since(start);
+
+        PROFILE_ZONE("terrain/scan_volume");
+        start = Clock::now();
+        Bounds bounds(chunk_from, chunk_to);
+        auto top = parameters.bottom;
+        for (int32_t y = 0; y < bounds.size.y; ++y) {
+            for (int32_t x = 0; x < bounds.size.x; ++x) top = std::max(top, columns.at(bounds.min.x + x, bounds.min.y + y));
+        }
+        const size_t layer = size_t(bounds.size.x) * bounds.size.y;
+        const int32_t depth = top - parameters.bottom;
+        stats_.volume = layer * depth;
+        auto cell = [&](int32_t x, int32_t y, int32_t z) {
+            return size_t(z - parameters.bottom) * layer + size_t(y - bounds.min.y) * bounds.size.x + (x - bounds.min.x);
+        };
+
+        std::vector<uint8_t> solid(stats_.volume);
+        Helpers::parallel_for(depth, [&](uint32_t zi) {
+            auto z = parameters.bottom + int32_t(zi);
+            for (int32_t y = bounds.min.y; y < bounds.min.y + bounds.size.y; ++y) {
+                for (int32_t x = bounds.min.x; x < bounds.min.x + bounds.size.x; ++x) solid[cell(x, y, z)] = z < columns.at(x, y);
+            }
+        }, threads);
+        for (const auto & chunk: chunks) {
+            stats_.stamped += chunk.size();
+            for (const auto & v: chunk) {
+                auto voxel = round(v);
+                if (!bounds.contains(voxel.x, voxel.y) || voxel.z < parameters.bottom || voxel.z >= top) continue;
+                auto & s = solid[cell(voxel.x, voxel.y, voxel.z)];
+                stats_.carved += s;
+                s = 0u;
+            }
+        }
+
+        // the columns around the chunks are not carved
+        auto is_solid = [&](const glm::ivec3 & v) -> bool {
+            if (v.z < parameters.bottom) return true;
+            if (v.z < top && bounds.contains(v.x, v.y)) return solid[cell(v.x, v.y, v.z)];
+            return v.z < columns.at(v.x, v.y);
+        };
+
+        std::vector<VoxelRenderer::Vertices> layers(depth);
+        std::vector<VoxelRenderer::FaceMasks> layer_masks(depth);
+        Helpers::parallel_for(depth, [&](uint32_t zi) {
+            auto z = parameters.bottom + int32_t(zi);
+            for (int32_t y = bounds.min.y; y < bounds.min.y + bounds.size.y; ++y) {
+                for (int32_t x = bounds.min.x; x < bounds.min.x + bounds.size.x; ++x) {
+                    if (!solid[cell(x, y, z)]) continue;
+                    GLubyte mask = 0u;
+                    for (uint32_t i = 0; i < 6u; ++i) {
+                        if (!is_solid(glm::ivec3(x, y, z) + VoxelRenderer::VerticesOptimizer::face_directions[i])) mask |= 1u << i;
+                    }
+                    if (mask == 0u) continue;
+                    layers[zi].push_back({ GLfloat(x), GLfloat(y), GLfloat(z) });
+                    layer_masks[zi].push_back(mask);
+                }
+            }
+        }, threads);
+        stats_.examined = stats_.volume;
+
+        auto vertices = join(layers, layer_masks, face_masks);
+        stats_.visible = vertices.size();
+        stats_.surface_seconds = seconds_since(start);
+        return vertices;
+    }
+
+    VoxelRenderer::Vertices Generator::scan_surface(
+        const glm::vec2 & chunk_from,
+        const glm::vec2 & chunk_to,
+        VoxelRenderer::FaceMasks & face_masks,
+        uint32_t threads
+    ) {
+        auto start = Clock::now();
+        auto columns = make_columns(chunk_from, chunk_to, threads);
+        stats_.height_seconds = seconds_since(start);
+
+        start = Clock::now();
+        auto chunks = carve(chunk_from, chunk_to, &columns, threads);
+        stats_.carve_seconds = seconds_since(start);
+
+        PROFILE_ZONE("terrain/scan_surface");
+        start = Clock::now();
+        Bounds bounds(chunk_from, chunk_to);
+        auto top = parameters.bottom;
+        for (int32_t y = 0; y < bounds.size.y; ++y) {
+            for (int32_t x = 0; x < bounds.size.x; ++x) top = std::max(top, columns.at(bounds.min.x + x, bounds.min.y + y));
+        }
+        stats_.volume = size_t(bounds.size.x) * bounds.size.y * (top - parameters.bottom);
+
+        VoxelSet carved;
+        for (const auto & chunk: chunks) {
+            stats_.stamped += chunk.size();
+            for (const auto & v: chunk) {
+                auto voxel = round(v);
+                if (!bounds.contains(voxel.x, voxel.y) || voxel.z < parameters.bottom) continue;
+                carved.insert(VoxelRenderer::VerticesOptimizer::pack(voxel.x, voxel.y, voxel.z));
+            }
+        }
+        stats_.carved = carved.size();
+
+        auto is_solid = [&](const glm::ivec3 & v) -> bool {
+            if (v.z < parameters.bottom) return true;
+            if (v.z >= columns.at(v.x, v.y)) return false;
+            return !bounds.contains(v.x, v.y) || carved.count(VoxelRenderer::VerticesOptimizer::pack(v.x, v.y, v.z)) == 0u;
+        };
+
+        // a voxel is exposed either to a lower column next to it, or to a cave
+        std::vector<uint64_t> candidates;
+        for (int32_t y = bounds.min.y; y < bounds.min.y + bounds.size.y; ++y) {
+            for (int32_t x = bounds.min.x; x < bounds.min.x + bounds.size.x; ++x) {
+                auto h = columns.at(x, y);
+                auto low = std::min({ h - 1, columns.at(x - 1, y), columns.at(x + 1, y), columns.at(x, y - 1), columns.at(x, y + 1) });
+                for (auto z = std::max(low, parameters.bottom); z < h; ++z) {
+                    candidates.push_back(VoxelRenderer::VerticesOptimizer::pack(x, y, z));
+                }
+            }
+        }
+        for (auto key: carved) {
+            auto voxel = VoxelRenderer::VerticesOptimizer::unpack(key);
+            for (const auto & direction: VoxelRenderer::VerticesOptimizer::face_directions) {
+                auto v = voxel + direction;
+                if (bounds.contains(v.x, v.y) && v.z >= parameters.bottom) candidates.push_back(VoxelRenderer::VerticesOptimizer::pack(v.x, v.y, v.z));
+            }
+        }
+        // the keys sort by z, y and x
+        std::sort(candidates.begin(), candidates.end());
+        candidates.erase(std::unique(candidates.begin(), candidates.end()), candidates.end());
+        stats_.examined = candidates.size();
+
+        auto parts = std::max<size_t>(1u, std::min<size_t>(Helpers::thread_count(threads) * 4u, candidates.size()));
+        std::vector<VoxelRenderer::Vertices> part_vertices(parts);
+        std::vector<VoxelRenderer::FaceMasks> part_masks(parts);
+        Helpers::parallel_for(parts, [&](uint32_t part) {
+            auto end = candidates.size() * (part + 1) / parts;
+            for (auto i = candidates.size() * part / parts; i < end; ++i) {
+                auto voxel = VoxelRenderer::VerticesOptimizer::unpack(candidates[i]);
+                if (!is_solid(voxel)) continue;
+                GLubyte mask = 0u;
+                for (uint32_t f = 0; f < 6u; ++f) {
+                    if (!is_solid(voxel + VoxelRenderer::VerticesOptimizer::face_directions[f])) mask |= 1u << f;
+                }
+                if (mask == 0u) continue;
+                part_vertices[part].push_back({ GLfloat(voxel.x), GLfloat(voxel.y), GLfloat(voxel.z) });
+                part_masks[part].push_back(mask);
+            }
+        }, threads);
+
+        auto vertices = join(part_vertices, part_masks, face_masks);
+        stats_.visible = vertices.size();
+        stats_.surface_seconds = seconds_since(start);
+        return vertices;
+    }
+}
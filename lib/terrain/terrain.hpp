@@ -0,0 +1,109 @@
+#ifndef TERRAIN_HPP
+#define TERRAIN_HPP
+
+#include <iostream>
+#include <vector>
+#include <chrono>
+#include <algorithm>
+#include <unordered_set>
+#include <noise/noise.h>
+#include <boost/format.hpp>
+
+#include <lib/helpers.hpp>
+#include <lib/cave_generator/cave_generator.hpp>
+#include <lib/voxel_renderer/voxel_renderer.hpp>
+#include <lib/profiler/profiler.hpp>
+#include <lib/memory_tracker/memory_tracker.hpp>
+#include <lib/arena/arena.hpp>
+
+namespace Terrain {
+    struct Parameters {
+        // the voxels below are bedrock, which the caves do not carve
+        int32_t bottom = -64;
+        // the heights of the columns are base_height +- relief
+        int32_t base_height = 160;
+        int32_t relief = 48;
+        uint32_t octaves = 6u;
+        float wavelength = 200.0f;
+    };
+
+    struct Stats {
+        double height_seconds = 0.0;
+        double carve_seconds = 0.0;
+        double surface_seconds = 0.0;
+        // the voxels of the region from the bottom to its highest column
+        uint64_t volume = 0u;
+        // the wall voxels stamped by the caves, and the solid voxels they carved
+        uint64_t stamped = 0u;
+        uint64_t carved = 0u;
+        // the voxels which were tested for being visible
+        uint64_t examined = 0u;
+        uint64_t visible = 0u;
+
+        double seconds() const { return height_seconds + carve_seconds + surface_seconds; }
+        void print(const std::string & name, std::ostream & os = std::cout) const;
+    };
+
+    // A heightmap of Perlin noise with the caves of CaveGenerator carved out of it. The whole volume can be
+    // carved and scanned for the voxels which are exposed, or only the voxels under the surface are carved and
+    // only the ones near the surface or near a cave are tested, which gives the same voxels.
+    class Generator {
+    public:
+        Generator(int32_t seed, const Parameters & parameters_ = {}, const CaveGenerator::Parameters & cave_parameters = {});
+
+        int32_t height(int32_t x, int32_t y) const;
+        const CaveGenerator::Generator & caves() const { return cave; }
+
+        // the visible voxels of the chunks sorted by z, y and x, and which of their faces are exposed
+        VoxelRenderer::Vertices generate(
+            const glm::vec2 & chunk_from,
+            const glm::vec2 & chunk_to,
+            VoxelRenderer::FaceMasks & face_masks,
+            bool surface_aware = true,
+            uint32_t threads = 0
+        );
+
+        // of the last generate
+        const Stats & stats() const { return stats_; }
+
+    private:
+        using VoxelSet = std::unordered_set<uint64_t, VoxelRenderer::VerticesOptimizer::VoxelHash>;
+
+        // the columns of the chunks and a border of one column around them
+        struct Columns {
+            glm::ivec2 min;
+            glm::ivec2 size;
+            std::vector<int32_t> heights;
+
+            int32_t at(int32_t x, int32_t y) const;
+        };
+
+        Parameters parameters;
+        CaveGenerator::Generator cave;
+        noise::module::Perlin height_noise;
+        Stats stats_;
+
+        Columns make_columns(const glm::vec2 & chunk_from, const glm::vec2 & chunk_to, uint32_t threads) const;
+        // the wall voxels of every chunk, only under the surface when the columns are given
+        std::vector<VoxelRenderer::Vertices> carve(
+            const glm::vec2 & chunk_from,
+            const glm::vec2 & chunk_to,
+            const Columns * columns,
+            uint32_t threads
+        ) const;
+        VoxelRenderer::Vertices scan_volume(
+            const glm::vec2 & chunk_from,
+            const glm::vec2 & chunk_to,
+            VoxelRenderer::FaceMasks & face_masks,
+            uint32_t threads
+        );
+        VoxelRenderer::Vertices scan_surface(
+            const glm::vec2 & chunk_from,
+            const glm::vec2 & chunk_to,
+            VoxelRenderer::FaceMasks & face_masks,
+            uint32_t threads
+        );
+    };
+}
+
+#endif
@@ -0,0 +1,104 @@
+#include <lib/voxel_renderer/ambient_occlusion.hpp>
+
+namespace VoxelRenderer {
+    namespace {
+        // the corners of the cube of geometry.glsl
+        const std::array<glm::ivec3, 8> cube_vertices{ {
+            { 1, 1, 1 }, { 0, 1, 1 }, { 0, 0, 1 }, { 1, 0, 1 },
+            { 1, 0, 0 }, { 1, 1, 0 }, { 0, 1, 0 }, { 0, 0, 0 }
+        } };
+        // the 4 distinct corners of the 2 triangles of each face of geometry.glsl, (a, b, c) and (a, c, d)
+        const std::array<std::array<uint32_t, 4>, 6> face_corners{ {
+            { 0, 1, 2, 3 },
+            { 0, 3, 4, 5 },
+            { 0, 5, 6, 1 },
+            { 1, 6, 7, 2 },
+            { 7, 4, 3, 2 },
+            { 4, 7, 6, 5 }
+        } };
+
+        // bits of the 2 voxels along the edges and the diagonal one, in front of each corner of each face
+        struct CornerNeighbours {
+            uint32_t side1;
+            uint32_t side2;
+            uint32_t diagonal;
+        };
+
+        std::array<std::array<CornerNeighbours, 4>, 6> make_corner_neighbours() {
+            std::array<std::array<CornerNeighbours, 4>, 6> table;
+            for (uint32_t i = 0; i < 6; ++i) {
+                const auto & n = VerticesOptimizer::face_directions[i];
+                for (uint32_t k = 0; k < 4; ++k) {
+                    const auto & corner = cube_vertices[face_corners[i][k]];
+                    // towards the corner along the 2 axes of the face
+                    std::array<glm::ivec3, 2> tangents;
+                    uint32_t t = 0u;
+                    for (int32_t a = 0; a < 3; ++a) {
+                        if (n[a] != 0) continue;
+                        glm::ivec3 d(0);
+                        d[a] = corner[a] == 1 ? 1 : -1;
+                        tangents[t++] = d;
+                    }
+                    table[i][k] = {
+                        AmbientOcclusion::neighbour_bit(n + tangents[0]),
+                        AmbientOcclusion::neighbour_bit(n + tangents[1]),
+                        AmbientOcclusion::neighbour_bit(n + tangents[0] + tangents[1])
+                    };
+                }
+            }
+            return table;
+        }
+
+        const auto corner_neighbours = make_corner_neighbours();
+
+        // by the 6 face bits of a face mask
+        std::array<uint32_t, 64> make_required_neighbours() {
+            std::array<uint32_t, 64> table;
+            for (uint32_t mask = 0; mask < table.size(); ++mask) {
+                table[mask] = 0u;
+                for (uint32_t i = 0; i < 6; ++i) {
+                    if ((mask & (1u << i)) == 0u) continue;
+                    for (const auto & c: corner_neighbours[i]) {
+                        table[mask] |= (1u << c.side1) | (1u << c.side2) | (1u << c.diagonal);
+                    }
+                }
+            }
+            return table;
+        }
+
+        const auto required_neighbours_table = make_required_neighbours();
+    }
+
+// AmbientOcclusion
+
+    uint32_t AmbientOcclusion::required_neighbours(GLubyte face_mask) {
+        return required_neighbours_table[face_mask & face_bits];
+    }
+
+    Occlusion AmbientOcclusion::occlusion(uint32_t neighbourhood, GLubyte face_mask) {
+        Occlusion result{ 0u, 0u };
+        for (uint32_t i = 0; i < 6; ++i) {
+            if ((face_mask & (1u << i)) == 0u) continue;
+            for (uint32_t k = 0; k < 4; ++k) {
+                const auto & c = corner_neighbours[i][k];
+                uint32_t side1 = neighbourhood >> c.side1 & 1u;
+                uint32_t side2 = neighbourhood >> c.side2 & 1u;
+                uint32_t diagonal = neighbourhood >> c.diagonal & 1u;
+                // the diagonal can not be seen between 2 occupied edges
+                uint32_t level = side1 & side2 ? 3u : side1 + side2 + diagonal;
+                result[i >> 2] |= level << ((i & 3u) * 8u + k * 2u);
+            }
+        }
+        return result;
+    }
+
+    void AmbientOcclusion::print_stats(std::ostream & os) const {
+        auto millions = stats_.faces / 1e6;
+        os << boost::format("Ambient occlusion: %d faces of %d voxels in %.3f s (%.3f s per million faces)")
+            % stats_.faces
+            % stats_.voxels
+            % stats_.seconds
+            % (millions > 0.0 ? stats_.seconds / millions : 0.0)
+            << std::endl;
+    }
+}
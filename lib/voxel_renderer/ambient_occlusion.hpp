@@ -0,0 +1,81 @@
+#ifndef AMBIENT_OCCLUSION_HPP
+#define AMBIENT_OCCLUSION_HPP
+
+#include <chrono>
+
+#include <lib/helpers.hpp>
+#include <lib/voxel_renderer/voxel_renderer.hpp>
+
+namespace VoxelRenderer {
+    // Voxel ambient occlusion of the corners of the faces, from the 2 voxels along the edges of a corner
+    // and the one diagonal to it in front of the face: 0 when none of them is occupied, up to 3 when both
+    // of the edges are. The neighbours in front of the exposed faces are looked up once into a bit set,
+    // and the levels of their corners are taken from it.
+    class AmbientOcclusion {
+    public:
+        // voxels are baked in parallel blocks of this many
+        static constexpr uint32_t block_size = 4096u;
+
+        struct Stats {
+            uint64_t voxels = 0u;
+            uint64_t faces = 0u;
+            double seconds = 0.0;
+        };
+
+        // bit of the neighbour at the offset in [-1, 1]^3
+        static uint32_t neighbour_bit(const glm::ivec3 & d) {
+            return uint32_t(d.x + 1) + 3u * uint32_t(d.y + 1) + 9u * uint32_t(d.z + 1);
+        }
+
+        static glm::ivec3 neighbour_offset(uint32_t bit) {
+            return { int32_t(bit % 3u) - 1, int32_t(bit / 3u % 3u) - 1, int32_t(bit / 9u) - 1 };
+        }
+
+        // the bits of the neighbours which the corners of the exposed faces depend on
+        static uint32_t required_neighbours(GLubyte face_mask);
+
+        template<typename Occupied>
+        static uint32_t neighbourhood(const glm::ivec3 & v, GLubyte face_mask, Occupied occupied) {
+            uint32_t bits = 0u;
+            for (auto wanted = required_neighbours(face_mask); wanted != 0u; wanted &= wanted - 1u) {
+                auto bit = uint32_t(__builtin_ctz(wanted));
+                bits |= uint32_t(occupied(v + neighbour_offset(bit))) << bit;
+            }
+            return bits;
+        }
+
+        // levels of the corners of the exposed faces, 0 for the others
+        static Occlusion occlusion(uint32_t neighbourhood, GLubyte face_mask);
+
+        // the occlusions of the visible voxels, looking up the occupancy of their neighbours concurrently
+        template<typename Occupied>
+        Occlusions bake(const Vertices & vertices, const FaceMasks & face_masks, Occupied occupied, uint32_t threads = 0) {
+            PROFILE_ZONE("ambient_occlusion/bake");
+            MEMORY_SCOPE("ambient_occlusion");
+            auto start = std::chrono::steady_clock::now();
+            Occlusions occlusions(vertices.size());
+            uint32_t blocks = (vertices.size() + block_size - 1u) / block_size;
+            Helpers::parallel_for(blocks, [&](uint32_t block) {
+                auto end = std::min<size_t>(size_t(block + 1u) * block_size, vertices.size());
+                for (size_t i = size_t(block) * block_size; i < end; ++i) {
+                    glm::ivec3 v{ int32_t(std::round(vertices[i][0])), int32_t(std::round(vertices[i][1])), int32_t(std::round(vertices[i][2])) };
+                    occlusions[i] = occlusion(neighbourhood(v, face_masks[i], occupied), face_masks[i]);
+                }
+            }, threads);
+
+            stats_.voxels += vertices.size();
+            for (auto mask: face_masks) stats_.faces += __builtin_popcount(mask & face_bits);
+            stats_.seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            return occlusions;
+        }
+
+        const Stats & stats() const { return stats_; }
+        void print_stats(std::ostream & os = std::cout) const;
+
+    private:
+        static constexpr GLubyte face_bits = 0x3fu;
+        Stats stats_;
+    };
+}
+
+#endif
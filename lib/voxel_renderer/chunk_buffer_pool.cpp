@@ -0,0 +1,198 @@
+#include <lib/voxel_renderer/chunk_buffer_pool.hpp>
+
+namespace VoxelRenderer {
+    ChunkBufferPool::ChunkBufferPool(const ShaderInfo & info, uint32_t page_count_) :
+        page_count(page_count_)
+    {
+        MEMORY_SCOPE("renderer/chunk_buffer_pool");
+        glGenVertexArrays(1, vao);
+        glGenBuffers(3, vbo);
+        glBindVertexArray(vao[0]);
+
+        // contents are only ever given through mapped ranges
+        glBindBuffer(GL_ARRAY_BUFFER, vbo[0]);
+        glBufferData(GL_ARRAY_BUFFER, GLsizeiptr(page_count) * page_size * sizeof(Vertices::value_type), nullptr, GL_DYNAMIC_DRAW);
+        glEnableVertexAttribArray(info.attribute.position_location);
+        glVertexAttribPointer(info.attribute.position_location, 3, GL_FLOAT, GL_FALSE, 0, nullptr);
+
+        glBindBuffer(GL_ARRAY_BUFFER, vbo[1]);
+        glBufferData(GL_ARRAY_BUFFER, GLsizeiptr(page_count) * page_size * sizeof(FaceMasks::value_type), nullptr, GL_DYNAMIC_DRAW);
+        glEnableVertexAttribArray(info.attribute.face_mask_location);
+        glVertexAttribIPointer(info.attribute.face_mask_location, 1, GL_UNSIGNED_BYTE, 0, nullptr);
+
+        glBindBuffer(GL_ARRAY_BUFFER, vbo[2]);
+        glBufferData(GL_ARRAY_BUFFER, GLsizeiptr(page_count) * page_size * sizeof(Occlusions::value_type), nullptr, GL_DYNAMIC_DRAW);
+        glEnableVertexAttribArray(info.attribute.occlusion_location);
+        glVertexAttribIPointer(info.attribute.occlusion_location, 2, GL_UNSIGNED_INT, 0, nullptr);
+        glBindVertexArray(0);
+
+        // pages are handed out from the front of the buffer first
+        for (uint32_t i = page_count; i > 0; --i) free_pages_.push_back(i - 1);
+    }
+
+    ChunkBufferPool::~ChunkBufferPool() {
+        glDeleteBuffers(3, vbo);
+        glDeleteVertexArrays(1, vao);
+    }
+
+    void ChunkBufferPool::upload(uint64_t key, const Vertices & vertices, const FaceMasks & face_masks, const Occlusions & occlusions) {
+        PROFILE_ZONE("renderer/chunk_upload");
+        auto start = std::chrono::steady_clock::now();
+        if (vertices.size() != face_masks.size()) throw std::string("every vertex needs a face mask");
+        if (!occlusions.empty() && occlusions.size() != vertices.size()) throw std::string("every vertex needs an occlusion");
+        uint32_t page_needed = (vertices.size() + page_size - 1) / page_size;
+        if (page_needed > page_count) {
+            throw (boost::format("a chunk of %d voxels does not fit in %d pages") % vertices.size() % page_count).str();
+        }
+
+        if (release(key)) ++stats_.reuploaded_chunks;
+        while (free_pages_.size() < page_needed) evict_least_recently_drawn();
+
+        Chunk chunk{ {}, uint32_t(vertices.size()), glm::vec3(0.0f), glm::vec3(0.0f), stats_.frames };
+        for (uint32_t i = 0; i < page_needed; ++i) {
+            chunk.pages.push_back(free_pages_.back());
+            free_pages_.pop_back();
+        }
+        if (!vertices.empty()) {
+            auto clip = Renderer::make_clip(vertices);
+            // a voxel spans its position to the position + its scale
+            uint32_t scale = 1u;
+            for (auto mask: face_masks) scale = std::max(scale, voxel_scale(mask));
+            chunk.min = clip.min;
+            chunk.max = clip.max + glm::vec3(scale);
+        }
+
+        write_pages(vbo[0], chunk.pages, vertices.data(), sizeof(Vertices::value_type), vertices.size());
+        write_pages(vbo[1], chunk.pages, face_masks.data(), sizeof(FaceMasks::value_type), face_masks.size());
+        // the pages may hold the levels of a previous owner
+        if (occlusions.empty()) {
+            Occlusions unoccluded(vertices.size(), Occlusion{ 0u, 0u });
+            write_pages(vbo[2], chunk.pages, unoccluded.data(), sizeof(Occlusions::value_type), unoccluded.size());
+        }
+        else {
+            write_pages(vbo[2], chunk.pages, occlusions.data(), sizeof(Occlusions::value_type), occlusions.size());
+        }
+        chunks[key] = std::move(chunk);
+
+        auto bytes = vertices.size() * (sizeof(Vertices::value_type) + sizeof(FaceMasks::value_type) + sizeof(Occlusions::value_type));
+        PROFILE_COUNTER("renderer/chunk_upload_bytes", bytes);
+        ++stats_.uploaded_chunks;
+        stats_.uploaded_bytes += bytes;
+        stats_.upload_seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    void ChunkBufferPool::evict(uint64_t key) {
+        if (release(key)) ++stats_.evicted_chunks;
+    }
+
+    void ChunkBufferPool::draw(const glm::mat4 & mvp) {
+        PROFILE_ZONE("renderer/chunk_draw");
+        firsts.clear();
+        counts.clear();
+        ++stats_.frames;
+
+        for (auto & entry: chunks) {
+            auto & chunk = entry.second;
+            if (chunk.size == 0u || !is_in_frustum(chunk, mvp)) continue;
+            chunk.last_drawn = stats_.frames;
+
+            // consecutive pages are merged into one range
+            for (uint32_t i = 0; i < chunk.pages.size(); ++i) {
+                GLint first = chunk.pages[i] * page_size;
+                GLsizei count = std::min(page_size, chunk.size - i * page_size);
+                if (!firsts.empty() && firsts.back() + counts.back() == first && counts.back() % page_size == 0) {
+                    counts.back() += count;
+                }
+                else {
+                    firsts.push_back(first);
+                    counts.push_back(count);
+                }
+                stats_.drawn_voxels += count;
+            }
+        }
+        if (firsts.empty()) return;
+
+        glBindVertexArray(vao[0]);
+        glMultiDrawArrays(GL_POINTS, firsts.data(), counts.data(), firsts.size());
+        glBindVertexArray(0);
+        ++stats_.draw_calls;
+        stats_.drawn_ranges += firsts.size();
+        PROFILE_COUNTER("renderer/chunk_draw_ranges", firsts.size());
+    }
+
+    void ChunkBufferPool::print_stats(std::ostream & os) const {
+        auto megabytes = stats_.uploaded_bytes / (1024.0 * 1024.0);
+        auto frames = std::max<uint64_t>(stats_.frames, 1u);
+        os << boost::format("Chunk buffer pool: %d chunks uploaded (%d again), %.1f MB in %.3f s (%.1f MB/s), %d evicted, %d of %d pages free")
+            % stats_.uploaded_chunks
+            % stats_.reuploaded_chunks
+            % megabytes
+            % stats_.upload_seconds
+            % (stats_.upload_seconds > 0.0 ? megabytes / stats_.upload_seconds : 0.0)
+            % stats_.evicted_chunks
+            % free_pages_.size()
+            % page_count
+            << std::endl;
+        os << boost::format("Chunk buffer pool: %d frames, %.2f draw calls, %.1f ranges and %.0f voxels per frame")
+            % stats_.frames
+            % (double(stats_.draw_calls) / frames)
+            % (double(stats_.drawn_ranges) / frames)
+            % (double(stats_.drawn_voxels) / frames)
+            << std::endl;
+    }
+
+    void ChunkBufferPool::write_pages(GLuint buffer, const std::vector<uint32_t> & pages, const void * data, size_t element_size, size_t size) {
+        glBindBuffer(GL_ARRAY_BUFFER, buffer);
+        auto bytes = static_cast<const uint8_t *>(data);
+        for (uint32_t i = 0; i < pages.size(); ++i) {
+            auto count = std::min<size_t>(page_size, size - size_t(i) * page_size);
+            auto * p = glMapBufferRange(
+                GL_ARRAY_BUFFER,
+                GLintptr(pages[i]) * page_size * element_size,
+                count * element_size,
+                GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT
+            );
+            if (!p) throw (boost::format("glMapBufferRange failed: 0x%x") % glGetError()).str();
+            std::memcpy(p, bytes + size_t(i) * page_size * element_size, count * element_size);
+            glUnmapBuffer(GL_ARRAY_BUFFER);
+        }
+    }
+
+    bool ChunkBufferPool::release(uint64_t key) {
+        auto it = chunks.find(key);
+        if (it == chunks.end()) return false;
+        free_pages_.insert(free_pages_.end(), it->second.pages.rbegin(), it->second.pages.rend());
+        chunks.erase(it);
+        return true;
+    }
+
+    void ChunkBufferPool::evict_least_recently_drawn() {
+        if (chunks.empty()) throw std::string("no chunk to evict");
+        auto victim = chunks.begin();
+        for (auto it = chunks.begin(); it != chunks.end(); ++it) {
+            if (it->second.last_drawn < victim->second.last_drawn) victim = it;
+        }
+        evict(victim->first);
+    }
+
+    bool ChunkBufferPool::is_in_frustum(const Chunk & chunk, const glm::mat4 & mvp) {
+        // outside when all the corners are beyond the same clip plane
+        uint32_t outside[6] = { 0u, 0u, 0u, 0u, 0u, 0u };
+        for (uint32_t i = 0; i < 8; ++i) {
+            glm::vec4 corner(
+                i & 1u ? chunk.max.x : chunk.min.x,
+                i & 2u ? chunk.max.y : chunk.min.y,
+                i & 4u ? chunk.max.z : chunk.min.z,
+                1.0f
+            );
+            auto p = mvp * corner;
+            outside[0] += p.x < -p.w;
+            outside[1] += p.x > p.w;
+            outside[2] += p.y < -p.w;
+            outside[3] += p.y > p.w;
+            outside[4] += p.z < -p.w;
+            outside[5] += p.z > p.w;
+        }
+        return std::none_of(std::begin(outside), std::end(outside), [](auto n) { return n == 8u; });
+    }
+}
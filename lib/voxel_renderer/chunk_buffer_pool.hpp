@@ -0,0 +1,78 @@
+#ifndef CHUNK_BUFFER_POOL_HPP
+#define CHUNK_BUFFER_POOL_HPP
+
+#include <chrono>
+#include <cstring>
+#include <unordered_map>
+
+#include <lib/voxel_renderer/voxel_renderer.hpp>
+
+namespace VoxelRenderer {
+    // Fixed-size pages of a position buffer, a face mask buffer and an occlusion buffer, handed out to chunks.
+    // A chunk is written through mapped page ranges which are invalidated first, so the driver does not
+    // wait for the draws of the previous owner of a page, and the pages of all the chunks in the view
+    // frustum are drawn with a single glMultiDrawArrays.
+    class ChunkBufferPool {
+    public:
+        static constexpr uint32_t page_size = 4096u; // voxels
+
+        struct Stats {
+            uint64_t uploaded_chunks = 0u;
+            uint64_t uploaded_bytes = 0u;
+            double upload_seconds = 0.0;
+            uint64_t evicted_chunks = 0u;
+            // uploaded again over their own pages, not counted as evicted
+            uint64_t reuploaded_chunks = 0u;
+            uint64_t frames = 0u;
+            uint64_t draw_calls = 0u;
+            uint64_t drawn_ranges = 0u;
+            uint64_t drawn_voxels = 0u;
+        };
+
+        ChunkBufferPool(const ShaderInfo & info, uint32_t page_count_ = 1024u);
+        ~ChunkBufferPool();
+
+        ChunkBufferPool(const ChunkBufferPool &) = delete;
+        ChunkBufferPool & operator=(const ChunkBufferPool &) = delete;
+
+        bool contains(uint64_t key) const { return chunks.count(key) != 0u; }
+        // evicts the least recently drawn chunks while there are not enough free pages, and the chunk is
+        // not occluded when the occlusions are empty
+        void upload(uint64_t key, const Vertices & vertices, const FaceMasks & face_masks, const Occlusions & occlusions = {});
+        void evict(uint64_t key);
+
+        // the uniforms of the program have to be bound already
+        void draw(const glm::mat4 & mvp);
+
+        size_t resident_chunks() const { return chunks.size(); }
+        size_t free_pages() const { return free_pages_.size(); }
+        const Stats & stats() const { return stats_; }
+        void print_stats(std::ostream & os = std::cout) const;
+
+    private:
+        struct Chunk {
+            std::vector<uint32_t> pages;
+            uint32_t size;
+            glm::vec3 min;
+            glm::vec3 max;
+            uint64_t last_drawn;
+        };
+
+        uint32_t page_count;
+        GLuint vao[1];
+        GLuint vbo[3];
+        std::vector<uint32_t> free_pages_;
+        std::unordered_map<uint64_t, Chunk> chunks;
+        std::vector<GLint> firsts;
+        std::vector<GLsizei> counts;
+        Stats stats_;
+
+        void write_pages(GLuint buffer, const std::vector<uint32_t> & pages, const void * data, size_t element_size, size_t size);
+        // frees the pages of the chunk, false when it is not resident
+        bool release(uint64_t key);
+        void evict_least_recently_drawn();
+        static bool is_in_frustum(const Chunk & chunk, const glm::mat4 & mvp);
+    };
+}
+
+#endif
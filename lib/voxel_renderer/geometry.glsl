@@ -2,6 +2,8 @@
 
 layout(points) in;
 layout(triangle_strip, max_vertices = 18) out;
+flat in uint v_face_mask[];
+flat in uvec2 v_occlusion[];
 out vec3 face_color;
 
 uniform mat4 model;
@@ -40,22 +42,34 @@ const vec4 face_color_base = vec4(0.5, 0.5, 0.5, 1.0);
 vec3 camera_direction = normalize(-1.0 * camera_position - camera_target);
 vec3 half_vector = normalize(light_direction + camera_direction);
 
-void display_face(int i) {
-    for (int j=0; j<3; j++) {
-        gl_Position = mvp * (gl_in[0].gl_Position + vec4(vertices[faces[j + i*6]], 0.0));
-        EmitVertex();
-    }
-    EndPrimitive();
+// bits 6 and 7 of the face mask are log2 of the edge of the cube
+float scale = float(1u << (v_face_mask[0] >> 6u));
+
+// the distinct corner of each vertex of the 2 triangles of a face, in the order of the occlusion levels
+const int[6] face_corners = int[](0, 1, 2, 0, 2, 3);
+const float occlusion_strength = 0.2;
 
-    for (int j=3; j<6; j++) {
-        gl_Position = mvp * (gl_in[0].gl_Position + vec4(vertices[faces[j + i*6]], 0.0));
+void display_face(int i, vec3 color) {
+    uint occlusion = v_occlusion[0][i / 4] >> uint((i % 4) * 8);
+    for (int j=0; j<6; j++) {
+        float level = float((occlusion >> uint(face_corners[j] * 2)) & 3u);
+        face_color = color * (1.0 - occlusion_strength * level);
+        gl_Position = mvp * (gl_in[0].gl_Position + vec4(scale * vertices[faces[j + i*6]], 0.0));
         EmitVertex();
+        if (j == 2) {
+            EndPrimitive();
+        }
     }
     EndPrimitive();
 }
 
 void main(void) {
     for (int i=0; i<6; i++) {
+        // faces shared with a neighbour are never seen
+        if ((v_face_mask[0] & (1u << i)) == 0u) {
+            continue;
+        }
+
         vec3 v0 = vertices[faces[i*6 + 0]];
         vec3 v1 = vertices[faces[i*6 + 1]];
         vec3 v2 = vertices[faces[i*6 + 2]];
@@ -65,10 +79,10 @@ void main(void) {
 
         float face_diffuse = max(0, dot(normalize(light_direction), face_normal));
         float face_specular = pow(max(0, dot(half_vector, face_normal)), 8.0);
-        face_color = face_color_base.rgb * face_diffuse + face_specular + ambient_color.rgb;
+        vec3 color = face_color_base.rgb * face_diffuse + face_specular + ambient_color.rgb;
 
         if (dot(face_normal, camera_direction) < 0.0) {
-            display_face(i);
+            display_face(i, color);
         }
     }
 }
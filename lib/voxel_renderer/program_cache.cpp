@@ -0,0 +1,109 @@
+#include <lib/voxel_renderer/program_cache.hpp>
+
+namespace VoxelRenderer {
+    namespace {
+        std::string gl_string(GLenum name) {
+            auto s = glGetString(name);
+            return s ? reinterpret_cast<const char *>(s) : "";
+        }
+    }
+
+// ProgramCache
+
+    std::optional<boost::filesystem::path> ProgramCache::default_directory() {
+        if (const char * dir = std::getenv("TGP_SHADER_CACHE")) {
+            if (std::string(dir) == "off") return std::nullopt;
+            return boost::filesystem::path(dir);
+        }
+        return ChunkCache::DiskCache::default_directory() / "shaders";
+    }
+
+    ProgramCache::ProgramCache(const std::optional<boost::filesystem::path> & directory_) : directory(directory_) {
+        if (!directory) return;
+        boost::system::error_code ec;
+        boost::filesystem::create_directories(*directory, ec);
+        if (ec) {
+            std::cerr << boost::format("Failed to create the shader cache %s: %s") % directory->string() % ec.message() << std::endl;
+            directory.reset();
+        }
+    }
+
+    ChunkCache::ParameterHash ProgramCache::key(const std::vector<const char *> & sources) const {
+        ChunkCache::ParameterHash hash;
+        hash.add(version)
+            .add(gl_string(GL_VENDOR))
+            .add(gl_string(GL_RENDERER))
+            .add(gl_string(GL_VERSION))
+            .add(gl_string(GL_SHADING_LANGUAGE_VERSION));
+        for (auto source: sources) hash.add(std::string(source));
+        return hash;
+    }
+
+    GLuint ProgramCache::load(const ChunkCache::ParameterHash & key) const {
+        if (!directory) return 0;
+        GLint formats = 0;
+        glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+        if (formats == 0) return 0;
+
+        auto path = path_for(key);
+        std::ifstream ifs(path.string(), std::ios::binary);
+        uint32_t header[4] = { 0, 0, 0, 0 };
+        if (
+            !ifs.read(reinterpret_cast<char *>(header), sizeof(header)) ||
+            header[0] != magic || header[1] != version ||
+            boost::filesystem::file_size(path) != sizeof(header) + header[3]
+        ) {
+            return 0;
+        }
+        std::vector<char> binary(header[3]);
+        if (!ifs.read(binary.data(), binary.size())) return 0;
+
+        GLuint program = glCreateProgram();
+        glProgramBinary(program, header[2], binary.data(), binary.size());
+        GLint is_linked = GL_FALSE;
+        glGetProgramiv(program, GL_LINK_STATUS, &is_linked);
+        if (is_linked == GL_FALSE) {
+            glDeleteProgram(program);
+            return 0;
+        }
+        return program;
+    }
+
+    void ProgramCache::store(const ChunkCache::ParameterHash & key, GLuint program) const {
+        if (!directory) return;
+        GLint length = 0;
+        glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+        if (length <= 0) return;
+
+        std::vector<char> binary(length);
+        GLenum format = 0;
+        glGetProgramBinary(program, length, &length, &format, binary.data());
+        uint32_t header[4] = { magic, version, format, uint32_t(length) };
+
+        auto path = path_for(key);
+        auto temp_path = boost::filesystem::unique_path(path.string() + ".%%%%-%%%%.tmp");
+        {
+            std::ofstream ofs(temp_path.string(), std::ios::binary | std::ios::trunc);
+            ofs.write(reinterpret_cast<const char *>(header), sizeof(header));
+            ofs.write(binary.data(), length);
+            if (!ofs.flush()) {
+                std::cerr << boost::format("Failed to write the shader cache: %s") % temp_path.string() << std::endl;
+                boost::system::error_code ec;
+                boost::filesystem::remove(temp_path, ec);
+                return;
+            }
+        }
+
+        // other processes see either no file or a complete one
+        boost::system::error_code ec;
+        boost::filesystem::rename(temp_path, path, ec);
+        if (ec) {
+            std::cerr << boost::format("Failed to write the shader cache: %s") % ec.message() << std::endl;
+            boost::filesystem::remove(temp_path, ec);
+        }
+    }
+
+    boost::filesystem::path ProgramCache::path_for(const ChunkCache::ParameterHash & key) const {
+        return *directory / (key.hex() + ".program");
+    }
+}
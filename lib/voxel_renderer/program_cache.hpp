@@ -0,0 +1,43 @@
+#ifndef PROGRAM_CACHE_HPP
+#define PROGRAM_CACHE_HPP
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <optional>
+#include <boost/format.hpp>
+#include <boost/filesystem.hpp>
+
+#include <lib/gl_helpers.hpp>
+#include <lib/chunk_cache/chunk_cache.hpp>
+
+namespace VoxelRenderer {
+    // Linked programs as the driver returns them from glGetProgramBinary, in files keyed by the vendor, renderer
+    // and version of the driver and by the sources. The driver may still reject a binary, e.g. after an update
+    // it does not show in its version string, and the program is then linked from the sources again.
+    class ProgramCache {
+    public:
+        // TGP_SHADER_CACHE, "off" to always link, or shaders/ in the chunk cache directory
+        static std::optional<boost::filesystem::path> default_directory();
+
+        ProgramCache(const std::optional<boost::filesystem::path> & directory_ = default_directory());
+
+        // of the current context
+        ChunkCache::ParameterHash key(const std::vector<const char *> & sources) const;
+        // a linked program, or 0 when it is not cached or the driver rejects it
+        GLuint load(const ChunkCache::ParameterHash & key) const;
+        // the program has to be linked with GL_PROGRAM_BINARY_RETRIEVABLE_HINT
+        void store(const ChunkCache::ParameterHash & key, GLuint program) const;
+
+    private:
+        static constexpr uint32_t magic = 0x42505447u; // "TGPB"
+        static constexpr uint32_t version = 1u;
+
+        std::optional<boost::filesystem::path> directory;
+
+        boost::filesystem::path path_for(const ChunkCache::ParameterHash & key) const;
+    };
+}
+
+#endif
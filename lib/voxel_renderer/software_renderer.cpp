@@ -0,0 +1,263 @@
+#include <chrono>
+
+#include <lib/voxel_renderer/software_renderer.hpp>
+
+namespace VoxelRenderer {
+    namespace {
+        // same cube as geometry.glsl
+        const glm::vec3 cube_vertices[8] = {
+            { 1.0f, 1.0f, 1.0f },
+            { 0.0f, 1.0f, 1.0f },
+            { 0.0f, 0.0f, 1.0f },
+            { 1.0f, 0.0f, 1.0f },
+            { 1.0f, 0.0f, 0.0f },
+            { 1.0f, 1.0f, 0.0f },
+            { 0.0f, 1.0f, 0.0f },
+            { 0.0f, 0.0f, 0.0f }
+        };
+        const int32_t cube_faces[36] = {
+            0,1,2, 0,2,3,
+            0,3,4, 0,4,5,
+            0,5,6, 0,6,1,
+            1,6,7, 1,7,2,
+            7,4,3, 7,3,2,
+            4,7,6, 4,6,5
+        };
+
+        std::string frame_path(const std::string & path, uint32_t frame, uint32_t frames) {
+            if (frames <= 1) return path;
+            auto p = boost::filesystem::path(path);
+            auto name = (boost::format("%s_%04d%s") % p.stem().string() % frame % p.extension().string()).str();
+            return (p.parent_path() / name).string();
+        }
+    }
+
+    SoftwareRenderer::SoftwareRenderer(uint32_t width_, uint32_t height_, uint32_t threads_) :
+        width(width_),
+        height(height_),
+        threads(Helpers::thread_count(threads_)),
+        tiles_x((width_ + tile_size - 1) / tile_size),
+        tiles_y((height_ + tile_size - 1) / tile_size)
+    {}
+
+    void SoftwareRenderer::render(
+        const Vertices & vertices_,
+        const std::string & path,
+        uint32_t frames,
+        CameraPosition camera_position
+    ) {
+        static const float pi = boost::math::constants::pi<float>();
+        FaceMasks face_masks;
+        auto vertices = VerticesOptimizer().optimize(vertices_, face_masks);
+        auto clip = Renderer::make_clip(vertices);
+        auto camera_position_ = camera_position(clip);
+        frames = std::max(frames, 1u);
+
+        double total_seconds = 0.0;
+        for (uint32_t i = 0; i < frames; ++i) {
+            auto begin = std::chrono::steady_clock::now();
+            auto image = draw(vertices, face_masks, clip, camera_position_, 2.0f * pi * i / frames);
+            total_seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+
+            auto p = frame_path(path, i, frames);
+            if (!cv::imwrite(p, image)) throw (boost::format("Failed to write %s") % p).str();
+        }
+
+        std::cout << boost::format("Software renderer: %d voxels, %d frames at %dx%d with %d threads, %.2f fps")
+            % vertices.size() % frames % width % height % threads % (frames / total_seconds)
+        << std::endl;
+    }
+
+    cv::Mat SoftwareRenderer::draw(
+        const Vertices & vertices,
+        const FaceMasks & face_masks,
+        const Renderer::VerticesClip & clip,
+        const glm::vec3 & camera_position,
+        float theta
+    ) {
+        PROFILE_ZONE("software_renderer/frame");
+        using namespace glm;
+
+        // the uniforms of Renderer::render
+        auto projection = perspective(radians(30.0f), 1.0f * width / height, 0.1f, 10000.0f);
+        vec3 light_direction(-0.5f, -1.0f, 0.0f);
+        vec3 camera_target(0.0f, 0.0f, 0.0f);
+        auto view = lookAt(camera_position, camera_target, vec3(0.0f, 0.0f, 1.0f));
+        mat4 model(1.0f);
+        model *= rotate(theta, vec3(0.0f, 0.0f, 1.0f));
+        model *= translate(-clip.center);
+
+        // per face shading of geometry.glsl, which only depends on the face direction
+        auto mvp = projection * view * model;
+        auto transpose_inverse_m = transpose(inverse(mat3(model)));
+        auto camera_direction = normalize(-1.0f * camera_position - camera_target);
+        auto half_vector = normalize(light_direction + camera_direction);
+        const vec3 ambient_color(0.1f, 0.1f, 0.1f);
+        const vec3 face_color_base(0.5f, 0.5f, 0.5f);
+
+        bool face_visible[6];
+        uint32_t face_color[6];
+        for (int32_t i = 0; i < 6; ++i) {
+            auto v0 = cube_vertices[cube_faces[i*6 + 0]];
+            auto v1 = cube_vertices[cube_faces[i*6 + 1]];
+            auto v2 = cube_vertices[cube_faces[i*6 + 2]];
+            auto face_normal = normalize(transpose_inverse_m * cross(v1 - v0, v2 - v0));
+
+            float face_diffuse = std::max(0.0f, dot(normalize(light_direction), face_normal));
+            float face_specular = std::pow(std::max(0.0f, dot(half_vector, face_normal)), 8.0f);
+            auto c = face_color_base * face_diffuse + face_specular + ambient_color;
+            auto channel = [](float v) { return uint32_t(std::round(255.0f * clamp(v, 0.0f, 1.0f))); };
+
+            face_visible[i] = dot(face_normal, camera_direction) < 0.0f;
+            face_color[i] = channel(c.z) | channel(c.y) << 8 | channel(c.x) << 16; // BGR for OpenCV
+        }
+
+        // corners are linear in the voxel position, so project them once as offsets
+        vec4 corner_offsets[8];
+        for (int32_t i = 0; i < 8; ++i) corner_offsets[i] = mvp * vec4(cube_vertices[i], 0.0f);
+
+        // bin the triangles of the visible faces by screen tile
+        std::vector<Bin> bins(threads);
+        uint32_t block_size = (vertices.size() + threads - 1) / threads;
+        Helpers::parallel_for(threads, [&](uint32_t b) {
+            auto & bin = bins[b];
+            bin.tiles.resize(tiles_x * tiles_y);
+            auto end = std::min<size_t>(vertices.size(), size_t(b + 1) * block_size);
+
+            for (size_t vi = size_t(b) * block_size; vi < end; ++vi) {
+                const auto & v = vertices[vi];
+                auto base = mvp * vec4(v[0], v[1], v[2], 1.0f);
+                vec3 screen[8];
+                bool in_front = true;
+                for (int32_t i = 0; i < 8; ++i) {
+                    auto p = base + corner_offsets[i];
+                    // faces crossing the near plane are dropped instead of clipped
+                    if (p.w <= 0.1f) {
+                        in_front = false;
+                        break;
+                    }
+                    screen[i] = {
+                        (p.x / p.w * 0.5f + 0.5f) * width,
+                        (0.5f - p.y / p.w * 0.5f) * height,
+                        p.z / p.w
+                    };
+                }
+                if (!in_front) continue;
+
+                for (int32_t f = 0; f < 6; ++f) {
+                    if (!face_visible[f] || !(face_masks[vi] >> f & 1u)) continue;
+
+                    for (int32_t k = 0; k < 2; ++k) {
+                        Triangle t;
+                        for (int32_t j = 0; j < 3; ++j) {
+                            const auto & s = screen[cube_faces[f*6 + k*3 + j]];
+                            t.x[j] = s.x;
+                            t.y[j] = s.y;
+                            t.z[j] = s.z;
+                        }
+                        t.color = face_color[f];
+
+                        auto min_x = std::max(0, int32_t(std::floor(std::min({ t.x[0], t.x[1], t.x[2] }))));
+                        auto max_x = std::min(int32_t(width) - 1, int32_t(std::floor(std::max({ t.x[0], t.x[1], t.x[2] }))));
+                        auto min_y = std::max(0, int32_t(std::floor(std::min({ t.y[0], t.y[1], t.y[2] }))));
+                        auto max_y = std::min(int32_t(height) - 1, int32_t(std::floor(std::max({ t.y[0], t.y[1], t.y[2] }))));
+                        if (min_x > max_x || min_y > max_y) continue;
+
+                        uint32_t id = bin.triangles.size();
+                        bin.triangles.push_back(t);
+                        for (auto ty = min_y / tile_size; ty <= max_y / tile_size; ++ty) {
+                            for (auto tx = min_x / tile_size; tx <= max_x / tile_size; ++tx) {
+                                bin.tiles[ty * tiles_x + tx].push_back(id);
+                            }
+                        }
+                    }
+                }
+            }
+        }, threads);
+
+        // rasterize every tile independently into its own depth and color buffer
+        cv::Mat image(height, width, CV_8UC3);
+        Helpers::parallel_for(tiles_x * tiles_y, [&](uint32_t tile) {
+            PROFILE_ZONE("software_renderer/tile");
+            int32_t tile_x = tile % tiles_x;
+            int32_t tile_y = tile / tiles_x;
+            float depth[tile_size * tile_size];
+            uint32_t color[tile_size * tile_size];
+            std::fill(std::begin(depth), std::end(depth), std::numeric_limits<float>::max());
+            std::fill(std::begin(color), std::end(color), 0xffffffu);
+
+            for (const auto & bin: bins) {
+                for (auto id: bin.tiles[tile]) rasterize(bin.triangles[id], tile_x, tile_y, depth, color);
+            }
+
+            auto x_end = std::min<int32_t>(tile_size, width - tile_x * tile_size);
+            auto y_end = std::min<int32_t>(tile_size, height - tile_y * tile_size);
+            for (int32_t y = 0; y < y_end; ++y) {
+                auto * row = image.ptr<cv::Vec3b>(tile_y * tile_size + y) + tile_x * tile_size;
+                for (int32_t x = 0; x < x_end; ++x) {
+                    auto c = color[y * tile_size + x];
+                    row[x][0] = c & 0xff;
+                    row[x][1] = (c >> 8) & 0xff;
+                    row[x][2] = (c >> 16) & 0xff;
+                }
+            }
+        }, threads);
+
+        return image;
+    }
+
+    void SoftwareRenderer::rasterize(const Triangle & t, int32_t tile_x, int32_t tile_y, float * depth, uint32_t * color) const {
+        // edge functions w_i(x, y) = a_i x + b_i y + c_i, positive inside
+        float area = (t.x[1] - t.x[0]) * (t.y[2] - t.y[0]) - (t.y[1] - t.y[0]) * (t.x[2] - t.x[0]);
+        if (std::abs(area) < 1e-12f) return;
+        float sign = area > 0.0f ? 1.0f : -1.0f;
+
+        float a[3], b[3], c[3];
+        for (int32_t i = 0; i < 3; ++i) {
+            int32_t j = (i + 1) % 3;
+            a[i] = sign * (t.y[i] - t.y[j]);
+            b[i] = sign * (t.x[j] - t.x[i]);
+            c[i] = sign * (t.x[i] * t.y[j] - t.y[i] * t.x[j]);
+        }
+        // depth is affine in screen space: z = dz_dx x + dz_dy y + z0, weights of the edge opposite to each vertex
+        float inv_area = 1.0f / std::abs(area);
+        float dz_dx = (a[1] * t.z[0] + a[2] * t.z[1] + a[0] * t.z[2]) * inv_area;
+        float dz_dy = (b[1] * t.z[0] + b[2] * t.z[1] + b[0] * t.z[2]) * inv_area;
+        float z0 = (c[1] * t.z[0] + c[2] * t.z[1] + c[0] * t.z[2]) * inv_area;
+
+        int32_t origin_x = tile_x * tile_size;
+        int32_t origin_y = tile_y * tile_size;
+        auto x_begin = std::max(0, int32_t(std::floor(std::min({ t.x[0], t.x[1], t.x[2] }))) - origin_x);
+        auto x_end = std::min(std::min<int32_t>(tile_size, width - origin_x), int32_t(std::floor(std::max({ t.x[0], t.x[1], t.x[2] }))) - origin_x + 1);
+        auto y_begin = std::max(0, int32_t(std::floor(std::min({ t.y[0], t.y[1], t.y[2] }))) - origin_y);
+        auto y_end = std::min(std::min<int32_t>(tile_size, height - origin_y), int32_t(std::floor(std::max({ t.y[0], t.y[1], t.y[2] }))) - origin_y + 1);
+
+        for (int32_t y = y_begin; y < y_end; ++y) {
+            float py = origin_y + y + 0.5f;
+            float * depth_row = depth + y * tile_size;
+            uint32_t * color_row = color + y * tile_size;
+
+            // branchless span so that the compiler vectorizes it across pixels
+            for (int32_t x = x_begin; x < x_end; ++x) {
+                float px = origin_x + x + 0.5f;
+                float w0 = a[0] * px + b[0] * py + c[0];
+                float w1 = a[1] * px + b[1] * py + c[1];
+                float w2 = a[2] * px + b[2] * py + c[2];
+                float z = dz_dx * px + dz_dy * py + z0;
+                bool hit = w0 >= 0.0f && w1 >= 0.0f && w2 >= 0.0f && z < depth_row[x];
+                depth_row[x] = hit ? z : depth_row[x];
+                color_row[x] = hit ? t.color : color_row[x];
+            }
+        }
+    }
+
+    bool SoftwareRenderer::render_from_env(const Vertices & vertices, CameraPosition camera_position) {
+        const char * path = std::getenv("TGP_SNAPSHOT");
+        if (!path) return false;
+
+        const char * frames = std::getenv("TGP_SNAPSHOT_FRAMES");
+        SoftwareRenderer renderer;
+        renderer.render(vertices, path, frames ? std::stoi(frames) : 1, camera_position);
+        return true;
+    }
+}
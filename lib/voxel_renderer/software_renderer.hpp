@@ -0,0 +1,66 @@
+#ifndef SOFTWARE_RENDERER_HPP
+#define SOFTWARE_RENDERER_HPP
+
+#include <opencv2/opencv.hpp>
+
+#include <lib/voxel_renderer/voxel_renderer.hpp>
+
+namespace VoxelRenderer {
+    // CPU counterpart of Renderer for headless snapshots, shading the cube faces like geometry.glsl
+    class SoftwareRenderer {
+    public:
+        using CameraPosition = std::function<glm::vec3(const Renderer::VerticesClip & clip)>;
+
+        SoftwareRenderer(uint32_t width_ = 1280, uint32_t height_ = 960, uint32_t threads_ = 0);
+
+        // writes a PNG, or a turntable of `frames` PNGs numbered like `name_0000.png`
+        void render(
+            const Vertices & vertices,
+            const std::string & path,
+            uint32_t frames = 1,
+            CameraPosition camera_position = &Renderer::default_camera_position
+        );
+
+        // draws the exposed faces of already visible voxels, theta is the turntable angle
+        cv::Mat draw(
+            const Vertices & visible_vertices,
+            const FaceMasks & face_masks,
+            const Renderer::VerticesClip & clip,
+            const glm::vec3 & camera_position,
+            float theta
+        );
+
+        // renders instead of opening a window when TGP_SNAPSHOT names an output path
+        // (TGP_SNAPSHOT_FRAMES for a turntable)
+        static bool render_from_env(
+            const Vertices & vertices,
+            CameraPosition camera_position = &Renderer::default_camera_position
+        );
+
+    private:
+        static constexpr int32_t tile_size = 64;
+
+        struct Triangle {
+            float x[3];
+            float y[3];
+            float z[3];
+            uint32_t color;
+        };
+
+        // triangles binned by the block of voxels that produced them, so that the result is deterministic
+        struct Bin {
+            std::vector<Triangle> triangles;
+            std::vector<std::vector<uint32_t>> tiles;
+        };
+
+        uint32_t width;
+        uint32_t height;
+        uint32_t threads;
+        int32_t tiles_x;
+        int32_t tiles_y;
+
+        void rasterize(const Triangle & t, int32_t tile_x, int32_t tile_y, float * depth, uint32_t * color) const;
+    };
+}
+
+#endif
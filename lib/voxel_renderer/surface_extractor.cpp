@@ -0,0 +1,170 @@
+#include <lib/voxel_renderer/surface_extractor.hpp>
+
+namespace VoxelRenderer {
+// SurfaceExtractor
+
+    SurfaceExtractor::SurfaceExtractor(const Vertices & vertices, uint32_t threads) {
+        PROFILE_ZONE("surface_extractor/extract");
+        MEMORY_SCOPE("surface_extractor");
+        voxels.reserve(vertices.size());
+        for (const auto & v: vertices) voxels.insert(key_of(v));
+
+        for (auto key: voxels) {
+            auto v = VerticesOptimizer::unpack(key);
+            auto mask = face_mask(v);
+            if (mask == 0u) continue;
+            slots.emplace(key, vertices_.size());
+            vertices_.push_back({ GLfloat(v.x), GLfloat(v.y), GLfloat(v.z) });
+            face_masks_.push_back(mask);
+        }
+        occlusions_ = ambient_occlusion.bake(vertices_, face_masks_, [this](const glm::ivec3 & v) { return is_occupied(v); }, threads);
+    }
+
+    void SurfaceExtractor::set(const glm::ivec3 & voxel, bool occupied) {
+        auto key = VerticesOptimizer::pack(voxel.x, voxel.y, voxel.z);
+        bool changed = occupied ? voxels.insert(key).second : voxels.erase(key) != 0u;
+        if (changed) dirty.push_back(key);
+    }
+
+    void SurfaceExtractor::replace(const Vertices & before, const Vertices & after) {
+        std::unordered_set<uint64_t, VerticesOptimizer::VoxelHash> after_keys;
+        after_keys.reserve(after.size());
+        for (const auto & v: after) after_keys.insert(key_of(v));
+
+        for (const auto & v: before) {
+            auto key = key_of(v);
+            if (after_keys.count(key) == 0u && voxels.erase(key) != 0u) dirty.push_back(key);
+        }
+        for (auto key: after_keys) {
+            if (voxels.insert(key).second) dirty.push_back(key);
+        }
+    }
+
+    IndexRanges SurfaceExtractor::update() {
+        if (dirty.empty()) return {};
+        PROFILE_ZONE("surface_extractor/update");
+        MEMORY_SCOPE("surface_extractor");
+        auto start = std::chrono::steady_clock::now();
+
+        // the face masks of the 6 neighbours and the occlusions of all the 26 see the change too
+        std::vector<uint64_t> affected;
+        affected.reserve(27u * dirty.size());
+        for (auto key: dirty) {
+            auto v = VerticesOptimizer::unpack(key);
+            for (int32_t z = -1; z <= 1; ++z) {
+                for (int32_t y = -1; y <= 1; ++y) {
+                    for (int32_t x = -1; x <= 1; ++x) {
+                        affected.push_back(VerticesOptimizer::pack(v.x + x, v.y + y, v.z + z));
+                    }
+                }
+            }
+        }
+        Helpers::unique(affected);
+
+        std::vector<uint32_t> changed;
+        uint64_t changed_occlusions = 0u;
+        for (auto key: affected) {
+            auto v = VerticesOptimizer::unpack(key);
+            GLubyte mask = voxels.count(key) != 0u ? face_mask(v) : 0u;
+            auto slot = slots.find(key);
+
+            if (mask != 0u && slot != slots.end()) {
+                auto level = occlusion(v, mask);
+                bool occlusion_changed = occlusions_[slot->second] != level;
+                if (face_masks_[slot->second] == mask && !occlusion_changed) continue;
+                face_masks_[slot->second] = mask;
+                occlusions_[slot->second] = level;
+                changed_occlusions += occlusion_changed;
+                changed.push_back(slot->second);
+            }
+            else if (mask != 0u) {
+                uint32_t index = vertices_.size();
+                if (!holes.empty()) {
+                    index = holes.back();
+                    holes.pop_back();
+                }
+                else {
+                    vertices_.emplace_back();
+                    face_masks_.emplace_back();
+                    occlusions_.emplace_back();
+                }
+                vertices_[index] = { GLfloat(v.x), GLfloat(v.y), GLfloat(v.z) };
+                face_masks_[index] = mask;
+                occlusions_[index] = occlusion(v, mask);
+                slots.emplace(key, index);
+                changed.push_back(index);
+            }
+            else if (slot != slots.end()) {
+                face_masks_[slot->second] = 0u;
+                occlusions_[slot->second] = Occlusion{ 0u, 0u };
+                holes.push_back(slot->second);
+                changed.push_back(slot->second);
+                slots.erase(slot);
+            }
+        }
+
+        // adjacent indices are written as a single range
+        std::sort(changed.begin(), changed.end());
+        IndexRanges ranges;
+        for (auto index: changed) {
+            if (!ranges.empty() && ranges.back().second == index) {
+                ++ranges.back().second;
+            }
+            else {
+                ranges.push_back({ index, index + 1u });
+            }
+        }
+
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        ++stats_.updates;
+        stats_.dirty_voxels += dirty.size();
+        stats_.recomputed_voxels += affected.size();
+        stats_.changed_vertices += changed.size();
+        stats_.changed_occlusions += changed_occlusions;
+        stats_.last_update_seconds = seconds;
+        stats_.update_seconds += seconds;
+        dirty.clear();
+        return ranges;
+    }
+
+    bool SurfaceExtractor::is_occupied(const glm::ivec3 & voxel) const {
+        return voxels.count(VerticesOptimizer::pack(voxel.x, voxel.y, voxel.z)) != 0u;
+    }
+
+    void SurfaceExtractor::print_stats(std::ostream & os) const {
+        os << boost::format("Surface: %d visible of %d voxels, %d holes") % slots.size() % voxels.size() % holes.size() << std::endl;
+        os << boost::format("Surface updates: %d (%d dirty, %d recomputed, %d changed vertices, %d changed occlusions)")
+            % stats_.updates
+            % stats_.dirty_voxels
+            % stats_.recomputed_voxels
+            % stats_.changed_vertices
+            % stats_.changed_occlusions
+            << std::endl;
+        os << boost::format("Surface update time: %.1f us per update")
+            % (stats_.updates == 0u ? 0.0 : 1e6 * stats_.update_seconds / stats_.updates)
+            << std::endl;
+        ambient_occlusion.print_stats(os);
+    }
+
+    GLubyte SurfaceExtractor::face_mask(const glm::ivec3 & voxel) const {
+        GLubyte mask = 0u;
+        for (uint32_t i = 0; i < VerticesOptimizer::face_directions.size(); ++i) {
+            const auto & d = VerticesOptimizer::face_directions[i];
+            mask |= GLubyte(voxels.count(VerticesOptimizer::pack(voxel.x + d.x, voxel.y + d.y, voxel.z + d.z)) == 0u) << i;
+        }
+        return mask;
+    }
+
+    Occlusion SurfaceExtractor::occlusion(const glm::ivec3 & voxel, GLubyte mask) const {
+        auto neighbourhood = AmbientOcclusion::neighbourhood(voxel, mask, [this](const glm::ivec3 & v) { return is_occupied(v); });
+        return AmbientOcclusion::occlusion(neighbourhood, mask);
+    }
+
+    uint64_t SurfaceExtractor::key_of(const std::array<GLfloat, 3> & v) {
+        return VerticesOptimizer::pack(
+            static_cast<int32_t>(std::round(v[0])),
+            static_cast<int32_t>(std::round(v[1])),
+            static_cast<int32_t>(std::round(v[2]))
+        );
+    }
+}
@@ -0,0 +1,71 @@
+#ifndef SURFACE_EXTRACTOR_HPP
+#define SURFACE_EXTRACTOR_HPP
+
+#include <chrono>
+#include <unordered_map>
+#include <unordered_set>
+
+#include <lib/helpers.hpp>
+#include <lib/voxel_renderer/voxel_renderer.hpp>
+#include <lib/voxel_renderer/ambient_occlusion.hpp>
+
+namespace VoxelRenderer {
+    // The visible voxels, their face masks and occlusions as VerticesOptimizer::optimize, kept up to date
+    // incrementally. Changed voxels are collected by set and replace, and update recomputes only them and their
+    // 26 neighbours, whose corners they may occlude, patching the vertices in place. A voxel which is no longer
+    // visible leaves a hole with the face mask 0, which draws nothing, and is reused by the next visible voxel,
+    // so the other vertices never move.
+    class SurfaceExtractor {
+    public:
+        struct Stats {
+            uint64_t updates = 0u;
+            uint64_t dirty_voxels = 0u;
+            uint64_t recomputed_voxels = 0u;
+            uint64_t changed_vertices = 0u;
+            uint64_t changed_occlusions = 0u;
+            double last_update_seconds = 0.0;
+            double update_seconds = 0.0;
+        };
+
+        SurfaceExtractor(const Vertices & vertices, uint32_t threads = 0);
+
+        // marks the voxel dirty only if it changes
+        void set(const glm::ivec3 & voxel, bool occupied);
+        // replaces the voxels of a regenerated chunk or a smoothing pass, given the voxels before and after
+        void replace(const Vertices & before, const Vertices & after);
+
+        // recomputes the dirty voxels and their neighbours, and returns the vertices whose mask or occlusion changed
+        IndexRanges update();
+
+        bool is_occupied(const glm::ivec3 & voxel) const;
+        bool is_dirty() const { return !dirty.empty(); }
+
+        // including the holes of the face mask 0
+        const Vertices & vertices() const { return vertices_; }
+        const FaceMasks & face_masks() const { return face_masks_; }
+        const Occlusions & occlusions() const { return occlusions_; }
+        size_t visible_count() const { return slots.size(); }
+        size_t voxel_count() const { return voxels.size(); }
+
+        const Stats & stats() const { return stats_; }
+        void print_stats(std::ostream & os = std::cout) const;
+
+    private:
+        std::unordered_set<uint64_t, VerticesOptimizer::VoxelHash> voxels;
+        // indices of the visible voxels in the vertices
+        std::unordered_map<uint64_t, uint32_t, VerticesOptimizer::VoxelHash> slots;
+        std::vector<uint32_t> holes;
+        std::vector<uint64_t> dirty;
+        Vertices vertices_;
+        FaceMasks face_masks_;
+        Occlusions occlusions_;
+        AmbientOcclusion ambient_occlusion;
+        Stats stats_;
+
+        GLubyte face_mask(const glm::ivec3 & voxel) const;
+        Occlusion occlusion(const glm::ivec3 & voxel, GLubyte mask) const;
+        static uint64_t key_of(const std::array<GLfloat, 3> & v);
+    };
+}
+
+#endif
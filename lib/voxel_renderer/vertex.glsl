@@ -1,7 +1,13 @@
 #version 410 core
 
 in vec3 position;
+in uint face_mask;
+in uvec2 occlusion;
+flat out uint v_face_mask;
+flat out uvec2 v_occlusion;
 
 void main(void) {
     gl_Position = vec4(position, 1.0);
+    v_face_mask = face_mask;
+    v_occlusion = occlusion;
 }
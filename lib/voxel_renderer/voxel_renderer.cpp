@@ -1,22 +1,36 @@
 #include <glm/gtc/type_ptr.hpp>
 #include <lib/voxel_renderer/voxel_renderer.hpp>
+#include <lib/voxel_renderer/chunk_buffer_pool.hpp>
+#include <lib/voxel_renderer/surface_extractor.hpp>
+#include <lib/voxel_renderer/ambient_occlusion.hpp>
+#include <lib/voxel_renderer/program_cache.hpp>
+#include <lib/voxel_renderer/shaders.hpp>
 
 namespace VoxelRenderer {
 // ShaderBuilder
     ShaderInfo ShaderBuilder::build() {
         ShaderInfo info;
 
-        GLuint v_shader_id = compile_from_file(GL_VERTEX_SHADER, "vertex.glsl");
-        GLuint g_shader_id = compile_from_file(GL_GEOMETRY_SHADER, "geometry.glsl");
-        GLuint f_shader_id = compile_from_file(GL_FRAGMENT_SHADER, "fragment.glsl");
-
-        info.id = glCreateProgram();
-        glAttachShader(info.id, v_shader_id);
-        glAttachShader(info.id, g_shader_id);
-        glAttachShader(info.id, f_shader_id);
-        glLinkProgram(info.id);
+        auto start = std::chrono::steady_clock::now();
+        ProgramCache cache;
+        auto key = cache.key({ Shaders::vertex, Shaders::geometry, Shaders::fragment });
+        info.id = cache.load(key);
+        auto cached = info.id != 0;
+        if (!cached) {
+            info.id = link();
+            cache.store(key, info.id);
+        }
+        // the startup timings are printed along with a trace, with TGP_TRACE
+        if (Profiler::is_enabled()) {
+            std::cout << boost::format("## Shader program %s in %.1f ms")
+                % (cached ? "loaded from the cache" : "linked")
+                % (1e3 * std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count())
+                << std::endl;
+        }
 
         info.attribute.position_location = glGetAttribLocation(info.id, "position");
+        info.attribute.face_mask_location = glGetAttribLocation(info.id, "face_mask");
+        info.attribute.occlusion_location = glGetAttribLocation(info.id, "occlusion");
         info.uniform.model_location = glGetUniformLocation(info.id, "model");
         info.uniform.view_location = glGetUniformLocation(info.id, "view");
         info.uniform.projection_location = glGetUniformLocation(info.id, "projection");
@@ -27,29 +41,37 @@ namespace VoxelRenderer {
         return info;
     }
 
-    GLuint ShaderBuilder::compile(uint32_t type, std::istream & is) {
-        std::string source;
-        std::copy(
-            std::istreambuf_iterator<char>(is),
-            std::istreambuf_iterator<char>(),
-            std::insert_iterator<std::string>(source, source.end())
-        );
+    GLuint ShaderBuilder::link() {
+        GLuint v_shader_id = compile(GL_VERTEX_SHADER, Shaders::vertex);
+        GLuint g_shader_id = compile(GL_GEOMETRY_SHADER, Shaders::geometry);
+        GLuint f_shader_id = compile(GL_FRAGMENT_SHADER, Shaders::fragment);
+
+        GLuint program_id = glCreateProgram();
+        glProgramParameteri(program_id, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+        glAttachShader(program_id, v_shader_id);
+        glAttachShader(program_id, g_shader_id);
+        glAttachShader(program_id, f_shader_id);
+        glLinkProgram(program_id);
+
+        // the program keeps what it needs of the shaders
+        for (auto shader_id: { v_shader_id, g_shader_id, f_shader_id }) {
+            glDetachShader(program_id, shader_id);
+            glDeleteShader(shader_id);
+        }
+        validate_program(program_id);
+
+        return program_id;
+    }
 
+    GLuint ShaderBuilder::compile(uint32_t type, const char * source) {
         GLuint shader_id = glCreateShader(type);
-        const char * s = source.c_str();
-        glShaderSource(shader_id, 1, &s, nullptr);
+        glShaderSource(shader_id, 1, &source, nullptr);
         glCompileShader(shader_id);
         validate(type, shader_id);
 
         return shader_id;
     }
 
-    GLuint ShaderBuilder::compile_from_file(uint32_t type, const std::string & relative_path) {
-        auto path = boost::filesystem::path(__FILE__).parent_path().append(relative_path);
-        std::ifstream ifs(path.string());
-        return compile(type, ifs);
-    }
-
     void ShaderBuilder::validate(uint32_t type, GLuint shader_id) {
         const std::string & shader_name = SHADER_NAMES.at(type);
         GLint is_compiled = GL_FALSE;
@@ -69,6 +91,24 @@ namespace VoxelRenderer {
         }
     }
 
+    void ShaderBuilder::validate_program(GLuint program_id) {
+        GLint is_linked = GL_FALSE;
+        glGetProgramiv(program_id, GL_LINK_STATUS, &is_linked);
+
+        if (is_linked == GL_FALSE) {
+            GLint length = 0;
+            glGetProgramiv(program_id, GL_INFO_LOG_LENGTH, &length);
+
+            std::string log;
+            log.resize(length);
+            glGetProgramInfoLog(program_id, length, &length, &log[0]);
+            std::cerr << boost::format("program: %s") % log << std::endl;
+
+            glDeleteProgram(program_id);
+            throw std::string("program is invalid");
+        }
+    }
+
     const std::map<uint32_t, std::string> ShaderBuilder::SHADER_NAMES{
         { GL_VERTEX_SHADER, "vertex_shader" },
         { GL_GEOMETRY_SHADER, "geometry_shader" },
@@ -77,12 +117,60 @@ namespace VoxelRenderer {
 
 // ShaderDataBinder
 
-    void ShaderDataBinder::create_buffer(const Vertices & vertices) {
-        glGenBuffers(1, vbo);
+    void ShaderDataBinder::create_buffer(const Vertices & vertices, const FaceMasks & face_masks, const Occlusions & occlusions) {
+        PROFILE_ZONE("renderer/upload");
+        MEMORY_SCOPE("renderer/upload");
+        PROFILE_COUNTER("renderer/upload_bytes", 3 * vertices.size() * sizeof(GLfloat) + face_masks.size() + occlusions.size() * sizeof(Occlusion));
+        glGenBuffers(3, vbo);
         glBindBuffer(GL_ARRAY_BUFFER, vbo[0]);
         glBufferData(GL_ARRAY_BUFFER, 3 * vertices.size() * sizeof(GLfloat), &vertices[0][0], GL_STATIC_DRAW);
+        glBindBuffer(GL_ARRAY_BUFFER, vbo[1]);
+        glBufferData(GL_ARRAY_BUFFER, face_masks.size(), face_masks.data(), GL_STATIC_DRAW);
+        glBindBuffer(GL_ARRAY_BUFFER, vbo[2]);
+        glBufferData(GL_ARRAY_BUFFER, occlusions.size() * sizeof(Occlusion), occlusions.data(), GL_STATIC_DRAW);
 
         glGenVertexArrays(1, vao);
+        capacity = vertices.size();
+        occluded = !occlusions.empty();
+    }
+
+    void ShaderDataBinder::update_buffer(const Vertices & vertices, const FaceMasks & face_masks, const Occlusions & occlusions, const IndexRanges & ranges) {
+        PROFILE_ZONE("renderer/upload");
+        occluded = !occlusions.empty();
+        if (vertices.size() > capacity) {
+            capacity = vertices.size() + vertices.size() / 2u;
+            glBindBuffer(GL_ARRAY_BUFFER, vbo[0]);
+            glBufferData(GL_ARRAY_BUFFER, 3 * capacity * sizeof(GLfloat), nullptr, GL_DYNAMIC_DRAW);
+            glBufferSubData(GL_ARRAY_BUFFER, 0, 3 * vertices.size() * sizeof(GLfloat), &vertices[0][0]);
+            glBindBuffer(GL_ARRAY_BUFFER, vbo[1]);
+            glBufferData(GL_ARRAY_BUFFER, capacity, nullptr, GL_DYNAMIC_DRAW);
+            glBufferSubData(GL_ARRAY_BUFFER, 0, face_masks.size(), face_masks.data());
+            glBindBuffer(GL_ARRAY_BUFFER, vbo[2]);
+            glBufferData(GL_ARRAY_BUFFER, capacity * sizeof(Occlusion), nullptr, GL_DYNAMIC_DRAW);
+            glBufferSubData(GL_ARRAY_BUFFER, 0, occlusions.size() * sizeof(Occlusion), occlusions.data());
+            PROFILE_COUNTER("renderer/upload_bytes", 3 * vertices.size() * sizeof(GLfloat) + face_masks.size() + occlusions.size() * sizeof(Occlusion));
+            return;
+        }
+
+        size_t bytes = 0u;
+        glBindBuffer(GL_ARRAY_BUFFER, vbo[0]);
+        for (const auto & [begin, end]: ranges) {
+            glBufferSubData(GL_ARRAY_BUFFER, 3 * begin * sizeof(GLfloat), 3 * (end - begin) * sizeof(GLfloat), &vertices[begin][0]);
+            bytes += 3 * (end - begin) * sizeof(GLfloat);
+        }
+        glBindBuffer(GL_ARRAY_BUFFER, vbo[1]);
+        for (const auto & [begin, end]: ranges) {
+            glBufferSubData(GL_ARRAY_BUFFER, begin, end - begin, &face_masks[begin]);
+            bytes += end - begin;
+        }
+        if (occluded) {
+            glBindBuffer(GL_ARRAY_BUFFER, vbo[2]);
+            for (const auto & [begin, end]: ranges) {
+                glBufferSubData(GL_ARRAY_BUFFER, begin * sizeof(Occlusion), (end - begin) * sizeof(Occlusion), &occlusions[begin]);
+                bytes += (end - begin) * sizeof(Occlusion);
+            }
+        }
+        PROFILE_COUNTER("renderer/upload_bytes", bytes);
     }
 
     void ShaderDataBinder::bind_params(
@@ -101,68 +189,147 @@ namespace VoxelRenderer {
 
             glVertexAttribPointer(info.attribute.position_location, 3, GL_FLOAT, GL_FALSE, 0, nullptr);
 
-            glUniformMatrix4fv(info.uniform.model_location, 1, GL_FALSE, glm::value_ptr(model));
-            glUniformMatrix4fv(info.uniform.view_location, 1, GL_FALSE, glm::value_ptr(view));
-            glUniformMatrix4fv(info.uniform.projection_location, 1, GL_FALSE, glm::value_ptr(projection));
-            glUniform3fv(info.uniform.light_direction_location, 1, glm::value_ptr(light_direction));
-            glUniform3fv(info.uniform.camera_position_location, 1, glm::value_ptr(camera_position));
-            glUniform3fv(info.uniform.camera_target_location, 1, glm::value_ptr(camera_target));
+            glBindBuffer(GL_ARRAY_BUFFER, vbo[1]);
+            glEnableVertexAttribArray(info.attribute.face_mask_location);
+            glVertexAttribIPointer(info.attribute.face_mask_location, 1, GL_UNSIGNED_BYTE, 0, nullptr);
+
+            bind_occlusions(info, vbo[2], occluded);
+            bind_uniforms(info, model, view, projection, light_direction, camera_position, camera_target);
         }
     }
 
+    void ShaderDataBinder::bind_occlusions(const ShaderInfo & info, GLuint buffer, bool occluded) {
+        if (!occluded) {
+            // every corner reads the constant level 0
+            glDisableVertexAttribArray(info.attribute.occlusion_location);
+            glVertexAttribI4ui(info.attribute.occlusion_location, 0u, 0u, 0u, 0u);
+            return;
+        }
+        glBindBuffer(GL_ARRAY_BUFFER, buffer);
+        glEnableVertexAttribArray(info.attribute.occlusion_location);
+        glVertexAttribIPointer(info.attribute.occlusion_location, 2, GL_UNSIGNED_INT, 0, nullptr);
+    }
+
+    void ShaderDataBinder::bind_uniforms(
+        const ShaderInfo & info,
+        const glm::mat4 & model,
+        const glm::mat4 & view,
+        const glm::mat4 & projection,
+        const glm::vec3 & light_direction,
+        const glm::vec3 & camera_position,
+        const glm::vec3 & camera_target
+    ) {
+        glUniformMatrix4fv(info.uniform.model_location, 1, GL_FALSE, glm::value_ptr(model));
+        glUniformMatrix4fv(info.uniform.view_location, 1, GL_FALSE, glm::value_ptr(view));
+        glUniformMatrix4fv(info.uniform.projection_location, 1, GL_FALSE, glm::value_ptr(projection));
+        glUniform3fv(info.uniform.light_direction_location, 1, glm::value_ptr(light_direction));
+        glUniform3fv(info.uniform.camera_position_location, 1, glm::value_ptr(camera_position));
+        glUniform3fv(info.uniform.camera_target_location, 1, glm::value_ptr(camera_target));
+    }
+
 // VerticesOptimizer
 
+    const std::array<glm::ivec3, 6> VerticesOptimizer::face_directions{ {
+        {  0,  0,  1 },
+        {  1,  0,  0 },
+        {  0,  1,  0 },
+        { -1,  0,  0 },
+        {  0, -1,  0 },
+        {  0,  0, -1 }
+    } };
+
     VoxelRenderer::Vertices VerticesOptimizer::optimize(const VoxelRenderer::Vertices & vertices) {
-        std::unordered_map<int32_t, std::unordered_map<int32_t, std::unordered_map<int32_t, glm::vec3>>> data;
-        auto is_nothing = [&data](int32_t x, int32_t y, int32_t z) {
-            if (data.find(x) == data.end()) return true;
+        FaceMasks face_masks;
+        return optimize(vertices, face_masks);
+    }
 
-            const auto & data_x = data.at(x);
-            if (data_x.find(y) == data_x.end()) return true;
+    VoxelRenderer::Vertices VerticesOptimizer::optimize(const VoxelRenderer::Vertices & vertices, FaceMasks & face_masks) {
+        return optimize(vertices, face_masks, nullptr, 0u);
+    }
 
-            const auto & data_xy = data_x.at(y);
-            if (data_xy.find(z) == data_xy.end()) return true;
+    VoxelRenderer::Vertices VerticesOptimizer::optimize(const VoxelRenderer::Vertices & vertices, FaceMasks & face_masks, Occlusions & occlusions, uint32_t threads) {
+        return optimize(vertices, face_masks, &occlusions, threads);
+    }
 
-            return false;
+    VoxelRenderer::Vertices VerticesOptimizer::optimize(const VoxelRenderer::Vertices & vertices, FaceMasks & face_masks, Occlusions * occlusions, uint32_t threads) {
+        MEMORY_SCOPE("optimizer");
+        arena.reset();
+        VoxelSet data(0, VoxelHash(), std::equal_to<uint64_t>(), Arena::Allocator<uint64_t>(&arena));
+        auto is_nothing = [&data](int32_t x, int32_t y, int32_t z) {
+            return data.find(pack(x, y, z)) == data.end();
         };
 
-        for (const auto & v: vertices) {
-            auto x = static_cast<int32_t>(std::round(v[0]));
-            auto y = static_cast<int32_t>(std::round(v[1]));
-            auto z = static_cast<int32_t>(std::round(v[2]));
-            if (is_nothing(x,y,z)) data[x][y][z] = { x, y, z };
+        {
+            PROFILE_ZONE("optimizer/dedup");
+            for (const auto & v: vertices) {
+                auto x = static_cast<int32_t>(std::round(v[0]));
+                auto y = static_cast<int32_t>(std::round(v[1]));
+                auto z = static_cast<int32_t>(std::round(v[2]));
+                data.insert(pack(x, y, z));
+            }
         }
 
         VoxelRenderer::Vertices result;
-        uint32_t data_size = 0;
-
-        for (const auto & x: data) {
-            for (const auto & y: x.second) {
-                data_size += y.second.size();
-                for (const auto & z: y.second) {
-                    if (
-                        is_nothing(x.first    , y.first    , z.first - 1) ||
-                        is_nothing(x.first    , y.first    , z.first + 1) ||
-                        is_nothing(x.first    , y.first - 1, z.first    ) ||
-                        is_nothing(x.first    , y.first + 1, z.first    ) ||
-                        is_nothing(x.first - 1, y.first    , z.first    ) ||
-                        is_nothing(x.first + 1, y.first    , z.first    )
-                    ) {
-                        result.push_back({ z.second.x, z.second.y, z.second.z });
-                    }
+        uint32_t data_size = data.size();
+        result.reserve(data_size);
+        face_masks.clear();
+        face_masks.reserve(data_size);
+        size_t exposed_faces = 0u;
+
+        {
+            PROFILE_ZONE("optimizer/surface");
+            for (auto key: data) {
+                auto v = unpack(key);
+                GLubyte mask = 0u;
+                for (uint32_t i = 0; i < face_directions.size(); ++i) {
+                    const auto & d = face_directions[i];
+                    mask |= GLubyte(is_nothing(v.x + d.x, v.y + d.y, v.z + d.z)) << i;
+                }
+                if (mask != 0u) {
+                    result.push_back({ GLfloat(v.x), GLfloat(v.y), GLfloat(v.z) });
+                    face_masks.push_back(mask);
+                    exposed_faces += __builtin_popcount(mask);
                 }
             }
         }
-        std::cout << "Original vertex size: " << vertices.size() << std::endl;
-        std::cout << "Unique vertex size: " << data_size << std::endl;
-        std::cout << "Visible vertex size: " << result.size() << std::endl;
+        PROFILE_COUNTER("optimizer/original_vertices", vertices.size());
+        PROFILE_COUNTER("optimizer/unique_vertices", data_size);
+        PROFILE_COUNTER("optimizer/visible_vertices", result.size());
+        PROFILE_COUNTER("optimizer/exposed_faces", exposed_faces);
+        stats = { vertices.size(), data_size, result.size(), exposed_faces };
+        if (verbose) {
+            std::cout << "Original vertex size: " << vertices.size() << std::endl;
+            std::cout << "Unique vertex size: " << data_size << std::endl;
+            std::cout << "Visible vertex size: " << result.size() << std::endl;
+            std::cout << boost::format("Exposed face size: %d of %d") % exposed_faces % (6 * result.size()) << std::endl;
+        }
+
+        if (occlusions) {
+            // the set is only read from here on
+            AmbientOcclusion ambient_occlusion;
+            *occlusions = ambient_occlusion.bake(result, face_masks, [&data](const glm::ivec3 & v) {
+                return data.find(pack(v.x, v.y, v.z)) != data.end();
+            }, threads);
+            if (verbose) ambient_occlusion.print_stats();
+        }
 
         return result;
     }
 
+    uint64_t VerticesOptimizer::pack(int32_t x, int32_t y, int32_t z) {
+        auto field = [](int32_t v) { return uint64_t(v + (1 << 20)) & 0x1fffffu; };
+        return field(x) | field(y) << 21 | field(z) << 42;
+    }
+
+    glm::ivec3 VerticesOptimizer::unpack(uint64_t key) {
+        auto field = [key](uint32_t i) { return int32_t((key >> (21 * i)) & 0x1fffffu) - (1 << 20); };
+        return { field(0), field(1), field(2) };
+    }
+
 // Renderer
 
     void Renderer::init(GLFWwindow * window_) {
+        init_time = std::chrono::steady_clock::now();
         window = window_;
         glfwSwapInterval(1);
         glEnable(GL_DEPTH_TEST);
@@ -170,6 +337,8 @@ namespace VoxelRenderer {
 
         ShaderBuilder builder;
         shader_info = builder.build();
+
+        if (auto frames = std::getenv("TGP_FRAMES")) max_frames = std::stoul(frames);
     }
 
     glm::vec3 Renderer::default_camera_position(const VerticesClip & clip) {
@@ -180,9 +349,7 @@ namespace VoxelRenderer {
         };
     }
 
-    void Renderer::render(const Vertices & vertices_, std::function<glm::vec3(const VerticesClip & clip)> camera_position) {
-        auto vertices = VerticesOptimizer().optimize(vertices_);
-
+    Renderer::VerticesClip Renderer::make_clip(const Vertices & vertices) {
         glm::vec3 min(
             std::numeric_limits<float>::max(),
             std::numeric_limits<float>::max(),
@@ -204,9 +371,16 @@ namespace VoxelRenderer {
         }
         auto center = (min + max) / 2.0f;
 
-        VerticesClip clip{ min, max, center };
+        return { min, max, center };
+    }
+
+    void Renderer::render(const Vertices & vertices_, CameraPosition camera_position) {
+        FaceMasks face_masks;
+        Occlusions occlusions;
+        auto vertices = VerticesOptimizer().optimize(vertices_, face_masks, occlusions);
+        auto clip = make_clip(vertices);
         ShaderDataBinder binder;
-        binder.create_buffer(vertices);
+        binder.create_buffer(vertices, face_masks, occlusions);
 
         float theta = 0.0f;
         auto animate = [&theta]() {
@@ -214,45 +388,170 @@ namespace VoxelRenderer {
             theta += 0.5f * pi / 360.0f;
         };
 
-        while (glfwWindowShouldClose(window) == GL_FALSE) {
+        for (uint32_t frame_count = 0; is_running(frame_count); ++frame_count) {
+            PROFILE_ZONE("renderer/frame");
             glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
             glUseProgram(shader_info.id);
 
-            int ww, wh;
-            glfwGetFramebufferSize(window, &ww, &wh);
-
-            auto projection = glm::perspective(
-                glm::radians(30.0f),
-                1.0f * ww / wh,
-                0.1f,
-                10000.0f
-            );
-            glm::vec3 light_direction(-0.5f, -1.0f, 0.0f);
-            glm::vec3 camera_position_ = camera_position(clip);
-            glm::vec3 camera_target(0.0f, 0.0f, 0.0f);
-            auto view = glm::lookAt(
-                camera_position_,
-                camera_target,
-                glm::vec3(0.0f, 0.0f, 1.0f)
+            auto frame = begin_frame(clip, theta, camera_position);
+            binder.bind_params(
+                shader_info,
+                frame.model,
+                frame.view,
+                frame.projection,
+                frame.light_direction,
+                frame.camera_position,
+                frame.camera_target
             );
-            glm::mat4 model(1.0f);
-            model *= glm::rotate(theta, glm::vec3(0.0f, 0.0f, 1.0f));
-            model *= glm::translate(-center);
+            glDrawArrays(GL_POINTS, 0, vertices.size() - 1);
+            animate();
+
+            glfwSwapBuffers(window);
+            glfwPollEvents();
+        }
+    }
+
+    void Renderer::render(SurfaceExtractor & surface, FrameEdit edit, CameraPosition camera_position) {
+        auto clip = make_clip(surface.vertices());
+        ShaderDataBinder binder;
+        binder.create_buffer(surface.vertices(), surface.face_masks(), surface.occlusions());
 
+        float theta = 0.0f;
+        auto animate = [&theta]() {
+            static const double pi = boost::math::constants::pi<double>();
+            theta += 0.5f * pi / 360.0f;
+        };
+
+        for (uint32_t frame_count = 0; is_running(frame_count); ++frame_count) {
+            PROFILE_ZONE("renderer/frame");
+            edit(surface, frame_count);
+            auto ranges = surface.update();
+            if (!ranges.empty()) binder.update_buffer(surface.vertices(), surface.face_masks(), surface.occlusions(), ranges);
+
+            glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+            glUseProgram(shader_info.id);
+
+            auto frame = begin_frame(clip, theta, camera_position);
             binder.bind_params(
                 shader_info,
-                model,
-                view,
-                projection,
-                light_direction,
-                camera_position_,
-                camera_target
+                frame.model,
+                frame.view,
+                frame.projection,
+                frame.light_direction,
+                frame.camera_position,
+                frame.camera_target
             );
-            glDrawArrays(GL_POINTS, 0, vertices.size() - 1);
+            glDrawArrays(GL_POINTS, 0, surface.vertices().size());
             animate();
 
             glfwSwapBuffers(window);
             glfwPollEvents();
         }
+        surface.print_stats();
+    }
+
+    void Renderer::render_chunks(
+        const std::vector<glm::vec2> & chunks,
+        ChunkLoader load,
+        CameraPosition camera_position,
+        uint32_t page_count,
+        uint32_t chunks_per_frame
+    ) {
+        VerticesOptimizer optimizer(false);
+        size_t next_chunk = 0u;
+
+        // chunks come in a few at a time
+        auto poll = [&]() {
+            std::vector<RegionSurface> surfaces;
+            for (uint32_t i = 0; i < chunks_per_frame && next_chunk < chunks.size(); ++i, ++next_chunk) {
+                const auto & chunk = chunks[next_chunk];
+                RegionSurface surface{ VerticesOptimizer::pack(chunk.x, chunk.y, 0), {}, {}, {} };
+                surface.vertices = optimizer.optimize(load(chunk), surface.face_masks, surface.occlusions);
+                surfaces.push_back(std::move(surface));
+            }
+            return surfaces;
+        };
+        render_regions(poll, camera_position, page_count);
+    }
+
+    void Renderer::render_regions(RegionSource poll, CameraPosition camera_position, uint32_t page_count) {
+        ChunkBufferPool pool(shader_info, page_count);
+        VerticesClip clip{ glm::vec3(std::numeric_limits<float>::max()), glm::vec3(std::numeric_limits<float>::lowest()), glm::vec3(0.0f) };
+
+        float theta = 0.0f;
+        auto animate = [&theta]() {
+            static const double pi = boost::math::constants::pi<double>();
+            theta += 0.5f * pi / 360.0f;
+        };
+
+        for (uint32_t frame_count = 0; is_running(frame_count); ++frame_count) {
+            PROFILE_ZONE("renderer/frame");
+
+            // the view is fitted to what has arrived so far
+            for (const auto & surface: poll()) {
+                pool.upload(surface.key, surface.vertices, surface.face_masks, surface.occlusions);
+                if (surface.vertices.empty()) continue;
+
+                auto region_clip = make_clip(surface.vertices);
+                clip.min = glm::min(clip.min, region_clip.min);
+                clip.max = glm::max(clip.max, region_clip.max);
+                clip.center = (clip.min + clip.max) / 2.0f;
+            }
+
+            glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+            glUseProgram(shader_info.id);
+
+            auto frame = begin_frame(clip, theta, camera_position);
+            ShaderDataBinder::bind_uniforms(
+                shader_info,
+                frame.model,
+                frame.view,
+                frame.projection,
+                frame.light_direction,
+                frame.camera_position,
+                frame.camera_target
+            );
+            pool.draw(frame.projection * frame.view * frame.model);
+            animate();
+
+            glfwSwapBuffers(window);
+            glfwPollEvents();
+        }
+        pool.print_stats();
+    }
+
+    Renderer::Frame Renderer::begin_frame(const VerticesClip & clip, float theta, const CameraPosition & camera_position) {
+        int ww, wh;
+        glfwGetFramebufferSize(window, &ww, &wh);
+
+        Frame frame;
+        frame.projection = glm::perspective(
+            glm::radians(30.0f),
+            1.0f * ww / wh,
+            0.1f,
+            10000.0f
+        );
+        frame.light_direction = glm::vec3(-0.5f, -1.0f, 0.0f);
+        frame.camera_position = camera_position(clip);
+        frame.camera_target = glm::vec3(0.0f, 0.0f, 0.0f);
+        frame.view = glm::lookAt(
+            frame.camera_position,
+            frame.camera_target,
+            glm::vec3(0.0f, 0.0f, 1.0f)
+        );
+        frame.model = glm::mat4(1.0f);
+        frame.model *= glm::rotate(theta, glm::vec3(0.0f, 0.0f, 1.0f));
+        frame.model *= glm::translate(-clip.center);
+        return frame;
+    }
+
+    bool Renderer::is_running(uint32_t frame) const {
+        if (frame == 1u && Profiler::is_enabled()) {
+            std::cout << boost::format("## First frame after %.1f ms")
+                % (1e3 * std::chrono::duration<double>(std::chrono::steady_clock::now() - init_time).count())
+                << std::endl;
+        }
+        if (max_frames > 0u && frame >= max_frames) return false;
+        return glfwWindowShouldClose(window) == GL_FALSE;
     }
 }
@@ -7,24 +7,60 @@
 #include <vector>
 #include <map>
 #include <unordered_map>
+#include <unordered_set>
 #include <array>
 #include <algorithm>
 #include <string>
 #include <functional>
+#include <chrono>
 #include <boost/format.hpp>
 #include <boost/filesystem.hpp>
 #include <boost/math/constants/constants.hpp>
 
 #include <lib/gl_helpers.hpp>
+#include <lib/profiler/profiler.hpp>
+#include <lib/memory_tracker/memory_tracker.hpp>
+#include <lib/arena/arena.hpp>
 
 namespace VoxelRenderer {
-    using Vertices = std::vector<std::array<GLfloat, 3>>;
+    struct VerticesTag { static constexpr const char * name = "vertices"; };
+    using Vertices = std::vector<std::array<GLfloat, 3>, MemoryTracker::Allocator<std::array<GLfloat, 3>, VerticesTag>>;
+
+    // bit i is set when the face i of the cube of geometry.glsl (+z, +x, +y, -x, -y, -z) has no neighbour
+    struct FaceMasksTag { static constexpr const char * name = "face_masks"; };
+    using FaceMasks = std::vector<GLubyte, MemoryTracker::Allocator<GLubyte, FaceMasksTag>>;
+
+    // bits 6 and 7 of a face mask are log2 of the edge of the cube, for the coarse voxels of previews
+    static constexpr uint32_t voxel_scale_shift = 6u;
+    inline uint32_t voxel_scale(GLubyte face_mask) { return 1u << (face_mask >> voxel_scale_shift); }
+
+    // ambient occlusion levels in [0, 3] of the 4 corners of the 6 faces of a voxel, 2 bits each: the corner k of
+    // the face i at bit (i % 4) * 8 + k * 2 of the word i / 4, in the order of the triangles of geometry.glsl
+    using Occlusion = std::array<GLuint, 2>;
+    struct OcclusionsTag { static constexpr const char * name = "occlusions"; };
+    using Occlusions = std::vector<Occlusion, MemoryTracker::Allocator<Occlusion, OcclusionsTag>>;
+
+    // the surface of a region of the world, which replaces the previous one of the same key
+    struct RegionSurface {
+        uint64_t key;
+        Vertices vertices;
+        FaceMasks face_masks;
+        // empty when the region is not occluded
+        Occlusions occlusions;
+    };
+
+    // [first, second) ranges of the vertices which changed
+    using IndexRanges = std::vector<std::pair<uint32_t, uint32_t>>;
+
+    class SurfaceExtractor;
 
     struct ShaderInfo {
         GLuint id;
 
         struct {
             GLuint position_location;
+            GLuint face_mask_location;
+            GLuint occlusion_location;
         } attribute;
 
         struct {
@@ -39,22 +75,29 @@ namespace VoxelRenderer {
 
     class ShaderBuilder {
     public:
+        // loads the program from the ProgramCache, or links it from the shaders embedded at build time
         ShaderInfo build();
 
     private:
         static const std::map<uint32_t, std::string> SHADER_NAMES;
 
-        GLuint compile(uint32_t type, std::istream & is);
-        GLuint compile_from_file(uint32_t type, const std::string & relative_path);
+        GLuint link();
+        GLuint compile(uint32_t type, const char * source);
         void validate(uint32_t type, GLuint shader_id);
+        void validate_program(GLuint program_id);
     };
 
     class ShaderDataBinder {
-        GLuint vbo[1];
+        GLuint vbo[3];
         GLuint vao[1];
+        size_t capacity = 0u;
+        bool occluded = false;
 
     public:
-        void create_buffer(const Vertices & vertices);
+        // the voxels are not occluded when the occlusions are empty
+        void create_buffer(const Vertices & vertices, const FaceMasks & face_masks, const Occlusions & occlusions = {});
+        // writes the ranges into the buffers, which are reallocated with some headroom once the vertices outgrow them
+        void update_buffer(const Vertices & vertices, const FaceMasks & face_masks, const Occlusions & occlusions, const IndexRanges & ranges);
         void bind_params(
             const ShaderInfo & info,
             const glm::mat4 & model,
@@ -64,16 +107,73 @@ namespace VoxelRenderer {
             const glm::vec3 & camera_position,
             const glm::vec3 & camera_target
         );
+        // the occlusion attribute from the buffer, or level 0 everywhere
+        static void bind_occlusions(const ShaderInfo & info, GLuint buffer, bool occluded);
+        static void bind_uniforms(
+            const ShaderInfo & info,
+            const glm::mat4 & model,
+            const glm::mat4 & view,
+            const glm::mat4 & projection,
+            const glm::vec3 & light_direction,
+            const glm::vec3 & camera_position,
+            const glm::vec3 & camera_target
+        );
     };
 
     class VerticesOptimizer {
     public:
+        struct VoxelHash {
+            size_t operator()(uint64_t key) const {
+                key ^= key >> 33;
+                key *= 0xff51afd7ed558ccdull;
+                key ^= key >> 33;
+                return key;
+            }
+        };
+
+    private:
+        using VoxelSet = std::unordered_set<uint64_t, VoxelHash, std::equal_to<uint64_t>, Arena::Allocator<uint64_t>>;
+
+        // the hash set is rebuilt on every call, so its nodes live in the arena
+        Arena::MonotonicArena arena{ "optimizer" };
+        bool verbose;
+
+    public:
+        struct Stats {
+            size_t original_vertices = 0u;
+            size_t unique_vertices = 0u;
+            size_t visible_vertices = 0u;
+            size_t exposed_faces = 0u;
+        };
+        Stats stats;
+
+        VerticesOptimizer(bool verbose_ = true) : verbose(verbose_) {}
+
         VoxelRenderer::Vertices optimize(const VoxelRenderer::Vertices & vertices);
+        // the visible voxels, and which of their faces are exposed
+        VoxelRenderer::Vertices optimize(const VoxelRenderer::Vertices & vertices, FaceMasks & face_masks);
+        // and the ambient occlusion of the corners of their faces, baked from the same voxels
+        VoxelRenderer::Vertices optimize(const VoxelRenderer::Vertices & vertices, FaceMasks & face_masks, Occlusions & occlusions, uint32_t threads = 0);
+
+    private:
+        VoxelRenderer::Vertices optimize(const VoxelRenderer::Vertices & vertices, FaceMasks & face_masks, Occlusions * occlusions, uint32_t threads);
+
+    public:
+        // neighbour directions in the order of the face mask bits
+        static const std::array<glm::ivec3, 6> face_directions;
+
+        // voxel coordinates in [-2^20, 2^20) packed into 21 bits each
+        static uint64_t pack(int32_t x, int32_t y, int32_t z);
+        static glm::ivec3 unpack(uint64_t key);
     };
 
     class Renderer {
         GLFWwindow * window = nullptr;
         ShaderInfo shader_info;
+        // 0 renders until the window is closed, TGP_FRAMES
+        uint32_t max_frames = 0u;
+        // from the start of init to the first frame, which is printed
+        std::chrono::steady_clock::time_point init_time;
 
     public:
         struct VerticesClip {
@@ -81,10 +181,45 @@ namespace VoxelRenderer {
             glm::vec3 max;
             glm::vec3 center;
         };
+        using CameraPosition = std::function<glm::vec3(const VerticesClip & clip)>;
+        using ChunkLoader = std::function<Vertices(const glm::vec2 & chunk)>;
+        using FrameEdit = std::function<void(SurfaceExtractor & surface, uint32_t frame)>;
+        using RegionSource = std::function<std::vector<RegionSurface>()>;
 
         static glm::vec3 default_camera_position(const VerticesClip & clip);
+        static VerticesClip make_clip(const Vertices & vertices);
         void init(GLFWwindow * window_);
-        void render(const Vertices & vertices, std::function<glm::vec3(const VerticesClip & clip)> camera_position = &Renderer::default_camera_position);
+        void render(const Vertices & vertices, CameraPosition camera_position = &Renderer::default_camera_position);
+        // edits the surface before every frame, and uploads only the vertices which changed
+        void render(SurfaceExtractor & surface, FrameEdit edit, CameraPosition camera_position = &Renderer::default_camera_position);
+
+        // streams the chunks into a ChunkBufferPool of `page_count` pages, loading at most chunks_per_frame every frame
+        void render_chunks(
+            const std::vector<glm::vec2> & chunks,
+            ChunkLoader load,
+            CameraPosition camera_position = &Renderer::default_camera_position,
+            uint32_t page_count = 1024u,
+            uint32_t chunks_per_frame = 4u
+        );
+        // draws the regions from a ChunkBufferPool of `page_count` pages, polling the source for new surfaces every frame
+        void render_regions(
+            RegionSource poll,
+            CameraPosition camera_position = &Renderer::default_camera_position,
+            uint32_t page_count = 1024u
+        );
+
+    private:
+        struct Frame {
+            glm::mat4 model;
+            glm::mat4 view;
+            glm::mat4 projection;
+            glm::vec3 light_direction;
+            glm::vec3 camera_position;
+            glm::vec3 camera_target;
+        };
+
+        Frame begin_frame(const VerticesClip & clip, float theta, const CameraPosition & camera_position);
+        bool is_running(uint32_t frame) const;
     };
 }
 
@@ -3,6 +3,9 @@
 #include <cmath>
 #include <noise/noise.h>
 #include <lib/voxel_renderer/voxel_renderer.hpp>
+#include <lib/voxel_renderer/software_renderer.hpp>
+#include <lib/mesh_exporter/mesh_exporter.hpp>
+#include <lib/cave_smoothing/cave_smoothing.hpp>
 
 class CaveGenerator {
 public:
@@ -137,13 +140,18 @@ public:
 };
 
 int main() {
+    Profiler::Session profiler_session;
+
     try {
+        CaveGenerator cave(300, 300, 300);
+        auto vertices = CaveSmoothing::Smoother::smooth_from_env(cave.generate(10u));
+        auto exported = MeshExporter::Exporter::export_from_env(vertices);
+        if (VoxelRenderer::SoftwareRenderer::render_from_env(vertices) || exported) return 0;
+
         auto window = GLHelpers::init("perlin worms 04");
         VoxelRenderer::Renderer renderer;
         renderer.init(window);
 
-        CaveGenerator cave(300, 300, 300);
-        auto vertices = cave.generate(10u);
         renderer.render(vertices);
     }
     catch (std::string str) {
@@ -0,0 +1,231 @@
+#include <iostream>
+#include <fstream>
+#include <chrono>
+#include <mutex>
+
+#include <lib/cave_generator/cave_generator.hpp>
+#include <lib/cave_smoothing/cave_smoothing.hpp>
+
+struct Options {
+    uint32_t seeds = 16u;
+    int32_t first_seed = 0;
+    uint32_t chunks = 21u;
+    uint32_t threads = 0u;
+    uint32_t smooth = 0u;
+    std::vector<std::pair<std::string, std::vector<uint32_t>>> sweeps;
+    std::string csv_path;
+    std::string json_path;
+
+    Options(int argc, char ** argv) {
+        Helpers::Arguments arguments(argc, argv);
+        seeds = arguments.get("--seeds", seeds);
+        first_seed = arguments.get("--first-seed", first_seed);
+        chunks = arguments.get("--chunks", chunks);
+        threads = arguments.get("--threads", threads);
+        smooth = arguments.get("--smooth", smooth);
+        csv_path = arguments.get("--csv", csv_path);
+        json_path = arguments.get("--json", json_path);
+        for (const auto & value: arguments.get_all("--sweep")) add_sweep(value);
+        arguments.check();
+        if (seeds == 0u || chunks == 0u) throw std::string("--seeds and --chunks must be positive");
+    }
+
+    void add_sweep(const std::string & value) {
+        auto eq = value.find('=');
+        if (eq == std::string::npos) throw (boost::format("--sweep expects name=v1,v2,...: %s") % value).str();
+
+        auto name = value.substr(0, eq);
+        CaveGenerator::Parameters().get(name);
+
+        std::vector<std::string> tokens;
+        boost::algorithm::split(tokens, value.substr(eq + 1), boost::is_any_of(","));
+        std::vector<uint32_t> values;
+        for (const auto & token: tokens) {
+            size_t end = 0u;
+            if (!token.empty() && std::isdigit(static_cast<unsigned char>(token[0]))) values.push_back(std::stoul(token, &end));
+            if (end == 0u || end != token.size()) throw (boost::format("--sweep expects unsigned values: %s") % value).str();
+        }
+        sweeps.push_back({ name, values });
+    }
+
+    // every combination of the swept values
+    std::vector<CaveGenerator::Parameters> parameter_sets() const {
+        std::vector<CaveGenerator::Parameters> sets{ {} };
+        for (const auto & sweep: sweeps) {
+            std::vector<CaveGenerator::Parameters> next;
+            for (const auto & set: sets) {
+                for (auto value: sweep.second) {
+                    auto parameters = set;
+                    parameters.set(sweep.first, value);
+                    parameters.validate();
+                    next.push_back(parameters);
+                }
+            }
+            sets = next;
+        }
+        return sets;
+    }
+};
+
+struct World {
+    int32_t seed;
+    CaveGenerator::Parameters parameters;
+    size_t carved_volume = 0u;
+    size_t surface_voxels = 0u;
+    uint32_t caves = 0u;
+    std::vector<uint32_t> depth_histogram;
+    double seconds = 0.0;
+    size_t smoothed_surface_voxels = 0u;
+    double smoothing_seconds = 0.0;
+
+    void generate(uint32_t chunks, uint32_t smooth) {
+        auto start = std::chrono::steady_clock::now();
+        CaveGenerator::Generator generator(seed, parameters);
+        glm::vec2 chunk_from{ 0, 0 };
+        glm::vec2 chunk_to{ chunks - 1, chunks - 1 };
+
+        {
+            // the world is released as soon as it is measured
+            auto vertices = generator.generate(chunk_from, chunk_to);
+            VoxelRenderer::VerticesOptimizer optimizer(false);
+            optimizer.optimize(vertices);
+            carved_volume = optimizer.stats.unique_vertices;
+            surface_voxels = optimizer.stats.visible_vertices;
+
+            if (smooth > 0u) {
+                CaveSmoothing::Parameters smoothing;
+                smoothing.iterations = smooth;
+                // worlds are already generated in parallel
+                CaveSmoothing::Smoother smoother(smoothing, 1u);
+                optimizer.optimize(smoother.smooth(vertices));
+                smoothed_surface_voxels = optimizer.stats.visible_vertices;
+                smoothing_seconds = smoother.stats().seconds;
+            }
+        }
+
+        depth_histogram = generator.count_caves(chunk_from, chunk_to);
+        caves = 0u;
+        for (auto count: depth_histogram) caves += count;
+        seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+};
+
+void write_csv(const std::string & path, const std::vector<World> & worlds, uint32_t max_depth) {
+    std::ofstream ofs(path);
+    if (!ofs) throw (boost::format("failed to open %s") % path).str();
+
+    ofs << "seed";
+    for (const auto & field: CaveGenerator::Parameters::fields) ofs << "," << field.first;
+    ofs << ",carved_volume,surface_voxels,caves";
+    for (uint32_t depth = 0; depth < max_depth; ++depth) ofs << ",depth_" << depth;
+    ofs << ",seconds,smoothed_surface_voxels,smoothing_seconds" << std::endl;
+
+    for (const auto & world: worlds) {
+        ofs << world.seed;
+        for (const auto & field: CaveGenerator::Parameters::fields) ofs << "," << world.parameters.*field.second;
+        ofs << "," << world.carved_volume << "," << world.surface_voxels << "," << world.caves;
+        for (uint32_t depth = 0; depth < max_depth; ++depth) {
+            ofs << "," << (depth < world.depth_histogram.size() ? world.depth_histogram[depth] : 0u);
+        }
+        ofs << boost::format(",%.6f,%d,%.6f") % world.seconds % world.smoothed_surface_voxels % world.smoothing_seconds << std::endl;
+    }
+}
+
+void write_json(const std::string & path, const std::vector<World> & worlds, uint32_t threads, double wall_seconds) {
+    std::ofstream ofs(path);
+    if (!ofs) throw (boost::format("failed to open %s") % path).str();
+
+    ofs << "{\"worlds\":[";
+    for (size_t i = 0; i < worlds.size(); ++i) {
+        const auto & world = worlds[i];
+        ofs << (i == 0 ? "" : ",") << "\n{\"seed\":" << world.seed << ",\"parameters\":{";
+        for (size_t j = 0; j < CaveGenerator::Parameters::fields.size(); ++j) {
+            const auto & field = CaveGenerator::Parameters::fields[j];
+            ofs << (j == 0 ? "" : ",") << "\"" << field.first << "\":" << world.parameters.*field.second;
+        }
+        ofs << boost::format("},\"carved_volume\":%d,\"surface_voxels\":%d,\"caves\":%d,\"depth_histogram\":[%s],\"seconds\":%.6f,\"smoothed_surface_voxels\":%d,\"smoothing_seconds\":%.6f}")
+            % world.carved_volume
+            % world.surface_voxels
+            % world.caves
+            % Helpers::to_string(world.depth_histogram, ",")
+            % world.seconds
+            % world.smoothed_surface_voxels
+            % world.smoothing_seconds;
+    }
+    ofs << boost::format("\n],\"threads\":%d,\"wall_seconds\":%.6f,\"worlds_per_hour\":%.2f}")
+        % threads
+        % wall_seconds
+        % (3600.0 * worlds.size() / wall_seconds)
+        << std::endl;
+}
+
+int main(int argc, char ** argv) {
+    Profiler::Session profiler_session;
+
+    try {
+        Options options(argc, argv);
+
+        std::vector<World> worlds;
+        for (const auto & parameters: options.parameter_sets()) {
+            for (uint32_t i = 0; i < options.seeds; ++i) {
+                World world;
+                world.seed = options.first_seed + int32_t(i);
+                world.parameters = parameters;
+                worlds.push_back(world);
+            }
+        }
+
+        auto threads = std::min<uint32_t>(Helpers::thread_count(options.threads), worlds.size());
+        std::cout << boost::format("Generating %d worlds of %dx%d chunks with %d threads")
+            % worlds.size() % options.chunks % options.chunks % threads << std::endl;
+
+        std::mutex mutex;
+        uint32_t done = 0u;
+        auto start = std::chrono::steady_clock::now();
+        Helpers::parallel_for(worlds.size(), [&](uint32_t i) {
+            auto & world = worlds[i];
+            world.generate(options.chunks, options.smooth);
+
+            std::lock_guard<std::mutex> lock(mutex);
+            std::cout << boost::format("[%d/%d] seed %d: %d carved, %d surface, %d caves (%s) in %.2f s")
+                % ++done
+                % worlds.size()
+                % world.seed
+                % world.carved_volume
+                % world.surface_voxels
+                % world.caves
+                % Helpers::to_string(world.depth_histogram, "/")
+                % world.seconds
+                << std::endl;
+            if (options.smooth > 0u) {
+                std::cout << boost::format("    smoothed: %d surface in %.2f s")
+                    % world.smoothed_surface_voxels
+                    % world.smoothing_seconds
+                    << std::endl;
+            }
+        }, threads);
+        auto wall_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        uint32_t max_depth = 0u;
+        double total_seconds = 0.0;
+        for (const auto & world: worlds) {
+            max_depth = std::max<uint32_t>(max_depth, world.depth_histogram.size());
+            total_seconds += world.seconds;
+        }
+
+        std::cout << boost::format("%d worlds in %.2f s (%.2f s per world on average): %.1f worlds/hour")
+            % worlds.size()
+            % wall_seconds
+            % (total_seconds / worlds.size())
+            % (3600.0 * worlds.size() / wall_seconds)
+            << std::endl;
+
+        if (!options.csv_path.empty()) write_csv(options.csv_path, worlds, max_depth);
+        if (!options.json_path.empty()) write_json(options.json_path, worlds, threads, wall_seconds);
+    }
+    catch (std::string str) {
+        std::cerr << str << std::endl;
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,63 @@
+#include <iostream>
+
+#include <lib/cave_generator/cave_generator.hpp>
+
+struct Case {
+    std::string name;
+    CaveGenerator::Parameters parameters;
+    bool valid;
+};
+
+CaveGenerator::Parameters with(const std::vector<std::pair<std::string, uint32_t>> & values) {
+    CaveGenerator::Parameters parameters;
+    for (const auto & [name, value]: values) parameters.set(name, value);
+    return parameters;
+}
+
+int main() {
+    Profiler::Session profiler_session;
+
+    try {
+        std::vector<Case> cases{
+            { "defaults", {}, true },
+            { "max_length = 0", with({ { "max_length", 0u }, { "min_length", 0u } }), false },
+            { "max_length = 1", with({ { "max_length", 1u }, { "min_length", 0u } }), true },
+            { "min_length > max_length", with({ { "min_length", 300u } }), false },
+            { "per_chunk = 0", with({ { "per_chunk", 0u } }), false },
+            { "max_layer = 8", with({ { "max_layer", CaveGenerator::max_cave_layer } }), true },
+            { "max_layer = 9", with({ { "max_layer", CaveGenerator::max_cave_layer + 1u } }), false },
+            { "max_layer = 2^32 - 1", with({ { "max_layer", std::numeric_limits<uint32_t>::max() } }), false },
+            { "max_branches = 5", with({ { "max_branches", CaveGenerator::max_branches_per_cave + 1u } }), false },
+            { "min_branches > max_branches", with({ { "max_branches", 1u }, { "min_branches", 2u } }), false },
+            { "angle_octaves = 0", with({ { "angle_octaves", 0u } }), false },
+            { "radius_octaves = 31", with({ { "radius_octaves", 31u } }), false }
+        };
+
+        uint32_t failures = 0u;
+        for (const auto & c: cases) {
+            // the generator validates its parameters too
+            std::string error;
+            try {
+                CaveGenerator::Generator generator(1335689814, c.parameters);
+                if (c.valid) generator.count_caves({ -2, -2 }, { 2, 2 });
+            }
+            catch (std::string str) {
+                error = str;
+            }
+            auto ok = error.empty() == c.valid;
+            if (!ok) ++failures;
+            std::cout << boost::format("%-28s %s%s")
+                % c.name
+                % (ok ? "ok" : "FAILED")
+                % (error.empty() ? "" : ": " + error)
+                << std::endl;
+        }
+        if (failures > 0u) throw (boost::format("%d of %d parameter sets were not validated as expected") % failures % cases.size()).str();
+    }
+    catch (std::string str) {
+        std::cerr << str << std::endl;
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,64 @@
+#include <iostream>
+#include <random>
+
+#include <lib/cave_pipeline/cave_pipeline.hpp>
+#include <lib/voxel_renderer/software_renderer.hpp>
+#include <lib/mesh_exporter/mesh_exporter.hpp>
+
+int main(int argc, char ** argv) {
+    Profiler::Session profiler_session;
+
+    try {
+        auto path = argc > 1 ? boost::filesystem::path(argv[1]) : boost::filesystem::path(__FILE__).parent_path() / "parameters.conf";
+        std::random_device rand_u32;
+        auto seed = argc > 2 ? std::stoi(argv[2]) : static_cast<int32_t>(rand_u32());
+        std::cout << "Seed: " << seed << std::endl;
+        std::cout << "Parameters: " << path.string() << std::endl;
+        if (!boost::filesystem::exists(path)) CavePipeline::save_parameters(path, {});
+
+        CavePipeline::FileWatcher watcher(path);
+        CavePipeline::Pipeline pipeline(seed, { 0, 0 }, { 10, 10 });
+        // the defaults stand in for an invalid file until it is saved again
+        try {
+            pipeline.update(CavePipeline::load_parameters(path));
+        }
+        catch (std::string str) {
+            std::cerr << boost::format("Rejected the parameters, using the defaults: %s") % str << std::endl;
+            pipeline.update({});
+        }
+        pipeline.print_stats();
+
+        auto camera_position = [](auto clip) {
+            return glm::vec3{
+                -2.0f * clip.max.x,
+                -2.0f * clip.max.y,
+                 4.0f * clip.max.z
+            };
+        };
+        auto exported = MeshExporter::Exporter::export_from_env(pipeline.vertices());
+        if (VoxelRenderer::SoftwareRenderer::render_from_env(pipeline.vertices(), camera_position) || exported) return 0;
+
+        auto window = GLHelpers::init("cave tuner 01");
+        VoxelRenderer::Renderer renderer;
+        renderer.init(window);
+
+        // reruns the stages of the changed parameters whenever the file is saved, keeping the last world on errors
+        auto reload = [&](VoxelRenderer::SurfaceExtractor &, uint32_t) {
+            if (!watcher.changed()) return;
+            try {
+                auto stage = pipeline.update(CavePipeline::load_parameters(path));
+                std::cout << boost::format("Reloaded %s from the %s stage") % path.string() % CavePipeline::stage_name(stage) << std::endl;
+                pipeline.print_stats();
+            }
+            catch (std::string str) {
+                std::cerr << boost::format("Rejected the parameters, keeping the last ones: %s") % str << std::endl;
+            }
+        };
+        renderer.render(pipeline.surface(), reload, camera_position);
+    }
+    catch (std::string str) {
+        std::cerr << str << std::endl;
+        return 1;
+    }
+    return 0;
+}
@@ -3,6 +3,8 @@
 #include <cmath>
 #include <noise/noise.h>
 #include <lib/voxel_renderer/voxel_renderer.hpp>
+#include <lib/voxel_renderer/software_renderer.hpp>
+#include <lib/mesh_exporter/mesh_exporter.hpp>
 #include <optional>
 
 static const auto PI = boost::math::constants::pi<float>();
@@ -212,16 +214,21 @@ private:
 };
 
 int main() {
-    try {
-        auto window = GLHelpers::init("perlin worms 05");
-        VoxelRenderer::Renderer renderer;
-        renderer.init(window);
+    Profiler::Session profiler_session;
 
+    try {
         std::random_device rand_u32;
         auto seed = static_cast<int32_t>(rand_u32());
 
         CaveGenerator cave(seed);
         auto vertices = cave.generate();
+        auto exported = MeshExporter::Exporter::export_from_env(vertices);
+        if (VoxelRenderer::SoftwareRenderer::render_from_env(vertices) || exported) return 0;
+
+        auto window = GLHelpers::init("perlin worms 05");
+        VoxelRenderer::Renderer renderer;
+        renderer.init(window);
+
         renderer.render(vertices);
     }
     catch (std::string str) {
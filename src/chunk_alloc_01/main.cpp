@@ -0,0 +1,90 @@
+#include <iostream>
+#include <chrono>
+
+#include <lib/cave_generator/cave_generator.hpp>
+
+struct Options {
+    int32_t seed = 1335689814;
+    uint32_t chunks = 9u;
+    uint32_t rounds = 3u;
+
+    Options(int argc, char ** argv) {
+        Helpers::Arguments arguments(argc, argv);
+        seed = arguments.get("--seed", seed);
+        chunks = arguments.get("--chunks", chunks);
+        rounds = arguments.get("--rounds", rounds);
+        arguments.check();
+        if (chunks == 0u || rounds == 0u) throw std::string("--chunks and --rounds must be positive");
+    }
+};
+
+int main(int argc, char ** argv) {
+    Profiler::Session profiler_session;
+
+    try {
+        Options options(argc, argv);
+#ifndef ENABLE_MEMORY_TRACKER
+        static_cast<void>(options);
+        throw std::string("the allocations are only counted when built with -DENABLE_MEMORY_TRACKER=ON");
+#else
+        std::cout << "Seed: " << options.seed << std::endl;
+
+        CaveGenerator::Generator generator(options.seed);
+        // centered on the origin, so that the negative chunks are covered too
+        auto half = int32_t(options.chunks / 2u);
+        glm::vec2 chunk_from{ -half, -half };
+        glm::vec2 chunk_to{ int32_t(options.chunks) - 1 - half, int32_t(options.chunks) - 1 - half };
+        CaveGenerator::FootprintIndex index(generator, chunk_from, chunk_to);
+
+        VoxelRenderer::Vertices buffer;
+        Arena::MonotonicArena arena("cave_generator");
+        size_t vertices = 0u;
+        auto generate_all = [&]() {
+            vertices = 0u;
+            for (int32_t x = chunk_from.x; x <= chunk_to.x; ++x) {
+                for (int32_t y = chunk_from.y; y <= chunk_to.y; ++y) {
+                    buffer.clear();
+                    generator.generate_chunk({ x, y }, index, buffer, arena);
+                    vertices += buffer.size();
+                }
+            }
+        };
+
+        // the buffer and the arena grow to the largest chunk, after which every chunk fits in them
+        auto before = MemoryTracker::totals();
+        generate_all();
+        auto after = MemoryTracker::totals();
+        std::cout << boost::format("Warm-up: %d chunks, %d vertices, %d allocations of %d bytes")
+            % (options.chunks * options.chunks)
+            % vertices
+            % (after.allocations - before.allocations)
+            % (after.allocated_bytes - before.allocated_bytes)
+            << std::endl;
+
+        uint64_t allocations = 0u;
+        for (uint32_t round = 0; round < options.rounds; ++round) {
+            auto start = std::chrono::steady_clock::now();
+            before = MemoryTracker::totals();
+            generate_all();
+            after = MemoryTracker::totals();
+            std::cout << boost::format("Round %d: %d allocations of %d bytes in %.2f s")
+                % (round + 1)
+                % (after.allocations - before.allocations)
+                % (after.allocated_bytes - before.allocated_bytes)
+                % std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count()
+                << std::endl;
+            allocations += after.allocations - before.allocations;
+        }
+        if (allocations > 0u) {
+            throw (boost::format("generate_chunk allocated %d times after the warm-up") % allocations).str();
+        }
+        std::cout << "No allocation after the warm-up" << std::endl;
+#endif
+    }
+    catch (std::string str) {
+        std::cerr << str << std::endl;
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,147 @@
+#include <iostream>
+#include <random>
+#include <chrono>
+#include <thread>
+#include <numeric>
+
+#include <lib/chunk_service/chunk_service.hpp>
+
+struct Options {
+    std::string command;
+    boost::filesystem::path socket = ChunkService::default_socket_path();
+    uint32_t threads = 0u;
+    uint64_t cache_mb = 256u;
+    int32_t seed = 1335689814;
+    uint32_t chunks = 16u;
+    uint32_t lod = 0u;
+    uint32_t clients = 4u;
+    uint32_t batches = 16u;
+    uint32_t batch = 16u;
+    bool verify = false;
+
+    Options(int argc, char ** argv) {
+        Helpers::Arguments arguments(argc, argv, { "--verify" });
+        if (arguments.positional().size() != 1u) throw std::string("usage: chunk_service_01 serve|bench|stats|stop [options]");
+        command = arguments.positional()[0];
+        socket = arguments.get("--socket", socket.string());
+        threads = arguments.get("--threads", threads);
+        cache_mb = arguments.get("--cache", cache_mb);
+        seed = arguments.get("--seed", seed);
+        chunks = arguments.get("--chunks", chunks);
+        lod = arguments.get("--lod", lod);
+        clients = arguments.get("--clients", clients);
+        batches = arguments.get("--batches", batches);
+        batch = arguments.get("--batch", batch);
+        verify = arguments.flag("--verify");
+        arguments.check();
+        if (chunks == 0u || clients == 0u || batch == 0u) throw std::string("--chunks, --clients and --batch must be positive");
+    }
+};
+
+// the voxels of a chunk as every consumer sees them, rounded and without duplicates
+VoxelRenderer::Vertices voxel_set(const VoxelRenderer::Vertices & vertices) {
+    return ChunkCache::VoxelCodec::decompress(ChunkCache::VoxelCodec::compress(vertices));
+}
+
+// clients which request random batches of the same chunks at once, so that they overlap in flight and in the cache
+void bench(const Options & options) {
+    std::vector<double> seconds(options.clients);
+    std::vector<size_t> voxels(options.clients);
+    // the error of every client, rethrown after they all joined
+    std::vector<std::string> errors(options.clients);
+    std::vector<std::thread> clients;
+    auto start = std::chrono::steady_clock::now();
+    for (uint32_t c = 0; c < options.clients; ++c) {
+        clients.emplace_back([&, c]() {
+            try {
+                ChunkService::Client client(options.socket);
+                std::mt19937 random(options.seed + c);
+                for (uint32_t b = 0; b < options.batches; ++b) {
+                    std::vector<ChunkService::ChunkRequest> requests(options.batch);
+                    for (auto & r: requests) {
+                        r.seed = options.seed;
+                        r.x = random() % options.chunks;
+                        r.y = random() % options.chunks;
+                        r.lod = options.lod;
+                    }
+                    auto batch_start = std::chrono::steady_clock::now();
+                    for (const auto & chunk: client.generate(requests)) voxels[c] += chunk.voxels;
+                    seconds[c] += std::chrono::duration<double>(std::chrono::steady_clock::now() - batch_start).count();
+                }
+            }
+            catch (std::string str) {
+                errors[c] = str;
+            }
+        });
+    }
+    for (auto & client: clients) client.join();
+    for (uint32_t c = 0; c < options.clients; ++c) {
+        if (!errors[c].empty()) throw (boost::format("client %d: %s") % c % errors[c]).str();
+    }
+    auto wall_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    size_t total_voxels = 0u;
+    for (auto v: voxels) total_voxels += v;
+    auto chunks = options.clients * options.batches * options.batch;
+    std::cout << boost::format("%d clients: %d chunks (%d voxels) in %.2f s, %.1f chunks/s, %.2f ms per batch on average")
+        % options.clients
+        % chunks
+        % total_voxels
+        % wall_seconds
+        % (chunks / wall_seconds)
+        % (1e3 * std::accumulate(seconds.begin(), seconds.end(), 0.0) / (options.clients * options.batches))
+        << std::endl;
+
+    if (options.verify) {
+        // the service against the generator in this process
+        CaveGenerator::Generator cave(options.seed);
+        glm::vec2 chunk_to(options.chunks - 1u, options.chunks - 1u);
+        CaveGenerator::FootprintIndex index(cave, { 0, 0 }, chunk_to);
+        std::vector<ChunkService::ChunkRequest> requests;
+        for (uint32_t x = 0; x < options.chunks; x += 3u) {
+            for (uint32_t y = 0; y < options.chunks; y += 3u) requests.push_back({ options.seed, ChunkService::Generator::caves, int32_t(x), int32_t(y), 0u });
+        }
+        ChunkService::Client client(options.socket);
+        auto chunks = client.generate(requests);
+        uint32_t mismatches = 0u;
+        for (size_t i = 0; i < requests.size(); ++i) {
+            glm::vec2 chunk(requests[i].x, requests[i].y);
+            if (ChunkCache::VoxelCodec::decompress(chunks[i]) != voxel_set(cave.generate_chunk(chunk, index))) ++mismatches;
+        }
+        std::cout << boost::format("Verified %d chunks: %d differ") % requests.size() % mismatches << std::endl;
+        if (mismatches > 0u) throw std::string("the service differs from the generator");
+    }
+
+    ChunkService::Client(options.socket).stats().print();
+}
+
+int main(int argc, char ** argv) {
+    Profiler::Session profiler_session;
+
+    try {
+        Options options(argc, argv);
+        if (options.command == "serve") {
+            ChunkService::Server server(options.socket, options.threads, options.cache_mb << 20);
+            std::cout << boost::format("Serving chunks on %s") % options.socket.string() << std::endl;
+            server.run();
+            server.stats().print();
+        }
+        else if (options.command == "bench") {
+            bench(options);
+        }
+        else if (options.command == "stats") {
+            ChunkService::Client(options.socket).stats().print();
+        }
+        else if (options.command == "stop") {
+            ChunkService::Client(options.socket).shutdown();
+        }
+        else {
+            throw (boost::format("unknown command: %s") % options.command).str();
+        }
+    }
+    catch (std::string str) {
+        std::cerr << str << std::endl;
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,89 @@
+#include <iostream>
+#include <chrono>
+
+#include <lib/cave_generator/cave_generator.hpp>
+#include <lib/chunk_cache/memory_cache.hpp>
+
+struct Options {
+    int32_t seed = 1335689814;
+    uint32_t view = 6u;
+    uint32_t path = 10u;
+    uint32_t laps = 2u;
+    uint32_t steps = 96u;
+    uint32_t hot = 0u;
+    uint64_t cold_mb = 64u;
+
+    Options(int argc, char ** argv) {
+        Helpers::Arguments arguments(argc, argv);
+        seed = arguments.get("--seed", seed);
+        view = arguments.get("--view", view);
+        path = arguments.get("--path", path);
+        laps = arguments.get("--laps", laps);
+        steps = arguments.get("--steps", steps);
+        hot = arguments.get("--hot", hot);
+        cold_mb = arguments.get("--cold", cold_mb);
+        arguments.check();
+        if (laps == 0u || steps == 0u) throw std::string("--laps and --steps must be positive");
+    }
+};
+
+int main(int argc, char ** argv) {
+    Profiler::Session profiler_session;
+
+    try {
+        Options options(argc, argv);
+        CaveGenerator::Generator cave(options.seed);
+        ChunkCache::DiskCache disk;
+
+        // the camera circles around the center of the world, which is as large as the path and the view around it
+        auto reach = int32_t(options.path + options.view);
+        glm::vec2 center(reach, reach);
+        glm::vec2 chunk_from{ 0, 0 };
+        glm::vec2 chunk_to{ 2 * reach, 2 * reach };
+        CaveGenerator::FootprintIndex index(cave, chunk_from, chunk_to);
+
+        std::vector<glm::ivec2> view;
+        auto radius = int32_t(options.view);
+        for (auto x = -radius; x <= radius; ++x) {
+            for (auto y = -radius; y <= radius; ++y) {
+                if (x * x + y * y <= radius * radius) view.push_back({ x, y });
+            }
+        }
+        std::sort(view.begin(), view.end(), [](const auto & a, const auto & b) { return a.x * a.x + a.y * a.y < b.x * b.x + b.y * b.y; });
+
+        // the chunks in the view stay hot by default, the ones the camera left are compressed
+        auto hot = options.hot > 0u ? options.hot : uint32_t(view.size());
+        ChunkCache::MemoryCache cache(hot, options.cold_mb << 20);
+        std::cout << boost::format("Seed: %d, %dx%d chunks, view of %d chunks, %d hot chunks, %d MB cold tier")
+            % options.seed
+            % (2 * reach + 1)
+            % (2 * reach + 1)
+            % view.size()
+            % hot
+            % options.cold_mb
+            << std::endl;
+
+        size_t voxels = 0u;
+        auto start = std::chrono::steady_clock::now();
+        for (uint32_t step = 0; step < options.laps * options.steps; ++step) {
+            auto angle = 2.0f * boost::math::constants::pi<float>() * step / options.steps;
+            glm::ivec2 camera(glm::round(center + float(options.path) * glm::vec2(std::cos(angle), std::sin(angle))));
+            for (const auto & offset: view) {
+                glm::vec2 chunk(camera + offset);
+                voxels += cache.fetch(cave.chunk_hash(chunk), [&]() {
+                    return disk.fetch(cave.chunk_hash(chunk), [&]() { return cave.generate_chunk(chunk, index); });
+                }).size();
+            }
+        }
+        auto seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        std::cout << boost::format("%d steps in %.2f s, %d voxels fetched") % (options.laps * options.steps) % seconds % voxels << std::endl;
+        cache.print_stats();
+        disk.print_stats();
+    }
+    catch (std::string str) {
+        std::cerr << str << std::endl;
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,107 @@
+#include <iostream>
+#include <cstring>
+#include <noise/noise.h>
+
+#include <lib/erosion/erosion.hpp>
+
+struct Options {
+    int32_t seed = 1335689814;
+    uint32_t size = 1024u;
+    uint32_t threads = 4u;
+    float droplets = 1.0f;
+    uint32_t thermal = 10u;
+
+    Options(int argc, char ** argv) {
+        Helpers::Arguments arguments(argc, argv);
+        seed = arguments.get("--seed", seed);
+        size = arguments.get("--size", size);
+        threads = arguments.get("--threads", threads);
+        droplets = arguments.get("--droplets", droplets);
+        thermal = arguments.get("--thermal", thermal);
+        arguments.check();
+        if (size == 0u || threads == 0u) throw std::string("--size and --threads must be positive");
+        if (droplets <= 0.0f) throw std::string("--droplets must be positive");
+    }
+};
+
+// the heightmap of perlin_worms_01, in the levels of its image
+Erosion::Heightmap make_heightmap(int32_t seed, uint32_t size) {
+    noise::module::Perlin perlin;
+    perlin.SetSeed(seed);
+    perlin.SetOctaveCount(6);
+    perlin.SetFrequency(10.0f / 2000.0f);
+
+    Erosion::Heightmap heightmap(size, size);
+    for (uint32_t y = 0; y < size; ++y) {
+        for (uint32_t x = 0; x < size; ++x) {
+            auto v = std::clamp(perlin.GetValue(1.0 * x, 1.0 * y, 0.0), -1.0, 1.0);
+            heightmap.at(x, y) = (v + 1.0) / 2.0 * 255.0;
+        }
+    }
+    return heightmap;
+}
+
+// the pixels whose heights differ in any bit
+size_t compare(const Erosion::Heightmap & a, const Erosion::Heightmap & b) {
+    size_t differences = 0u;
+    for (size_t i = 0; i < a.heights.size(); ++i) {
+        differences += std::memcmp(&a.heights[i], &b.heights[i], sizeof(float)) != 0;
+    }
+    return differences;
+}
+
+int main(int argc, char ** argv) {
+    Profiler::Session profiler_session;
+
+    try {
+        Options options(argc, argv);
+        std::cout << boost::format("Seed: %d, %dx%d pixels") % options.seed % options.size % options.size << std::endl;
+
+        Erosion::Parameters parameters;
+        parameters.droplets_per_pixel = options.droplets;
+        parameters.thermal_iterations = options.thermal;
+        auto input = make_heightmap(options.seed, options.size);
+
+        // the hydraulic and the thermal passes are compared apart, so that a difference points at one of them
+        std::vector<Erosion::Heightmap> hydraulic;
+        std::vector<Erosion::Heightmap> thermal;
+        std::vector<Erosion::Eroder::Stats> stats;
+        for (auto threads: { 1u, options.threads }) {
+            Erosion::Eroder eroder(parameters, options.seed, threads);
+            auto map = input;
+            eroder.hydraulic(map);
+            hydraulic.push_back(map);
+            eroder.thermal(map);
+            thermal.push_back(map);
+            stats.push_back(eroder.stats());
+            std::cout << boost::format("%d threads: %d droplets (%d steps) over %d tiles in %.3f s, %d thermal iterations in %.3f s")
+                % threads
+                % eroder.stats().droplets
+                % eroder.stats().steps
+                % eroder.stats().tiles
+                % eroder.stats().hydraulic_seconds
+                % eroder.stats().thermal_iterations
+                % eroder.stats().thermal_seconds
+                << std::endl;
+        }
+
+        auto hydraulic_differences = compare(hydraulic[0], hydraulic[1]);
+        auto thermal_differences = compare(thermal[0], thermal[1]);
+        auto same_droplets = stats[0].droplets == stats[1].droplets && stats[0].steps == stats[1].steps;
+        std::cout << boost::format("1 against %d threads: %d pixels differ after the hydraulic pass, %d after the thermal pass%s")
+            % options.threads
+            % hydraulic_differences
+            % thermal_differences
+            % (same_droplets ? "" : ", the droplets or their steps differ")
+            << std::endl;
+        if (hydraulic_differences > 0u || thermal_differences > 0u || !same_droplets) {
+            throw (boost::format("the erosion with %d threads differs from the one with 1 thread") % options.threads).str();
+        }
+    }
+    catch (std::string str) {
+        std::cerr << str << std::endl;
+        return 1;
+    }
+
+    return 0;
+}
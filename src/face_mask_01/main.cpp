@@ -0,0 +1,166 @@
+#include <iostream>
+#include <chrono>
+#include <unordered_set>
+
+#include <lib/cave_generator/cave_generator.hpp>
+#include <lib/progressive/progressive.hpp>
+
+using VoxelRenderer::VerticesOptimizer;
+
+struct Options {
+    int32_t seed = 1335689814;
+    uint32_t chunks = 21u;
+    uint32_t rounds = 5u;
+
+    Options(int argc, char ** argv) {
+        Helpers::Arguments arguments(argc, argv);
+        seed = arguments.get("--seed", seed);
+        chunks = arguments.get("--chunks", chunks);
+        rounds = arguments.get("--rounds", rounds);
+        arguments.check();
+        if (chunks == 0u || rounds == 0u) throw std::string("--chunks and --rounds must be positive");
+    }
+};
+
+// the optimizer before the face masks: a voxel is visible when any neighbour is empty, and nothing else is kept
+VoxelRenderer::Vertices visible_only(const VoxelRenderer::Vertices & vertices, Arena::MonotonicArena & arena) {
+    arena.reset();
+    std::unordered_set<uint64_t, VerticesOptimizer::VoxelHash, std::equal_to<uint64_t>, Arena::Allocator<uint64_t>> data(
+        0, VerticesOptimizer::VoxelHash(), std::equal_to<uint64_t>(), Arena::Allocator<uint64_t>(&arena)
+    );
+    for (const auto & v: vertices) data.insert(VerticesOptimizer::pack(std::round(v[0]), std::round(v[1]), std::round(v[2])));
+    auto is_nothing = [&data](int32_t x, int32_t y, int32_t z) { return data.find(VerticesOptimizer::pack(x, y, z)) == data.end(); };
+
+    VoxelRenderer::Vertices result;
+    result.reserve(data.size());
+    for (auto key: data) {
+        auto v = VerticesOptimizer::unpack(key);
+        if (
+            is_nothing(v.x    , v.y    , v.z - 1) ||
+            is_nothing(v.x    , v.y    , v.z + 1) ||
+            is_nothing(v.x    , v.y - 1, v.z    ) ||
+            is_nothing(v.x    , v.y + 1, v.z    ) ||
+            is_nothing(v.x - 1, v.y    , v.z    ) ||
+            is_nothing(v.x + 1, v.y    , v.z    )
+        ) {
+            result.push_back({ GLfloat(v.x), GLfloat(v.y), GLfloat(v.z) });
+        }
+    }
+    return result;
+}
+
+// the mean and the best of the rounds, in ms
+std::pair<double, double> time_rounds(uint32_t rounds, const std::function<void()> & callback) {
+    double sum = 0.0;
+    double best = std::numeric_limits<double>::max();
+    for (uint32_t i = 0; i < rounds; ++i) {
+        auto start = std::chrono::steady_clock::now();
+        callback();
+        auto ms = 1e3 * std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        sum += ms;
+        best = std::min(best, ms);
+    }
+    return { sum / rounds, best };
+}
+
+// compares the masks with a scan of the 6 neighbours in a sorted list of the voxels, on the lattice of the stride,
+// and checks that the voxels left out have no empty neighbour; returns the mismatches
+size_t check(
+    const VoxelRenderer::Vertices & vertices,
+    const VoxelRenderer::Vertices & visible,
+    const VoxelRenderer::FaceMasks & face_masks,
+    uint32_t stride
+) {
+    auto cell = [stride](float v) {
+        auto i = int32_t(std::round(v));
+        auto s = int32_t(stride);
+        return i >= 0 ? i / s : -((-i + s - 1) / s);
+    };
+    std::vector<uint64_t> keys;
+    keys.reserve(vertices.size());
+    for (const auto & v: vertices) keys.push_back(VerticesOptimizer::pack(cell(v[0]), cell(v[1]), cell(v[2])));
+    Helpers::unique(keys);
+    auto has = [&keys](const glm::ivec3 & v) { return std::binary_search(keys.begin(), keys.end(), VerticesOptimizer::pack(v.x, v.y, v.z)); };
+    auto mask_of = [&has](const glm::ivec3 & v) {
+        GLubyte mask = 0u;
+        for (uint32_t i = 0; i < VerticesOptimizer::face_directions.size(); ++i) {
+            if (!has(v + VerticesOptimizer::face_directions[i])) mask |= GLubyte(1u << i);
+        }
+        return mask;
+    };
+
+    uint32_t scale_bits = 0u;
+    while ((1u << scale_bits) < stride) ++scale_bits;
+    size_t mismatches = visible.size() == face_masks.size() ? 0u : 1u;
+    std::vector<uint64_t> visible_keys;
+    for (size_t i = 0; i < std::min(visible.size(), face_masks.size()); ++i) {
+        glm::ivec3 v{ cell(visible[i][0]), cell(visible[i][1]), cell(visible[i][2]) };
+        visible_keys.push_back(VerticesOptimizer::pack(v.x, v.y, v.z));
+        auto expected = GLubyte(mask_of(v) | scale_bits << VoxelRenderer::voxel_scale_shift);
+        if (!has(v) || face_masks[i] != expected) ++mismatches;
+    }
+    Helpers::unique(visible_keys);
+    if (visible_keys.size() != visible.size()) ++mismatches;
+    for (auto key: keys) {
+        auto hidden = !std::binary_search(visible_keys.begin(), visible_keys.end(), key);
+        if (hidden && mask_of(VerticesOptimizer::unpack(key)) != 0u) ++mismatches;
+    }
+    return mismatches;
+}
+
+int main(int argc, char ** argv) {
+    Profiler::Session profiler_session;
+
+    try {
+        Options options(argc, argv);
+        std::cout << "Seed: " << options.seed << std::endl;
+
+        CaveGenerator::Generator cave(options.seed);
+        auto vertices = cave.generate({ 0, 0 }, { options.chunks - 1, options.chunks - 1 });
+
+        VerticesOptimizer optimizer(false);
+        VoxelRenderer::FaceMasks face_masks;
+        auto visible = optimizer.optimize(vertices, face_masks);
+        const auto & stats = optimizer.stats;
+        std::cout << boost::format("Voxels: %d carved, %d unique, %d visible, %d exposed faces of %d (%.1f%%)")
+            % stats.original_vertices
+            % stats.unique_vertices
+            % stats.visible_vertices
+            % stats.exposed_faces
+            % (6u * stats.visible_vertices)
+            % (100.0 * stats.exposed_faces / std::max<size_t>(6u * stats.visible_vertices, 1u))
+            << std::endl;
+
+        Arena::MonotonicArena arena("visible_only");
+        size_t visible_before = 0u;
+        auto before = time_rounds(options.rounds, [&]() { visible_before = visible_only(vertices, arena).size(); });
+        auto after = time_rounds(options.rounds, [&]() { optimizer.optimize(vertices, face_masks); });
+        std::cout << boost::format("Visibility only (before): %.1f ms on average, %.1f ms at best") % before.first % before.second << std::endl;
+        std::cout << boost::format("Visibility and face masks: %.1f ms on average, %.1f ms at best") % after.first % after.second << std::endl;
+
+        auto start = std::chrono::steady_clock::now();
+        auto mismatches = check(vertices, visible, face_masks, 1u);
+        if (visible_before != visible.size()) ++mismatches;
+        std::cout << boost::format("Checked %d masks and %d hidden voxels against the neighbour scan in %.1f ms: %d mismatches")
+            % visible.size()
+            % (stats.unique_vertices - visible.size())
+            % (1e3 * std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count())
+            % mismatches
+            << std::endl;
+
+        // the coarse voxels of the previews carry their scale in the bits 6 and 7
+        for (uint32_t stride = 2u; stride <= Progressive::max_stride; stride *= 2u) {
+            auto surface = Progressive::make_surface(0u, vertices, stride);
+            auto stride_mismatches = check(vertices, surface.vertices, surface.face_masks, stride);
+            std::cout << boost::format("Stride %d: checked %d masks: %d mismatches") % stride % surface.vertices.size() % stride_mismatches << std::endl;
+            mismatches += stride_mismatches;
+        }
+        if (mismatches > 0u) throw (boost::format("%d face masks differ from the neighbour scan") % mismatches).str();
+    }
+    catch (std::string str) {
+        std::cerr << str << std::endl;
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,162 @@
+#include <iostream>
+#include <random>
+#include <chrono>
+#include <cstdlib>
+#include <noise/noise.h>
+#include <opencv2/opencv.hpp>
+
+#include <lib/height_pyramid/height_pyramid.hpp>
+
+struct Options {
+    int32_t seed = 1335689814;
+    uint32_t size = 16384u;
+    uint32_t threads = 0u;
+    std::string output = "heightmap.tgph";
+    uint32_t queries = 1000u;
+    uint32_t verify = 16u;
+    float detail = 0.1f;
+
+    Options(int argc, char ** argv) {
+        Helpers::Arguments arguments(argc, argv);
+        seed = arguments.get("--seed", seed);
+        size = arguments.get("--size", size);
+        threads = arguments.get("--threads", threads);
+        output = arguments.get("--output", output);
+        queries = arguments.get("--queries", queries);
+        verify = arguments.get("--verify", verify);
+        detail = arguments.get("--detail", detail);
+        arguments.check();
+        if (size == 0u) throw std::string("--size must be positive");
+        if (detail <= 0.0f) throw std::string("--detail must be positive");
+    }
+};
+
+double seconds_since(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+void print_latencies(const std::string & name, std::vector<double> latencies) {
+    if (latencies.empty()) return;
+    std::sort(latencies.begin(), latencies.end());
+    double sum = 0.0;
+    for (auto l: latencies) sum += l;
+    std::cout << boost::format("%s: %.1f us on average, %.1f us p50, %.1f us p99, %.1f us at most")
+        % name
+        % (1e6 * sum / latencies.size())
+        % (1e6 * latencies[latencies.size() / 2])
+        % (1e6 * latencies[latencies.size() * 99 / 100])
+        % (1e6 * latencies.back())
+        << std::endl;
+}
+
+int main(int argc, char ** argv) {
+    Profiler::Session profiler_session;
+
+    try {
+        Options options(argc, argv);
+        std::cout << "Seed: " << options.seed << std::endl;
+
+        // the heightmap of perlin_worms_01, sampled tile by tile into the pyramid
+        noise::module::Perlin perlin;
+        perlin.SetSeed(options.seed);
+        perlin.SetOctaveCount(6);
+        perlin.SetFrequency(10.0f / 2000.0f);
+        {
+            HeightPyramid::Pyramid built(options.output, options.size, options.size, [&](uint32_t x, uint32_t y) {
+                auto v = glm::clamp(perlin.GetValue(x, y, 0.0), -1.0, 1.0);
+                return float((v + 1.0) / 2.0 * 255.0);
+            }, options.threads);
+            built.print_stats();
+        }
+
+        auto start = std::chrono::steady_clock::now();
+        HeightPyramid::Pyramid pyramid(options.output);
+        std::cout << boost::format("Height pyramid mapped in %.3f ms") % (1e3 * seconds_since(start)) << std::endl;
+
+        std::mt19937 random(uint32_t(options.seed));
+        auto max_extent = std::max(options.size / 4u, 1u);
+        std::vector<double> range_latencies;
+        std::vector<double> highest_latencies;
+        uint32_t mismatches = 0u;
+        for (uint32_t i = 0; i < options.queries; ++i) {
+            glm::uvec2 min{ random() % options.size, random() % options.size };
+            auto max = glm::min(min + glm::uvec2(1u + random() % max_extent, 1u + random() % max_extent), glm::uvec2(options.size));
+
+            start = std::chrono::steady_clock::now();
+            auto cell = pyramid.range(min, max);
+            range_latencies.push_back(seconds_since(start));
+
+            start = std::chrono::steady_clock::now();
+            auto highest = pyramid.highest(min, max);
+            highest_latencies.push_back(seconds_since(start));
+
+            // against every height of the range
+            if (i < options.verify) {
+                HeightPyramid::Cell expected{ std::numeric_limits<float>::max(), std::numeric_limits<float>::lowest(), 0.0f };
+                double sum = 0.0;
+                for (auto y = min.y; y < max.y; ++y) {
+                    for (auto x = min.x; x < max.x; ++x) {
+                        auto h = pyramid.height(x, y);
+                        expected.min = std::min(expected.min, h);
+                        expected.max = std::max(expected.max, h);
+                        sum += h;
+                    }
+                }
+                auto mean = sum / (double(max.x - min.x) * (max.y - min.y));
+                auto at = highest.first;
+                if (
+                    cell.min != expected.min || cell.max != expected.max || std::abs(cell.mean - mean) > 1e-3 * std::max(1.0, std::abs(mean)) ||
+                    highest.second != expected.max || at.x < min.x || at.x >= max.x || at.y < min.y || at.y >= max.y ||
+                    pyramid.height(at.x, at.y) != expected.max
+                ) {
+                    ++mismatches;
+                }
+            }
+        }
+        print_latencies("Range queries", range_latencies);
+        print_latencies("Highest point queries", highest_latencies);
+        if (options.verify > 0u) {
+            std::cout << boost::format("Verified %d queries: %d mismatches") % std::min(options.verify, options.queries) % mismatches << std::endl;
+        }
+
+        // the cells for a viewer at the center, finer towards it
+        start = std::chrono::steady_clock::now();
+        auto nodes = pyramid.select(glm::vec2(options.size / 2.0f), options.detail);
+        std::cout << boost::format("LOD selection: %d cells instead of %d heights in %.3f ms")
+            % nodes.size()
+            % (uint64_t(options.size) * options.size)
+            % (1e3 * seconds_since(start))
+            << std::endl;
+
+        // the means of the finest level which fits the display
+        uint32_t level = 0u;
+        while (level + 1u < pyramid.levels() && std::max(pyramid.size(level).x, pyramid.size(level).y) > 2000u) ++level;
+        auto size = pyramid.size(level);
+        cv::Mat image = cv::Mat::zeros(size.y, size.x, CV_8UC3);
+        for (uint32_t y = 0; y < size.y; ++y) {
+            for (uint32_t x = 0; x < size.x; ++x) {
+                auto c = static_cast<uint8_t>(glm::clamp(pyramid.cell(level, x, y).mean, 0.0f, 255.0f));
+                image.at<cv::Vec3b>(y, x)[0] = c;
+                image.at<cv::Vec3b>(y, x)[1] = c;
+                image.at<cv::Vec3b>(y, x)[2] = c;
+            }
+        }
+        if (mismatches > 0u) throw (boost::format("%d queries differ from the heights") % mismatches).str();
+
+        // TGP_SNAPSHOT writes the image instead of showing it
+        if (auto path = std::getenv("TGP_SNAPSHOT")) {
+            if (!cv::imwrite(path, image)) throw (boost::format("Failed to write the snapshot: %s") % path).str();
+            return 0;
+        }
+        cv::namedWindow("height pyramid 01");
+        cv::imshow("height pyramid 01", image);
+        cv::waitKey(1000 * 100);
+        cv::destroyWindow("height pyramid 01");
+    }
+    catch (std::string str) {
+        std::cerr << str << std::endl;
+        return 1;
+    }
+
+    return 0;
+}
@@ -3,6 +3,7 @@
 #include <random>
 #include <noise/noise.h>
 #include <opencv2/opencv.hpp>
+#include <lib/erosion/erosion.hpp>
 
 void display(const cv::Mat & image) {
     std::string windowName = "windowName";
@@ -22,37 +23,69 @@ double threshold(double v, double t, double l, double u) {
     return v < t ? l : u;
 }
 
-int main() {
-    cv::Mat image = cv::Mat::zeros(2000, 2000, CV_8UC3);
-    const uint32_t x_length = image.cols;
-    const uint32_t y_length = image.rows;
-
-    noise::module::Perlin perlin;
-    std::random_device rand_u32;
-    perlin.SetSeed(static_cast<int32_t>(rand_u32()));
-    perlin.SetOctaveCount(6);
-    perlin.SetFrequency(10.0f / 2000.0f);
-
-    std::cout << "seed: " << perlin.GetSeed() << std::endl;
-
-    for (uint32_t x = 0; x < x_length; ++x) {
-        for (uint32_t y = 0; y < y_length; ++y) {
-            double v = perlin.GetValue(
-                1.0 * x,
-                1.0 * y,
-                0.0
-            );
-            v = clamp(v, -1.0, 1.0);
-            v = (v + 1.0) / 2.0;
-            //v = std::abs(v);
-            //v = threshold(std::abs(v), 0.05, 0.0, 1.0);
-            auto c = static_cast<uint8_t>(v * 255.0);
-            image.at<cv::Vec3b>(x,y)[0] = c;
-            image.at<cv::Vec3b>(x,y)[1] = c;
-            image.at<cv::Vec3b>(x,y)[2] = c;
+int main(int argc, char ** argv) {
+    Profiler::Session profiler_session;
+
+    try {
+        // heightmap_size [seed]
+        const uint32_t size = argc > 1 ? std::stoul(argv[1]) : 2000u;
+        std::random_device rand_u32;
+        auto seed = argc > 2 ? std::stoi(argv[2]) : static_cast<int32_t>(rand_u32());
+
+        cv::Mat image = cv::Mat::zeros(size, size, CV_8UC3);
+        const uint32_t x_length = image.cols;
+        const uint32_t y_length = image.rows;
+
+        noise::module::Perlin perlin;
+        perlin.SetSeed(seed);
+        perlin.SetOctaveCount(6);
+        perlin.SetFrequency(10.0f / 2000.0f);
+
+        std::cout << "seed: " << perlin.GetSeed() << std::endl;
+
+        // heights in the levels of the image, which erode in the same unit as a pixel
+        Erosion::Heightmap heightmap(x_length, y_length);
+        Helpers::parallel_for(x_length, [&](uint32_t x) {
+            for (uint32_t y = 0; y < y_length; ++y) {
+                double v = perlin.GetValue(
+                    1.0 * x,
+                    1.0 * y,
+                    0.0
+                );
+                v = clamp(v, -1.0, 1.0);
+                v = (v + 1.0) / 2.0;
+                //v = std::abs(v);
+                //v = threshold(std::abs(v), 0.05, 0.0, 1.0);
+                heightmap.at(x, y) = v * 255.0;
+            }
+        });
+
+        // TGP_EROSION="droplets_per_pixel[,thermal_iterations]"
+        if (auto parameters = Erosion::Parameters::from_env()) {
+            Erosion::Eroder eroder(*parameters, seed);
+            eroder.erode(heightmap);
+            eroder.print_stats();
+        }
+
+        for (uint32_t x = 0; x < x_length; ++x) {
+            for (uint32_t y = 0; y < y_length; ++y) {
+                auto c = static_cast<uint8_t>(clamp(heightmap.at(x, y), 0.0, 255.0));
+                image.at<cv::Vec3b>(x,y)[0] = c;
+                image.at<cv::Vec3b>(x,y)[1] = c;
+                image.at<cv::Vec3b>(x,y)[2] = c;
+            }
         }
-    }
-    display(image);
 
+        // TGP_SNAPSHOT writes the image instead of showing it
+        if (auto path = std::getenv("TGP_SNAPSHOT")) {
+            if (!cv::imwrite(path, image)) throw (boost::format("Failed to write the snapshot: %s") % path).str();
+            return 0;
+        }
+        display(image);
+    }
+    catch (std::string str) {
+        std::cerr << str << std::endl;
+        return 1;
+    }
     return 0;
 }
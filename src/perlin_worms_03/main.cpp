@@ -2,6 +2,9 @@
 #include <random>
 #include <noise/noise.h>
 #include <lib/voxel_renderer/voxel_renderer.hpp>
+#include <lib/voxel_renderer/software_renderer.hpp>
+#include <lib/mesh_exporter/mesh_exporter.hpp>
+#include <lib/progressive/progressive.hpp>
 
 double clamp(double v, double l, double u) {
     if (v < l) return l;
@@ -18,26 +21,32 @@ public:
     uint32_t x_length;
     uint32_t y_length;
     uint32_t z_length;
+    noise::module::Perlin perlin;
 
-    NoiseGenerator(uint32_t x_length_, uint32_t y_length_, uint32_t z_length_):
+    NoiseGenerator(uint32_t x_length_, uint32_t y_length_, uint32_t z_length_, int32_t seed):
         x_length(x_length_),
         y_length(y_length_),
         z_length(z_length_)
-    {}
-
-    VoxelRenderer::Vertices generate() {
-        VoxelRenderer::Vertices vertices;
-        noise::module::Perlin perlin;
-        std::random_device rand_u32;
-        perlin.SetSeed(static_cast<int32_t>(rand_u32()));
+    {
+        perlin.SetSeed(seed);
         perlin.SetOctaveCount(6);
         perlin.SetFrequency(2.0);
+    }
 
-        std::cout << "seed: " << perlin.GetSeed() << std::endl;
+    VoxelRenderer::Vertices generate() const {
+        PROFILE_ZONE("noise/generate");
+        MEMORY_SCOPE("noise/generate");
+        return generate_region({ 0, 0, 0 }, { x_length, y_length, z_length }, 1u);
+    }
 
-        for (uint32_t x = 0; x < x_length; ++x) {
-            for (uint32_t y = 0; y < y_length; ++y) {
-                for (uint32_t z = 0; z < z_length; ++z) {
+    // samples the density at every stride-th voxel of the box from the origin, clipped to the world
+    VoxelRenderer::Vertices generate_region(const glm::uvec3 & origin, const glm::uvec3 & size, uint32_t stride) const {
+        VoxelRenderer::Vertices vertices;
+        auto end = glm::min(origin + size, glm::uvec3(x_length, y_length, z_length));
+
+        for (uint32_t x = origin.x; x < end.x; x += stride) {
+            for (uint32_t y = origin.y; y < end.y; y += stride) {
+                for (uint32_t z = origin.z; z < end.z; z += stride) {
                     float v = perlin.GetValue(
                         1.0 * x / x_length,
                         1.0 * y / y_length,
@@ -61,13 +70,44 @@ public:
 };
 
 int main() {
+    Profiler::Session profiler_session;
+
     try {
+        std::random_device rand_u32;
+        NoiseGenerator noise(200, 200, 200, static_cast<int32_t>(rand_u32()));
+        std::cout << "seed: " << noise.perlin.GetSeed() << std::endl;
+
+        // TGP_PROGRESSIVE=<stride> previews the world at the stride first, and refines it region by region
+        if (auto stride = Progressive::stride_from_env()) {
+            const uint32_t region_size = 40u;
+            std::vector<uint64_t> regions;
+            for (uint32_t x = 0; x < noise.x_length; x += region_size) {
+                for (uint32_t y = 0; y < noise.y_length; y += region_size) {
+                    for (uint32_t z = 0; z < noise.z_length; z += region_size) regions.push_back(VoxelRenderer::VerticesOptimizer::pack(x, y, z));
+                }
+            }
+            Progressive::Refiner refiner(regions, [&](uint64_t key, uint32_t stride) {
+                return noise.generate_region(glm::uvec3(VoxelRenderer::VerticesOptimizer::unpack(key)), glm::uvec3(region_size), stride);
+            }, stride);
+            refiner.start();
+            refiner.print_stats();
+
+            auto window = GLHelpers::init("perlin noise 03");
+            VoxelRenderer::Renderer renderer;
+            renderer.init(window);
+            renderer.render_regions([&]() { return refiner.take(); });
+            refiner.print_stats();
+            return 0;
+        }
+
+        auto vertices = noise.generate();
+        auto exported = MeshExporter::Exporter::export_from_env(vertices);
+        if (VoxelRenderer::SoftwareRenderer::render_from_env(vertices) || exported) return 0;
+
         auto window = GLHelpers::init("perlin noise 03");
         VoxelRenderer::Renderer renderer;
         renderer.init(window);
 
-        NoiseGenerator noise(200, 200, 200);
-        auto vertices = noise.generate();
         renderer.render(vertices);
     }
     catch (std::string str) {
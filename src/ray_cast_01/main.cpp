@@ -0,0 +1,261 @@
+#include <iostream>
+#include <random>
+#include <chrono>
+
+#include <lib/cave_generator/cave_generator.hpp>
+#include <lib/ray_cast/ray_cast.hpp>
+
+struct Options {
+    int32_t seed = 1335689814;
+    uint32_t chunks = 21u;
+    uint32_t rays = 1000000u;
+    uint32_t threads = 0u;
+    uint32_t verify = 0u;
+
+    Options(int argc, char ** argv) {
+        Helpers::Arguments arguments(argc, argv);
+        seed = arguments.get("--seed", seed);
+        chunks = arguments.get("--chunks", chunks);
+        rays = arguments.get("--rays", rays);
+        threads = arguments.get("--threads", threads);
+        verify = arguments.get("--verify", verify);
+        arguments.check();
+        if (chunks == 0u || rays == 0u) throw std::string("--chunks and --rays must be positive");
+    }
+};
+
+// a plain DDA in double precision, voxel by voxel from where the ray enters the bounds of the grid;
+// edge is set when the ray crosses two voxel boundaries closer than the float grid can tell apart
+RayCast::Hit plain_cast(const RayCast::OccupancyGrid & grid, const RayCast::Ray & ray, bool & edge) {
+    RayCast::Hit result;
+    edge = false;
+    glm::dvec3 ray_direction(ray.direction);
+    auto length = std::sqrt(ray_direction.x * ray_direction.x + ray_direction.y * ray_direction.y + ray_direction.z * ray_direction.z);
+    if (!(length > 0.0)) return result;
+    glm::dvec3 origin(ray.origin);
+    glm::dvec3 direction = ray_direction / length;
+    glm::dvec3 min(grid.min());
+    glm::dvec3 max = min + glm::dvec3(grid.size());
+
+    double near = std::numeric_limits<double>::lowest();
+    double far = std::numeric_limits<double>::max();
+    int32_t entry_axis = -1;
+    for (int32_t a = 0; a < 3; ++a) {
+        if (direction[a] == 0.0) {
+            if (origin[a] < min[a] || origin[a] >= max[a]) return result;
+            continue;
+        }
+        auto t0 = (min[a] - origin[a]) / direction[a];
+        auto t1 = (max[a] - origin[a]) / direction[a];
+        if (t0 > t1) std::swap(t0, t1);
+        if (t0 > near) {
+            near = t0;
+            entry_axis = a;
+        }
+        far = std::min(far, t1);
+    }
+    if (far <= std::max(near, 0.0) || near > ray.max_distance) return result;
+
+    // the face of the voxel entered when stepping along the axis, in the order of the face mask bits
+    auto face_of = [](int32_t axis, double d) {
+        static const uint32_t faces[3][2] = { { 1u, 3u }, { 2u, 4u }, { 0u, 5u } };
+        return faces[axis][d > 0.0 ? 1 : 0];
+    };
+    auto inside = [&](const glm::ivec3 & v) {
+        for (int32_t a = 0; a < 3; ++a) {
+            if (v[a] < grid.min()[a] || v[a] >= grid.min()[a] + grid.size()[a]) return false;
+        }
+        return true;
+    };
+
+    // a gap to a voxel boundary within a few ulps of the float coordinates at this distance along the ray
+    auto near_edge = [&](double distance, double gap) {
+        auto extent = glm::max(glm::abs(origin - min), glm::abs(origin + distance * direction - min));
+        return gap <= 1e-6 * std::max(extent.x, std::max(extent.y, extent.z));
+    };
+
+    double distance = std::max(near, 0.0);
+    auto p = origin + distance * direction;
+    glm::ivec3 voxel = glm::clamp(glm::ivec3(glm::floor(p)), grid.min(), grid.min() + grid.size() - 1);
+    auto face = RayCast::no_face;
+    if (near > 0.0) {
+        voxel[entry_axis] = direction[entry_axis] > 0.0 ? grid.min()[entry_axis] : grid.min()[entry_axis] + grid.size()[entry_axis] - 1;
+        face = face_of(entry_axis, direction[entry_axis]);
+        for (int32_t a = 0; a < 3; ++a) {
+            if (a != entry_axis) edge |= near_edge(distance, std::abs(p[a] - std::round(p[a])));
+        }
+    }
+    while (true) {
+        if (grid.is_occupied(voxel)) {
+            result.hit = true;
+            result.voxel = voxel;
+            result.face = face;
+            result.distance = float(distance);
+            return result;
+        }
+        int32_t axis = -1;
+        double next = std::numeric_limits<double>::max();
+        // how far the ray still is from the boundary it crosses after this one, along the axis of that boundary
+        double gap = std::numeric_limits<double>::max();
+        for (int32_t a = 0; a < 3; ++a) {
+            if (direction[a] == 0.0) continue;
+            auto t = (double(voxel[a] + (direction[a] > 0.0 ? 1 : 0)) - origin[a]) / direction[a];
+            if (t < next) {
+                if (axis >= 0) gap = (next - t) * std::abs(direction[axis]);
+                next = t;
+                axis = a;
+            }
+            else {
+                gap = std::min(gap, (t - next) * std::abs(direction[a]));
+            }
+        }
+        if (next > ray.max_distance) return result;
+        edge |= near_edge(next, gap);
+        ++result.steps;
+        voxel[axis] += direction[axis] > 0.0 ? 1 : -1;
+        if (!inside(voxel)) return result;
+        distance = next;
+        face = face_of(axis, direction[axis]);
+    }
+}
+
+// compares the first rays of a suite with the plain DDA, returns the mismatches; the rays through a voxel edge
+// or corner may go either way, so they are only counted
+size_t verify(const RayCast::OccupancyGrid & grid, const std::vector<RayCast::Ray> & rays, const std::vector<RayCast::Hit> & hits, uint32_t count) {
+    count = std::min<size_t>(count, rays.size());
+    if (count == 0u) return 0u;
+    size_t mismatches = 0u;
+    size_t edges = 0u;
+    uint64_t steps = 0u;
+    double seconds = 0.0;
+    for (uint32_t i = 0; i < count; ++i) {
+        bool edge = false;
+        auto start = std::chrono::steady_clock::now();
+        auto expected = plain_cast(grid, rays[i], edge);
+        seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        steps += expected.steps;
+        const auto & hit = hits[i];
+        auto same = hit.hit == expected.hit;
+        if (same && hit.hit) {
+            same = hit.voxel == expected.voxel &&
+                hit.face == expected.face &&
+                std::abs(hit.distance - expected.distance) <= 1e-3f * std::max(1.0f, expected.distance);
+        }
+        if (!same && edge) {
+            ++edges;
+        }
+        else if (!same) {
+            if (mismatches < 5u) {
+                std::cerr << boost::format("Ray %d: (%d, %d, %d) face %d at %.4f, the plain DDA: (%d, %d, %d) face %d at %.4f")
+                    % i
+                    % hit.voxel.x % hit.voxel.y % hit.voxel.z % hit.face % (hit.hit ? hit.distance : -1.0f)
+                    % expected.voxel.x % expected.voxel.y % expected.voxel.z % expected.face % (expected.hit ? expected.distance : -1.0f)
+                    << std::endl;
+            }
+            ++mismatches;
+        }
+    }
+    std::cout << boost::format("%-14s verified %d rays against the plain DDA (%.1f steps per ray, %.2f M rays/s): %d mismatches, %d differ at a voxel edge")
+        % ""
+        % count
+        % (double(steps) / count)
+        % (count / seconds / 1e6)
+        % mismatches
+        % edges
+        << std::endl;
+    return mismatches;
+}
+
+// casts the rays in the grid, and reports the throughput per thread
+std::vector<RayCast::Hit> run_suite(const std::string & name, RayCast::OccupancyGrid & grid, const std::vector<RayCast::Ray> & rays, uint32_t threads) {
+    auto before = grid.stats();
+    auto hits = grid.cast(rays, threads);
+    auto after = grid.stats();
+
+    auto seconds = after.seconds - before.seconds;
+    auto count = double(after.rays - before.rays);
+    threads = Helpers::thread_count(threads);
+    std::cout << boost::format("%-14s %d rays, %5.1f%% hit, %5.1f steps per ray, %.3f s: %.2f M rays/s (%.2f M rays/s per thread)")
+        % name
+        % rays.size()
+        % (100.0 * (after.hits - before.hits) / count)
+        % ((after.steps - before.steps) / count)
+        % seconds
+        % (count / seconds / 1e6)
+        % (count / seconds / 1e6 / threads)
+        << std::endl;
+    return hits;
+}
+
+int main(int argc, char ** argv) {
+    Profiler::Session profiler_session;
+
+    try {
+        Options options(argc, argv);
+        std::cout << boost::format("Seed: %d, %dx%d chunks") % options.seed % options.chunks % options.chunks << std::endl;
+
+        auto start = std::chrono::steady_clock::now();
+        CaveGenerator::Generator cave(options.seed);
+        auto vertices = cave.generate({ 0, 0 }, { options.chunks - 1, options.chunks - 1 });
+        std::cout << boost::format("Generated %d voxels in %.2f s")
+            % vertices.size()
+            % std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count()
+            << std::endl;
+
+        std::mt19937 random(options.seed);
+        std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+        std::normal_distribution<float> normal;
+        auto carved = [&]() {
+            const auto & v = vertices[random() % vertices.size()];
+            return glm::vec3(v[0] + 0.5f, v[1] + 0.5f, v[2] + 0.5f);
+        };
+
+        size_t mismatches = 0u;
+
+        // the editor picks the caves as rendered, from the camera of cave_02 to any point of the world
+        {
+            RayCast::OccupancyGrid grid(vertices, RayCast::Solid::voxels);
+            auto min = glm::vec3(grid.min());
+            auto max = min + glm::vec3(grid.size());
+            glm::vec3 camera{ -2.0f * max.x, -2.0f * max.y, 4.0f * max.z };
+
+            std::vector<RayCast::Ray> rays(options.rays);
+            for (auto & ray: rays) {
+                glm::vec3 target(
+                    min.x + unit(random) * (max.x - min.x),
+                    min.y + unit(random) * (max.y - min.y),
+                    min.z + unit(random) * (max.z - min.z)
+                );
+                ray = { camera, target - camera };
+            }
+            auto hits = run_suite("pick", grid, rays, options.threads);
+            mismatches += verify(grid, rays, hits, options.verify);
+            grid.print_stats();
+        }
+
+        // gameplay and AI rays from inside the caves, blocked by the rock around them
+        {
+            RayCast::OccupancyGrid grid(vertices, RayCast::Solid::complement);
+
+            std::vector<RayCast::Ray> rays(options.rays);
+            for (auto & ray: rays) {
+                auto from = carved();
+                auto to = carved();
+                ray = { from, to - from, glm::length(to - from) };
+            }
+            auto hits = run_suite("line of sight", grid, rays, options.threads);
+            mismatches += verify(grid, rays, hits, options.verify);
+
+            for (auto & ray: rays) ray = { carved(), { normal(random), normal(random), normal(random) } };
+            hits = run_suite("random", grid, rays, options.threads);
+            mismatches += verify(grid, rays, hits, options.verify);
+            grid.print_stats();
+        }
+        if (mismatches > 0u) throw (boost::format("%d rays differ from the plain DDA") % mismatches).str();
+    }
+    catch (std::string str) {
+        std::cerr << str << std::endl;
+        return 1;
+    }
+    return 0;
+}
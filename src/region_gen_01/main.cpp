@@ -0,0 +1,201 @@
+#include <iostream>
+#include <random>
+#include <chrono>
+#include <map>
+#include <csignal>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include <lib/cave_generator/cave_generator.hpp>
+#include <lib/region_file/region_file.hpp>
+
+struct Options {
+    int32_t seed = 1335689814;
+    uint32_t chunks = 64u;
+    uint32_t slab_width = 2u;
+    uint32_t workers = 0u;
+    std::string output = "region.tgpr";
+    uint64_t capacity_mb = 1024u;
+    uint32_t fail = 0u;
+    uint32_t max_restarts = 64u;
+    uint32_t verify = 0u;
+
+    Options(int argc, char ** argv) {
+        Helpers::Arguments arguments(argc, argv);
+        seed = arguments.get("--seed", seed);
+        chunks = arguments.get("--chunks", chunks);
+        slab_width = arguments.get("--slab-width", slab_width);
+        workers = arguments.get("--workers", workers);
+        output = arguments.get("--output", output);
+        capacity_mb = arguments.get("--capacity", capacity_mb);
+        fail = arguments.get("--fail", fail);
+        max_restarts = arguments.get("--max-restarts", max_restarts);
+        verify = arguments.get("--verify", verify);
+        arguments.check();
+        if (chunks == 0u || slab_width == 0u) throw std::string("--chunks and --slab-width must be positive");
+        if (fail > 100u) throw std::string("--fail is a percentage");
+    }
+};
+
+// generates the slabs it claims until none is left, and dies in the middle of the first attempt at a slab
+// with the probability of --fail, as a node of a cluster may
+int run_worker(RegionFile::Region & region, const Options & options) {
+    auto pid = int32_t(::getpid());
+    CaveGenerator::Generator generator(options.seed);
+    Arena::MonotonicArena arena("region_gen_01");
+    VoxelRenderer::Vertices vertices;
+    std::mt19937 random(uint32_t(options.seed) ^ uint32_t(pid));
+
+    while (auto slab = region.claim(pid)) {
+        auto chunks = region.slab_chunks(*slab);
+        auto slab_chunks = uint32_t((chunks.second.x - chunks.first.x + 1) * (chunks.second.y - chunks.first.y + 1));
+        auto crash_after = region.attempts(*slab) == 1u && random() % 100u < options.fail
+            ? int64_t(random() % slab_chunks)
+            : -1;
+
+        CaveGenerator::FootprintIndex index(generator, glm::vec2(chunks.first), glm::vec2(chunks.second));
+        for (int32_t x = chunks.first.x; x <= chunks.second.x; ++x) {
+            for (int32_t y = chunks.first.y; y <= chunks.second.y; ++y) {
+                if (region.is_ready({ x, y })) continue;
+                if (crash_after-- == 0) ::kill(pid, SIGKILL);
+
+                vertices.clear();
+                generator.generate_chunk(glm::vec2(x, y), index, vertices, arena);
+                region.write({ x, y }, vertices);
+            }
+        }
+        region.complete(*slab);
+    }
+    return 0;
+}
+
+pid_t launch_worker(RegionFile::Region & region, const Options & options) {
+    // the children would flush the buffer of the parent again
+    std::cout.flush();
+    std::cerr.flush();
+
+    auto pid = ::fork();
+    if (pid < 0) throw std::string("failed to start a worker");
+    if (pid > 0) return pid;
+
+    int code = 1;
+    try {
+        code = run_worker(region, options);
+    }
+    catch (std::string str) {
+        std::cerr << boost::format("Worker %d: %s") % ::getpid() % str << std::endl;
+    }
+    // without the destructors and the exit handlers of the coordinator
+    ::_exit(code);
+}
+
+std::string describe(int status) {
+    if (WIFSIGNALED(status)) return (boost::format("killed by signal %d") % WTERMSIG(status)).str();
+    return (boost::format("exited with %d") % WEXITSTATUS(status)).str();
+}
+
+// compares evenly spaced chunks of the region with the ones generated by a single process for the whole region
+void verify(const RegionFile::Region & region, const Options & options) {
+    CaveGenerator::Generator generator(options.seed);
+    const auto & layout = region.layout();
+    CaveGenerator::FootprintIndex index(generator, glm::vec2(layout.chunk_from), glm::vec2(layout.chunk_to));
+    auto count = uint64_t(options.chunks) * options.chunks;
+    auto sorted = [](VoxelRenderer::Vertices vertices) {
+        std::sort(vertices.begin(), vertices.end());
+        return vertices;
+    };
+
+    uint32_t mismatches = 0u;
+    for (uint32_t i = 0; i < options.verify; ++i) {
+        auto n = i * count / options.verify;
+        glm::ivec2 chunk{ layout.chunk_from.x + int32_t(n / options.chunks), layout.chunk_from.y + int32_t(n % options.chunks) };
+        if (sorted(region.read(chunk)) != sorted(generator.generate_chunk(glm::vec2(chunk), index))) {
+            std::cout << boost::format("Chunk (%d, %d) differs") % chunk.x % chunk.y << std::endl;
+            ++mismatches;
+        }
+    }
+    std::cout << boost::format("Verified %d chunks: %d differ") % options.verify % mismatches << std::endl;
+    if (mismatches > 0u) throw std::string("the region differs from the generator");
+}
+
+int main(int argc, char ** argv) {
+    Profiler::Session profiler_session;
+
+    try {
+        Options options(argc, argv);
+        CaveGenerator::Generator generator(options.seed);
+
+        RegionFile::Region::Layout layout;
+        layout.parameter_hash = generator.parameter_hash().digest();
+        layout.chunk_from = { 0, 0 };
+        layout.chunk_to = { options.chunks - 1u, options.chunks - 1u };
+        layout.slab_width = options.slab_width;
+        RegionFile::Region region(options.output, layout, options.capacity_mb << 20);
+
+        auto before = region.progress();
+        auto workers = std::min(Helpers::thread_count(options.workers), before.slabs - before.done_slabs);
+        std::cout << boost::format("Seed: %d, %dx%d chunks in %d slabs of %d columns, %d slabs done already, %d workers")
+            % options.seed
+            % options.chunks
+            % options.chunks
+            % before.slabs
+            % options.slab_width
+            % before.done_slabs
+            % workers
+            << std::endl;
+
+        auto start = std::chrono::steady_clock::now();
+        std::map<pid_t, uint32_t> running;
+        uint32_t restarts = 0u;
+        for (uint32_t i = 0; i < workers; ++i) running[launch_worker(region, options)] = i;
+
+        while (!running.empty()) {
+            int status = 0;
+            auto pid = ::waitpid(-1, &status, 0);
+            if (pid < 0) throw std::string("failed to wait for the workers");
+            auto worker = running.at(pid);
+            running.erase(pid);
+            if (WIFEXITED(status) && WEXITSTATUS(status) == 0) continue;
+
+            auto released = region.release(pid);
+            auto progress = region.progress();
+            std::cout << boost::format("Worker %d (%d) %s, released %d slabs, %d of %d slabs done")
+                % worker
+                % pid
+                % describe(status)
+                % released
+                % progress.done_slabs
+                % progress.slabs
+                << std::endl;
+            // an error which the worker reported would only repeat, as when the file is full
+            auto crashed = WIFSIGNALED(status);
+            if (crashed && progress.done_slabs + progress.claimed_slabs < progress.slabs && restarts < options.max_restarts) {
+                running[launch_worker(region, options)] = worker;
+                ++restarts;
+            }
+        }
+        auto seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        auto after = region.progress();
+        auto chunks = after.ready_chunks - before.ready_chunks;
+        std::cout << boost::format("%d chunks in %.2f s with %d workers and %d restarts: %.1f chunks/s (%.1f chunks/s per worker)")
+            % chunks
+            % seconds
+            % workers
+            % restarts
+            % (chunks / seconds)
+            % (workers > 0u ? chunks / seconds / workers : 0.0)
+            << std::endl;
+        region.print_stats();
+
+        if (after.done_slabs < after.slabs) {
+            throw (boost::format("%d slabs are not generated, run again to resume") % (after.slabs - after.done_slabs)).str();
+        }
+        if (options.verify > 0u) verify(region, options);
+    }
+    catch (std::string str) {
+        std::cerr << str << std::endl;
+        return 1;
+    }
+    return 0;
+}
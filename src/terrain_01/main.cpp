@@ -0,0 +1,92 @@
+#include <iostream>
+#include <cstdlib>
+#include <opencv2/opencv.hpp>
+
+#include <lib/terrain/terrain.hpp>
+#include <lib/voxel_renderer/software_renderer.hpp>
+
+struct Options {
+    int32_t seed = 1335689814;
+    uint32_t chunks = 16u;
+    uint32_t threads = 0u;
+    // surface, volume or compare
+    std::string mode = "surface";
+
+    Options(int argc, char ** argv) {
+        Helpers::Arguments arguments(argc, argv);
+        seed = arguments.get("--seed", seed);
+        chunks = arguments.get("--chunks", chunks);
+        threads = arguments.get("--threads", threads);
+        mode = arguments.get("--mode", mode);
+        arguments.check();
+        if (chunks == 0u) throw std::string("--chunks must be positive");
+        if (mode != "surface" && mode != "volume" && mode != "compare") throw (boost::format("unknown mode: %s") % mode).str();
+    }
+};
+
+int main(int argc, char ** argv) {
+    Profiler::Session profiler_session;
+
+    try {
+        Options options(argc, argv);
+        std::cout << "Seed: " << options.seed << std::endl;
+        Terrain::Generator terrain(options.seed);
+        glm::vec2 chunk_from{ 0, 0 };
+        glm::vec2 chunk_to{ options.chunks - 1, options.chunks - 1 };
+
+        VoxelRenderer::FaceMasks face_masks;
+        auto vertices = terrain.generate(chunk_from, chunk_to, face_masks, options.mode != "volume", options.threads);
+        terrain.stats().print(options.mode == "volume" ? "volume" : "surface");
+
+        // both ways have to give the same voxels and faces
+        if (options.mode == "compare") {
+            auto surface_stats = terrain.stats();
+            VoxelRenderer::FaceMasks volume_face_masks;
+            auto volume_vertices = terrain.generate(chunk_from, chunk_to, volume_face_masks, false, options.threads);
+            terrain.stats().print("volume");
+            std::cout << boost::format("Surface-aware speedup: %.2fx in total, %.2fx carving, %.1fx fewer voxels examined")
+                % (terrain.stats().seconds() / surface_stats.seconds())
+                % (terrain.stats().carve_seconds / surface_stats.carve_seconds)
+                % (double(terrain.stats().examined) / surface_stats.examined)
+                << std::endl;
+            if (volume_vertices != vertices || volume_face_masks != face_masks) {
+                throw (boost::format("the surface-aware terrain differs: %d voxels against %d") % vertices.size() % volume_vertices.size()).str();
+            }
+            std::cout << "Surface-aware terrain matches the volume scan" << std::endl;
+            return 0;
+        }
+
+        auto camera_position = [](auto clip) {
+            return glm::vec3{
+                -1.0f * clip.max.x,
+                -1.0f * clip.max.y,
+                 2.0f * clip.max.z
+            };
+        };
+
+        // TGP_SNAPSHOT writes the image instead of opening a window
+        if (auto path = std::getenv("TGP_SNAPSHOT")) {
+            auto clip = VoxelRenderer::Renderer::make_clip(vertices);
+            VoxelRenderer::SoftwareRenderer renderer;
+            cv::imwrite(path, renderer.draw(vertices, face_masks, clip, camera_position(clip), 0.0f));
+            return 0;
+        }
+
+        auto window = GLHelpers::init("terrain 01");
+        VoxelRenderer::Renderer renderer;
+        renderer.init(window);
+        bool uploaded = false;
+        renderer.render_regions([&]() {
+            std::vector<VoxelRenderer::RegionSurface> surfaces;
+            if (!uploaded) surfaces.push_back({ 0u, vertices, face_masks, {} });
+            uploaded = true;
+            return surfaces;
+        }, camera_position);
+    }
+    catch (std::string str) {
+        std::cerr << str << std::endl;
+        return 1;
+    }
+
+    return 0;
+}